@@ -0,0 +1,739 @@
+/** @file klish-bench.c
+ *
+ * KTP load generator and latency benchmark. It opens several concurrent
+ * sessions to running klishd and sends requests from corpus file. Each
+ * session is served by separate forked process with its own event loop so
+ * sessions don't affect each other's latency. The latencies are collected
+ * within shared memory and are processed by parent process.
+ *
+ * The sessions are synchronized. All sessions are connected and
+ * authenticated before the first request is sent. The klishd service
+ * processes are measured (RSS) when all sessions have finished their
+ * requests but before disconnection.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/list.h>
+#include <faux/file.h>
+#include <faux/eloop.h>
+#include <faux/error.h>
+#include <klish/ktp.h>
+#include <klish/ktp_session.h>
+
+#include "private.h"
+
+
+// Request from corpus
+typedef struct bench_req_s {
+	bench_type_e type;
+	char *line;
+} bench_req_t;
+
+// Latency of single request
+typedef struct bench_sample_s {
+	uint32_t type; // bench_type_e
+	uint32_t usec;
+} bench_sample_t;
+
+// Per-session results. It's stored within shared memory
+typedef struct bench_result_s {
+	bool_t failed; // Can't connect or session is broken
+	size_t done; // Number of completed requests
+	size_t errors; // Number of requests with non-zero retcode
+	uint64_t bytes[BENCH_TYPE_MAX]; // Received output
+} bench_result_t;
+
+typedef struct bench_s {
+	struct options *opts;
+	bench_req_t *reqs; // Corpus
+	size_t reqs_num;
+	size_t by_type[BENCH_TYPE_MAX]; // Number of corpus requests by type
+	unsigned int weights_sum;
+	bench_result_t *results; // Shared memory
+	bench_sample_t *samples; // Shared memory
+	size_t shm_size;
+} bench_t;
+
+// Context of session process
+typedef struct worker_s {
+	bench_t *bench;
+	bench_result_t *result;
+	bench_type_e type; // Type of current request
+	bool_t answered; // Answer to current request is received
+} worker_t;
+
+// Memory of klishd service process
+typedef struct bench_mem_s {
+	size_t procs;
+	unsigned long long rss[3]; // min, sum, max
+	unsigned long long private[3]; // min, sum, max
+} bench_mem_t;
+
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/** @brief Loads corpus file.
+ *
+ * Each non-empty line is "<type> <line>". The lines started with '#' are
+ * comments. The completion and help requests can have empty line to get
+ * hints for the first word.
+ */
+static bool_t bench_load_corpus(bench_t *bench, const char *path)
+{
+	faux_file_t *f = NULL;
+	char *str = NULL;
+	size_t lineno = 0;
+	bool_t rc = BOOL_TRUE;
+
+	f = faux_file_open(path, O_RDONLY, 0);
+	if (!f) {
+		fprintf(stderr, "Error: Can't open corpus file %s\n", path);
+		return BOOL_FALSE;
+	}
+
+	while ((str = faux_file_getline(f))) {
+		char *p = str;
+		char *word = NULL;
+		bench_type_e type = BENCH_TYPE_MAX;
+		bench_req_t *req = NULL;
+
+		lineno++;
+		while ((' ' == *p) || ('\t' == *p))
+			p++;
+		if (('\0' == *p) || ('#' == *p)) {
+			faux_str_free(str);
+			continue;
+		}
+		word = p;
+		while (*p && (*p != ' ') && (*p != '\t'))
+			p++;
+		if (*p)
+			*p++ = '\0';
+		type = bench_type_from_str(word);
+		if (BENCH_TYPE_MAX == type) {
+			fprintf(stderr, "Error: %s:%zu: Unknown request type "
+				"\"%s\"\n", path, lineno, word);
+			faux_str_free(str);
+			rc = BOOL_FALSE;
+			break;
+		}
+
+		bench->reqs = realloc(bench->reqs,
+			(bench->reqs_num + 1) * sizeof(*bench->reqs));
+		assert(bench->reqs);
+		req = &bench->reqs[bench->reqs_num];
+		req->type = type;
+		req->line = faux_str_dup(p);
+		bench->reqs_num++;
+		bench->by_type[type]++;
+		faux_str_free(str);
+	}
+	faux_file_close(f);
+
+	if (rc && (0 == bench->reqs_num)) {
+		fprintf(stderr, "Error: Corpus file %s is empty\n", path);
+		rc = BOOL_FALSE;
+	}
+
+	return rc;
+}
+
+
+static bool_t bench_prepare_mix(bench_t *bench)
+{
+	struct options *opts = bench->opts;
+	bench_type_e type = BENCH_CMD;
+
+	for (type = BENCH_CMD; type < BENCH_TYPE_MAX; type++) {
+		if (!opts->mix_userdefined)
+			opts->mix[type] = bench->by_type[type] ? 1 : 0;
+		if (opts->mix[type] && !bench->by_type[type]) {
+			fprintf(stderr, "Warning: There are no \"%s\" requests "
+				"within corpus\n", bench_type_str(type));
+			opts->mix[type] = 0;
+		}
+		bench->weights_sum += opts->mix[type];
+	}
+	if (0 == bench->weights_sum) {
+		fprintf(stderr, "Error: Mix doesn't match corpus\n");
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Choose request according to mix. The type is chosen first.
+static const bench_req_t *bench_choose(const bench_t *bench,
+	unsigned int *seed)
+{
+	unsigned int r = rand_r(seed) % bench->weights_sum;
+	bench_type_e type = BENCH_CMD;
+	size_t n = 0;
+	size_t i = 0;
+
+	for (type = BENCH_CMD; type < BENCH_TYPE_MAX; type++) {
+		if (r < bench->opts->mix[type])
+			break;
+		r -= bench->opts->mix[type];
+	}
+	n = rand_r(seed) % bench->by_type[type];
+	for (i = 0; i < bench->reqs_num; i++) {
+		if (bench->reqs[i].type != type)
+			continue;
+		if (0 == n)
+			return &bench->reqs[i];
+		n--;
+	}
+
+	return NULL;
+}
+
+
+static bool_t worker_output_cb(ktp_session_t *ktp, const char *line,
+	size_t len, void *udata)
+{
+	worker_t *worker = (worker_t *)udata;
+
+	worker->result->bytes[worker->type] += len;
+
+	ktp = ktp; // Happy compiler
+	line = line;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t worker_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg,
+	void *udata)
+{
+	worker_t *worker = (worker_t *)udata;
+
+	worker->answered = BOOL_TRUE;
+
+	ktp = ktp; // Happy compiler
+	msg = msg;
+
+	return BOOL_TRUE;
+}
+
+
+// Benchmark doesn't provide stdin to commands
+static bool_t worker_incompleted_ack_cb(ktp_session_t *ktp,
+	const faux_msg_t *msg, void *udata)
+{
+	if (KTP_STATUS_IS_NEED_STDIN(ktp_session_cmd_features(ktp)))
+		ktp_session_stdin_close(ktp);
+
+	msg = msg; // Happy compiler
+	udata = udata;
+
+	return BOOL_TRUE;
+}
+
+
+// Writes status bytes to status pipe. The write is repeated on EINTR.
+static bool_t worker_status(int fd, const char *status)
+{
+	size_t len = strlen(status);
+
+	while (len > 0) {
+		ssize_t r = write(fd, status, len);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return BOOL_FALSE;
+		}
+		status += r;
+		len -= r;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Waits for EOF on synchronization pipe
+static void worker_wait(int fd)
+{
+	char c = 0;
+
+	while ((read(fd, &c, 1) < 0) && (EINTR == errno));
+}
+
+
+/** @brief Session process.
+ *
+ * Sends "r" to status pipe when session is ready and "d" when all requests
+ * are done.
+ */
+static int worker_run(bench_t *bench, size_t idx, int status_fd,
+	int start_fd, int release_fd)
+{
+	struct options *opts = bench->opts;
+	worker_t worker = {};
+	bench_sample_t *samples = bench->samples + idx * opts->requests;
+	unsigned int seed = opts->seed + idx;
+	int sock = -1;
+	faux_eloop_t *eloop = NULL;
+	ktp_session_t *ktp = NULL;
+	size_t i = 0;
+
+	worker.bench = bench;
+	worker.result = &bench->results[idx];
+	worker.result->failed = BOOL_TRUE; // Pessimism
+
+	signal(SIGPIPE, SIG_IGN);
+
+	sock = ktp_connect_unix(opts->unix_socket_path);
+	if (sock < 0) {
+		worker_status(status_fd, "rd");
+		return -1;
+	}
+	eloop = faux_eloop_new(NULL);
+	ktp = ktp_session_new(sock, eloop);
+	assert(ktp);
+	ktp_session_set_machine(ktp, BOOL_TRUE);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDOUT, worker_output_cb, &worker);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDERR, worker_output_cb, &worker);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_AUTH_ACK, worker_ack_cb, &worker);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_CMD_ACK, worker_ack_cb, &worker);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_CMD_ACK_INCOMPLETED,
+		worker_incompleted_ack_cb, &worker);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_COMPLETION_ACK,
+		worker_ack_cb, &worker);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_HELP_ACK, worker_ack_cb, &worker);
+
+	// Authentication. Event loop stops on each answer.
+	ktp_session_auth(ktp, NULL);
+	faux_eloop_loop(eloop);
+	if (!worker.answered || ktp_session_done(ktp)) {
+		worker_status(status_fd, "rd");
+		goto out;
+	}
+
+	// Ready. Wait for start. Main process is gone if status can't be sent.
+	if (!worker_status(status_fd, "r"))
+		goto out;
+	worker.result->failed = BOOL_FALSE;
+	worker_wait(start_fd);
+
+	for (i = 0; i < opts->requests; i++) {
+		const bench_req_t *req = bench_choose(bench, &seed);
+		faux_error_t *error = NULL;
+		uint64_t start = 0;
+		int retcode = 0;
+
+		worker.type = req->type;
+		worker.answered = BOOL_FALSE;
+		start = bench_now();
+		if ((BENCH_CMD == req->type) || (BENCH_OUTPUT == req->type)) {
+			error = faux_error_new();
+			ktp_session_cmd(ktp, req->line, error, BOOL_FALSE);
+		} else if (BENCH_COMPLETION == req->type) {
+			ktp_session_completion(ktp, req->line, BOOL_FALSE);
+		} else {
+			ktp_session_help(ktp, req->line);
+		}
+		faux_eloop_loop(eloop);
+		samples[i].type = req->type;
+		samples[i].usec = bench_now() - start;
+		if (error) {
+			if (!ktp_session_retcode(ktp, &retcode) ||
+				(retcode != 0))
+				worker.result->errors++;
+			faux_error_free(error);
+		}
+		if (!worker.answered) {
+			worker.result->failed = BOOL_TRUE;
+			break;
+		}
+		worker.result->done++;
+		if (ktp_session_done(ktp))
+			break;
+	}
+
+	// Done. Wait for memory measurement
+	if (worker_status(status_fd, "d"))
+		worker_wait(release_fd);
+
+out:
+	ktp_session_free(ktp);
+	faux_eloop_free(eloop);
+	ktp_disconnect(sock);
+
+	return worker.result->failed ? -1 : 0;
+}
+
+
+// Reads status bytes from session processes until "num" bytes "c" are got
+static bool_t bench_wait_status(int fd, char c, size_t *got, size_t *other,
+	size_t num)
+{
+	while (*got < num) {
+		char buf[64] = {};
+		ssize_t r = 0;
+		ssize_t i = 0;
+
+		r = read(fd, buf, sizeof(buf));
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return BOOL_FALSE;
+		}
+		if (0 == r) // All session processes are dead
+			return BOOL_FALSE;
+		for (i = 0; i < r; i++) {
+			if (buf[i] == c)
+				(*got)++;
+			else
+				(*other)++;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Finds out PID of klishd listening daemon
+static pid_t bench_klishd_pid(const char *path)
+{
+	int sock = -1;
+	struct ucred cred = {};
+	socklen_t len = sizeof(cred);
+
+	sock = ktp_connect_unix(path);
+	if (sock < 0)
+		return -1;
+	if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+		cred.pid = -1;
+	ktp_disconnect(sock);
+
+	return cred.pid;
+}
+
+
+static void bench_mem_add(unsigned long long *v, unsigned long long val,
+	size_t procs)
+{
+	if ((0 == procs) || (val < v[0]))
+		v[0] = val;
+	v[1] += val;
+	if (val > v[2])
+		v[2] = val;
+}
+
+
+/** @brief Measures memory of klishd service processes.
+ *
+ * The service processes are the children of klishd listening daemon.
+ * The probe connection that is used to find out daemon's PID produces
+ * short-lived service process too but it's finished already.
+ */
+static void bench_measure_mem(pid_t klishd, bench_mem_t *mem)
+{
+	DIR *dir = NULL;
+	struct dirent *ent = NULL;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return;
+	while ((ent = readdir(dir))) {
+		char *path = NULL;
+		faux_file_t *f = NULL;
+		char *line = NULL;
+		int pid = 0;
+		int ppid = 0;
+		unsigned long long rss = 0;
+		unsigned long long private = 0;
+
+		if ((ent->d_name[0] < '0') || (ent->d_name[0] > '9'))
+			continue;
+		pid = atoi(ent->d_name);
+
+		// Parent PID
+		path = faux_str_sprintf("/proc/%d/stat", pid);
+		f = faux_file_open(path, O_RDONLY, 0);
+		faux_str_free(path);
+		if (!f)
+			continue;
+		line = faux_file_getline(f);
+		faux_file_close(f);
+		if (line) {
+			char *p = strrchr(line, ')');
+			if (!p || (sscanf(p + 1, " %*c %d", &ppid) != 1))
+				ppid = 0;
+			faux_str_free(line);
+		}
+		if (ppid != klishd)
+			continue;
+
+		// Memory
+		path = faux_str_sprintf("/proc/%d/smaps_rollup", pid);
+		f = faux_file_open(path, O_RDONLY, 0);
+		faux_str_free(path);
+		if (!f)
+			continue;
+		while ((line = faux_file_getline(f))) {
+			unsigned long long val = 0;
+			if (sscanf(line, "Rss: %llu", &val) == 1)
+				rss = val;
+			else if ((sscanf(line, "Private_Clean: %llu",
+				&val) == 1) ||
+				(sscanf(line, "Private_Dirty: %llu", &val) == 1))
+				private += val;
+			faux_str_free(line);
+		}
+		faux_file_close(f);
+
+		bench_mem_add(mem->rss, rss, mem->procs);
+		bench_mem_add(mem->private, private, mem->procs);
+		mem->procs++;
+	}
+	closedir(dir);
+}
+
+
+static int bench_sample_compare(const void *first, const void *second)
+{
+	const bench_sample_t *f = (const bench_sample_t *)first;
+	const bench_sample_t *s = (const bench_sample_t *)second;
+
+	if (f->type != s->type)
+		return (f->type < s->type) ? -1 : 1;
+	if (f->usec != s->usec)
+		return (f->usec < s->usec) ? -1 : 1;
+
+	return 0;
+}
+
+
+// Percentile of sorted samples. The "q" is in units of 0.1%
+static double bench_percentile(const bench_sample_t *samples, size_t num,
+	unsigned int q)
+{
+	size_t idx = (num * q + 999) / 1000;
+
+	if (idx > 0)
+		idx--;
+
+	return samples[idx].usec / 1000.0;
+}
+
+
+static void bench_report(bench_t *bench, uint64_t duration,
+	const bench_mem_t *mem)
+{
+	struct options *opts = bench->opts;
+	size_t total = 0;
+	size_t errors = 0;
+	size_t failed = 0;
+	uint64_t bytes[BENCH_TYPE_MAX] = {};
+	bench_sample_t *samples = NULL;
+	size_t num = 0;
+	size_t i = 0;
+	bench_type_e type = BENCH_CMD;
+	double sec = duration / 1000000.0;
+
+	// Collect completed requests of all sessions together
+	samples = faux_zmalloc(opts->sessions * opts->requests *
+		sizeof(*samples));
+	assert(samples);
+	for (i = 0; i < opts->sessions; i++) {
+		bench_result_t *r = &bench->results[i];
+		if (r->failed)
+			failed++;
+		total += r->done;
+		errors += r->errors;
+		for (type = BENCH_CMD; type < BENCH_TYPE_MAX; type++)
+			bytes[type] += r->bytes[type];
+		memcpy(samples + num, bench->samples + i * opts->requests,
+			r->done * sizeof(*samples));
+		num += r->done;
+		if (opts->verbose)
+			printf("Session %zu: requests %zu, errors %zu%s\n",
+				i, r->done, r->errors,
+				r->failed ? ", failed" : "");
+	}
+	qsort(samples, num, sizeof(*samples), bench_sample_compare);
+
+	printf("Sessions: %u, failed: %zu\n", opts->sessions, failed);
+	printf("Requests: %zu, errors: %zu\n", total, errors);
+	printf("Duration: %.3f s, throughput: %.1f req/s\n",
+		sec, (sec > 0) ? (total / sec) : 0.0);
+	printf("%-10s %8s %10s %10s %10s %10s %12s\n", "type", "count",
+		"p50,ms", "p99,ms", "p99.9,ms", "max,ms", "output,B/s");
+
+	i = 0;
+	for (type = BENCH_CMD; type < BENCH_TYPE_MAX; type++) {
+		size_t first = i;
+		size_t n = 0;
+		while ((i < num) && (samples[i].type == type))
+			i++;
+		n = i - first;
+		if (0 == n)
+			continue;
+		printf("%-10s %8zu %10.3f %10.3f %10.3f %10.3f %12.0f\n",
+			bench_type_str(type), n,
+			bench_percentile(samples + first, n, 500),
+			bench_percentile(samples + first, n, 990),
+			bench_percentile(samples + first, n, 999),
+			samples[i - 1].usec / 1000.0,
+			(sec > 0) ? (bytes[type] / sec) : 0.0);
+	}
+	faux_free(samples);
+
+	if (mem->procs > 0) {
+		printf("Service processes: %zu\n", mem->procs);
+		printf("RSS, kB: min %llu, avg %llu, max %llu\n",
+			mem->rss[0], mem->rss[1] / mem->procs, mem->rss[2]);
+		printf("Private, kB: min %llu, avg %llu, max %llu\n",
+			mem->private[0], mem->private[1] / mem->procs,
+			mem->private[2]);
+	} else {
+		printf("Service processes: can't measure memory\n");
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	int retval = -1;
+	struct options *opts = NULL;
+	bench_t bench = {};
+	void *shm = NULL;
+	int status_pipe[2] = {-1, -1};
+	int start_pipe[2] = {-1, -1};
+	int release_pipe[2] = {-1, -1};
+	size_t ready = 0;
+	size_t done = 0;
+	size_t forked = 0;
+	pid_t klishd = -1;
+	bench_mem_t mem = {};
+	uint64_t start = 0;
+	uint64_t duration = 0;
+	size_t i = 0;
+
+	// Parse command line options
+	opts = opts_init();
+	if (opts_parse(argc, argv, opts)) {
+		fprintf(stderr, "Error: Can't parse command line options\n");
+		goto err;
+	}
+	bench.opts = opts;
+
+	if (!bench_load_corpus(&bench, opts->corpus))
+		goto err;
+	if (!bench_prepare_mix(&bench))
+		goto err;
+
+	klishd = bench_klishd_pid(opts->unix_socket_path);
+	if (klishd < 0) {
+		fprintf(stderr, "Error: Can't connect to server\n");
+		goto err;
+	}
+
+	// Results are written by session processes
+	bench.shm_size = opts->sessions * (sizeof(*bench.results) +
+		opts->requests * sizeof(*bench.samples));
+	shm = mmap(NULL, bench.shm_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == shm) {
+		fprintf(stderr, "Error: Can't allocate shared memory\n");
+		shm = NULL;
+		goto err;
+	}
+	bench.results = (bench_result_t *)shm;
+	bench.samples = (bench_sample_t *)(bench.results + opts->sessions);
+
+	if ((pipe(status_pipe) < 0) || (pipe(start_pipe) < 0) ||
+		(pipe(release_pipe) < 0)) {
+		fprintf(stderr, "Error: Can't create pipes\n");
+		goto err;
+	}
+
+	// Fork session processes
+	fflush(stdout);
+	fflush(stderr);
+	for (i = 0; i < opts->sessions; i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			fprintf(stderr, "Error: Can't fork session process\n");
+			break;
+		}
+		if (0 == pid) {
+			int rc = 0;
+			close(status_pipe[0]);
+			close(start_pipe[1]);
+			close(release_pipe[1]);
+			rc = worker_run(&bench, i, status_pipe[1],
+				start_pipe[0], release_pipe[0]);
+			_exit(rc < 0 ? 1 : 0);
+		}
+		forked++;
+	}
+	close(status_pipe[1]);
+	status_pipe[1] = -1;
+
+	// Start all sessions simultaneously
+	if (!bench_wait_status(status_pipe[0], 'r', &ready, &done, forked))
+		fprintf(stderr, "Warning: Some sessions are not ready\n");
+	start = bench_now();
+	close(start_pipe[1]);
+	start_pipe[1] = -1;
+	if (!bench_wait_status(status_pipe[0], 'd', &done, &ready, forked))
+		fprintf(stderr, "Warning: Some sessions are broken\n");
+	duration = bench_now() - start;
+
+	// All service processes are alive while sessions wait for release
+	bench_measure_mem(klishd, &mem);
+	close(release_pipe[1]);
+	release_pipe[1] = -1;
+	while ((wait(NULL) > 0) || (EINTR == errno));
+
+	bench_report(&bench, duration, &mem);
+
+	retval = 0;
+err:
+	for (i = 0; i < 2; i++) {
+		if (status_pipe[i] >= 0)
+			close(status_pipe[i]);
+		if (start_pipe[i] >= 0)
+			close(start_pipe[i]);
+		if (release_pipe[i] >= 0)
+			close(release_pipe[i]);
+	}
+	if (shm)
+		munmap(shm, bench.shm_size);
+	for (i = 0; i < bench.reqs_num; i++)
+		faux_str_free(bench.reqs[i].line);
+	faux_free(bench.reqs);
+	opts_free(opts);
+
+	return retval;
+}
@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/conv.h>
+
+#include <klish/ktp_session.h>
+
+#include "private.h"
+
+
+static const char *bench_type_names[BENCH_TYPE_MAX] = {
+	"cmd",
+	"completion",
+	"help",
+	"output",
+};
+
+
+const char *bench_type_str(bench_type_e type)
+{
+	if (type >= BENCH_TYPE_MAX)
+		return NULL;
+
+	return bench_type_names[type];
+}
+
+
+bench_type_e bench_type_from_str(const char *str)
+{
+	bench_type_e type = BENCH_CMD;
+
+	if (!str)
+		return BENCH_TYPE_MAX;
+	for (type = BENCH_CMD; type < BENCH_TYPE_MAX; type++) {
+		if (faux_str_casecmp(str, bench_type_names[type]) == 0)
+			return type;
+	}
+
+	return BENCH_TYPE_MAX;
+}
+
+
+/** @brief Initialize option structure by defaults
+ */
+struct options *opts_init(void)
+{
+	struct options *opts = NULL;
+
+	opts = faux_zmalloc(sizeof(*opts));
+	assert(opts);
+
+	// Initialize
+	opts->verbose = BOOL_FALSE;
+	opts->unix_socket_path = faux_str_dup(KLISH_DEFAULT_UNIX_SOCKET_PATH);
+	opts->corpus = NULL;
+	opts->sessions = DEFAULT_SESSIONS;
+	opts->requests = DEFAULT_REQUESTS;
+	opts->seed = DEFAULT_SEED;
+	opts->mix_userdefined = BOOL_FALSE;
+
+	return opts;
+}
+
+
+/** @brief Free options structure
+ */
+void opts_free(struct options *opts)
+{
+	if (!opts)
+		return;
+	faux_str_free(opts->unix_socket_path);
+	faux_str_free(opts->corpus);
+
+	faux_free(opts);
+}
+
+
+/** @brief Parse mix of request types
+ *
+ * The format is "<type>=<weight>,<type>=<weight>...". Not specified types
+ * get zero weight.
+ */
+static bool_t opts_parse_mix(const char *str, struct options *opts)
+{
+	char *mix = faux_str_dup(str);
+	char *saveptr = NULL;
+	char *item = NULL;
+	bool_t rc = BOOL_TRUE;
+
+	memset(opts->mix, 0, sizeof(opts->mix));
+	for (item = strtok_r(mix, ",", &saveptr); item;
+		item = strtok_r(NULL, ",", &saveptr)) {
+		char *weight = strchr(item, '=');
+		bench_type_e type = BENCH_TYPE_MAX;
+		if (!weight) {
+			rc = BOOL_FALSE;
+			break;
+		}
+		*weight = '\0';
+		weight++;
+		type = bench_type_from_str(item);
+		if ((BENCH_TYPE_MAX == type) ||
+			!faux_conv_atoui(weight, &opts->mix[type], 0)) {
+			rc = BOOL_FALSE;
+			break;
+		}
+	}
+	faux_str_free(mix);
+
+	return rc;
+}
+
+
+/** @brief Parse command line options
+ */
+int opts_parse(int argc, char *argv[], struct options *opts)
+{
+	static const char *shortopts = "hvS:n:r:m:s:";
+	static const struct option longopts[] = {
+		{"help",		0, NULL, 'h'},
+		{"verbose",		0, NULL, 'v'},
+		{"socket",		1, NULL, 'S'},
+		{"sessions",		1, NULL, 'n'},
+		{"requests",		1, NULL, 'r'},
+		{"mix",			1, NULL, 'm'},
+		{"seed",		1, NULL, 's'},
+		{NULL,			0, NULL, 0}
+	};
+
+	optind = 1;
+	while(1) {
+		int opt = 0;
+
+		opt = getopt_long(argc, argv, shortopts, longopts, NULL);
+		if (-1 == opt)
+			break;
+		switch (opt) {
+		case 'v':
+			opts->verbose = BOOL_TRUE;
+			break;
+		case 'h':
+			help(0, argv[0]);
+			_exit(0);
+			break;
+		case 'S':
+			faux_str_free(opts->unix_socket_path);
+			opts->unix_socket_path = faux_str_dup(optarg);
+			break;
+		case 'n':
+			if (!faux_conv_atoui(optarg, &opts->sessions, 0) ||
+				(0 == opts->sessions)) {
+				fprintf(stderr, "Error: Illegal number of "
+					"sessions: %s\n", optarg);
+				_exit(-1);
+			}
+			break;
+		case 'r':
+			if (!faux_conv_atoui(optarg, &opts->requests, 0) ||
+				(0 == opts->requests)) {
+				fprintf(stderr, "Error: Illegal number of "
+					"requests: %s\n", optarg);
+				_exit(-1);
+			}
+			break;
+		case 'm':
+			if (!opts_parse_mix(optarg, opts)) {
+				fprintf(stderr, "Error: Illegal mix: %s\n",
+					optarg);
+				_exit(-1);
+			}
+			opts->mix_userdefined = BOOL_TRUE;
+			break;
+		case 's':
+			if (!faux_conv_atoui(optarg, &opts->seed, 0)) {
+				fprintf(stderr, "Error: Illegal seed: %s\n",
+					optarg);
+				_exit(-1);
+			}
+			break;
+		default:
+			help(-1, argv[0]);
+			_exit(-1);
+			break;
+		}
+	}
+
+	// Corpus file
+	if (optind != (argc - 1)) {
+		fprintf(stderr, "Error: Corpus file must be specified\n");
+		help(-1, argv[0]);
+		_exit(-1);
+	}
+	opts->corpus = faux_str_dup(argv[optind]);
+
+	return 0;
+}
+
+
+/** @brief Print help message
+ */
+void help(int status, const char *argv0)
+{
+	const char *name = NULL;
+
+	if (!argv0)
+		return;
+
+	// Find the basename
+	name = strrchr(argv0, '/');
+	if (name)
+		name++;
+	else
+		name = argv0;
+
+	if (status != 0) {
+		fprintf(stderr, "Try `%s -h' for more information.\n",
+			name);
+	} else {
+		printf("Version : %s\n", VERSION);
+		printf("Usage   : %s [options] <corpus file>\n", name);
+		printf("KTP load generator and latency benchmark\n");
+		printf("Options :\n");
+		printf("\t-h, --help Print this help.\n");
+		printf("\t-v, --verbose Show per-session statistics.\n");
+		printf("\t-S <path>, --socket=<path> UNIX socket of klishd.\n");
+		printf("\t-n <num>, --sessions=<num> Number of concurrent "
+			"sessions.\n");
+		printf("\t-r <num>, --requests=<num> Number of requests "
+			"per session.\n");
+		printf("\t-m <mix>, --mix=<mix> Weights of request types,\n"
+			"\t\tfor example \"cmd=60,completion=20,help=15,output=5\".\n"
+			"\t\tDefault is equal weights of types found in corpus.\n");
+		printf("\t-s <num>, --seed=<num> Seed for request "
+			"selection.\n");
+		printf("Corpus file format. One request per line:\n"
+			"\t<cmd|completion|help|output> <line>\n");
+	}
+}
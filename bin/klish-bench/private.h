@@ -0,0 +1,42 @@
+#include <faux/faux.h>
+#include <klish/ktp.h>
+#include <klish/ktp_session.h>
+
+#ifndef VERSION
+#define VERSION "1.0.0"
+#endif
+
+#define DEFAULT_SESSIONS 1
+#define DEFAULT_REQUESTS 100 // Per session
+#define DEFAULT_SEED 1
+
+
+// Types of requests
+typedef enum {
+	BENCH_CMD, // KTP_CMD
+	BENCH_COMPLETION, // KTP_COMPLETION
+	BENCH_HELP, // KTP_HELP
+	BENCH_OUTPUT, // KTP_CMD with large output
+	BENCH_TYPE_MAX,
+} bench_type_e;
+
+/** @brief Command line options
+ */
+struct options {
+	bool_t verbose;
+	char *unix_socket_path;
+	char *corpus;
+	unsigned int sessions;
+	unsigned int requests; // Per session
+	unsigned int seed;
+	unsigned int mix[BENCH_TYPE_MAX]; // Weights of request types
+	bool_t mix_userdefined;
+};
+
+// Options
+void help(int status, const char *argv0);
+struct options *opts_init(void);
+void opts_free(struct options *opts);
+int opts_parse(int argc, char *argv[], struct options *opts);
+const char *bench_type_str(bench_type_e type);
+bench_type_e bench_type_from_str(const char *str);
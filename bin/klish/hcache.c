@@ -0,0 +1,224 @@
+/** @file hcache.c
+ *
+ * Client side cache of completion and help answers. Server marks cacheable
+ * answers with token. Token is also sent within AUTH and CMD acks. Server
+ * changes token when anything that can change answers happens (command
+ * execution, server restart). So client drops all cached answers when it
+ * gets new token.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <faux/str.h>
+#include <faux/msg.h>
+#include <klish/ktp.h>
+
+#include "private.h"
+
+
+typedef struct hcache_rec_s {
+	ktp_cmd_e cmd; // KTP_COMPLETION_ACK or KTP_HELP_ACK
+	char *line;
+	faux_msg_t *msg;
+	size_t used; // Tick of last usage. For LRU
+} hcache_rec_t;
+
+
+struct hcache_s {
+	hcache_rec_t recs[HCACHE_SIZE];
+	char *token;
+	size_t tick;
+	size_t hits;
+	size_t misses;
+};
+
+
+static void hcache_rec_clean(hcache_rec_t *rec)
+{
+	faux_str_free(rec->line);
+	faux_msg_free(rec->msg);
+	memset(rec, 0, sizeof(*rec));
+}
+
+
+hcache_t *hcache_new(void)
+{
+	hcache_t *cache = NULL;
+
+	cache = faux_zmalloc(sizeof(*cache));
+	assert(cache);
+	if (!cache)
+		return NULL;
+
+	return cache;
+}
+
+
+void hcache_free(hcache_t *cache)
+{
+	if (!cache)
+		return;
+
+	hcache_flush(cache);
+	faux_str_free(cache->token);
+	faux_free(cache);
+}
+
+
+void hcache_flush(hcache_t *cache)
+{
+	size_t i = 0;
+
+	assert(cache);
+	if (!cache)
+		return;
+
+	for (i = 0; i < HCACHE_SIZE; i++)
+		hcache_rec_clean(&cache->recs[i]);
+}
+
+
+size_t hcache_hits(const hcache_t *cache)
+{
+	assert(cache);
+	if (!cache)
+		return 0;
+
+	return cache->hits;
+}
+
+
+size_t hcache_misses(const hcache_t *cache)
+{
+	assert(cache);
+	if (!cache)
+		return 0;
+
+	return cache->misses;
+}
+
+
+/** @brief Gets token from server's message.
+ *
+ * Cache is flushed if token was changed or message has no token.
+ *
+ * @param [in] cache Cache.
+ * @param [in] msg AUTH_ACK or CMD_ACK message.
+ */
+void hcache_set_token(hcache_t *cache, const faux_msg_t *msg)
+{
+	char *token = NULL;
+
+	assert(cache);
+	if (!cache)
+		return;
+
+	token = faux_msg_get_str_param_by_type(msg, KTP_PARAM_TOKEN);
+	if (token && cache->token && (strcmp(token, cache->token) == 0)) {
+		faux_str_free(token);
+		return;
+	}
+
+	hcache_flush(cache);
+	faux_str_free(cache->token);
+	cache->token = token;
+}
+
+
+/** @brief Finds cached answer.
+ *
+ * @param [in] cache Cache.
+ * @param [in] cmd Type of answer: KTP_COMPLETION_ACK or KTP_HELP_ACK.
+ * @param [in] line Line to cursor position.
+ * @return Cached message (owned by cache) or NULL.
+ */
+const faux_msg_t *hcache_get(hcache_t *cache, ktp_cmd_e cmd, const char *line)
+{
+	size_t i = 0;
+
+	assert(cache);
+	if (!cache)
+		return NULL;
+	if (!line)
+		return NULL;
+
+	for (i = 0; i < HCACHE_SIZE; i++) {
+		hcache_rec_t *rec = &cache->recs[i];
+		if (!rec->msg || (rec->cmd != cmd))
+			continue;
+		if (strcmp(rec->line, line) != 0)
+			continue;
+		rec->used = ++cache->tick;
+		cache->hits++;
+		return rec->msg;
+	}
+	cache->misses++;
+
+	return NULL;
+}
+
+
+/** @brief Stores answer to cache.
+ *
+ * Answer is stored only if it has the same token as the current one.
+ * Answers without token are not cacheable. The least recently used record
+ * is replaced when cache is full.
+ *
+ * @param [in] cache Cache.
+ * @param [in] line Line to cursor position the answer was requested for.
+ * @param [in] msg COMPLETION_ACK or HELP_ACK message. It will be copied.
+ * @return BOOL_TRUE - stored, BOOL_FALSE - not cacheable or error.
+ */
+bool_t hcache_put(hcache_t *cache, const char *line, const faux_msg_t *msg)
+{
+	char *token = NULL;
+	hcache_rec_t *rec = NULL;
+	faux_msg_t *copy = NULL;
+	faux_list_node_t *iter = NULL;
+	uint16_t param_type = 0;
+	void *param_data = NULL;
+	uint32_t param_len = 0;
+	size_t i = 0;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	if (!line || !msg || !cache->token)
+		return BOOL_FALSE;
+
+	token = faux_msg_get_str_param_by_type(msg, KTP_PARAM_TOKEN);
+	if (!token)
+		return BOOL_FALSE;
+	if (strcmp(token, cache->token) != 0) {
+		faux_str_free(token);
+		return BOOL_FALSE;
+	}
+	faux_str_free(token);
+
+	// Find free or least recently used record
+	rec = &cache->recs[0];
+	for (i = 0; i < HCACHE_SIZE; i++) {
+		if (!cache->recs[i].msg) {
+			rec = &cache->recs[i];
+			break;
+		}
+		if (cache->recs[i].used < rec->used)
+			rec = &cache->recs[i];
+	}
+	hcache_rec_clean(rec);
+
+	copy = ktp_msg_preform(faux_msg_get_cmd(msg), faux_msg_get_status(msg));
+	iter = faux_msg_init_param_iter(msg);
+	while (faux_msg_get_param_each(&iter, &param_type,
+		&param_data, &param_len))
+		faux_msg_add_param(copy, param_type, param_data, param_len);
+
+	rec->cmd = faux_msg_get_cmd(msg);
+	rec->line = faux_str_dup(line);
+	rec->msg = copy;
+	rec->used = ++cache->tick;
+
+	return BOOL_TRUE;
+}
@@ -23,6 +23,7 @@
 
 #include <faux/faux.h>
 #include <faux/str.h>
+#include <faux/conv.h>
 #include <faux/msg.h>
 #include <faux/list.h>
 #include <faux/file.h>
@@ -30,6 +31,7 @@
 #include <klish/ktp.h>
 #include <klish/ktp_session.h>
 #include <tinyrl/tinyrl.h>
+#include <tinyrl/pager.h>
 
 #include "private.h"
 
@@ -39,7 +41,8 @@ typedef enum {
 	MODE_CMDLINE,
 	MODE_FILES,
 	MODE_STDIN,
-	MODE_INTERACTIVE
+	MODE_INTERACTIVE,
+	MODE_MACHINE
 } client_mode_e;
 
 
@@ -55,12 +58,18 @@ typedef struct ctx_s {
 	// TRI_FALSE - Can't start pager or pager has exited
 	tri_t pager_working;
 	FILE *pager_pipe;
+	pager_t *pager; // Built-in pager
 	client_mode_e mode;
+	hcache_t *hcache; // Completion and help cache. MODE_INTERACTIVE
+	char *hint_line; // Line of requested completion or help
 	// Parsing state vars
 	faux_list_node_t *cmdline_iter; // MODE_CMDLINE
 	faux_list_node_t *files_iter; // MODE_FILES
 	faux_file_t *files_fd; // MODE_FILES
 	faux_file_t *stdin_fd; // MODE_STDIN
+	bool_t input_eof; // All commands are read
+	// Pipelined commands (sent but not acknowledged yet)
+	faux_list_t *batch_lines;
 } ctx_t;
 
 
@@ -92,7 +101,11 @@ static bool_t ctrl_c_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
 static void reset_hotkey_table(ctx_t *ctx);
 static bool_t send_winch_notification(ctx_t *ctx);
 static bool_t send_next_command(ctx_t *ctx);
+static bool_t send_next_batch(ctx_t *ctx);
+static void echo_command(ctx_t *ctx, const char *line);
 static void signal_handler_empty(int signo);
+static void process_completion(ctx_t *ctx, const faux_msg_t *msg);
+static void process_help(ctx_t *ctx, const faux_msg_t *msg);
 
 // Keys
 static bool_t tinyrl_key_enter(tinyrl_t *tinyrl, unsigned char key);
@@ -144,7 +157,9 @@ int main(int argc, char **argv)
 
 	// Find out client mode
 	ctx.mode = MODE_INTERACTIVE; // Default
-	if (faux_list_len(opts->commands) > 0)
+	if (opts->machine)
+		ctx.mode = MODE_MACHINE;
+	else if (faux_list_len(opts->commands) > 0)
 		ctx.mode = MODE_CMDLINE;
 	else if (faux_list_len(opts->files) > 0)
 		ctx.mode = MODE_FILES;
@@ -168,7 +183,8 @@ int main(int argc, char **argv)
 	// To don't stop klish client on exit. SIGTSTP can be pended
 	faux_eloop_add_signal(eloop, SIGTSTP, ctrl_c_cb, &ctx);
 	// Notify server about terminal window size change
-	faux_eloop_add_signal(eloop, SIGWINCH, sigwinch_cb, &ctx);
+	if (ctx.mode != MODE_MACHINE)
+		faux_eloop_add_signal(eloop, SIGWINCH, sigwinch_cb, &ctx);
 
 	// Ignore SIGINT etc. Don't use SIG_IGN because it will
 	// not interrupt syscall. It necessary because in MODE_STDIN
@@ -200,6 +216,13 @@ int main(int argc, char **argv)
 	if (ctx.mode != MODE_STDIN)
 		fcntl(STDIN_FILENO, F_SETFL, stdin_flags | O_NONBLOCK);
 
+	// Machine mode doesn't need terminal and has its own callbacks
+	if (ctx.mode == MODE_MACHINE) {
+		if (machine_run(ktp, opts))
+			retval = 0;
+		goto err;
+	}
+
 	// TiniRL
 	if (ctx.mode == MODE_INTERACTIVE)
 		hist_path = faux_expand_tilde("~/.klish_history");
@@ -215,6 +238,16 @@ int main(int argc, char **argv)
 	ctx.opts = opts;
 	ctx.pager_working = TRI_UNDEFINED;
 
+	// Built-in pager reads keys from terminal itself
+	if (opts->pager_enabled &&
+		(faux_str_casecmp(opts->pager, BUILTIN_PAGER) == 0)) {
+		if ((ctx.mode != MODE_STDIN) &&
+			isatty(STDIN_FILENO) && isatty(STDOUT_FILENO))
+			ctx.pager = pager_new(stdin, stdout);
+		if (!ctx.pager)
+			opts->pager_enabled = BOOL_FALSE;
+	}
+
 	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDIN, async_stdin_sent_cb, &ctx);
 	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDOUT, stdout_cb, &ctx);
 	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDERR, stderr_cb, &ctx);
@@ -249,8 +282,15 @@ int main(int argc, char **argv)
 		tinyrl_bind_key(tinyrl, '\r', tinyrl_key_enter);
 		tinyrl_bind_key(tinyrl, '\t', tinyrl_key_tab);
 		tinyrl_bind_key(tinyrl, '?', tinyrl_key_help);
+		ctx.hcache = hcache_new();
 	}
 
+	// Pipelining for non-interactive modes
+	if ((ctx.mode != MODE_INTERACTIVE) && (opts->window > 1))
+		ctx.batch_lines = faux_list_new(FAUX_LIST_UNSORTED,
+			FAUX_LIST_NONUNIQUE, NULL, NULL,
+			(void (*)(void *))faux_str_free);
+
 	// Send AUTH message to server
 	if (!ktp_session_auth(ktp, NULL))
 		goto err;
@@ -266,11 +306,18 @@ err:
 	// Restore stdin mode
 	fcntl(STDIN_FILENO, F_SETFL, stdin_flags);
 	reset_hotkey_table(&ctx);
+	faux_list_free(ctx.batch_lines);
 	if (tinyrl) {
 		if (tinyrl_busy(tinyrl))
 			faux_error_free(ktp_session_error(ktp));
 		tinyrl_free(tinyrl);
 	}
+	pager_free(ctx.pager);
+	if (ctx.hcache && opts->verbose)
+		fprintf(stderr, "Hint cache: %zu hits, %zu misses\n",
+			hcache_hits(ctx.hcache), hcache_misses(ctx.hcache));
+	hcache_free(ctx.hcache);
+	faux_str_free(ctx.hint_line);
 	ktp_session_free(ktp);
 	faux_eloop_free(eloop);
 	ktp_disconnect(unix_sock);
@@ -283,15 +330,12 @@ err:
 }
 
 
-static bool_t send_next_command(ctx_t *ctx)
+static char *get_next_line(ctx_t *ctx)
 {
 	char *line = NULL;
-	faux_error_t *error = NULL;
-	bool_t rc = BOOL_FALSE;
 
-	// User must type next interactive command. So just return
-	if (ctx->mode == MODE_INTERACTIVE)
-		return BOOL_TRUE;
+	if (ctx->input_eof)
+		return NULL;
 
 	// Commands from cmdline
 	if (ctx->mode == MODE_CMDLINE) {
@@ -321,20 +365,53 @@ static bool_t send_next_command(ctx_t *ctx)
 			ctx->stdin_fd = faux_file_fdopen(STDIN_FILENO);
 		if (ctx->stdin_fd)
 			line = faux_file_getline(ctx->stdin_fd);
-		if (!line) // EOF
+		if (!line) { // EOF
 			faux_file_close(ctx->stdin_fd);
+			ctx->stdin_fd = NULL;
+		}
 	}
 
+	if (!line)
+		ctx->input_eof = BOOL_TRUE;
+
+	return line;
+}
+
+
+static void echo_command(ctx_t *ctx, const char *line)
+{
+	const char *prompt = NULL;
+
+	if (!ctx->opts->verbose)
+		return;
+
+	prompt = tinyrl_prompt(ctx->tinyrl);
+	printf("%s%s\n", prompt ? prompt : "", line);
+	fflush(stdout);
+}
+
+
+static bool_t send_next_command(ctx_t *ctx)
+{
+	char *line = NULL;
+	faux_error_t *error = NULL;
+	bool_t rc = BOOL_FALSE;
+
+	// User must type next interactive command. So just return
+	if (ctx->mode == MODE_INTERACTIVE)
+		return BOOL_TRUE;
+
+	// Pipelined commands
+	if (ctx->batch_lines)
+		return send_next_batch(ctx);
+
+	line = get_next_line(ctx);
 	if (!line) {
 		ktp_session_set_done(ctx->ktp, BOOL_TRUE);
 		return BOOL_TRUE;
 	}
 
-	if (ctx->opts->verbose) {
-		const char *prompt = tinyrl_prompt(ctx->tinyrl);
-		printf("%s%s\n", prompt ? prompt : "", line);
-		fflush(stdout);
-	}
+	echo_command(ctx, line);
 
 	error = faux_error_new();
 	rc = ktp_session_cmd(ctx->ktp, line, error, ctx->opts->dry_run);
@@ -351,6 +428,63 @@ static bool_t send_next_command(ctx_t *ctx)
 }
 
 
+/** @brief Sends commands to server without waiting for answers.
+ *
+ * Up to "window" commands can be sent but not acknowledged yet. The window is
+ * refilled when the half of commands is acknowledged so each KTP_CMD_BATCH
+ * request contains several commands.
+ */
+static bool_t send_next_batch(ctx_t *ctx)
+{
+	size_t window = ctx->opts->window;
+	size_t outstanding = 0;
+	size_t num = 0;
+	size_t i = 0;
+	const char **lines = NULL;
+	faux_list_node_t *prev_tail = NULL;
+	faux_list_node_t *iter = NULL;
+	char *line = NULL;
+	bool_t rc = BOOL_FALSE;
+
+	outstanding = faux_list_len(ctx->batch_lines);
+	if (outstanding > (window / 2))
+		return BOOL_TRUE;
+
+	prev_tail = faux_list_tail(ctx->batch_lines);
+	while (((outstanding + num) < window) && (line = get_next_line(ctx))) {
+		faux_list_add(ctx->batch_lines, line);
+		num++;
+	}
+	if (0 == num) {
+		if (0 == outstanding)
+			ktp_session_set_done(ctx->ktp, BOOL_TRUE);
+		return BOOL_TRUE;
+	}
+
+	lines = faux_zmalloc(num * sizeof(*lines));
+	assert(lines);
+	iter = prev_tail ? faux_list_next_node(prev_tail) :
+		faux_list_head(ctx->batch_lines);
+	for (i = 0; i < num; i++)
+		lines[i] = (const char *)faux_list_each(&iter);
+	rc = ktp_session_batch(ctx->ktp, lines, num, ctx->opts->dry_run,
+		ctx->opts->stop_on_error);
+	faux_free(lines);
+	if (!rc)
+		return BOOL_FALSE;
+
+	// Echo the command is executing now
+	if (0 == outstanding)
+		echo_command(ctx,
+			(const char *)faux_list_data(faux_list_head(ctx->batch_lines)));
+
+	// Suppose non-interactive command by default
+	tinyrl_enable_isig(ctx->tinyrl);
+
+	return BOOL_TRUE;
+}
+
+
 static bool_t stderr_cb(ktp_session_t *ktp, const char *line, size_t len,
 	void *user_data)
 {
@@ -450,6 +584,8 @@ bool_t auth_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 
 	process_prompt_param(ctx->tinyrl, msg);
 	process_hotkey_param(ctx, msg);
+	if (ctx->hcache)
+		hcache_set_token(ctx->hcache, msg);
 
 	if (!ktp_session_retcode(ktp, &rc))
 		rc = -1;
@@ -491,7 +627,10 @@ bool_t cmd_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 
 	// Wait for pager
 	if (ctx->pager_working != TRI_UNDEFINED) {
-		pclose(ctx->pager_pipe);
+		if (ctx->pager)
+			pager_stop(ctx->pager);
+		else
+			pclose(ctx->pager_pipe);
 		ctx->pager_working = TRI_UNDEFINED;
 		ctx->pager_pipe = NULL;
 		it_was_pager = BOOL_TRUE;
@@ -517,6 +656,8 @@ bool_t cmd_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 
 	process_prompt_param(ctx->tinyrl, msg);
 	process_hotkey_param(ctx, msg);
+	if (ctx->hcache)
+		hcache_set_token(ctx->hcache, msg);
 
 	if (!ktp_session_retcode(ktp, &rc))
 		rc = -1;
@@ -546,6 +687,15 @@ bool_t cmd_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 			stdin_cb, ctx);
 	}
 
+	// Pipelined command is acknowledged. Echo the next one.
+	if (ctx->batch_lines && (faux_list_len(ctx->batch_lines) > 0)) {
+		faux_list_node_t *head = NULL;
+		faux_list_del(ctx->batch_lines, faux_list_head(ctx->batch_lines));
+		head = faux_list_head(ctx->batch_lines);
+		if (head)
+			echo_command(ctx, (const char *)faux_list_data(head));
+	}
+
 	// Send next command for non-interactive modes
 	send_next_command(ctx);
 
@@ -804,11 +954,22 @@ static bool_t tinyrl_key_hotkey(tinyrl_t *tinyrl, unsigned char key)
 static bool_t tinyrl_key_tab(tinyrl_t *tinyrl, unsigned char key)
 {
 	char *line = NULL;
+	const faux_msg_t *cached = NULL;
 	ctx_t *ctx = (ctx_t *)tinyrl_udata(tinyrl);
 
 	line = tinyrl_line_to_pos(tinyrl);
+
+	// Answer from cache doesn't need server request
+	cached = hcache_get(ctx->hcache, KTP_COMPLETION_ACK, line);
+	if (cached) {
+		faux_str_free(line);
+		process_completion(ctx, cached);
+		return BOOL_TRUE;
+	}
+
 	ktp_session_completion(ctx->ktp, line, ctx->opts->dry_run);
-	faux_str_free(line);
+	faux_str_free(ctx->hint_line);
+	ctx->hint_line = line;
 
 	tinyrl_set_busy(tinyrl, BOOL_TRUE);
 
@@ -821,6 +982,7 @@ static bool_t tinyrl_key_tab(tinyrl_t *tinyrl, unsigned char key)
 static bool_t tinyrl_key_help(tinyrl_t *tinyrl, unsigned char key)
 {
 	char *line = NULL;
+	const faux_msg_t *cached = NULL;
 	ctx_t *ctx = (ctx_t *)tinyrl_udata(tinyrl);
 
 	line = tinyrl_line_to_pos(tinyrl);
@@ -831,8 +993,17 @@ static bool_t tinyrl_key_help(tinyrl_t *tinyrl, unsigned char key)
 		return tinyrl_key_default(tinyrl, key);
 	}
 
+	// Answer from cache doesn't need server request
+	cached = hcache_get(ctx->hcache, KTP_HELP_ACK, line);
+	if (cached) {
+		faux_str_free(line);
+		process_help(ctx, cached);
+		return BOOL_TRUE;
+	}
+
 	ktp_session_help(ctx->ktp, line);
-	faux_str_free(line);
+	faux_str_free(ctx->hint_line);
+	ctx->hint_line = line;
 
 	tinyrl_set_busy(tinyrl, BOOL_TRUE);
 
@@ -877,9 +1048,8 @@ static void display_completions(const tinyrl_t *tinyrl, faux_list_t *completions
 }
 
 
-bool_t completion_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
+static void process_completion(ctx_t *ctx, const faux_msg_t *msg)
 {
-	ctx_t *ctx = (ctx_t *)udata;
 	faux_list_node_t *iter = NULL;
 	uint32_t param_len = 0;
 	char *param_data = NULL;
@@ -888,12 +1058,15 @@ bool_t completion_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 	faux_list_t *completions = NULL;
 	size_t completions_num = 0;
 	size_t max_compl_len = 0;
-
-	tinyrl_set_busy(ctx->tinyrl, BOOL_FALSE);
-
-	process_prompt_param(ctx->tinyrl, msg);
+	char *more_str = NULL;
+	unsigned int more = 0; // Number of omitted completions
 
 	prefix = faux_msg_get_str_param_by_type(msg, KTP_PARAM_PREFIX);
+	more_str = faux_msg_get_str_param_by_type(msg, KTP_PARAM_MORE);
+	if (more_str) {
+		faux_conv_atoui(more_str, &more, 10);
+		faux_str_free(more_str);
+	}
 
 	completions = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
 		NULL, NULL, (void (*)(void *))faux_str_free);
@@ -912,7 +1085,7 @@ bool_t completion_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 	completions_num = faux_list_len(completions);
 
 	// Single possible completion
-	if (1 == completions_num) {
+	if ((1 == completions_num) && (0 == more)) {
 		char *compl = (char *)faux_list_data(faux_list_head(completions));
 		tinyrl_line_insert(ctx->tinyrl, compl, strlen(compl));
 		// Add space after completion
@@ -920,16 +1093,18 @@ bool_t completion_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 		tinyrl_redisplay(ctx->tinyrl);
 
 	// Multi possible completions
-	} else if (completions_num > 1) {
+	} else if (completions_num > 0) {
 		faux_list_node_t *eq_iter = NULL;
 		size_t eq_part = 0;
 		char *str = NULL;
 		char *compl = NULL;
 
-		// Try to find equal part for all possible completions
+		// Try to find equal part for all possible completions. The
+		// truncated list is not suitable because omitted completions
+		// can differ.
 		eq_iter = faux_list_head(completions);
 		str = (char *)faux_list_data(eq_iter);
-		eq_part = strlen(str);
+		eq_part = (0 == more) ? strlen(str) : 0;
 		eq_iter = faux_list_next_node(eq_iter);
 
 		while ((compl = (char *)faux_list_each(&eq_iter)) && (eq_part > 0)) {
@@ -950,21 +1125,36 @@ bool_t completion_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 			tinyrl_reset_line_state(ctx->tinyrl);
 			display_completions(ctx->tinyrl, completions,
 				prefix, max_compl_len);
+			if (more > 0) {
+				tinyrl_printf(ctx->tinyrl, "%u more...", more);
+				tinyrl_crlf(ctx->tinyrl);
+			}
 			tinyrl_redisplay(ctx->tinyrl);
 		}
 	}
 
 	faux_list_free(completions);
 	faux_str_free(prefix);
+}
+
+
+bool_t completion_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
+{
+	ctx_t *ctx = (ctx_t *)udata;
+
+	tinyrl_set_busy(ctx->tinyrl, BOOL_FALSE);
+
+	process_prompt_param(ctx->tinyrl, msg);
+	process_completion(ctx, msg);
+	if (ctx->hcache)
+		hcache_put(ctx->hcache, ctx->hint_line, msg);
+	faux_str_free(ctx->hint_line);
+	ctx->hint_line = NULL;
 
 	// Operation is finished so restore stdin handler
 	faux_eloop_add_fd(ktp_session_eloop(ktp), STDIN_FILENO, POLLIN,
 		stdin_cb, ctx);
 
-	// Happy compiler
-	ktp = ktp;
-	msg = msg;
-
 	return BOOL_TRUE;
 }
 
@@ -987,9 +1177,8 @@ static void display_help(const tinyrl_t *tinyrl, faux_list_t *help_list,
 }
 
 
-bool_t help_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
+static void process_help(ctx_t *ctx, const faux_msg_t *msg)
 {
-	ctx_t *ctx = (ctx_t *)udata;
 	faux_list_t *help_list = NULL;
 	faux_list_node_t *iter = NULL;
 	uint32_t param_len = 0;
@@ -997,10 +1186,6 @@ bool_t help_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 	uint16_t param_type = 0;
 	size_t max_prefix_len = 0;
 
-	tinyrl_set_busy(ctx->tinyrl, BOOL_FALSE);
-
-	process_prompt_param(ctx->tinyrl, msg);
-
 	help_list = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
 		help_compare, NULL, help_free);
 
@@ -1045,13 +1230,26 @@ bool_t help_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 	}
 
 	faux_list_free(help_list);
+}
+
+
+bool_t help_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
+{
+	ctx_t *ctx = (ctx_t *)udata;
+
+	tinyrl_set_busy(ctx->tinyrl, BOOL_FALSE);
+
+	process_prompt_param(ctx->tinyrl, msg);
+	process_help(ctx, msg);
+	if (ctx->hcache)
+		hcache_put(ctx->hcache, ctx->hint_line, msg);
+	faux_str_free(ctx->hint_line);
+	ctx->hint_line = NULL;
 
 	// Operation is finished so restore stdin handler
 	faux_eloop_add_fd(ktp_session_eloop(ktp), STDIN_FILENO, POLLIN,
 		stdin_cb, ctx);
 
-	ktp = ktp; // happy compiler
-
 	return BOOL_TRUE;
 }
 
@@ -1077,11 +1275,29 @@ static bool_t stdout_cb(ktp_session_t *ktp, const char *line, size_t len,
 		!KTP_STATUS_IS_INTERACTIVE(ktp_session_cmd_features(ktp)) // Non interactive command
 		) {
 
-		ctx->pager_pipe = popen(ctx->opts->pager, "we");
-		if (!ctx->pager_pipe)
-			ctx->pager_working = TRI_FALSE; // Indicates can't start
-		else
-			ctx->pager_working = TRI_TRUE;
+		if (ctx->pager) {
+			// Built-in pager can't share terminal input with
+			// command that needs stdin
+			if (!KTP_STATUS_IS_NEED_STDIN(ktp_session_cmd_features(ktp)))
+				ctx->pager_working = TRI_TRUE;
+		} else {
+			ctx->pager_pipe = popen(ctx->opts->pager, "we");
+			if (!ctx->pager_pipe)
+				ctx->pager_working = TRI_FALSE; // Indicates can't start
+			else
+				ctx->pager_working = TRI_TRUE;
+		}
+	}
+
+	// Built-in pager gets data directly from KTP receive buffer. It
+	// returns when screen is not full yet or user wants more lines.
+	if (ctx->pager && (ctx->pager_working == TRI_TRUE)) {
+		if (!pager_write(ctx->pager, line, len)) {
+			// User quits pager. Output is not needed anymore.
+			ktp_session_stdout_close(ktp);
+			ctx->pager_working = TRI_FALSE;
+		}
+		return BOOL_TRUE;
 	}
 
 	// Write to pager's pipe if pager is really working
@@ -1109,24 +1325,28 @@ bool_t notification_cb(ktp_session_t *ktp, const faux_msg_t *msg, void *udata)
 {
 	char *str = NULL;
 	ctx_t *ctx = (ctx_t *)udata;
+	bool_t editing = BOOL_FALSE;
 
 	str = faux_msg_get_str_param_by_type(msg, KTP_PARAM_ERROR);
 	if (!str)
 		return BOOL_TRUE;
 
-	if (ctx->mode == MODE_INTERACTIVE) {
+	// Notification (background job completion for example) can be
+	// received while another command is running. Then there is no
+	// line to redisplay.
+	editing = (ctx->mode == MODE_INTERACTIVE) &&
+		(ktp_session_state(ktp) == KTP_SESSION_STATE_IDLE);
+	if (editing) {
 		tinyrl_multi_crlf(ctx->tinyrl);
 		tinyrl_reset_line_state(ctx->tinyrl);
 	}
 	fprintf(stderr, "Note: %s\n", str);
 	fflush(stderr);
-	if (ctx->mode == MODE_INTERACTIVE)
+	if (editing)
 		tinyrl_redisplay(ctx->tinyrl);
 
 	faux_str_free(str);
 
-	ktp = ktp; // Happy compiler
-
 	return BOOL_TRUE;
 }
 
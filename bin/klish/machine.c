@@ -0,0 +1,318 @@
+/** @file machine.c
+ *
+ * Machine mode of klish client. It's intended for automation tools. The
+ * client works over KTP machine session so it doesn't get prompts, hotkeys
+ * and doesn't use terminal.
+ *
+ * Input (stdin). One request per line:
+ * <id> <command line>
+ *
+ * Output (stdout). The stream of frames:
+ * o <id> <len>\n<data> - Command's stdout chunk
+ * e <id> <len>\n<data> - Command's stderr chunk (and error messages)
+ * r <id> <retcode> <usec>\n - Command is completed
+ *
+ * If server drops the rest of requests due to error (stop-on-error mode)
+ * then each dropped request gets "e" frame with error message and "r" frame
+ * with -1 retcode.
+ *
+ * The requests are pipelined. Up to "window" requests can be sent but not
+ * completed yet. Commands are executed sequentially by server so frames of
+ * different requests are not mixed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/eloop.h>
+#include <faux/error.h>
+#include <faux/list.h>
+#include <klish/ktp.h>
+#include <klish/ktp_session.h>
+
+#include "private.h"
+
+
+#define MACHINE_READ_CHUNK 65536
+#define MACHINE_DROPPED_MSG "Error: Request is dropped due to previous error\n"
+
+
+typedef struct machine_s {
+	ktp_session_t *ktp;
+	struct options *opts;
+	size_t window; // Max number of outstanding requests
+	char *ibuf; // Received but not sent input
+	size_t ibuf_len;
+	bool_t input_eof;
+	bool_t polled; // Stdin is watched by event loop
+	size_t outstanding; // Number of sent but not completed requests
+	faux_list_t *ids; // IDs of sent but not completed requests
+} machine_t;
+
+
+static void machine_frame(const char *type, const char *id,
+	const char *data, size_t len)
+{
+	fprintf(stdout, "%s %s %zu\n", type, id ? id : "-", len);
+	fwrite(data, 1, len, stdout);
+}
+
+
+static bool_t machine_stdout_cb(ktp_session_t *ktp, const char *line,
+	size_t len, void *udata)
+{
+	machine_frame("o", ktp_session_req_id(ktp), line, len);
+
+	udata = udata; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t machine_stderr_cb(ktp_session_t *ktp, const char *line,
+	size_t len, void *udata)
+{
+	machine_frame("e", ktp_session_req_id(ktp), line, len);
+
+	udata = udata; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+// Sends complete input lines as a single batch while window is not full
+static bool_t machine_send(machine_t *m)
+{
+	const char **ids = NULL;
+	const char **lines = NULL;
+	size_t num = 0;
+	size_t max = 0;
+	char *pos = m->ibuf;
+	char *end = m->ibuf + m->ibuf_len;
+	faux_eloop_t *eloop = ktp_session_eloop(m->ktp);
+	bool_t rc = BOOL_TRUE;
+
+	if (m->outstanding < m->window)
+		max = m->window - m->outstanding;
+	if (max > 0) {
+		ids = faux_zmalloc(max * sizeof(*ids));
+		lines = faux_zmalloc(max * sizeof(*lines));
+		assert(ids && lines);
+	}
+
+	// Lines are split in place. Separators are replaced by '\0'.
+	while ((num < max) && (pos < end)) {
+		char *nl = memchr(pos, '\n', end - pos);
+		char *sep = NULL;
+		if (!nl)
+			break;
+		*nl = '\0';
+		if (nl > pos && ('\r' == *(nl - 1)))
+			*(nl - 1) = '\0';
+		if ('\0' == *pos) { // Empty line
+			pos = nl + 1;
+			continue;
+		}
+		ids[num] = pos;
+		sep = strpbrk(pos, " \t");
+		if (sep) {
+			*sep = '\0';
+			lines[num] = sep + 1;
+		} else {
+			lines[num] = "";
+		}
+		num++;
+		pos = nl + 1;
+	}
+
+	if (num > 0) {
+		size_t i = 0;
+		rc = ktp_session_batch_ids(m->ktp, ids, lines, num,
+			m->opts->dry_run, m->opts->stop_on_error);
+		m->outstanding += num;
+		for (i = 0; i < num; i++)
+			faux_list_add(m->ids, faux_str_dup(ids[i]));
+	}
+	faux_free(ids);
+	faux_free(lines);
+
+	// Remove sent lines from buffer
+	m->ibuf_len = end - pos;
+	if (m->ibuf_len > 0)
+		memmove(m->ibuf, pos, m->ibuf_len);
+
+	// Window is full. Don't read input until some answers are received
+	if (m->polled) {
+		if (m->outstanding >= m->window)
+			faux_eloop_exclude_fd_event(eloop, STDIN_FILENO, POLLIN);
+		else
+			faux_eloop_include_fd_event(eloop, STDIN_FILENO, POLLIN);
+	}
+
+	// All is done
+	if (m->input_eof && (0 == m->outstanding))
+		ktp_session_set_done(m->ktp, BOOL_TRUE);
+
+	return rc;
+}
+
+
+static bool_t machine_stdin_cb(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *udata)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	machine_t *m = (machine_t *)udata;
+	ssize_t r = -1;
+
+	if (info->revents & POLLIN) {
+		m->ibuf = realloc(m->ibuf,
+			m->ibuf_len + MACHINE_READ_CHUNK + 1);
+		assert(m->ibuf);
+		r = read(STDIN_FILENO, m->ibuf + m->ibuf_len,
+			MACHINE_READ_CHUNK);
+		if (r > 0)
+			m->ibuf_len += r;
+		else if ((r < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+			return BOOL_TRUE;
+	}
+
+	// EOF or error
+	if ((0 == r) || (r < 0) ||
+		(info->revents & (POLLHUP | POLLERR | POLLNVAL))) {
+		faux_eloop_del_fd(eloop, STDIN_FILENO);
+		m->polled = BOOL_FALSE;
+		m->input_eof = BOOL_TRUE;
+		// The last line can be without line feed
+		if ((m->ibuf_len > 0) && (m->ibuf[m->ibuf_len - 1] != '\n')) {
+			m->ibuf = realloc(m->ibuf, m->ibuf_len + 1);
+			m->ibuf[m->ibuf_len++] = '\n';
+		}
+	}
+
+	type = type; // Happy compiler
+
+	if (!machine_send(m))
+		return BOOL_FALSE;
+
+	return !ktp_session_done(m->ktp);
+}
+
+
+static bool_t machine_auth_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg,
+	void *udata)
+{
+	machine_t *m = (machine_t *)udata;
+	int rc = -1;
+
+	if (!ktp_session_retcode(ktp, &rc) || (rc < 0)) {
+		fprintf(stderr, "Error: Server doesn't support machine sessions\n");
+		ktp_session_set_done(ktp, BOOL_TRUE);
+		return BOOL_FALSE;
+	}
+
+	faux_eloop_add_fd(ktp_session_eloop(ktp), STDIN_FILENO, POLLIN,
+		machine_stdin_cb, m);
+	m->polled = BOOL_TRUE;
+
+	msg = msg; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t machine_cmd_ack_cb(ktp_session_t *ktp, const faux_msg_t *msg,
+	void *udata)
+{
+	machine_t *m = (machine_t *)udata;
+	int rc = -1;
+	faux_error_t *error = NULL;
+	const char *id = ktp_session_req_id(ktp);
+
+	// Error messages are sent as stderr of request
+	error = ktp_session_error(ktp);
+	if (faux_error_len(error) > 0) {
+		char *err = faux_error_cstr(error);
+		faux_str_cat(&err, "\n");
+		machine_frame("e", id, err, strlen(err));
+		faux_str_free(err);
+	}
+	faux_error_free(error);
+
+	if (!ktp_session_retcode(ktp, &rc))
+		rc = -1;
+	fprintf(stdout, "r %s %d %llu\n", id ? id : "-", rc,
+		ktp_session_cmd_duration(ktp));
+	fflush(stdout);
+
+	if (m->outstanding > 0)
+		m->outstanding--;
+	if (faux_list_head(m->ids))
+		faux_list_del(m->ids, faux_list_head(m->ids));
+	machine_send(m);
+
+	msg = msg; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Executes requests from stdin within machine session.
+ *
+ * @param [in] ktp KTP session. Not authorized yet.
+ * @param [in] opts Client options.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t machine_run(ktp_session_t *ktp, struct options *opts)
+{
+	machine_t m = {};
+
+	assert(ktp);
+	assert(opts);
+
+	m.ktp = ktp;
+	m.opts = opts;
+	m.window = opts->window_userdefined ?
+		opts->window : MACHINE_DEFAULT_WINDOW;
+	m.ids = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, (void (*)(void *))faux_str_free);
+
+	ktp_session_set_machine(ktp, BOOL_TRUE);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDOUT, machine_stdout_cb, &m);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_STDERR, machine_stderr_cb, &m);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_AUTH_ACK,
+		machine_auth_ack_cb, &m);
+	ktp_session_set_cb(ktp, KTP_SESSION_CB_CMD_ACK, machine_cmd_ack_cb, &m);
+
+	if (!ktp_session_auth(ktp, NULL)) {
+		faux_list_free(m.ids);
+		return BOOL_FALSE;
+	}
+
+	faux_eloop_loop(ktp_session_eloop(ktp));
+	free(m.ibuf);
+
+	// Requests are not completed. Probably server has dropped them.
+	// Inform about each dropped request.
+	if (m.outstanding > 0) {
+		faux_list_node_t *iter = faux_list_head(m.ids);
+		const char *id = NULL;
+		while ((id = (const char *)faux_list_each(&iter))) {
+			machine_frame("e", id, MACHINE_DROPPED_MSG,
+				strlen(MACHINE_DROPPED_MSG));
+			fprintf(stdout, "r %s %d %llu\n", id, -1, 0ULL);
+		}
+	}
+	fflush(stdout);
+	faux_list_free(m.ids);
+
+	if (m.outstanding > 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
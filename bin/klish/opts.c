@@ -14,6 +14,7 @@
 #include <faux/str.h>
 #include <faux/list.h>
 #include <faux/ini.h>
+#include <faux/conv.h>
 
 #include <klish/ktp_session.h>
 
@@ -34,6 +35,9 @@ struct options *opts_init(void)
 	opts->stop_on_error = BOOL_FALSE;
 	opts->dry_run = BOOL_FALSE;
 	opts->quiet = BOOL_FALSE;
+	opts->machine = BOOL_FALSE;
+	opts->window = 1; // No pipelining
+	opts->window_userdefined = BOOL_FALSE;
 	opts->cfgfile = faux_str_dup(DEFAULT_CFGFILE);
 	opts->cfgfile_userdefined = BOOL_FALSE;
 	opts->unix_socket_path = faux_str_dup(KLISH_DEFAULT_UNIX_SOCKET_PATH);
@@ -71,7 +75,7 @@ void opts_free(struct options *opts)
  */
 int opts_parse(int argc, char *argv[], struct options *opts)
 {
-	static const char *shortopts = "hvf:c:erq";
+	static const char *shortopts = "hvf:c:erqw:m";
 	static const struct option longopts[] = {
 		{"conf",		1, NULL, 'f'},
 		{"help",		0, NULL, 'h'},
@@ -80,6 +84,8 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		{"stop-on-error",	0, NULL, 'e'},
 		{"dry-run",		0, NULL, 'r'},
 		{"quiet",		0, NULL, 'q'},
+		{"window",		1, NULL, 'w'},
+		{"machine",		0, NULL, 'm'},
 		{NULL,			0, NULL, 0}
 	};
 
@@ -110,6 +116,18 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		case 'c':
 			faux_list_add(opts->commands, optarg);
 			break;
+		case 'w':
+			if (!faux_conv_atoui(optarg, &opts->window, 0) ||
+				(0 == opts->window)) {
+				fprintf(stderr, "Error: Illegal window size: %s\n",
+					optarg);
+				_exit(-1);
+			}
+			opts->window_userdefined = BOOL_TRUE;
+			break;
+		case 'm':
+			opts->machine = BOOL_TRUE;
+			break;
 		case 'f':
 			faux_str_free(opts->cfgfile);
 			opts->cfgfile = faux_str_dup(optarg);
@@ -139,6 +157,14 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		_exit(-1);
 	}
 
+	// Machine mode gets requests from stdin only
+	if (opts->machine && (!faux_list_is_empty(opts->commands) ||
+		!faux_list_is_empty(opts->files))) {
+		fprintf(stderr, "Error: Machine mode gets requests from stdin "
+			"only\n");
+		_exit(-1);
+	}
+
 	return 0;
 }
 
@@ -173,6 +199,11 @@ void help(int status, const char *argv0)
 		printf("\t-e, --stop-on-error Stop script execution on error.\n");
 		printf("\t-q, --quiet Disable echo while executing commands\n\t\tfrom the file stream.\n");
 		printf("\t-r, --dry-run Don't actually execute ACTION scripts.\n");
+		printf("\t-w <num>, --window=<num> Send up to <num> commands\n"
+			"\t\twithout waiting for answers in non-interactive modes.\n");
+		printf("\t-m, --machine Machine mode for automation tools.\n"
+			"\t\tRequests \"<id> <line>\" are read from stdin. Framed\n"
+			"\t\toutput of each request is written to stdout.\n");
 		printf("\t-f <path>, --conf=<path> Config file ("
 			DEFAULT_CFGFILE ").\n");
 	}
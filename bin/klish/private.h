@@ -7,9 +7,12 @@
 #endif
 
 #define DEFAULT_CFGFILE "/etc/klish/klish.conf"
-#define DEFAULT_PAGER "/usr/bin/less -I -F -e -X -K -d -R"
+#define BUILTIN_PAGER "builtin"
+#define DEFAULT_PAGER BUILTIN_PAGER
 
 #define OBUF_LIMIT 65536
+#define HCACHE_SIZE 32 // Max number of cached completion/help answers
+#define MACHINE_DEFAULT_WINDOW 64 // Outstanding requests in machine mode
 
 /** @brief Command line and config file options
  */
@@ -23,6 +26,9 @@ struct options {
 	bool_t stop_on_error;
 	bool_t dry_run;
 	bool_t quiet;
+	bool_t machine; // Machine mode for automation tools
+	unsigned int window; // Max number of pipelined commands
+	bool_t window_userdefined;
 	faux_list_t *commands;
 	faux_list_t *files;
 };
@@ -33,3 +39,17 @@ struct options *opts_init(void);
 void opts_free(struct options *opts);
 int opts_parse(int argc, char *argv[], struct options *opts);
 bool_t config_parse(const char *cfgfile, struct options *opts);
+
+// Machine mode
+bool_t machine_run(ktp_session_t *ktp, struct options *opts);
+
+// Completion and help cache
+typedef struct hcache_s hcache_t;
+hcache_t *hcache_new(void);
+void hcache_free(hcache_t *cache);
+void hcache_flush(hcache_t *cache);
+size_t hcache_hits(const hcache_t *cache);
+size_t hcache_misses(const hcache_t *cache);
+void hcache_set_token(hcache_t *cache, const faux_msg_t *msg);
+const faux_msg_t *hcache_get(hcache_t *cache, ktp_cmd_e cmd, const char *line);
+bool_t hcache_put(hcache_t *cache, const char *line, const faux_msg_t *msg);
@@ -51,8 +51,10 @@ bool_t daemonize(const char *pidfile);
 bool_t kentry_entrys_is_empty(const kentry_t *entry);
 static int create_listen_unix_sock(const char *path);
 static kscheme_t *load_all_dbs(const char *dbs,
-	faux_ini_t *global_config, faux_error_t *error);
+	faux_ini_t *global_config, bool_t lazy, faux_error_t *error);
 static bool_t clear_scheme(kscheme_t *scheme, faux_error_t *error);
+static void log_view_stats(const kscheme_t *scheme);
+static void log_memory_usage(void);
 static void signal_handler_empty(int signo);
 
 
@@ -65,6 +67,20 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
+static bool_t metrics_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t metrics_client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t metrics_client_timeout_ev(faux_eloop_t *eloop,
+	faux_eloop_type_e type, void *associated_data, void *user_data);
+
+// Metrics endpoint of listening daemon
+typedef struct metrics_client_s metrics_client_t;
+typedef struct metrics_server_s {
+	kmetrics_t *metrics;
+	metrics_client_t *clients; // List of connected clients
+} metrics_server_t;
+static void metrics_client_free(faux_eloop_t *eloop, metrics_client_t *client);
 
 
 /** @brief Main function
@@ -85,6 +101,10 @@ int main(int argc, char **argv)
 	struct sigaction sig_act = {};
 	sigset_t sig_set = {};
 	char *log_service_name = NULL;
+	kocache_t *ocache = NULL;
+	kmetrics_t *metrics = NULL;
+	int metrics_sock = -1;
+	metrics_server_t metrics_server = {};
 
 	// Parse command line options
 	opts = opts_init();
@@ -117,14 +137,75 @@ int main(int argc, char **argv)
 	syslog(LOG_INFO, "Start daemon");
 
 	// Fork the daemon if needed
-	if (!opts->foreground && !daemonize(opts->pidfile))
+	if (!opts->foreground && !opts->scheme_stats && !opts->replay &&
+		!daemonize(opts->pidfile))
 			goto err;
 
 	// Load scheme
-	if (!(scheme = load_all_dbs(opts->dbs, config, error))) {
+	if (!(scheme = load_all_dbs(opts->dbs, config, opts->lazy_scheme,
+		error))) {
 		fprintf(stderr, "Scheme errors:\n");
 		goto err;
 	}
+	if (opts->verbose)
+		log_view_stats(scheme);
+
+	// Show scheme statistics and exit
+	if (opts->scheme_stats) {
+		char *stats = NULL;
+		stats = kscheme_stats(scheme);
+		if (stats)
+			printf("%s", stats);
+		faux_str_free(stats);
+		stats = kscheme_view_stats(scheme);
+		if (stats)
+			printf("%s", stats);
+		faux_str_free(stats);
+		retval = 0;
+		goto err;
+	}
+
+	// Replay recorded session and exit
+	if (opts->replay) {
+		retval = replay(opts->replay, scheme,
+			opts->replay_original_speed);
+		goto err;
+	}
+
+	// Shared output cache. It must be created before forking of service
+	// processes.
+	if (opts->output_cache_size > 0) {
+		ocache = kocache_new(opts->output_cache_size);
+		if (!ocache)
+			syslog(LOG_ERR, "Can't create output cache of size %u",
+				opts->output_cache_size);
+	}
+
+	// Shared metrics. It must be created before forking of service
+	// processes too.
+	if (opts->metrics_socket_path) {
+		metrics = kmetrics_new(KMETRICS_DEFAULT_COMMANDS);
+		if (metrics)
+			metrics_sock = create_listen_unix_sock(
+				opts->metrics_socket_path);
+		if (metrics_sock < 0) {
+			syslog(LOG_ERR, "Can't create metrics endpoint %s",
+				opts->metrics_socket_path);
+			kmetrics_free(metrics);
+			metrics = NULL;
+		}
+	}
+
+	// Trace files contain command lines so directory is private
+	if ((opts->trace_buffer_size > 0) &&
+		(mkdir(opts->trace_dir, 0700) < 0) && (errno != EEXIST))
+		syslog(LOG_ERR, "Can't create trace directory %s: %s",
+			opts->trace_dir, strerror(errno));
+	// Recordings contain stdin of ACTIONs (passwords too)
+	if (opts->record_dir && (mkdir(opts->record_dir, 0700) < 0) &&
+		(errno != EEXIST))
+		syslog(LOG_ERR, "Can't create record directory %s: %s",
+			opts->record_dir, strerror(errno));
 
 	// Listen socket
 	syslog(LOG_DEBUG, "Create listen UNIX socket: %s", opts->unix_socket_path);
@@ -140,15 +221,32 @@ int main(int argc, char **argv)
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGQUIT, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGHUP, refresh_config_ev, opts);
-	faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, NULL);
+	faux_eloop_add_signal(eloop, SIGCHLD, wait_for_child_ev, metrics);
+	// SIGUSR2 dumps trace of service processes ("pkill -USR2 klishd").
+	// Listening daemon has no trace but it must survive. Don't use SIG_IGN
+	// because it will be inherited.
+	sigemptyset(&sig_set);
+	sig_act.sa_flags = 0;
+	sig_act.sa_mask = sig_set;
+	sig_act.sa_handler = &signal_handler_empty;
+	sigaction(SIGUSR2, &sig_act, NULL);
 	// Listen socket. Waiting for new connections
 	faux_eloop_add_fd(eloop, listen_unix_sock, POLLIN,
 		listen_socket_ev, &client_fd);
+	// Metrics socket
+	metrics_server.metrics = metrics;
+	if (metrics_sock >= 0)
+		faux_eloop_add_fd(eloop, metrics_sock, POLLIN,
+			metrics_socket_ev, &metrics_server);
 	// Scheduled events
 //	faux_eloop_add_sched_once_delayed(eloop, &delayed, 1, sched_once, NULL);
 //	faux_eloop_add_sched_periodic_delayed(eloop, 2, sched_periodic, NULL, &period, FAUX_SCHED_INFINITE);
 	// Main loop
 	faux_eloop_loop(eloop);
+	// Forked service process must not keep connections of metrics clients
+	// open. Listening daemon drops them on exit too.
+	while (metrics_server.clients)
+		metrics_client_free(eloop, metrics_server.clients);
 	faux_eloop_free(eloop);
 
 	retval = 0;
@@ -162,12 +260,18 @@ err: // For listen daemon
 	// Close listen socket
 	if (listen_unix_sock >= 0)
 		close(listen_unix_sock);
+	if (metrics_sock >= 0)
+		close(metrics_sock);
 
 	// Finish listen daemon if it's not forked service process.
 	if (client_fd < 0) {
 
 		// Free scheme
 		clear_scheme(scheme, error);
+		kocache_free(ocache);
+		kmetrics_free(metrics);
+		if (metrics)
+			unlink(opts->metrics_socket_path);
 
 		// Free command line options
 		opts_free(opts);
@@ -189,6 +293,8 @@ err: // For listen daemon
 	// ATTENTION: It's a forked service process
 	retval = -1; // Pessimism for service process
 	eloop = NULL;
+	kmetrics_inc(metrics, KMETRICS_SESSIONS_TOTAL, 1);
+	kmetrics_inc(metrics, KMETRICS_FORKS_SESSION, 1);
 
 	// Re-Initialize syslog
 	log_service_name = faux_str_sprintf(LOG_SERVICE_NAME "[%d]", getpid());
@@ -209,6 +315,70 @@ err: // For listen daemon
 
 	syslog(LOG_DEBUG, "New connection %d", client_fd);
 
+	// Audit log
+	if (opts->audit_target) {
+		kaudit_t *audit = kaudit_new(opts->audit_target,
+			opts->audit_buffer_size, opts->audit_policy);
+		if (!audit || !ktpd_session_set_audit(ktpd_session, audit,
+			opts->audit_flush_interval)) {
+			kaudit_free(audit);
+			syslog(LOG_ERR, "Can't create audit log \"%s\"",
+				opts->audit_target);
+		}
+	}
+
+	// Output cache
+	if (ocache)
+		ktpd_session_set_ocache(ktpd_session, ocache);
+
+	// Metrics
+	if (metrics)
+		ktpd_session_set_metrics(ktpd_session, metrics);
+
+	// Latency trace. It's dumped on SIGUSR2
+	if (opts->trace_buffer_size > 0) {
+		ktrace_t *trace = ktrace_new(opts->trace_buffer_size);
+		char *trace_path = faux_str_sprintf("%s/klish-trace-%d.json",
+			opts->trace_dir, getpid());
+		if (!trace || !ktpd_session_set_trace(ktpd_session, trace,
+			trace_path)) {
+			ktrace_free(trace);
+			syslog(LOG_ERR, "Can't create latency trace");
+		}
+		faux_str_free(trace_path);
+	}
+
+	// Session recording
+	if (opts->record_dir) {
+		char *rec_path = faux_str_sprintf("%s/klish-rec-%d.ktprec",
+			opts->record_dir, getpid());
+		ktp_rec_t *rec = ktp_rec_new(rec_path, BOOL_TRUE);
+		if (!rec || !ktpd_session_set_rec(ktpd_session, rec)) {
+			ktp_rec_free(rec);
+			syslog(LOG_ERR, "Can't record session to %s", rec_path);
+		}
+		faux_str_free(rec_path);
+	}
+
+	// Slow request log
+	if ((opts->slow_command_ms > 0) || (opts->slow_completion_ms > 0) ||
+		(opts->slow_help_ms > 0)) {
+		kslow_t *slow = kslow_new(opts->slow_log ?
+			opts->slow_log : "syslog");
+		if (slow) {
+			kslow_set_threshold(slow, KSLOW_CMD,
+				opts->slow_command_ms);
+			kslow_set_threshold(slow, KSLOW_COMPLETION,
+				opts->slow_completion_ms);
+			kslow_set_threshold(slow, KSLOW_HELP,
+				opts->slow_help_ms);
+		}
+		if (!slow || !ktpd_session_set_slow(ktpd_session, slow)) {
+			kslow_free(slow);
+			syslog(LOG_ERR, "Can't create slow request log");
+		}
+	}
+
 	// Signals
 	faux_eloop_add_signal(eloop, SIGINT, stop_loop_ev, NULL);
 	faux_eloop_add_signal(eloop, SIGTERM, stop_loop_ev, NULL);
@@ -228,7 +398,16 @@ err: // For listen daemon
 	retval = 0;
 err_client:
 
+	// Show VIEWs really used by session
+	if (opts->verbose && opts->lazy_scheme)
+		log_view_stats(scheme);
+	// Show memory shared with klishd (copy-on-write) and private memory
+	if (opts->verbose)
+		log_memory_usage();
+
 	ktpd_session_free(ktpd_session);
+	kocache_free(ocache);
+	kmetrics_free(metrics);
 	faux_eloop_free(eloop);
 	syslog(LOG_DEBUG, "Close connection %d", client_fd);
 	close(client_fd);
@@ -340,7 +519,7 @@ static bool_t load_db(kscheme_t *scheme, const char *db_name,
 
 
 static kscheme_t *load_all_dbs(const char *dbs,
-	faux_ini_t *global_config, faux_error_t *error)
+	faux_ini_t *global_config, bool_t lazy, faux_error_t *error)
 {
 	kscheme_t *scheme = NULL;
 	faux_argv_t *dbs_argv = NULL;
@@ -393,6 +572,7 @@ static kscheme_t *load_all_dbs(const char *dbs,
 	}
 
 	// Prepare scheme
+	kscheme_set_lazy(scheme, lazy);
 	context = kcontext_new(KCONTEXT_TYPE_PLUGIN_INIT);
 	kcontext_set_scheme(context, scheme);
 	retcode = kscheme_prepare(scheme, context, error);
@@ -403,6 +583,22 @@ static kscheme_t *load_all_dbs(const char *dbs,
 		return NULL;
 	}
 
+	// Finalize scheme. Build syms' udata within daemon so forked
+	// service processes will share it. Errors are not fatal. The udata
+	// will be built on first use.
+	{
+		faux_error_t *fin_error = faux_error_new();
+		context = kcontext_new(KCONTEXT_TYPE_SERVICE_ACTION);
+		if (!kscheme_finalize(scheme, context, fin_error)) {
+			faux_error_node_t *err_iter = faux_error_iter(fin_error);
+			const char *err = NULL;
+			while ((err = faux_error_each(&err_iter)))
+				syslog(LOG_WARNING, "Scheme finalize: %s", err);
+		}
+		kcontext_free(context);
+		faux_error_free(fin_error);
+	}
+
 
 	// Debug
 /*	{
@@ -422,6 +618,54 @@ static kscheme_t *load_all_dbs(const char *dbs,
 }
 
 
+static void log_view_stats(const kscheme_t *scheme)
+{
+	char *stats = NULL;
+	const char *str = NULL;
+	char *line = NULL;
+
+	stats = kscheme_view_stats(scheme);
+	if (!stats)
+		return;
+	str = stats;
+	while ((line = faux_str_getline(str, &str))) {
+		syslog(LOG_DEBUG, "Scheme: %s", line);
+		faux_str_free(line);
+	}
+	faux_str_free(stats);
+}
+
+
+static void log_memory_usage(void)
+{
+	faux_file_t *f = NULL;
+	char *line = NULL;
+	unsigned long long rss = 0;
+	unsigned long long shared = 0;
+	unsigned long long private = 0;
+
+	f = faux_file_open("/proc/self/smaps_rollup", O_RDONLY, 0);
+	if (!f)
+		return;
+	while ((line = faux_file_getline(f))) {
+		unsigned long long val = 0;
+		if (sscanf(line, "Rss: %llu", &val) == 1)
+			rss = val;
+		else if ((sscanf(line, "Shared_Clean: %llu", &val) == 1) ||
+			(sscanf(line, "Shared_Dirty: %llu", &val) == 1))
+			shared += val;
+		else if ((sscanf(line, "Private_Clean: %llu", &val) == 1) ||
+			(sscanf(line, "Private_Dirty: %llu", &val) == 1))
+			private += val;
+		faux_str_free(line);
+	}
+	faux_file_close(f);
+
+	syslog(LOG_DEBUG, "Memory: RSS %llu kB, shared %llu kB, private %llu kB",
+		rss, shared, private);
+}
+
+
 static bool_t clear_scheme(kscheme_t *scheme, faux_error_t *error)
 {
 	kcontext_t *context = NULL;
@@ -515,9 +759,11 @@ static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 {
 	int wstatus = 0;
 	pid_t child_pid = -1;
+	kmetrics_t *metrics = (kmetrics_t *)user_data; // Can be NULL
 
 	// Wait for any child process. Doesn't block.
 	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+		kmetrics_inc(metrics, KMETRICS_SESSIONS_CLOSED, 1);
 		if (WIFSIGNALED(wstatus)) {
 			syslog(LOG_ERR, "Service process %d was terminated "
 				"by signal: %d",
@@ -532,7 +778,6 @@ static bool_t wait_for_child_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	eloop = eloop;
 	type = type;
 	associated_data = associated_data;
-	user_data = user_data;
 
 	return BOOL_TRUE;
 }
@@ -614,6 +859,175 @@ static bool_t listen_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
+#define METRICS_CLIENT_TIMEOUT 5 // Seconds to get request and send answer
+
+
+// Metrics client. The listening daemon must not block on slow or dead
+// client so socket is non-blocking and answer is sent by parts.
+struct metrics_client_s {
+	int fd;
+	metrics_server_t *server;
+	char *answer;
+	size_t len;
+	size_t sent;
+	metrics_client_t *prev;
+	metrics_client_t *next;
+};
+
+
+static void metrics_client_free(faux_eloop_t *eloop, metrics_client_t *client)
+{
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		client->server->clients = client->next;
+	if (client->next)
+		client->next->prev = client->prev;
+	faux_eloop_del_fd(eloop, client->fd);
+	// Listening daemon has no other scheduled events so fd is used as ID
+	faux_eloop_del_sched(eloop, client->fd);
+	close(client->fd);
+	faux_str_free(client->answer);
+	faux_free(client);
+}
+
+
+/** @brief Event on metrics socket. New metrics client.
+ */
+static bool_t metrics_socket_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	int new_conn = -1;
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	metrics_client_t *client = NULL;
+	struct timespec timeout = {};
+	int fflags = 0;
+
+	new_conn = accept(info->fd, NULL, NULL);
+	if (new_conn < 0) {
+		syslog(LOG_ERR, "Can't accept() metrics connection");
+		return BOOL_TRUE;
+	}
+	fflags = fcntl(new_conn, F_GETFL);
+	fcntl(new_conn, F_SETFL, fflags | O_NONBLOCK);
+	fcntl(new_conn, F_SETFD, FD_CLOEXEC);
+
+	client = faux_zmalloc(sizeof(*client));
+	assert(client);
+	if (!client) {
+		close(new_conn);
+		return BOOL_TRUE;
+	}
+	client->fd = new_conn;
+	client->server = (metrics_server_t *)user_data;
+	client->answer = NULL;
+	client->next = client->server->clients;
+	if (client->next)
+		client->next->prev = client;
+	client->server->clients = client;
+
+	// Wait for request. Idle client is dropped by timeout.
+	faux_eloop_add_fd(eloop, new_conn, POLLIN, metrics_client_ev, client);
+	timeout.tv_sec = METRICS_CLIENT_TIMEOUT;
+	faux_eloop_add_sched_once_delayed(eloop, &timeout, new_conn,
+		metrics_client_timeout_ev, client);
+
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+// Prepares answer for metrics client
+static char *metrics_answer(kmetrics_t *metrics, const char *req)
+{
+	char *body = kmetrics_text(metrics);
+	char *answer = NULL;
+
+	if (strncmp(req, "GET ", 4) == 0) {
+		answer = faux_str_sprintf("HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n",
+			body ? strlen(body) : 0);
+	}
+	faux_str_cat(&answer, body);
+	faux_str_free(body);
+
+	return answer;
+}
+
+
+/** @brief Sends metrics to client.
+ *
+ * Client gets metrics in Prometheus text format and connection is closed.
+ * If client's request is HTTP GET then answer has HTTP header. So metrics
+ * can be scraped by HTTP client supporting UNIX sockets or by simple
+ * "socat - UNIX-CONNECT:<path>".
+ */
+static bool_t metrics_client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	metrics_client_t *client = (metrics_client_t *)user_data;
+	ssize_t r = 0;
+
+	type = type; // Happy compiler
+
+	// Request
+	if (!client->answer) {
+		char req[512] = {};
+		r = read(info->fd, req, sizeof(req) - 1);
+		if ((r < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+			return BOOL_TRUE;
+		if (r < 0) {
+			metrics_client_free(eloop, client);
+			return BOOL_TRUE;
+		}
+		client->answer = metrics_answer(client->server->metrics, req);
+		if (!client->answer) {
+			metrics_client_free(eloop, client);
+			return BOOL_TRUE;
+		}
+		client->len = strlen(client->answer);
+		client->sent = 0;
+		faux_eloop_exclude_fd_event(eloop, info->fd, POLLIN);
+		faux_eloop_include_fd_event(eloop, info->fd, POLLOUT);
+	}
+
+	// Answer. Client that has gone away must not kill daemon by SIGPIPE.
+	r = send(info->fd, client->answer + client->sent,
+		client->len - client->sent, MSG_NOSIGNAL);
+	if ((r < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+		return BOOL_TRUE;
+	if (r > 0)
+		client->sent += r;
+	if ((r < 0) || (client->sent >= client->len))
+		metrics_client_free(eloop, client);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Drops metrics client that doesn't complete exchange in time.
+ */
+static bool_t metrics_client_timeout_ev(faux_eloop_t *eloop,
+	faux_eloop_type_e type, void *associated_data, void *user_data)
+{
+	metrics_client_t *client = (metrics_client_t *)user_data;
+
+	syslog(LOG_DEBUG, "Metrics client %d is dropped by timeout",
+		client->fd);
+	metrics_client_free(eloop, client);
+
+	// Happy compiler
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
 static void signal_handler_empty(int signo)
 {
 	signo = signo; // Happy compiler
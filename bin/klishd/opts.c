@@ -42,6 +42,23 @@ struct options *opts_init(void)
 	opts->verbose = BOOL_FALSE;
 	opts->log_facility = LOG_DAEMON;
 	opts->dbs = faux_str_dup(DEFAULT_DBS);
+	opts->lazy_scheme = BOOL_FALSE;
+	opts->scheme_stats = BOOL_FALSE;
+	opts->audit_target = NULL;
+	opts->audit_buffer_size = KAUDIT_DEFAULT_SIZE;
+	opts->audit_policy = KAUDIT_POLICY_BLOCK;
+	opts->audit_flush_interval = KAUDIT_DEFAULT_INTERVAL;
+	opts->output_cache_size = KOCACHE_DEFAULT_SIZE;
+	opts->trace_buffer_size = 0;
+	opts->trace_dir = faux_str_dup(KTRACE_DEFAULT_DIR);
+	opts->metrics_socket_path = NULL;
+	opts->record_dir = NULL;
+	opts->slow_log = NULL;
+	opts->slow_command_ms = 0;
+	opts->slow_completion_ms = 0;
+	opts->slow_help_ms = 0;
+	opts->replay = NULL;
+	opts->replay_original_speed = BOOL_FALSE;
 
 	return opts;
 }
@@ -55,6 +72,12 @@ void opts_free(struct options *opts)
 	faux_str_free(opts->cfgfile);
 	faux_str_free(opts->unix_socket_path);
 	faux_str_free(opts->dbs);
+	faux_str_free(opts->audit_target);
+	faux_str_free(opts->trace_dir);
+	faux_str_free(opts->metrics_socket_path);
+	faux_str_free(opts->record_dir);
+	faux_str_free(opts->slow_log);
+	faux_str_free(opts->replay);
 	faux_free(opts);
 }
 
@@ -63,7 +86,7 @@ void opts_free(struct options *opts)
  */
 int opts_parse(int argc, char *argv[], struct options *opts)
 {
-	static const char *shortopts = "hp:f:dl:v";
+	static const char *shortopts = "hp:f:dl:vsR:o";
 	static const struct option longopts[] = {
 		{"help",		0, NULL, 'h'},
 		{"pid",			1, NULL, 'p'},
@@ -71,6 +94,9 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		{"foreground",		0, NULL, 'd'},
 		{"verbose",		0, NULL, 'v'},
 		{"facility",		1, NULL, 'l'},
+		{"scheme-stats",	0, NULL, 's'},
+		{"replay",		1, NULL, 'R'},
+		{"original-speed",	0, NULL, 'o'},
 		{NULL,			0, NULL, 0}
 	};
 
@@ -97,6 +123,16 @@ int opts_parse(int argc, char *argv[], struct options *opts)
 		case 'v':
 			opts->verbose = BOOL_TRUE;
 			break;
+		case 's':
+			opts->scheme_stats = BOOL_TRUE;
+			break;
+		case 'R':
+			faux_str_free(opts->replay);
+			opts->replay = faux_str_dup(optarg);
+			break;
+		case 'o':
+			opts->replay_original_speed = BOOL_TRUE;
+			break;
 		case 'l':
 			if (faux_log_facility_id(optarg, &(opts->log_facility))) {
 				fprintf(stderr, "Error: Illegal syslog facility %s.\n", optarg);
@@ -149,6 +185,12 @@ void help(int status, const char *argv0)
 		printf("\t-f <path>, --conf=<path> Config file ("
 			DEFAULT_CFGFILE ").\n");
 		printf("\t-l, --facility Syslog facility (DAEMON).\n");
+		printf("\t-s, --scheme-stats Load scheme, show its memory footprint\n"
+			"\t\tand exit.\n");
+		printf("\t-R <path>, --replay=<path> Replay recorded session,\n"
+			"\t\tcompare answers, show latencies and exit.\n");
+		printf("\t-o, --original-speed Keep pauses between requests\n"
+			"\t\tof recorded session. Default is max speed.\n");
 	}
 }
 
@@ -187,6 +229,116 @@ faux_ini_t *config_parse(const char *cfgfile, struct options *opts)
 		opts->dbs = faux_str_dup(tmp);
 	}
 
+	// LazyScheme: y/n
+	if ((tmp = faux_ini_find(ini, "LazyScheme"))) {
+		if (faux_str_casecmp(tmp, "y") == 0)
+			opts->lazy_scheme = BOOL_TRUE;
+		else
+			opts->lazy_scheme = BOOL_FALSE;
+	}
+
+	// AuditTarget: syslog, file:<path>, unix:<path>
+	if ((tmp = faux_ini_find(ini, "AuditTarget"))) {
+		faux_str_free(opts->audit_target);
+		opts->audit_target = faux_str_dup(tmp);
+	}
+
+	// AuditBufferSize
+	if ((tmp = faux_ini_find(ini, "AuditBufferSize"))) {
+		unsigned int size = 0;
+		if (faux_conv_atoui(tmp, &size, 0) && (size > 0))
+			opts->audit_buffer_size = size;
+		else
+			syslog(LOG_WARNING, "Illegal AuditBufferSize: %s", tmp);
+	}
+
+	// AuditPolicy: block, drop-new, drop-old
+	if ((tmp = faux_ini_find(ini, "AuditPolicy"))) {
+		kaudit_policy_e policy = kaudit_policy_from_str(tmp);
+		if (policy != KAUDIT_POLICY_NONE)
+			opts->audit_policy = policy;
+		else
+			syslog(LOG_WARNING, "Illegal AuditPolicy: %s", tmp);
+	}
+
+	// AuditFlushInterval
+	if ((tmp = faux_ini_find(ini, "AuditFlushInterval"))) {
+		unsigned int interval = 0;
+		if (faux_conv_atoui(tmp, &interval, 0) && (interval > 0))
+			opts->audit_flush_interval = interval;
+		else
+			syslog(LOG_WARNING, "Illegal AuditFlushInterval: %s", tmp);
+	}
+
+	// OutputCacheSize. Bytes. 0 - disabled
+	if ((tmp = faux_ini_find(ini, "OutputCacheSize"))) {
+		unsigned int size = 0;
+		if (faux_conv_atoui(tmp, &size, 0))
+			opts->output_cache_size = size;
+		else
+			syslog(LOG_WARNING, "Illegal OutputCacheSize: %s", tmp);
+	}
+
+	// TraceBufferSize. Events. 0 - disabled
+	if ((tmp = faux_ini_find(ini, "TraceBufferSize"))) {
+		unsigned int size = 0;
+		if (faux_conv_atoui(tmp, &size, 0))
+			opts->trace_buffer_size = size;
+		else
+			syslog(LOG_WARNING, "Illegal TraceBufferSize: %s", tmp);
+	}
+
+	// TraceDir
+	if ((tmp = faux_ini_find(ini, "TraceDir"))) {
+		faux_str_free(opts->trace_dir);
+		opts->trace_dir = faux_str_dup(tmp);
+	}
+
+	// MetricsSocketPath. Not defined - disabled
+	if ((tmp = faux_ini_find(ini, "MetricsSocketPath"))) {
+		faux_str_free(opts->metrics_socket_path);
+		opts->metrics_socket_path = faux_str_dup(tmp);
+	}
+
+	// RecordDir. Not defined - disabled
+	if ((tmp = faux_ini_find(ini, "RecordDir"))) {
+		faux_str_free(opts->record_dir);
+		opts->record_dir = faux_str_dup(tmp);
+	}
+
+	// SlowLog: syslog, file:<path>
+	if ((tmp = faux_ini_find(ini, "SlowLog"))) {
+		faux_str_free(opts->slow_log);
+		opts->slow_log = faux_str_dup(tmp);
+	}
+
+	// SlowCommandMs. Milliseconds. 0 - disabled
+	if ((tmp = faux_ini_find(ini, "SlowCommandMs"))) {
+		unsigned int ms = 0;
+		if (faux_conv_atoui(tmp, &ms, 0))
+			opts->slow_command_ms = ms;
+		else
+			syslog(LOG_WARNING, "Illegal SlowCommandMs: %s", tmp);
+	}
+
+	// SlowCompletionMs. Milliseconds. 0 - disabled
+	if ((tmp = faux_ini_find(ini, "SlowCompletionMs"))) {
+		unsigned int ms = 0;
+		if (faux_conv_atoui(tmp, &ms, 0))
+			opts->slow_completion_ms = ms;
+		else
+			syslog(LOG_WARNING, "Illegal SlowCompletionMs: %s", tmp);
+	}
+
+	// SlowHelpMs. Milliseconds. 0 - disabled
+	if ((tmp = faux_ini_find(ini, "SlowHelpMs"))) {
+		unsigned int ms = 0;
+		if (faux_conv_atoui(tmp, &ms, 0))
+			opts->slow_help_ms = ms;
+		else
+			syslog(LOG_WARNING, "Illegal SlowHelpMs: %s", tmp);
+	}
+
 	return ini;
 }
 
@@ -206,6 +358,20 @@ int opts_show(struct options *opts)
 	syslog(LOG_DEBUG, "opts: ConfigPath = %s\n", opts->cfgfile);
 	syslog(LOG_DEBUG, "opts: UnixSocketPath = %s\n", opts->unix_socket_path);
 	syslog(LOG_DEBUG, "opts: DBs = %s\n", opts->dbs);
+	syslog(LOG_DEBUG, "opts: LazyScheme = %s\n", opts->lazy_scheme ? "true" : "false");
+	syslog(LOG_DEBUG, "opts: AuditTarget = %s\n", opts->audit_target ? opts->audit_target : "none");
+	syslog(LOG_DEBUG, "opts: AuditBufferSize = %u\n", opts->audit_buffer_size);
+	syslog(LOG_DEBUG, "opts: AuditPolicy = %s\n", kaudit_policy_str(opts->audit_policy));
+	syslog(LOG_DEBUG, "opts: AuditFlushInterval = %u\n", opts->audit_flush_interval);
+	syslog(LOG_DEBUG, "opts: OutputCacheSize = %u\n", opts->output_cache_size);
+	syslog(LOG_DEBUG, "opts: TraceBufferSize = %u\n", opts->trace_buffer_size);
+	syslog(LOG_DEBUG, "opts: TraceDir = %s\n", opts->trace_dir);
+	syslog(LOG_DEBUG, "opts: MetricsSocketPath = %s\n", opts->metrics_socket_path ? opts->metrics_socket_path : "none");
+	syslog(LOG_DEBUG, "opts: RecordDir = %s\n", opts->record_dir ? opts->record_dir : "none");
+	syslog(LOG_DEBUG, "opts: SlowLog = %s\n", opts->slow_log ? opts->slow_log : "syslog");
+	syslog(LOG_DEBUG, "opts: SlowCommandMs = %u\n", opts->slow_command_ms);
+	syslog(LOG_DEBUG, "opts: SlowCompletionMs = %u\n", opts->slow_completion_ms);
+	syslog(LOG_DEBUG, "opts: SlowHelpMs = %u\n", opts->slow_help_ms);
 
 	return 0;
 }
@@ -3,6 +3,11 @@
 #endif
 
 #include <faux/ini.h>
+#include <klish/kaudit.h>
+#include <klish/kocache.h>
+#include <klish/ktrace.h>
+#include <klish/kmetrics.h>
+#include <klish/kscheme.h>
 
 #define LOG_NAME "klishd-listen"
 #define LOG_SERVICE_NAME "klishd"
@@ -19,9 +24,26 @@ struct options {
 	bool_t cfgfile_userdefined;
 	char *unix_socket_path;
 	char *dbs;
+	bool_t lazy_scheme; // Prepare VIEWs on first use
 	bool_t foreground; // Don't daemonize
 	bool_t verbose;
 	int log_facility;
+	bool_t scheme_stats; // Show scheme statistics and exit
+	char *audit_target; // Audit log target. NULL - disabled
+	unsigned int audit_buffer_size; // Audit log ring buffer size (records)
+	kaudit_policy_e audit_policy; // What to do when audit buffer is full
+	unsigned int audit_flush_interval; // Seconds
+	unsigned int output_cache_size; // Shared output cache size. 0 - disabled
+	unsigned int trace_buffer_size; // Latency trace size (events). 0 - disabled
+	char *trace_dir; // Directory for trace dumps
+	char *metrics_socket_path; // Metrics endpoint. NULL - disabled
+	char *record_dir; // Directory for session recordings. NULL - disabled
+	char *slow_log; // Slow request log target. NULL - syslog
+	unsigned int slow_command_ms; // Slow command threshold. 0 - disabled
+	unsigned int slow_completion_ms; // Slow completion threshold
+	unsigned int slow_help_ms; // Slow help threshold
+	char *replay; // Recording to replay. NULL - normal daemon
+	bool_t replay_original_speed; // Keep pauses of recorded session
 };
 
 // Options and config file
@@ -31,3 +53,6 @@ void opts_free(struct options *opts);
 int opts_parse(int argc, char *argv[], struct options *opts);
 int opts_show(struct options *opts);
 faux_ini_t *config_parse(const char *cfgfile, struct options *opts);
+
+// Replay of recorded session
+int replay(const char *path, kscheme_t *scheme, bool_t original_speed);
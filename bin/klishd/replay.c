@@ -0,0 +1,620 @@
+/** @file replay.c
+ *
+ * Replay of recorded KTP session. The recorded client's messages are sent
+ * to KTPd session again and answers are compared to recorded ones. The KTPd
+ * session is served by the same process and event loop. The client and
+ * server are connected by socketpair so replay measures KTPd itself without
+ * klishd listener and fork of service process.
+ *
+ * Recording is splitted to requests. The request is a client's message and
+ * all server's messages up to the next client's message. The request is
+ * completed when all answers are received. The stdout and stderr can be
+ * splitted to messages differently each run so the streams are compared as
+ * a whole but not message by message.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/msg.h>
+#include <faux/async.h>
+#include <faux/eloop.h>
+#include <klish/kscheme.h>
+#include <klish/ktp.h>
+#include <klish/ktp_session.h>
+#include <klish/ktp_rec.h>
+
+#include "private.h"
+
+#define REPLAY_TIMEOUT 10 // Seconds to wait for answers
+#define REPLAY_TIMEOUT_SCHED_ID 101
+#define REPLAY_NEXT_SCHED_ID 102
+
+
+typedef enum {
+	REPLAY_CMD,
+	REPLAY_COMPLETION,
+	REPLAY_HELP,
+	REPLAY_OTHER,
+	REPLAY_TYPE_MAX,
+} replay_type_e;
+
+static const char *replay_type_names[REPLAY_TYPE_MAX] = {
+	"cmd",
+	"completion",
+	"help",
+	"other",
+};
+
+
+typedef struct replay_blob_s {
+	char *data;
+	size_t len;
+} replay_blob_t;
+
+
+typedef struct replay_sample_s {
+	replay_type_e type;
+	uint64_t usec; // Replayed latency
+	uint64_t rec_usec; // Recorded latency
+} replay_sample_t;
+
+
+typedef struct replay_s {
+	ktp_rec_t *rec;
+	faux_eloop_t *eloop;
+	faux_async_t *async; // Client side of socketpair
+	ktp_rx_t rx;
+	bool_t original_speed;
+	bool_t failed; // Broken recording or timeout
+	// Look-ahead. The client's message of the next request
+	bool_t next_valid;
+	replay_blob_t next_input;
+	uint64_t next_ts;
+	// Current request
+	faux_msg_t *input; // NULL for answers before first client's message
+	uint64_t input_ts; // Recorded time of client's message
+	uint64_t last_ts; // Recorded time of last answer
+	uint64_t started; // Replay time of client's message
+	bool_t sent;
+	replay_blob_t exp_msgs; // Normalized answers except streams
+	size_t exp_num;
+	replay_blob_t exp_out;
+	replay_blob_t exp_err;
+	replay_blob_t got_msgs;
+	size_t got_num;
+	replay_blob_t got_out;
+	replay_blob_t got_err;
+	// Statistics
+	size_t requests;
+	size_t messages; // Received answers
+	size_t mismatches;
+	replay_sample_t *samples;
+	size_t samples_num;
+	size_t samples_size;
+} replay_t;
+
+
+static uint64_t replay_now(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void replay_blob_add(replay_blob_t *blob, const char *data, size_t len)
+{
+	if (0 == len)
+		return;
+	blob->data = realloc(blob->data, blob->len + len);
+	assert(blob->data);
+	memcpy(blob->data + blob->len, data, len);
+	blob->len += len;
+}
+
+
+static bool_t replay_blob_eq(const replay_blob_t *f, const replay_blob_t *s)
+{
+	if (f->len != s->len)
+		return BOOL_FALSE;
+	if (0 == f->len)
+		return BOOL_TRUE;
+
+	return (memcmp(f->data, s->data, f->len) == 0) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+static void replay_blob_clear(replay_blob_t *blob)
+{
+	free(blob->data);
+	blob->data = NULL;
+	blob->len = 0;
+}
+
+
+// Normalized answer is splitted to stdout, stderr and other messages
+static void replay_add_answer(replay_blob_t *msgs, size_t *num,
+	replay_blob_t *out, replay_blob_t *err, const char *data, size_t len)
+{
+	int cmd = ktp_rec_msg_cmd(data, len);
+	const char *line = NULL;
+	size_t line_len = 0;
+
+	if ((KTP_STDOUT == cmd) || (KTP_STDERR == cmd)) {
+		if (ktp_rec_msg_param(data, len, KTP_PARAM_LINE,
+			&line, &line_len))
+			replay_blob_add((KTP_STDOUT == cmd) ? out : err,
+				line, line_len);
+		return;
+	}
+	replay_blob_add(msgs, data, len);
+	(*num)++;
+}
+
+
+static replay_type_e replay_type(const faux_msg_t *msg)
+{
+	if (!msg)
+		return REPLAY_OTHER;
+
+	switch (faux_msg_get_cmd(msg)) {
+	case KTP_CMD:
+	case KTP_CMD_BATCH:
+		return REPLAY_CMD;
+	case KTP_COMPLETION:
+		return REPLAY_COMPLETION;
+	case KTP_HELP:
+		return REPLAY_HELP;
+	default:
+		break;
+	}
+
+	return REPLAY_OTHER;
+}
+
+
+/** @brief Loads next request from recording.
+ *
+ * @return 1 - request is loaded, 0 - end of recording, -1 - error.
+ */
+static int replay_load(replay_t *r)
+{
+	ktp_rec_dir_e dir = KTP_REC_IN;
+	uint64_t ts = 0;
+	const char *data = NULL;
+	size_t len = 0;
+	int rc = 0;
+
+	// Clear previous request
+	faux_msg_free(r->input);
+	r->input = NULL;
+	r->sent = BOOL_FALSE;
+	replay_blob_clear(&r->exp_msgs);
+	replay_blob_clear(&r->exp_out);
+	replay_blob_clear(&r->exp_err);
+	replay_blob_clear(&r->got_msgs);
+	replay_blob_clear(&r->got_out);
+	replay_blob_clear(&r->got_err);
+	r->exp_num = 0;
+	r->got_num = 0;
+
+	// Client's message was read while previous request loading
+	if (r->next_valid) {
+		faux_hdr_t *hdr = (faux_hdr_t *)r->next_input.data;
+		if (r->next_input.len < sizeof(*hdr) ||
+			!ktp_check_header(hdr))
+			return -1;
+		r->input = faux_msg_deserialize_parts(hdr,
+			r->next_input.data + sizeof(*hdr),
+			r->next_input.len - sizeof(*hdr));
+		if (!r->input)
+			return -1;
+		r->input_ts = r->next_ts;
+		replay_blob_clear(&r->next_input);
+		r->next_valid = BOOL_FALSE;
+	}
+	r->last_ts = r->input_ts;
+
+	while ((rc = ktp_rec_next(r->rec, &dir, &ts, &data, &len)) > 0) {
+		if (KTP_REC_IN == dir) {
+			replay_blob_add(&r->next_input, data, len);
+			r->next_ts = ts;
+			r->next_valid = BOOL_TRUE;
+			break;
+		}
+		replay_add_answer(&r->exp_msgs, &r->exp_num,
+			&r->exp_out, &r->exp_err, data, len);
+		r->last_ts = ts;
+	}
+	if (rc < 0)
+		return -1;
+
+	if (!r->input && (0 == r->exp_num) && (0 == r->exp_out.len) &&
+		(0 == r->exp_err.len))
+		return r->next_valid ? replay_load(r) : 0;
+
+	return 1;
+}
+
+
+static bool_t replay_timeout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	replay_t *r = (replay_t *)user_data;
+
+	fprintf(stderr, "Error: Request %zu: no answer within %u seconds\n",
+		r->requests + 1, REPLAY_TIMEOUT);
+	r->failed = BOOL_TRUE;
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_FALSE; // Stop event loop
+}
+
+
+static bool_t replay_stop_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+	user_data = user_data;
+
+	return BOOL_FALSE; // Stop event loop
+}
+
+
+static bool_t replay_start(replay_t *r);
+static bool_t replay_next_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+
+// Request is completed when all expected answers are received
+static bool_t replay_check(replay_t *r)
+{
+	uint64_t usec = 0;
+	uint64_t prev_ts = 0;
+	uint64_t prev_started = 0;
+	int rc = 0;
+
+	if (!r->sent)
+		return BOOL_TRUE;
+	if ((r->got_num < r->exp_num) || (r->got_out.len < r->exp_out.len) ||
+		(r->got_err.len < r->exp_err.len))
+		return BOOL_TRUE;
+
+	faux_eloop_del_sched(r->eloop, REPLAY_TIMEOUT_SCHED_ID);
+	usec = replay_now() - r->started;
+	r->requests++;
+
+	if ((r->got_num != r->exp_num) ||
+		!replay_blob_eq(&r->got_msgs, &r->exp_msgs) ||
+		!replay_blob_eq(&r->got_out, &r->exp_out) ||
+		!replay_blob_eq(&r->got_err, &r->exp_err)) {
+		char *line = NULL;
+		if (r->input)
+			line = faux_msg_get_str_param_by_type(r->input,
+				KTP_PARAM_LINE);
+		printf("Mismatch: request %zu, %s \"%s\": answers %zu/%zu, "
+			"stdout %zu/%zu, stderr %zu/%zu bytes\n", r->requests,
+			replay_type_names[replay_type(r->input)],
+			line ? line : "", r->got_num, r->exp_num,
+			r->got_out.len, r->exp_out.len,
+			r->got_err.len, r->exp_err.len);
+		faux_str_free(line);
+		r->mismatches++;
+	}
+
+	// Latency
+	if (r->input) {
+		replay_sample_t *s = NULL;
+		if (r->samples_num == r->samples_size) {
+			r->samples_size = r->samples_size ?
+				r->samples_size * 2 : 1024;
+			r->samples = realloc(r->samples,
+				r->samples_size * sizeof(*r->samples));
+			assert(r->samples);
+		}
+		s = &r->samples[r->samples_num++];
+		s->type = replay_type(r->input);
+		s->usec = usec;
+		s->rec_usec = r->last_ts - r->input_ts;
+	}
+
+	// Next request
+	prev_ts = r->input_ts;
+	prev_started = r->started;
+	rc = replay_load(r);
+	if (rc < 0) {
+		fprintf(stderr, "Error: Broken recording %s\n",
+			ktp_rec_path(r->rec));
+		r->failed = BOOL_TRUE;
+	}
+	if (rc <= 0)
+		return BOOL_FALSE; // Stop event loop
+
+	// Keep original pauses between client's messages
+	if (r->original_speed && r->input && (r->input_ts > prev_ts)) {
+		uint64_t pause = r->input_ts - prev_ts;
+		uint64_t elapsed = replay_now() - prev_started;
+		if (pause > elapsed) {
+			struct timespec delay = {};
+			pause -= elapsed;
+			delay.tv_sec = pause / 1000000;
+			delay.tv_nsec = (pause % 1000000) * 1000;
+			faux_eloop_add_sched_once_delayed(r->eloop, &delay,
+				REPLAY_NEXT_SCHED_ID, replay_next_ev, r);
+			return BOOL_TRUE;
+		}
+	}
+
+	return replay_start(r);
+}
+
+
+static bool_t replay_next_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	replay_t *r = (replay_t *)user_data;
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return replay_start(r);
+}
+
+
+static bool_t replay_start(replay_t *r)
+{
+	struct timespec timeout = {};
+
+	r->started = replay_now();
+	if (r->input)
+		faux_msg_send_async(r->input, r->async);
+	r->sent = BOOL_TRUE;
+
+	timeout.tv_sec = REPLAY_TIMEOUT;
+	faux_eloop_add_sched_once_delayed(r->eloop, &timeout,
+		REPLAY_TIMEOUT_SCHED_ID, replay_timeout_ev, r);
+
+	// Answers can be received already
+	return replay_check(r);
+}
+
+
+static bool_t replay_read_cb(faux_async_t *async,
+	faux_buf_t *buf, size_t len, void *user_data)
+{
+	replay_t *r = (replay_t *)user_data;
+	faux_msg_t *msg = NULL;
+	const char *body = NULL;
+	size_t body_len = 0;
+	char *data = NULL;
+	size_t data_len = 0;
+	int rc = 0;
+
+	rc = ktp_rx_recv(&r->rx, async, buf, len, &body, &body_len);
+	if (rc < 0)
+		return BOOL_FALSE;
+	if (0 == rc)
+		return BOOL_TRUE; // Header is received. Wait for body
+
+	msg = faux_msg_deserialize_parts(&r->rx.hdr, body, body_len);
+	ktp_rx_done(&r->rx, async, buf);
+	if (!msg)
+		return BOOL_FALSE;
+	data = ktp_rec_msg_encode(msg, &data_len);
+	faux_msg_free(msg);
+	if (!data)
+		return BOOL_FALSE;
+	replay_add_answer(&r->got_msgs, &r->got_num,
+		&r->got_out, &r->got_err, data, data_len);
+	faux_free(data);
+	r->messages++;
+
+	// Read callback can't stop event loop so stop it by timeout event
+	if (!replay_check(r)) {
+		struct timespec now = {};
+		faux_eloop_del_sched(r->eloop, REPLAY_TIMEOUT_SCHED_ID);
+		faux_eloop_add_sched_once_delayed(r->eloop, &now,
+			REPLAY_TIMEOUT_SCHED_ID, replay_stop_ev, r);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static int replay_sample_compare(const void *first, const void *second)
+{
+	const replay_sample_t *f = (const replay_sample_t *)first;
+	const replay_sample_t *s = (const replay_sample_t *)second;
+
+	if (f->type != s->type)
+		return (f->type < s->type) ? -1 : 1;
+	if (f->usec != s->usec)
+		return (f->usec < s->usec) ? -1 : 1;
+
+	return 0;
+}
+
+
+static int replay_usec_compare(const void *first, const void *second)
+{
+	uint64_t f = *(const uint64_t *)first;
+	uint64_t s = *(const uint64_t *)second;
+
+	if (f != s)
+		return (f < s) ? -1 : 1;
+
+	return 0;
+}
+
+
+// Percentile of sorted values. The "q" is in units of 0.1%
+static double replay_percentile(const uint64_t *usec, size_t num,
+	unsigned int q)
+{
+	size_t idx = (num * q + 999) / 1000;
+
+	if (idx > 0)
+		idx--;
+
+	return usec[idx] / 1000.0;
+}
+
+
+static void replay_report(replay_t *r, uint64_t duration)
+{
+	size_t i = 0;
+	uint64_t rec_total = 0;
+	uint64_t total = 0;
+	uint64_t *usec = NULL;
+	uint64_t *rec_usec = NULL;
+	replay_type_e type = REPLAY_CMD;
+
+	qsort(r->samples, r->samples_num, sizeof(*r->samples),
+		replay_sample_compare);
+	usec = faux_zmalloc((r->samples_num + 1) * sizeof(*usec));
+	rec_usec = faux_zmalloc((r->samples_num + 1) * sizeof(*rec_usec));
+	assert(usec && rec_usec);
+
+	printf("Recording: %s\n", ktp_rec_path(r->rec));
+	printf("Requests: %zu, answers: %zu, mismatches: %zu\n",
+		r->requests, r->messages, r->mismatches);
+	printf("%-10s %8s %10s %10s %10s %10s %10s\n", "type", "count",
+		"rec p50", "rec p99", "p50,ms", "p99,ms", "max,ms");
+	for (type = REPLAY_CMD; type < REPLAY_TYPE_MAX; type++) {
+		size_t first = i;
+		size_t n = 0;
+		size_t k = 0;
+		while ((i < r->samples_num) && (r->samples[i].type == type))
+			i++;
+		n = i - first;
+		if (0 == n)
+			continue;
+		for (k = 0; k < n; k++) {
+			usec[k] = r->samples[first + k].usec;
+			rec_usec[k] = r->samples[first + k].rec_usec;
+			total += usec[k];
+			rec_total += rec_usec[k];
+		}
+		qsort(rec_usec, n, sizeof(*rec_usec), replay_usec_compare);
+		printf("%-10s %8zu %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+			replay_type_names[type], n,
+			replay_percentile(rec_usec, n, 500),
+			replay_percentile(rec_usec, n, 990),
+			replay_percentile(usec, n, 500),
+			replay_percentile(usec, n, 990),
+			usec[n - 1] / 1000.0);
+	}
+	printf("Processing time, ms: recorded %.3f, replayed %.3f\n",
+		rec_total / 1000.0, total / 1000.0);
+	printf("Duration: %.3f s\n", duration / 1000000.0);
+
+	faux_free(usec);
+	faux_free(rec_usec);
+}
+
+
+/** @brief Replays recorded KTP session.
+ *
+ * @param [in] path Recording file.
+ * @param [in] scheme Loaded scheme.
+ * @param [in] original_speed Keep pauses between client's messages.
+ * @return 0 - answers are the same as recorded, -1 - mismatch or error.
+ */
+int replay(const char *path, kscheme_t *scheme, bool_t original_speed)
+{
+	replay_t r = {};
+	int sv[2] = {-1, -1};
+	ktpd_session_t *ktpd = NULL;
+	uint64_t started = 0;
+	int rc = 0;
+	int retval = -1;
+
+	r.rec = ktp_rec_new(path, BOOL_FALSE);
+	if (!r.rec) {
+		fprintf(stderr, "Error: Can't open recording %s\n", path);
+		return -1;
+	}
+	r.original_speed = original_speed;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		fprintf(stderr, "Error: Can't create socketpair\n");
+		goto err;
+	}
+	r.eloop = faux_eloop_new(NULL);
+
+	// Server side. Function ktpd_session_new() adds events to eloop itself
+	ktpd = ktpd_session_new(sv[0], scheme, NULL, r.eloop);
+	if (!ktpd) {
+		fprintf(stderr, "Error: Can't create KTPd session\n");
+		goto err;
+	}
+
+	// Client side
+	r.async = faux_async_new(sv[1]);
+	assert(r.async);
+	faux_async_set_read_limits(r.async,
+		sizeof(faux_hdr_t), sizeof(faux_hdr_t));
+	faux_async_set_read_cb(r.async, replay_read_cb, &r);
+	faux_async_set_stall_cb(r.async, ktp_stall_cb, r.eloop);
+	faux_eloop_add_fd(r.eloop, sv[1], POLLIN, ktp_peer_ev, r.async);
+
+	rc = replay_load(&r);
+	if (rc < 0) {
+		fprintf(stderr, "Error: Broken recording %s\n", path);
+		goto err;
+	}
+	started = replay_now();
+	if ((rc > 0) && replay_start(&r))
+		faux_eloop_loop(r.eloop);
+	replay_report(&r, replay_now() - started);
+
+	if (!r.failed && (0 == r.mismatches))
+		retval = 0;
+
+err:
+	ktpd_session_free(ktpd);
+	faux_async_free(r.async);
+	ktp_rx_fini(&r.rx);
+	faux_eloop_free(r.eloop);
+	if (sv[0] >= 0)
+		close(sv[0]);
+	if (sv[1] >= 0)
+		close(sv[1]);
+	faux_msg_free(r.input);
+	replay_blob_clear(&r.next_input);
+	replay_blob_clear(&r.exp_msgs);
+	replay_blob_clear(&r.exp_out);
+	replay_blob_clear(&r.exp_err);
+	replay_blob_clear(&r.got_msgs);
+	replay_blob_clear(&r.got_out);
+	replay_blob_clear(&r.got_err);
+	free(r.samples);
+	ktp_rec_free(r.rec);
+
+	return retval;
+}
@@ -27,6 +27,8 @@ struct ientry_s {
 	char *transparent;
 	char *order;
 	char *filter;
+	char *cache;
+	char *cache_policy;
 	ientry_t * (*entrys)[]; // Nested entrys
 	iaction_t * (*actions)[];
 	ihotkey_t * (*hotkeys)[];
@@ -161,6 +161,33 @@ bool_t ientry_parse(const ientry_t *info, kentry_t *entry, faux_error_t *error)
 		}
 	}
 
+	// Cache. TTL of COMMAND or COMPL output
+	if (!faux_str_is_empty(info->cache)) {
+		unsigned int i = 0;
+		if (!faux_conv_atoui(info->cache, &i, 0) ||
+			!kentry_set_cache(entry, (size_t)i)) {
+			faux_error_add(error, TAG": Illegal 'cache' attribute");
+			retcode = BOOL_FALSE;
+		}
+	}
+
+	// Cache policy of PROMPT, HELP or COMPL
+	if (!faux_str_is_empty(info->cache_policy)) {
+		kentry_cache_e policy = KENTRY_CACHE_NONE;
+		if (!faux_str_casecmp(info->cache_policy, "always"))
+			policy = KENTRY_CACHE_ALWAYS;
+		else if (!faux_str_casecmp(info->cache_policy, "path"))
+			policy = KENTRY_CACHE_PATH;
+		else if (!faux_str_casecmp(info->cache_policy, "static"))
+			policy = KENTRY_CACHE_STATIC;
+		if ((KENTRY_CACHE_NONE == policy) ||
+			!kentry_set_cache_policy(entry, policy)) {
+			faux_error_add(error,
+				TAG": Illegal 'cache_policy' attribute");
+			retcode = BOOL_FALSE;
+		}
+	}
+
 	return retcode;
 }
 
@@ -417,6 +444,27 @@ char *ientry_deploy(const kentry_t *kentry, int level)
 		}
 		attr2ctext(&str, "filter", filter, level + 1);
 
+		// Cache
+		if (kentry_cache(kentry) > 0) {
+			num = faux_str_sprintf("%zu", kentry_cache(kentry));
+			attr2ctext(&str, "cache", num, level + 1);
+			faux_str_free(num);
+			num = NULL;
+		}
+		switch (kentry_cache_policy(kentry)) {
+		case KENTRY_CACHE_ALWAYS:
+			attr2ctext(&str, "cache_policy", "always", level + 1);
+			break;
+		case KENTRY_CACHE_PATH:
+			attr2ctext(&str, "cache_policy", "path", level + 1);
+			break;
+		case KENTRY_CACHE_STATIC:
+			attr2ctext(&str, "cache_policy", "static", level + 1);
+			break;
+		default:
+			break;
+		}
+
 		// ENTRY list
 		entrys_iter = kentry_entrys_iter(kentry);
 		if (entrys_iter) {
@@ -9,6 +9,7 @@
 #include <faux/error.h>
 #include <klish/ksym.h>
 #include <klish/kplugin.h>
+#include <klish/kstrpool.h>
 
 
 typedef struct kaction_s kaction_t;
@@ -37,6 +38,8 @@ C_DECL_BEGIN
 
 kaction_t *kaction_new(void);
 void kaction_free(kaction_t *action);
+bool_t kaction_intern(kaction_t *action, kstrpool_t *pool);
+size_t kaction_footprint(const kaction_t *action);
 
 const char *kaction_sym_ref(const kaction_t *action);
 bool_t kaction_set_sym_ref(kaction_t *action, const char *sym_ref);
@@ -0,0 +1,59 @@
+/** @file kaudit.h
+ *
+ * @brief Klish audit log
+ *
+ * The audit log stores structured records about executed commands within
+ * ring buffer. The records are written to target (syslog, file or UNIX
+ * socket) by batches. So command execution doesn't wait for log writing.
+ */
+
+#ifndef _klish_kaudit_h
+#define _klish_kaudit_h
+
+#include <sys/types.h>
+#include <faux/faux.h>
+
+
+typedef struct kaudit_s kaudit_t;
+
+typedef enum {
+	KAUDIT_TARGET_NONE,
+	KAUDIT_TARGET_SYSLOG,
+	KAUDIT_TARGET_FILE, // Append records to file
+	KAUDIT_TARGET_UNIX, // Send records to UNIX datagram socket
+} kaudit_target_e;
+
+// What to do when ring buffer is full
+typedef enum {
+	KAUDIT_POLICY_NONE,
+	KAUDIT_POLICY_BLOCK, // Flush buffer synchronously
+	KAUDIT_POLICY_DROP_NEW, // Drop new record
+	KAUDIT_POLICY_DROP_OLD, // Overwrite the oldest record
+} kaudit_policy_e;
+
+#define KAUDIT_DEFAULT_SIZE 256
+#define KAUDIT_DEFAULT_INTERVAL 1 // Seconds
+
+
+C_DECL_BEGIN
+
+kaudit_t *kaudit_new(const char *target, size_t size, kaudit_policy_e policy);
+void kaudit_free(kaudit_t *audit);
+
+kaudit_policy_e kaudit_policy_from_str(const char *str);
+const char *kaudit_policy_str(kaudit_policy_e policy);
+
+bool_t kaudit_push(kaudit_t *audit, uid_t uid, const char *user,
+	const char *line, const char *full_line, unsigned int stage,
+	int retcode, unsigned long duration_ms);
+size_t kaudit_flush(kaudit_t *audit);
+size_t kaudit_len(const kaudit_t *audit);
+
+// Statistics
+size_t kaudit_records(const kaudit_t *audit);
+size_t kaudit_dropped(const kaudit_t *audit);
+size_t kaudit_flushes(const kaudit_t *audit);
+
+C_DECL_END
+
+#endif // _klish_kaudit_h
@@ -0,0 +1,39 @@
+/** @file kcompl.h
+ *
+ * @brief Klish completion cache
+ *
+ * The cache stores output of COMPL entries with non-zero 'cache' attribute.
+ * The output is stored as sorted array of unique candidate strings. The key
+ * is COMPL entry, candidate entry, values of already parsed arguments,
+ * prefix and limit of completions.
+ */
+
+#ifndef _klish_kcompl_h
+#define _klish_kcompl_h
+
+#include <faux/list.h>
+#include <klish/kentry.h>
+#include <klish/kpargv.h>
+
+
+typedef struct kcompl_s kcompl_t;
+
+C_DECL_BEGIN
+
+kcompl_t *kcompl_new(void);
+void kcompl_free(kcompl_t *compl);
+
+bool_t kcompl_put(kcompl_t *compl, const kentry_t *entry,
+	const kentry_t *candidate, const kpargv_t *pargv, const char *out);
+bool_t kcompl_get(kcompl_t *compl, const kentry_t *entry,
+	const kentry_t *candidate, const kpargv_t *pargv,
+	const char *prefix, faux_list_t *completions);
+size_t kcompl_flush(kcompl_t *compl, const char *name);
+
+// Statistics
+size_t kcompl_hits(const kcompl_t *compl);
+size_t kcompl_misses(const kcompl_t *compl);
+
+C_DECL_END
+
+#endif // _klish_kcompl_h
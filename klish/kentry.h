@@ -9,6 +9,7 @@
 #include <faux/list.h>
 #include <klish/kaction.h>
 #include <klish/khotkey.h>
+#include <klish/kstrpool.h>
 
 typedef struct kentry_s kentry_t;
 
@@ -45,6 +46,14 @@ typedef enum {
 	KENTRY_FILTER_DUAL, // Entry can be filter or non-filter
 } kentry_filter_e;
 
+// Cache policy (for PROMPT)
+typedef enum {
+	KENTRY_CACHE_NONE, // Illegal
+	KENTRY_CACHE_ALWAYS, // Don't cache. Execute every time
+	KENTRY_CACHE_PATH, // Execute when path is changed
+	KENTRY_CACHE_STATIC, // Execute once
+} kentry_cache_e;
+
 // Number of max occurs
 typedef enum {
 	KENTRY_OCCURS_UNBOUNDED = (size_t)(-1),
@@ -59,7 +68,9 @@ C_DECL_BEGIN
 kentry_t *kentry_new(const char *name);
 void kentry_free(kentry_t *entry);
 
-bool_t kentry_link(kentry_t *dst, const kentry_t *src);
+bool_t kentry_link(kentry_t *dst, kentry_t *src);
+bool_t kentry_intern(kentry_t *entry, kstrpool_t *pool);
+size_t kentry_footprint(const kentry_t *entry, size_t *lists_num);
 
 // Name
 const char *kentry_name(const kentry_t *entry);
@@ -102,6 +113,15 @@ bool_t kentry_set_order(kentry_t *entry, bool_t order);
 // Filter
 kentry_filter_e kentry_filter(const kentry_t *entry);
 bool_t kentry_set_filter(kentry_t *entry, kentry_filter_e filter);
+// Cache (TTL of cached completions in seconds)
+size_t kentry_cache(const kentry_t *entry);
+bool_t kentry_set_cache(kentry_t *entry, size_t cache);
+// Cache policy
+kentry_cache_e kentry_cache_policy(const kentry_t *entry);
+bool_t kentry_set_cache_policy(kentry_t *entry, kentry_cache_e cache_policy);
+// Prepared
+bool_t kentry_prepared(const kentry_t *entry);
+bool_t kentry_set_prepared(kentry_t *entry, bool_t prepared);
 // User data
 void *kentry_udata(const kentry_t *entry);
 bool_t kentry_set_udata(kentry_t *entry, void *data, kentry_udata_free_fn udata_free_fn);
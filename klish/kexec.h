@@ -45,6 +45,9 @@ bool_t kexec_set_buferr(kexec_t *exec, faux_buf_t *buferr);
 // Return code
 bool_t kexec_done(const kexec_t *exec);
 bool_t kexec_retcode(const kexec_t *exec, int *status);
+bool_t kexec_kill(const kexec_t *exec, int sig);
+unsigned long kexec_duration_ms(const kexec_t *exec);
+unsigned long long kexec_duration_us(const kexec_t *exec);
 // Saved path
 kpath_t *kexec_saved_path(const kexec_t *exec);
 // Line
@@ -78,6 +78,9 @@
 #define KSET_BOOL(obj, name) \
 	KSET(obj, bool_t, name)
 
+// Note: The nested lists can be allocated on demand so functions to access
+// nested objects must consider NULL list as an empty list.
+
 // Function to add object to list
 #define _KADD_NESTED(obj, type, nested) \
 	bool_t k##obj##_add_##nested(k##obj##_t *inst, type subobj)
@@ -104,6 +107,8 @@
 	assert(str_key); \
 	if (!str_key) \
 		return NULL; \
+	if (!inst->nested##s) \
+		return NULL; \
 	return (k##nested##_t *)faux_list_kfind(inst->nested##s, str_key); \
 }
 
@@ -133,6 +138,8 @@
 	assert(inst); \
 	if (!inst) \
 		return -1; \
+	if (!inst->nested) \
+		return 0; \
 	return faux_list_len(inst->nested); \
 }
 
@@ -143,6 +150,8 @@
 	assert(inst); \
 	if (!inst) \
 		return -1; \
+	if (!inst->nested) \
+		return BOOL_TRUE; \
 	return faux_list_is_empty(inst->nested); \
 }
 
@@ -153,6 +162,8 @@
 	assert(inst); \
 	if (!inst) \
 		return NULL; \
+	if (!inst->nested) \
+		return NULL; \
 	return (k##obj##_##nested##_node_t *)faux_list_head(inst->nested); \
 }
 
@@ -163,6 +174,8 @@
 	assert(inst); \
 	if (!inst) \
 		return NULL; \
+	if (!inst->nested) \
+		return NULL; \
 	return (k##obj##_##nested##_node_t *)faux_list_tail(inst->nested); \
 }
 
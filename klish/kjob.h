@@ -0,0 +1,39 @@
+/** @file kjob.h
+ *
+ * @brief Klish background job
+ *
+ * The job is a command (kexec_t) that is executed in background. Session
+ * can have several jobs running while user enters another commands. The
+ * output of job is stored within kexec's buffers until user brings job
+ * to foreground.
+ */
+
+#ifndef _klish_kjob_h
+#define _klish_kjob_h
+
+#include <faux/faux.h>
+#include <klish/kexec.h>
+
+typedef struct kjob_s kjob_t;
+
+
+C_DECL_BEGIN
+
+kjob_t *kjob_new(unsigned int id, kexec_t *exec);
+void kjob_free(kjob_t *job);
+
+// ID. The small number that user uses to reference job
+unsigned int kjob_id(const kjob_t *job);
+// Exec. Job owns it
+kexec_t *kjob_exec(const kjob_t *job);
+kexec_t *kjob_release_exec(kjob_t *job);
+// Done. All ACTIONs are completed
+bool_t kjob_done(const kjob_t *job);
+bool_t kjob_set_done(kjob_t *job, bool_t done);
+
+const char *kjob_line(const kjob_t *job);
+size_t kjob_buffered(const kjob_t *job);
+
+C_DECL_END
+
+#endif // _klish_kjob_h
@@ -0,0 +1,62 @@
+/** @file kmetrics.h
+ *
+ * @brief Klish metrics
+ *
+ * The metrics are counters and latency histograms shared by klishd and all
+ * its service processes. It's a shared memory segment created by klishd
+ * before fork(). Service processes update it by atomic operations without
+ * locks. The klishd shows metrics in Prometheus text format. The metrics are
+ * disabled when there is no metrics object so all update functions accept
+ * NULL metrics and do nothing.
+ */
+
+#ifndef _klish_kmetrics_h
+#define _klish_kmetrics_h
+
+#include <stdint.h>
+#include <faux/faux.h>
+
+
+typedef struct kmetrics_s kmetrics_t;
+
+typedef enum {
+	KMETRICS_SESSIONS_TOTAL, // Started service processes
+	KMETRICS_SESSIONS_CLOSED, // Terminated service processes
+	KMETRICS_FORKS_SESSION,
+	KMETRICS_FORKS_ACTION, // Async ACTION
+	KMETRICS_FORKS_GRABBER, // Output grabber of sync ACTION
+	KMETRICS_FORKS_SCRIPT, // Helper process of "script" plugin
+	KMETRICS_PTYPE_VALIDATIONS,
+	KMETRICS_KTP_BYTES_IN,
+	KMETRICS_KTP_BYTES_OUT,
+	KMETRICS_COMMANDS_DROPPED, // Commands table is full
+	KMETRICS_COUNTER_MAX,
+} kmetrics_counter_e;
+
+typedef enum {
+	KMETRICS_HIST_PARSE,
+	KMETRICS_HIST_COMPLETION,
+	KMETRICS_HIST_HELP,
+	KMETRICS_HIST_MAX,
+} kmetrics_hist_e;
+
+#define KMETRICS_DEFAULT_COMMANDS 1024 // Max number of different COMMANDs
+
+
+C_DECL_BEGIN
+
+kmetrics_t *kmetrics_new(size_t commands);
+void kmetrics_free(kmetrics_t *metrics);
+
+uint64_t kmetrics_now(const kmetrics_t *metrics);
+void kmetrics_inc(kmetrics_t *metrics, kmetrics_counter_e counter,
+	uint64_t value);
+void kmetrics_observe(kmetrics_t *metrics, kmetrics_hist_e hist,
+	uint64_t start);
+void kmetrics_command(kmetrics_t *metrics, const char *view,
+	const char *command, uint64_t usec);
+char *kmetrics_text(const kmetrics_t *metrics);
+
+C_DECL_END
+
+#endif // _klish_kmetrics_h
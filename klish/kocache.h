@@ -0,0 +1,54 @@
+/** @file kocache.h
+ *
+ * @brief Klish command output cache
+ *
+ * The cache stores output of COMMANDs with non-zero 'cache' attribute
+ * (TTL in seconds). The cache is shared by all service processes of klishd.
+ * It's a shared memory segment created by klishd before fork(). The key is a
+ * command entry, values of parsed arguments and user ID. The identical
+ * requests of different sessions are coalesced. While one session executes
+ * command the others wait for its output.
+ */
+
+#ifndef _klish_kocache_h
+#define _klish_kocache_h
+
+#include <sys/types.h>
+#include <faux/faux.h>
+#include <klish/kentry.h>
+#include <klish/kpargv.h>
+
+
+typedef struct kocache_s kocache_t;
+
+typedef enum {
+	KOCACHE_MISS, // Not found. Caller must execute command and store output
+	KOCACHE_HIT, // Output is found
+	KOCACHE_PENDING, // Another process is executing the same command
+} kocache_e;
+
+#define KOCACHE_DEFAULT_SIZE (4 * 1024 * 1024) // Bytes
+#define KOCACHE_SLOT_SIZE (64 * 1024) // Bytes. Max size of key and output
+
+
+C_DECL_BEGIN
+
+kocache_t *kocache_new(size_t size);
+void kocache_free(kocache_t *cache);
+
+char *kocache_key(const kentry_t *entry, const kpargv_t *pargv, uid_t uid);
+kocache_e kocache_get(kocache_t *cache, const char *key,
+	char **out, size_t *out_len, int *retcode);
+bool_t kocache_put(kocache_t *cache, const char *key,
+	const char *out, size_t out_len, int retcode, size_t ttl);
+bool_t kocache_abort(kocache_t *cache, const char *key);
+size_t kocache_max_len(const kocache_t *cache);
+
+// Statistics
+size_t kocache_hits(const kocache_t *cache);
+size_t kocache_misses(const kocache_t *cache);
+size_t kocache_coalesced(const kocache_t *cache);
+
+C_DECL_END
+
+#endif // _klish_kocache_h
@@ -54,6 +54,7 @@ const char *kparg_value(const kparg_t *parg);
 
 kpargv_t *kpargv_new();
 void kpargv_free(kpargv_t *pargv);
+kpargv_t *kpargv_clone(const kpargv_t *pargv);
 
 // Status
 kpargv_status_e kpargv_status(const kpargv_t *pargv);
@@ -75,6 +76,9 @@ bool_t kpargv_set_purpose(kpargv_t *pargv, kpargv_purpose_e purpose);
 // Last argument
 bool_t kpargv_set_last_arg(kpargv_t *pargv, const char *last_arg);
 const char *kpargv_last_arg(const kpargv_t *pargv);
+// Limit of completions
+size_t kpargv_limit(const kpargv_t *pargv);
+bool_t kpargv_set_limit(kpargv_t *pargv, size_t limit);
 // Candidate parg
 bool_t kpargv_set_candidate_parg(kpargv_t *pargv, kparg_t *candidate_parg);
 kparg_t *kpargv_candidate_parg(const kpargv_t *pargv);
@@ -28,12 +28,22 @@ kscheme_t *kscheme_new(void);
 void kscheme_free(kscheme_t *scheme);
 
 bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *error);
+bool_t kscheme_prepare_view(kscheme_t *scheme, kentry_t *entry,
+	faux_error_t *error);
+bool_t kscheme_finalize(kscheme_t *scheme, kcontext_t *context,
+	faux_error_t *error);
 bool_t kscheme_fini(kscheme_t *scheme, kcontext_t *context, faux_error_t *error);
 bool_t kscheme_init_session_plugins(kscheme_t *scheme, kcontext_t *context,
 	faux_error_t *error);
 bool_t kscheme_fini_session_plugins(kscheme_t *scheme, kcontext_t *context,
 	faux_error_t *error);
 
+// Lazy VIEW preparation
+bool_t kscheme_lazy(const kscheme_t *scheme);
+bool_t kscheme_set_lazy(kscheme_t *scheme, bool_t lazy);
+char *kscheme_view_stats(const kscheme_t *scheme);
+char *kscheme_stats(const kscheme_t *scheme);
+
 // PLUGINs
 faux_list_t *kscheme_plugins(const kscheme_t *scheme);
 bool_t kscheme_add_plugins(kscheme_t *scheme, kplugin_t *plugin);
@@ -25,6 +25,7 @@ struct kaction_s {
 	tri_t permanent;
 	tri_t sync;
 	char *script;
+	bool_t interned; // The sym_ref and script are owned by string pool
 	void *udata;
 	kaction_udata_free_fn udata_free_fn;
 };
@@ -68,7 +69,6 @@ KSET(action, tri_t, sync);
 
 // Script
 KGET_STR(action, script);
-KSET_STR(action, script);
 
 // Symbol
 KGET(action, ksym_t *, sym);
@@ -97,6 +97,7 @@ kaction_t *kaction_new(void)
 	action->exec_on = KACTION_COND_SUCCESS;
 	action->update_retcode = BOOL_TRUE;
 	action->script = NULL;
+	action->interned = BOOL_FALSE;
 	action->sym = NULL;
 	action->plugin = NULL;
 	action->udata = NULL;
@@ -111,9 +112,11 @@ void kaction_free(kaction_t *action)
 	if (!action)
 		return;
 
-	faux_str_free(action->sym_ref);
+	if (!action->interned) {
+		faux_str_free(action->sym_ref);
+		faux_str_free(action->script);
+	}
 	faux_str_free(action->lock);
-	faux_str_free(action->script);
 	if (action->udata && action->udata_free_fn)
 		action->udata_free_fn(action->udata);
 
@@ -121,6 +124,82 @@ void kaction_free(kaction_t *action)
 }
 
 
+bool_t kaction_set_script(kaction_t *action, const char *script)
+{
+	assert(action);
+	if (!action)
+		return BOOL_FALSE;
+	// Interned strings are shared so they can't be changed
+	if (action->interned)
+		return BOOL_FALSE;
+
+	faux_str_free(action->script);
+	action->script = faux_str_dup(script);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Moves ACTION's sym reference and script to string pool.
+ */
+bool_t kaction_intern(kaction_t *action, kstrpool_t *pool)
+{
+	const char *sym_ref = NULL;
+	const char *script = NULL;
+
+	assert(action);
+	if (!action)
+		return BOOL_FALSE;
+	assert(pool);
+	if (!pool)
+		return BOOL_FALSE;
+	if (action->interned)
+		return BOOL_TRUE;
+
+	if (action->sym_ref) {
+		sym_ref = kstrpool_intern(pool, action->sym_ref);
+		if (!sym_ref)
+			return BOOL_FALSE;
+	}
+	if (action->script) {
+		script = kstrpool_intern(pool, action->script);
+		if (!script)
+			return BOOL_FALSE;
+	}
+	faux_str_free(action->sym_ref);
+	faux_str_free(action->script);
+	action->sym_ref = (char *)sym_ref;
+	action->script = (char *)script;
+	action->interned = BOOL_TRUE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets memory used by ACTION itself. Interned strings are not counted.
+ */
+size_t kaction_footprint(const kaction_t *action)
+{
+	size_t size = 0;
+
+	assert(action);
+	if (!action)
+		return 0;
+
+	size = sizeof(*action);
+	if (action->lock)
+		size += strlen(action->lock) + 1;
+	if (!action->interned) {
+		if (action->sym_ref)
+			size += strlen(action->sym_ref) + 1;
+		if (action->script)
+			size += strlen(action->script) + 1;
+	}
+
+	return size;
+}
+
+
 bool_t kaction_meet_exec_conditions(const kaction_t *action, int current_retcode)
 {
 	bool_t r = BOOL_FALSE; // Default is pessimistic
@@ -11,6 +11,7 @@
 #include <klish/kaction.h>
 #include <klish/kentry.h>
 #include <klish/khotkey.h>
+#include <klish/kstrpool.h>
 
 
 // WARNING: Changing this structure don't forget to update kentry_link()
@@ -29,10 +30,17 @@ struct kentry_s {
 	bool_t transparent; // Is higher-level commands available
 	bool_t order; // Is entry ordered
 	kentry_filter_e filter; // Is entry filter. Filter can't have inline actions.
+	size_t cache; // TTL of cached COMMAND or COMPL output (seconds). 0 - no cache
+	kentry_cache_e cache_policy; // Cache policy of PROMPT, HELP or COMPL
+	bool_t prepared; // Is entry already prepared (refs and syms are resolved)
+	bool_t interned; // Strings are owned by scheme's string pool
+	// Lists are allocated on demand. The most of entries has no
+	// nested ENTRYs, ACTIONs or hotkeys.
 	faux_list_t *entrys; // Nested ENTRYs
 	faux_list_t *actions; // Nested ACTIONs
 	faux_list_t *hotkeys; // Hotkeys
-	// Fast links to nested entries with special purposes.
+	// Fast links to nested entries with special purposes. Allocated on
+	// demand too.
 	kentry_t** nested_by_purpose;
 	void *udata;
 	kentry_udata_free_fn udata_free_fn;
@@ -46,7 +54,6 @@ KGET_STR(entry, name);
 
 // Help
 KGET_STR(entry, help);
-KSET_STR(entry, help);
 
 // Parent
 KGET(entry, kentry_t *, parent);
@@ -74,11 +81,9 @@ KSET(entry, size_t, max);
 
 // Ref string (must be resolved later)
 KGET_STR(entry, ref_str);
-KSET_STR(entry, ref_str);
 
 // Value
 KGET_STR(entry, value);
-KSET_STR(entry, value);
 
 // Restore
 KGET_BOOL(entry, restore);
@@ -96,11 +101,22 @@ KSET_BOOL(entry, order);
 KGET(entry, kentry_filter_e, filter);
 KSET(entry, kentry_filter_e, filter);
 
+// Cache
+KGET(entry, size_t, cache);
+KSET(entry, size_t, cache);
+
+// Cache policy
+KGET(entry, kentry_cache_e, cache_policy);
+KSET(entry, kentry_cache_e, cache_policy);
+
+// Prepared
+KGET_BOOL(entry, prepared);
+KSET_BOOL(entry, prepared);
+
 // Nested ENTRYs list
 KGET(entry, faux_list_t *, entrys);
 static KCMP_NESTED(entry, entry, name);
 static KCMP_NESTED_BY_KEY(entry, entry, name);
-KADD_NESTED(entry, kentry_t *, entrys);
 KFIND_NESTED(entry, entry);
 KNESTED_LEN(entry, entrys);
 KNESTED_IS_EMPTY(entry, entrys);
@@ -109,7 +125,6 @@ KNESTED_EACH(entry, kentry_t *, entrys);
 
 // ACTION list
 KGET(entry, faux_list_t *, actions);
-KADD_NESTED(entry, kaction_t *, actions);
 KNESTED_LEN(entry, actions);
 KNESTED_ITER(entry, actions);
 KNESTED_EACH(entry, kaction_t *, actions);
@@ -117,7 +132,6 @@ KNESTED_EACH(entry, kaction_t *, actions);
 // HOTKEY list
 KGET(entry, faux_list_t *, hotkeys);
 KCMP_NESTED(entry, hotkey, key);
-KADD_NESTED(entry, khotkey_t *, hotkeys);
 KNESTED_LEN(entry, hotkeys);
 KNESTED_ITER(entry, hotkeys);
 KNESTED_EACH(entry, khotkey_t *, hotkeys);
@@ -150,29 +164,122 @@ kentry_t *kentry_new(const char *name)
 	entry->transparent = BOOL_TRUE;
 	entry->order = BOOL_FALSE;
 	entry->filter = KENTRY_FILTER_FALSE;
+	entry->cache = 0;
+	entry->cache_policy = KENTRY_CACHE_ALWAYS;
+	entry->prepared = BOOL_FALSE;
+	entry->interned = BOOL_FALSE;
 	entry->udata = NULL;
 	entry->udata_free_fn = NULL;
 
-	// ENTRY list
-	entry->entrys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_UNIQUE,
-		kentry_entry_compare, kentry_entry_kcompare,
-		(void (*)(void *))kentry_free);
-	assert(entry->entrys);
+	// Lists will be created on demand
+	entry->entrys = NULL;
+	entry->actions = NULL;
+	entry->hotkeys = NULL;
+	entry->nested_by_purpose = NULL;
+
+	return entry;
+}
 
-	// ACTION list
-	entry->actions = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
-		NULL, NULL, (void (*)(void *))kaction_free);
-	assert(entry->actions);
 
-	// HOTKEY list
-	entry->hotkeys = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_UNIQUE,
-		kentry_hotkey_compare, NULL, (void (*)(void *))khotkey_free);
-	assert(entry->hotkeys);
+// Interned strings are shared so they can't be changed
+static bool_t kentry_set_str(kentry_t *entry, char **field, const char *val)
+{
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	if (entry->interned)
+		return BOOL_FALSE;
 
-	entry->nested_by_purpose = faux_zmalloc(
-		KENTRY_PURPOSE_MAX * sizeof(*(entry->nested_by_purpose)));
+	faux_str_free(*field);
+	*field = faux_str_dup(val);
 
-	return entry;
+	return BOOL_TRUE;
+}
+
+
+bool_t kentry_set_help(kentry_t *entry, const char *help)
+{
+	return kentry_set_str(entry, &entry->help, help);
+}
+
+
+bool_t kentry_set_ref_str(kentry_t *entry, const char *ref_str)
+{
+	return kentry_set_str(entry, &entry->ref_str, ref_str);
+}
+
+
+bool_t kentry_set_value(kentry_t *entry, const char *value)
+{
+	return kentry_set_str(entry, &entry->value, value);
+}
+
+
+bool_t kentry_add_entrys(kentry_t *entry, kentry_t *nested_entry)
+{
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(nested_entry);
+	if (!nested_entry)
+		return BOOL_FALSE;
+
+	if (!entry->entrys) {
+		entry->entrys = faux_list_new(FAUX_LIST_UNSORTED,
+			FAUX_LIST_UNIQUE,
+			kentry_entry_compare, kentry_entry_kcompare,
+			(void (*)(void *))kentry_free);
+		assert(entry->entrys);
+	}
+	if (!faux_list_add(entry->entrys, nested_entry))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kentry_add_actions(kentry_t *entry, kaction_t *action)
+{
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(action);
+	if (!action)
+		return BOOL_FALSE;
+
+	if (!entry->actions) {
+		entry->actions = faux_list_new(FAUX_LIST_UNSORTED,
+			FAUX_LIST_NONUNIQUE,
+			NULL, NULL, (void (*)(void *))kaction_free);
+		assert(entry->actions);
+	}
+	if (!faux_list_add(entry->actions, action))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+bool_t kentry_add_hotkeys(kentry_t *entry, khotkey_t *hotkey)
+{
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(hotkey);
+	if (!hotkey)
+		return BOOL_FALSE;
+
+	if (!entry->hotkeys) {
+		entry->hotkeys = faux_list_new(FAUX_LIST_UNSORTED,
+			FAUX_LIST_UNIQUE,
+			kentry_hotkey_compare, NULL,
+			(void (*)(void *))khotkey_free);
+		assert(entry->hotkeys);
+	}
+	if (!faux_list_add(entry->hotkeys, hotkey))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
 }
 
 
@@ -181,9 +288,12 @@ static void kentry_free_non_link(kentry_t *entry)
 	if (!entry)
 		return;
 
-	faux_list_free(entry->entrys);
-	faux_list_free(entry->actions);
-	faux_list_free(entry->hotkeys);
+	if (entry->entrys)
+		faux_list_free(entry->entrys);
+	if (entry->actions)
+		faux_list_free(entry->actions);
+	if (entry->hotkeys)
+		faux_list_free(entry->hotkeys);
 	faux_free(entry->nested_by_purpose);
 }
 
@@ -193,10 +303,12 @@ static void kentry_free_common(kentry_t *entry)
 	if (!entry)
 		return;
 
-	faux_str_free(entry->name);
-	faux_str_free(entry->value);
-	faux_str_free(entry->help);
-	faux_str_free(entry->ref_str);
+	if (!entry->interned) {
+		faux_str_free(entry->name);
+		faux_str_free(entry->value);
+		faux_str_free(entry->help);
+		faux_str_free(entry->ref_str);
+	}
 	if (entry->udata && entry->udata_free_fn)
 		entry->udata_free_fn(entry->udata);
 }
@@ -218,7 +330,7 @@ void kentry_free(kentry_t *entry)
 }
 
 
-bool_t kentry_link(kentry_t *dst, const kentry_t *src)
+bool_t kentry_link(kentry_t *dst, kentry_t *src)
 {
 	assert(dst);
 	if (!dst)
@@ -239,8 +351,10 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 
 	// name - orig
 	// help - orig
+	// Interning is applied to the whole scheme at once so interned
+	// strings of src can be shared.
 	if (!dst->help)
-		dst->help = faux_str_dup(src->help);
+		dst->help = dst->interned ? src->help : faux_str_dup(src->help);
 	// parent - orig
 	// container - orig
 	// mode - ref
@@ -251,12 +365,19 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 	// ref_str - orig
 	// value - orig
 	if (!dst->value)
-		dst->value = faux_str_dup(src->value);
+		dst->value = dst->interned ? src->value : faux_str_dup(src->value);
 	// restore - orig
 	// transparent - orig
 	// order - orig
 	// filter - ref
 	dst->filter = src->filter;
+	// cache - orig or ref
+	if (0 == dst->cache)
+		dst->cache = src->cache;
+	// cache_policy - orig or ref
+	if (KENTRY_CACHE_ALWAYS == dst->cache_policy)
+		dst->cache_policy = src->cache_policy;
+	// prepared - orig
 	// entrys - ref
 	dst->entrys = src->entrys;
 	// actions - ref
@@ -264,6 +385,10 @@ bool_t kentry_link(kentry_t *dst, const kentry_t *src)
 	// hotkeys - ref
 	dst->hotkeys = src->hotkeys;
 	// nested_by_purpose - ref
+	// The src can be not prepared yet so allocate array to share it
+	if (!src->nested_by_purpose)
+		src->nested_by_purpose = faux_zmalloc(
+			KENTRY_PURPOSE_MAX * sizeof(*(src->nested_by_purpose)));
 	dst->nested_by_purpose = src->nested_by_purpose;
 	// udata - orig
 	// udata_free_fn - orig
@@ -277,6 +402,8 @@ kentry_t *kentry_nested_by_purpose(const kentry_t *entry, kentry_purpose_e purpo
 	assert(entry);
 	if (!entry)
 		return NULL;
+	if (!entry->nested_by_purpose)
+		return NULL;
 
 	return entry->nested_by_purpose[purpose];
 }
@@ -289,6 +416,15 @@ bool_t kentry_set_nested_by_purpose(kentry_t *entry, kentry_purpose_e purpose,
 	if (!entry)
 		return BOOL_FALSE;
 
+	if (!entry->nested_by_purpose) {
+		if (!nested)
+			return BOOL_TRUE;
+		entry->nested_by_purpose = faux_zmalloc(
+			KENTRY_PURPOSE_MAX * sizeof(*(entry->nested_by_purpose)));
+		assert(entry->nested_by_purpose);
+		if (!entry->nested_by_purpose)
+			return BOOL_FALSE;
+	}
 	entry->nested_by_purpose[purpose] = nested;
 
 	return BOOL_TRUE;
@@ -366,3 +502,87 @@ kaction_io_e kentry_out(const kentry_t *entry)
 
 	return io;
 }
+
+
+/** @brief Moves ENTRY's strings to string pool.
+ *
+ * The own copies of strings are freed and ENTRY uses pooled strings. After
+ * that strings can't be changed.
+ */
+bool_t kentry_intern(kentry_t *entry, kstrpool_t *pool)
+{
+	char **fields[4] = {};
+	size_t i = 0;
+
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+	assert(pool);
+	if (!pool)
+		return BOOL_FALSE;
+	if (entry->interned)
+		return BOOL_TRUE;
+
+	fields[0] = &entry->name;
+	fields[1] = &entry->help;
+	fields[2] = &entry->ref_str;
+	fields[3] = &entry->value;
+	for (i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+		char *str = *fields[i];
+		if (!str)
+			continue;
+		*fields[i] = (char *)kstrpool_intern(pool, str);
+		if (!*fields[i]) { // Can't intern. Restore all
+			*fields[i] = str;
+			while (i-- > 0)
+				*fields[i] = faux_str_dup(*fields[i]);
+			return BOOL_FALSE;
+		}
+		faux_str_free(str);
+	}
+	entry->interned = BOOL_TRUE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets memory used by ENTRY itself.
+ *
+ * Nested ENTRYs and ACTIONs are not counted. Interned strings are not
+ * counted too because they belong to the pool. The lists are counted as
+ * a number of allocated lists.
+ */
+size_t kentry_footprint(const kentry_t *entry, size_t *lists_num)
+{
+	size_t size = 0;
+
+	assert(entry);
+	if (!entry)
+		return 0;
+
+	size = sizeof(*entry);
+	if (!entry->interned) {
+		if (entry->name)
+			size += strlen(entry->name) + 1;
+		if (entry->help)
+			size += strlen(entry->help) + 1;
+		if (entry->ref_str)
+			size += strlen(entry->ref_str) + 1;
+		if (entry->value)
+			size += strlen(entry->value) + 1;
+	}
+	// Links share lists with referenced ENTRY
+	if (!entry->ref_str) {
+		if (entry->nested_by_purpose)
+			size += KENTRY_PURPOSE_MAX *
+				sizeof(*(entry->nested_by_purpose));
+		if (lists_num)
+			*lists_num = (entry->entrys ? 1 : 0) +
+				(entry->actions ? 1 : 0) +
+				(entry->hotkeys ? 1 : 0);
+	} else if (lists_num) {
+		*lists_num = 0;
+	}
+
+	return size;
+}
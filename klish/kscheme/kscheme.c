@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 #include <faux/str.h>
 #include <faux/list.h>
@@ -11,13 +12,31 @@
 #include <klish/kentry.h>
 #include <klish/kscheme.h>
 #include <klish/kcontext.h>
+#include <klish/kpargv.h>
 #include <klish/kustore.h>
+#include <klish/kstrpool.h>
+
+
+// Preparation statistics for top-level ENTRY (usually VIEW)
+typedef struct kscheme_view_stat_s {
+	kentry_t *view;
+	bool_t retcode; // Result of preparation
+	size_t entrys; // Number of prepared nested ENTRYs
+	size_t actions; // Number of ACTIONs with resolved symbols
+	size_t links; // Number of resolved references
+	unsigned long long int usec; // Preparation time (including refs)
+} kscheme_view_stat_t;
 
 
 struct kscheme_s {
 	faux_list_t *plugins;
 	faux_list_t *entrys;
 	kustore_t *ustore;
+	kstrpool_t *strpool; // Interned strings of all scheme objects
+	bool_t lazy; // Prepare VIEWs on first use only
+	faux_list_t *view_stats; // Statistics of prepared top-level ENTRYs
+	kscheme_view_stat_t *cur_stat; // Stat of VIEW is being prepared now
+	size_t finalized_syms; // Number of sym prepare hooks called
 };
 
 // Simple methods
@@ -42,6 +61,10 @@ KNESTED_LEN(scheme, entrys);
 KNESTED_ITER(scheme, entrys);
 KNESTED_EACH(scheme, kentry_t *, entrys);
 
+// Lazy VIEW preparation
+KGET_BOOL(scheme, lazy);
+KSET_BOOL(scheme, lazy);
+
 
 kscheme_t *kscheme_new(void)
 {
@@ -69,6 +92,17 @@ kscheme_t *kscheme_new(void)
 	scheme->ustore = kustore_new();
 	assert(scheme->ustore);
 
+	// String pool
+	scheme->strpool = kstrpool_new();
+	assert(scheme->strpool);
+
+	// Lazy preparation
+	scheme->lazy = BOOL_FALSE;
+	scheme->view_stats = faux_list_new(FAUX_LIST_UNSORTED,
+		FAUX_LIST_NONUNIQUE, NULL, NULL, faux_free);
+	assert(scheme->view_stats);
+	scheme->cur_stat = NULL;
+
 	return scheme;
 }
 
@@ -79,7 +113,10 @@ void kscheme_free(kscheme_t *scheme)
 		return;
 
 	kustore_free(scheme->ustore);
+	faux_list_free(scheme->view_stats);
 	faux_list_free(scheme->entrys);
+	// Entries use pooled strings so free pool after them
+	kstrpool_free(scheme->strpool);
 	// The plugin_free() must be after all other free functions because
 	// plugins contain free callback function for the other components.
 	faux_list_free(scheme->plugins);
@@ -266,10 +303,10 @@ bool_t kscheme_prepare_action_list(kscheme_t *scheme, kentry_t *entry,
 	assert(entry);
 	if (!entry)
 		return BOOL_FALSE;
+	// Entry without ACTIONs has no list at all
 	action_list = kentry_actions(entry);
-	assert(action_list);
 	if (!action_list)
-		return BOOL_FALSE;
+		return BOOL_TRUE;
 	if (faux_list_is_empty(action_list))
 		return BOOL_TRUE;
 
@@ -288,6 +325,8 @@ bool_t kscheme_prepare_action_list(kscheme_t *scheme, kentry_t *entry,
 		}
 		kaction_set_sym(action, sym);
 		kaction_set_plugin(action, plugin);
+		if (scheme->cur_stat)
+			scheme->cur_stat->actions++;
 		// Filter can't contain sync symbols
 		if ((kentry_filter(entry) != KENTRY_FILTER_FALSE) &&
 			kaction_is_sync(action)) {
@@ -360,6 +399,9 @@ bool_t kscheme_prepare_entry(kscheme_t *scheme, kentry_t *entry,
 	if (!entry)
 		return BOOL_FALSE;
 
+	if (scheme->cur_stat)
+		scheme->cur_stat->entrys++;
+
 	// Firstly if ENTRY is link to another ENTRY then make a copy
 	if (kentry_ref_str(entry)) {
 		ref_entry = entry;
@@ -372,10 +414,17 @@ bool_t kscheme_prepare_entry(kscheme_t *scheme, kentry_t *entry,
 				return BOOL_FALSE;
 			}
 		}
+		// Referenced ENTRY can be within VIEW that is not prepared yet
+		// (lazy scheme). Link shares nested lists with referenced
+		// ENTRY so it must be fully functional.
+		if (!kscheme_prepare_view(scheme, ref_entry, error))
+			return BOOL_FALSE;
 		if (!kentry_link(entry, ref_entry)) {
 			faux_error_sprintf(error, "Can't create link to ENTRY \"%s\"", ref);
 			return BOOL_FALSE;
 		}
+		if (scheme->cur_stat)
+			scheme->cur_stat->links++;
 		return BOOL_TRUE;
 	}
 
@@ -419,11 +468,288 @@ bool_t kscheme_prepare_entry(kscheme_t *scheme, kentry_t *entry,
 }
 
 
+// Top-level ENTRY with common purpose is a VIEW. The PTYPEs, LOGs etc.
+// are not VIEWs.
+static bool_t kscheme_entry_is_view(const kentry_t *entry)
+{
+	if (kentry_parent(entry))
+		return BOOL_FALSE;
+	if (kentry_purpose(entry) != KENTRY_PURPOSE_COMMON)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static kscheme_view_stat_t *kscheme_find_view_stat(const kscheme_t *scheme,
+	const kentry_t *view)
+{
+	faux_list_node_t *iter = NULL;
+	kscheme_view_stat_t *stat = NULL;
+
+	iter = faux_list_head(scheme->view_stats);
+	while ((stat = (kscheme_view_stat_t *)faux_list_each(&iter))) {
+		if (stat->view == view)
+			return stat;
+	}
+
+	return NULL;
+}
+
+
+/** @brief Prepares top-level ENTRY (VIEW) containing specified ENTRY.
+ *
+ * The function can be used for any nested ENTRY. It finds the top-level
+ * ENTRY and prepares the whole subtree if it's not prepared yet. For
+ * non-lazy scheme all the VIEWs are prepared by kscheme_prepare() so the
+ * function does nothing. The lazy scheme prepares VIEW on the first request:
+ * navigation to VIEW or reference resolving. Note the forked service process
+ * prepares VIEWs within its own memory so each session pays for the
+ * VIEWs it really uses only.
+ */
+bool_t kscheme_prepare_view(kscheme_t *scheme, kentry_t *entry,
+	faux_error_t *error)
+{
+	kentry_t *view = entry;
+	kscheme_view_stat_t *stat = NULL;
+	kscheme_view_stat_t *saved_stat = NULL;
+	struct timespec start = {};
+	struct timespec stop = {};
+
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+	assert(entry);
+	if (!entry)
+		return BOOL_FALSE;
+
+	while (kentry_parent(view))
+		view = kentry_parent(view);
+
+	// Already prepared (or is being prepared now)
+	if (kentry_prepared(view)) {
+		stat = kscheme_find_view_stat(scheme, view);
+		return stat ? stat->retcode : BOOL_TRUE;
+	}
+
+	// Set flag before real preparation to break reference loops
+	kentry_set_prepared(view, BOOL_TRUE);
+	stat = faux_zmalloc(sizeof(*stat));
+	assert(stat);
+	if (!stat)
+		return BOOL_FALSE;
+	stat->view = view;
+	stat->retcode = BOOL_TRUE;
+	faux_list_add(scheme->view_stats, stat);
+
+	saved_stat = scheme->cur_stat;
+	scheme->cur_stat = stat;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	stat->retcode = kscheme_prepare_entry(scheme, view, error);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	scheme->cur_stat = saved_stat;
+
+	stat->usec = (stop.tv_sec - start.tv_sec) * 1000000ULL +
+		(stop.tv_nsec - start.tv_nsec) / 1000;
+	if (!stat->retcode)
+		faux_error_sprintf(error, "Can't prepare ENTRY \"%s\"",
+			kentry_name(view));
+
+	return stat->retcode;
+}
+
+
+/** @brief Generates text report about top-level ENTRYs preparation.
+ *
+ * One line per prepared top-level ENTRY and summary line. For lazy scheme
+ * it shows which VIEWs were really used.
+ */
+char *kscheme_view_stats(const kscheme_t *scheme)
+{
+	char *str = NULL;
+	faux_list_node_t *iter = NULL;
+	kscheme_view_stat_t *stat = NULL;
+	size_t views_num = 0;
+	size_t views_prepared = 0;
+	kscheme_entrys_node_t *entrys_iter = NULL;
+	kentry_t *entry = NULL;
+
+	assert(scheme);
+	if (!scheme)
+		return NULL;
+
+	iter = faux_list_head(scheme->view_stats);
+	while ((stat = (kscheme_view_stat_t *)faux_list_each(&iter))) {
+		char *tmp = faux_str_sprintf("%s \"%s\": entrys=%zu "
+			"actions=%zu links=%zu time=%lluus%s\n",
+			kscheme_entry_is_view(stat->view) ? "VIEW" : "ENTRY",
+			kentry_name(stat->view), stat->entrys, stat->actions,
+			stat->links, stat->usec, stat->retcode ? "" : " FAILED");
+		faux_str_cat(&str, tmp);
+		faux_str_free(tmp);
+	}
+
+	entrys_iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&entrys_iter))) {
+		if (!kscheme_entry_is_view(entry))
+			continue;
+		views_num++;
+		if (kentry_prepared(entry))
+			views_prepared++;
+	}
+	{
+		char *tmp = faux_str_sprintf("Prepared VIEWs: %zu of %zu (%s)\n",
+			views_prepared, views_num,
+			scheme->lazy ? "lazy" : "eager");
+		faux_str_cat(&str, tmp);
+		faux_str_free(tmp);
+	}
+
+	return str;
+}
+
+
+static bool_t kscheme_intern_entry(kscheme_t *scheme, kentry_t *entry)
+{
+	kentry_entrys_node_t *iter = NULL;
+	kentry_actions_node_t *actions_iter = NULL;
+	kentry_t *nested_entry = NULL;
+	kaction_t *action = NULL;
+	bool_t retcode = BOOL_TRUE;
+
+	if (!kentry_intern(entry, scheme->strpool))
+		retcode = BOOL_FALSE;
+
+	actions_iter = kentry_actions_iter(entry);
+	while ((action = kentry_actions_each(&actions_iter)))
+		if (!kaction_intern(action, scheme->strpool))
+			retcode = BOOL_FALSE;
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested_entry = kentry_entrys_each(&iter)))
+		if (!kscheme_intern_entry(scheme, nested_entry))
+			retcode = BOOL_FALSE;
+
+	return retcode;
+}
+
+
+/** @brief Moves strings of all scheme's ENTRYs and ACTIONs to string pool.
+ *
+ * Big schemes contain many identical strings like help strings, PTYPE
+ * references and symbol names. The scheme keeps single copy of them. The
+ * failure is not fatal. Some objects just stay with its own strings.
+ */
+static bool_t kscheme_intern(kscheme_t *scheme)
+{
+	kscheme_entrys_node_t *iter = NULL;
+	kentry_t *entry = NULL;
+	bool_t retcode = BOOL_TRUE;
+
+	iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&iter)))
+		if (!kscheme_intern_entry(scheme, entry))
+			retcode = BOOL_FALSE;
+
+	return retcode;
+}
+
+
+typedef struct {
+	size_t entrys;
+	size_t links;
+	size_t entrys_bytes;
+	size_t actions;
+	size_t actions_bytes;
+	size_t hotkeys;
+	size_t lists;
+} kscheme_stat_t;
+
+
+static void kscheme_stat_entry(const kentry_t *entry, kscheme_stat_t *stat)
+{
+	kentry_entrys_node_t *iter = NULL;
+	kentry_actions_node_t *actions_iter = NULL;
+	kentry_t *nested_entry = NULL;
+	kaction_t *action = NULL;
+	size_t lists_num = 0;
+
+	stat->entrys++;
+	stat->entrys_bytes += kentry_footprint(entry, &lists_num);
+	stat->lists += lists_num;
+
+	// Link shares nested objects with referenced ENTRY. Don't count
+	// them twice.
+	if (kentry_ref_str(entry)) {
+		stat->links++;
+		return;
+	}
+
+	stat->hotkeys += kentry_hotkeys_len(entry);
+	actions_iter = kentry_actions_iter(entry);
+	while ((action = kentry_actions_each(&actions_iter))) {
+		stat->actions++;
+		stat->actions_bytes += kaction_footprint(action);
+	}
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested_entry = kentry_entrys_each(&iter)))
+		kscheme_stat_entry(nested_entry, stat);
+}
+
+
+/** @brief Generates text report about scheme's memory footprint.
+ *
+ * It shows number of objects, memory used by objects of each kind and the
+ * string pool statistics. The bytes saved by string interning show the
+ * memory used by duplicate strings without interning.
+ */
+char *kscheme_stats(const kscheme_t *scheme)
+{
+	char *str = NULL;
+	kscheme_stat_t stat = {};
+	kscheme_entrys_node_t *iter = NULL;
+	kentry_t *entry = NULL;
+
+	assert(scheme);
+	if (!scheme)
+		return NULL;
+
+	iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&iter)))
+		kscheme_stat_entry(entry, &stat);
+
+	str = faux_str_sprintf(
+		"PLUGINs: %zd\n"
+		"ENTRYs: %zu (links %zu), %zu bytes\n"
+		"ACTIONs: %zu, %zu bytes\n"
+		"HOTKEYs: %zu\n"
+		"Nested lists: %zu\n"
+		"String pool: %zu strings, %zu bytes\n"
+		"Duplicate strings: %zu, %zu bytes saved\n"
+		"Sym prepare hooks: %zu\n",
+		kscheme_plugins_len(scheme),
+		stat.entrys, stat.links, stat.entrys_bytes,
+		stat.actions, stat.actions_bytes,
+		stat.hotkeys,
+		stat.lists,
+		kstrpool_len(scheme->strpool), kstrpool_bytes(scheme->strpool),
+		kstrpool_dups(scheme->strpool),
+		kstrpool_dups_bytes(scheme->strpool),
+		scheme->finalized_syms);
+
+	return str;
+}
+
+
 /** @brief Prepares schema for execution.
  *
  * It loads plugins, link unresolved symbols, then iterates all the
  * objects and link them to each other, check access
  * permissions. Without this function the schema is not fully functional.
+ *
+ * The lazy scheme skips VIEWs here. They will be prepared on the first use
+ * by kscheme_prepare_view().
  */
 bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *error)
 {
@@ -439,10 +765,16 @@ bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *err
 	if (!kscheme_load_plugins(scheme, context, error))
 		return BOOL_FALSE;
 
+	// Intern strings before linking because links share some strings
+	// with referenced ENTRYs.
+	kscheme_intern(scheme);
+
 	// Iterate ENTRYs
 	entrys_iter = kscheme_entrys_iter(scheme);
 	while ((entry = kscheme_entrys_each(&entrys_iter))) {
-		if (!kscheme_prepare_entry(scheme, entry, error))
+		if (scheme->lazy && kscheme_entry_is_view(entry))
+			continue;
+		if (!kscheme_prepare_view(scheme, entry, error))
 			return BOOL_FALSE;
 	}
 
@@ -450,6 +782,183 @@ bool_t kscheme_prepare(kscheme_t *scheme, kcontext_t *context, faux_error_t *err
 }
 
 
+static bool_t kscheme_finalize_actions(kscheme_t *scheme,
+	kcontext_t *context, const kentry_t *entry, faux_error_t *error)
+{
+	kentry_actions_node_t *iter = NULL;
+	kentry_actions_node_t *node = NULL;
+	bool_t retcode = BOOL_TRUE;
+
+	if (!entry)
+		return BOOL_TRUE;
+
+	iter = kentry_actions_iter(entry);
+	while ((node = iter)) {
+		kaction_t *action = kentry_actions_each(&iter);
+		ksym_t *sym = kaction_sym(action);
+		ksym_fn prepare = NULL;
+		int rc = 0;
+
+		if (!sym) // Not prepared
+			continue;
+		prepare = ksym_prepare(sym);
+		if (!prepare)
+			continue;
+		kcontext_set_action_iter(context, node);
+		kcontext_set_sym(context, sym);
+		kcontext_set_plugin(context, kaction_plugin(action));
+		rc = prepare(context);
+		scheme->finalized_syms++;
+		if (rc < 0) {
+			faux_error_sprintf(error,
+				"Can't prepare symbol \"%s\" for ENTRY \"%s\" (%d)",
+				ksym_name(sym), kentry_name(entry), rc);
+			retcode = BOOL_FALSE;
+		}
+	}
+	kcontext_set_action_iter(context, NULL);
+
+	return retcode;
+}
+
+
+static bool_t kscheme_finalize_entry(kscheme_t *scheme, kcontext_t *context,
+	kpargv_t *pargv, kentry_t *entry, faux_error_t *error)
+{
+	kentry_entrys_node_t *iter = NULL;
+	kentry_t *nested_entry = NULL;
+	bool_t retcode = BOOL_TRUE;
+
+	// The service ENTRYs (PTYPE, COMPLETION, HELP) are executed with
+	// common ENTRY as a candidate. So process them from the common ENTRY
+	// point of view.
+	if (kentry_purpose(entry) == KENTRY_PURPOSE_COMMON) {
+		kparg_t *parg = kparg_new(entry, NULL);
+		kentry_t *ptype = kentry_nested_by_purpose(entry,
+			KENTRY_PURPOSE_PTYPE);
+
+		kpargv_set_candidate_parg(pargv, parg);
+		if (!kscheme_finalize_actions(scheme, context, entry, error))
+			retcode = BOOL_FALSE;
+		if (!kscheme_finalize_actions(scheme, context,
+			kentry_nested_by_purpose(entry,
+			KENTRY_PURPOSE_COMPLETION), error))
+			retcode = BOOL_FALSE;
+		if (!kscheme_finalize_actions(scheme, context,
+			kentry_nested_by_purpose(entry,
+			KENTRY_PURPOSE_HELP), error))
+			retcode = BOOL_FALSE;
+		if (ptype) {
+			if (!kscheme_finalize_actions(scheme, context, ptype,
+				error))
+				retcode = BOOL_FALSE;
+			if (!kscheme_finalize_actions(scheme, context,
+				kentry_nested_by_purpose(ptype,
+				KENTRY_PURPOSE_COMPLETION), error))
+				retcode = BOOL_FALSE;
+			if (!kscheme_finalize_actions(scheme, context,
+				kentry_nested_by_purpose(ptype,
+				KENTRY_PURPOSE_HELP), error))
+				retcode = BOOL_FALSE;
+		}
+		kpargv_set_candidate_parg(pargv, NULL);
+		kparg_free(parg);
+
+	// Top-level service ENTRYs (PTYPE, COMPLETION, HELP) can be referenced
+	// by VIEWs of lazy scheme only. Then they are not reachable from
+	// prepared ENTRYs. So process them from their own point of view. The
+	// syms that keep udata within ACTION don't depend on candidate. The
+	// ENTRYs reachable by links will be processed again but the hooks
+	// don't rebuild existent udata.
+	} else if (!kentry_parent(entry) &&
+		((kentry_purpose(entry) == KENTRY_PURPOSE_PTYPE) ||
+		(kentry_purpose(entry) == KENTRY_PURPOSE_COMPLETION) ||
+		(kentry_purpose(entry) == KENTRY_PURPOSE_HELP))) {
+		kparg_t *parg = kparg_new(entry, NULL);
+
+		kpargv_set_candidate_parg(pargv, parg);
+		if (!kscheme_finalize_actions(scheme, context, entry, error))
+			retcode = BOOL_FALSE;
+		if (!kscheme_finalize_actions(scheme, context,
+			kentry_nested_by_purpose(entry,
+			KENTRY_PURPOSE_COMPLETION), error))
+			retcode = BOOL_FALSE;
+		if (!kscheme_finalize_actions(scheme, context,
+			kentry_nested_by_purpose(entry,
+			KENTRY_PURPOSE_HELP), error))
+			retcode = BOOL_FALSE;
+		kpargv_set_candidate_parg(pargv, NULL);
+		kparg_free(parg);
+	}
+
+	// Link shares nested ENTRYs with referenced ENTRY
+	if (kentry_ref_str(entry))
+		return retcode;
+
+	iter = kentry_entrys_iter(entry);
+	while ((nested_entry = kentry_entrys_each(&iter)))
+		if (!kscheme_finalize_entry(scheme, context, pargv,
+			nested_entry, error))
+			retcode = BOOL_FALSE;
+
+	return retcode;
+}
+
+
+/** @brief Finalizes prepared scheme.
+ *
+ * Must be called after kscheme_prepare(). It calls optional prepare hooks of
+ * syms (see ksym_set_prepare()) for all prepared ENTRYs. So the syms can build
+ * their udata within klishd process. Else the udata is built on first use by
+ * each forked service process separately. It costs time and breaks
+ * copy-on-write sharing of memory pages. The top-level PTYPEs, COMPLETIONs
+ * and HELPs are processed too, so the ACTIONs of shared PTYPEs get udata
+ * even if they are referenced by lazy VIEWs only.
+ *
+ * VIEWs of lazy scheme are not prepared yet so they are skipped. The
+ * syms of ACTIONs within such VIEWs (COMMAND matching data, precompiled
+ * Lua chunks, regex DFAs) build udata on first use within service process.
+ * It's the cost of lazy loading.
+ *
+ * The errors are not fatal for scheme. The sym will try to build udata
+ * on first use again.
+ */
+bool_t kscheme_finalize(kscheme_t *scheme, kcontext_t *context,
+	faux_error_t *error)
+{
+	kscheme_entrys_node_t *iter = NULL;
+	kentry_t *entry = NULL;
+	kpargv_t *pargv = NULL;
+	bool_t retcode = BOOL_TRUE;
+
+	assert(scheme);
+	if (!scheme)
+		return BOOL_FALSE;
+	if (!context)
+		return BOOL_FALSE;
+
+	pargv = kpargv_new();
+	assert(pargv);
+	kcontext_set_type(context, KCONTEXT_TYPE_SERVICE_ACTION);
+	kcontext_set_scheme(context, scheme);
+	kcontext_set_parent_pargv(context, pargv);
+
+	iter = kscheme_entrys_iter(scheme);
+	while ((entry = kscheme_entrys_each(&iter))) {
+		if (!kentry_prepared(entry))
+			continue;
+		if (!kscheme_finalize_entry(scheme, context, pargv,
+			entry, error))
+			retcode = BOOL_FALSE;
+	}
+
+	kcontext_set_parent_pargv(context, NULL);
+	kpargv_free(pargv);
+
+	return retcode;
+}
+
+
 bool_t kscheme_named_udata_new(kscheme_t *scheme,
 	const char *name, void *data, kudata_data_free_fn free_fn)
 {
@@ -0,0 +1,171 @@
+/** @file kstrpool.c
+ *
+ * Simple hash table with chains. The string itself is stored within the
+ * chain node so single malloc() is needed for each unique string.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kstrpool.h>
+
+#define KSTRPOOL_INITIAL_SIZE 256
+
+typedef struct kstrpool_node_s kstrpool_node_t;
+
+struct kstrpool_node_s {
+	kstrpool_node_t *next;
+	unsigned int hash;
+	char str[];
+};
+
+struct kstrpool_s {
+	kstrpool_node_t **buckets;
+	size_t size; // Number of buckets
+	size_t len; // Number of unique strings
+	size_t bytes; // Bytes used by unique strings
+	size_t dups; // Number of interned duplicates
+	size_t dups_bytes; // Bytes saved by duplicates interning
+};
+
+
+// Simple methods
+KGET(strpool, size_t, len);
+KGET(strpool, size_t, bytes);
+KGET(strpool, size_t, dups);
+KGET(strpool, size_t, dups_bytes);
+
+
+// FNV-1a
+static unsigned int kstrpool_hash(const char *str)
+{
+	unsigned int hash = 2166136261u;
+	const unsigned char *p = (const unsigned char *)str;
+
+	while (*p) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+kstrpool_t *kstrpool_new(void)
+{
+	kstrpool_t *pool = NULL;
+
+	pool = faux_zmalloc(sizeof(*pool));
+	assert(pool);
+	if (!pool)
+		return NULL;
+
+	pool->size = KSTRPOOL_INITIAL_SIZE;
+	pool->buckets = faux_zmalloc(pool->size * sizeof(*pool->buckets));
+	assert(pool->buckets);
+	if (!pool->buckets) {
+		faux_free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+
+void kstrpool_free(kstrpool_t *pool)
+{
+	size_t i = 0;
+
+	if (!pool)
+		return;
+
+	for (i = 0; i < pool->size; i++) {
+		kstrpool_node_t *node = pool->buckets[i];
+		while (node) {
+			kstrpool_node_t *next = node->next;
+			faux_free(node);
+			node = next;
+		}
+	}
+	faux_free(pool->buckets);
+	faux_free(pool);
+}
+
+
+static void kstrpool_grow(kstrpool_t *pool)
+{
+	kstrpool_node_t **buckets = NULL;
+	size_t size = pool->size * 2;
+	size_t i = 0;
+
+	buckets = faux_zmalloc(size * sizeof(*buckets));
+	if (!buckets)
+		return; // Not fatal. Chains will be longer.
+
+	for (i = 0; i < pool->size; i++) {
+		kstrpool_node_t *node = pool->buckets[i];
+		while (node) {
+			kstrpool_node_t *next = node->next;
+			size_t idx = node->hash & (size - 1);
+			node->next = buckets[idx];
+			buckets[idx] = node;
+			node = next;
+		}
+	}
+	faux_free(pool->buckets);
+	pool->buckets = buckets;
+	pool->size = size;
+}
+
+
+/** @brief Gets interned copy of string.
+ *
+ * @param [in] pool String pool.
+ * @param [in] str String to intern.
+ * @return Pointer to string stored within pool or NULL on error.
+ */
+const char *kstrpool_intern(kstrpool_t *pool, const char *str)
+{
+	unsigned int hash = 0;
+	size_t idx = 0;
+	size_t len = 0;
+	kstrpool_node_t *node = NULL;
+
+	assert(pool);
+	if (!pool)
+		return NULL;
+	if (!str)
+		return NULL;
+
+	len = strlen(str);
+	hash = kstrpool_hash(str);
+	idx = hash & (pool->size - 1);
+	for (node = pool->buckets[idx]; node; node = node->next) {
+		if ((node->hash == hash) && (strcmp(node->str, str) == 0)) {
+			pool->dups++;
+			pool->dups_bytes += len + 1;
+			return node->str;
+		}
+	}
+
+	node = faux_malloc(sizeof(*node) + len + 1);
+	assert(node);
+	if (!node)
+		return NULL;
+	node->hash = hash;
+	memcpy(node->str, str, len + 1);
+	node->next = pool->buckets[idx];
+	pool->buckets[idx] = node;
+	pool->len++;
+	pool->bytes += len + 1;
+
+	if (pool->len > (pool->size * 2))
+		kstrpool_grow(pool);
+
+	return node->str;
+}
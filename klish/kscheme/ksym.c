@@ -17,6 +17,7 @@ struct ksym_s {
 	tri_t permanent; // Dry-run option has no effect for permanent sym
 	tri_t sync; // Don't fork before sync sym execution
 	bool_t silent; // Silent syn doesn't have stdin, stdout, stderr
+	ksym_fn prepare; // Optional hook to build udata while scheme finalizing
 };
 
 
@@ -42,6 +43,10 @@ KSET(sym, tri_t, sync);
 KGET(sym, bool_t, silent);
 KSET(sym, bool_t, silent);
 
+// Prepare hook
+KGET(sym, ksym_fn, prepare);
+KSET(sym, ksym_fn, prepare);
+
 
 ksym_t *ksym_new_ext(const char *name, ksym_fn function,
 	tri_t permanent, tri_t sync, bool_t silent)
@@ -62,6 +67,7 @@ ksym_t *ksym_new_ext(const char *name, ksym_fn function,
 	sym->permanent = permanent;
 	sym->sync = sync;
 	sym->silent = silent;
+	sym->prepare = NULL;
 
 	return sym;
 }
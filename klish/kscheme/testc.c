@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <faux/str.h>
+#include <faux/error.h>
+#include <klish/kscheme.h>
+#include <klish/kentry.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+#include <klish/kcontext.h>
+
+
+static unsigned int testc_kscheme_prepared = 0;
+
+
+static int testc_kscheme_sym(kcontext_t *context)
+{
+	context = context; // Happy compiler
+
+	return 0;
+}
+
+
+static int testc_kscheme_prepare(kcontext_t *context)
+{
+	if (!kcontext_action(context))
+		return -1;
+	if (!kcontext_candidate_entry(context))
+		return -1;
+	testc_kscheme_prepared++;
+
+	return 0;
+}
+
+
+static kentry_t *testc_kscheme_entry(const char *name,
+	kentry_purpose_e purpose, ksym_t *sym)
+{
+	kentry_t *entry = kentry_new(name);
+	kaction_t *action = kaction_new();
+
+	kentry_set_purpose(entry, purpose);
+	kaction_set_sym(action, sym);
+	kentry_add_actions(entry, action);
+
+	return entry;
+}
+
+
+// Top-level PTYPE is finalized even if it's referenced by lazy VIEWs only.
+// Lazy VIEW is not prepared so it's skipped. Its syms build udata on first
+// use within service process.
+int testc_kscheme_finalize(void)
+{
+	int ret = -1;
+	kscheme_t *scheme = kscheme_new();
+	ksym_t *sym = ksym_new("sym", testc_kscheme_sym);
+	kcontext_t *context = kcontext_new(KCONTEXT_TYPE_NONE);
+	faux_error_t *error = faux_error_new();
+	kentry_t *ptype = NULL;
+	kentry_t *view = NULL;
+
+	ksym_set_prepare(sym, testc_kscheme_prepare);
+
+	ptype = testc_kscheme_entry("PTYPE", KENTRY_PURPOSE_PTYPE, sym);
+	kentry_set_prepared(ptype, BOOL_TRUE);
+	kscheme_add_entrys(scheme, ptype);
+
+	view = kentry_new("view");
+	kentry_add_entrys(view,
+		testc_kscheme_entry("cmd", KENTRY_PURPOSE_COMMON, sym));
+	kscheme_add_entrys(scheme, view);
+
+	testc_kscheme_prepared = 0;
+	if (!kscheme_finalize(scheme, context, error)) {
+		printf("Can't finalize scheme\n");
+		faux_error_show(error);
+		goto err;
+	}
+	if (testc_kscheme_prepared != 1) {
+		printf("Top-level PTYPE: %u prepare hook calls, expected 1\n",
+			testc_kscheme_prepared);
+		goto err;
+	}
+
+	// Now VIEW is prepared (loaded)
+	kentry_set_prepared(view, BOOL_TRUE);
+	testc_kscheme_prepared = 0;
+	if (!kscheme_finalize(scheme, context, error)) {
+		printf("Can't finalize scheme with prepared VIEW\n");
+		faux_error_show(error);
+		goto err;
+	}
+	if (testc_kscheme_prepared != 2) {
+		printf("Prepared VIEW: %u prepare hook calls, expected 2\n",
+			testc_kscheme_prepared);
+		goto err;
+	}
+
+	ret = 0;
+err:
+	faux_error_free(error);
+	kcontext_free(context);
+	kscheme_free(scheme);
+	ksym_free(sym);
+
+	return ret;
+}
@@ -8,9 +8,18 @@
 
 #include <klish/kscheme.h>
 #include <klish/kpath.h>
+#include <klish/kcompl.h>
+#include <faux/list.h>
+#include <klish/kaudit.h>
+#include <klish/ktrace.h>
+#include <klish/kmetrics.h>
+#include <klish/kslow.h>
 
 
 typedef struct ksession_s ksession_t;
+typedef struct kjob_s kjob_t; // To use with session structure
+
+typedef faux_list_node_t ksession_jobs_node_t;
 
 
 C_DECL_BEGIN
@@ -20,11 +29,24 @@ void ksession_free(ksession_t *session);
 
 kscheme_t *ksession_scheme(const ksession_t *session);
 kpath_t *ksession_path(const ksession_t *session);
+kcompl_t *ksession_compl(const ksession_t *session);
+kaudit_t *ksession_audit(const ksession_t *session);
+bool_t ksession_set_audit(ksession_t *session, kaudit_t *audit);
+ktrace_t *ksession_trace(const ksession_t *session);
+bool_t ksession_set_trace(ksession_t *session, ktrace_t *trace);
+kmetrics_t *ksession_metrics(const ksession_t *session);
+bool_t ksession_set_metrics(ksession_t *session, kmetrics_t *metrics);
+kslow_t *ksession_slow(const ksession_t *session);
+bool_t ksession_set_slow(ksession_t *session, kslow_t *slow);
 
 // Done
 bool_t ksession_done(const ksession_t *session);
 bool_t ksession_set_done(ksession_t *session, bool_t done);
 
+// Prompt expiration flag
+bool_t ksession_prompt_expired(const ksession_t *session);
+bool_t ksession_set_prompt_expired(ksession_t *session, bool_t prompt_expired);
+
 // Width of pseudo terminal
 size_t ksession_term_width(const ksession_t *session);
 bool_t ksession_set_term_width(ksession_t *session, size_t term_width);
@@ -49,6 +71,18 @@ bool_t ksession_set_uid(ksession_t *session, uid_t uid);
 const char *ksession_user(const ksession_t *session);
 bool_t ksession_set_user(ksession_t *session, const char *user);
 
+// Background jobs
+bool_t ksession_add_jobs(ksession_t *session, kjob_t *job);
+ssize_t ksession_jobs_len(const ksession_t *session);
+ksession_jobs_node_t *ksession_jobs_iter(const ksession_t *session);
+kjob_t *ksession_jobs_each(ksession_jobs_node_t **iter);
+kjob_t *ksession_find_job(const ksession_t *session, unsigned int id);
+bool_t ksession_del_job(ksession_t *session, kjob_t *job);
+unsigned int ksession_free_job_id(const ksession_t *session);
+// Job to bring to foreground after current command. 0 - no request
+unsigned int ksession_fg_job(const ksession_t *session);
+bool_t ksession_set_fg_job(ksession_t *session, unsigned int fg_job);
+
 // Client isatty
 bool_t ksession_isatty_stdin(const ksession_t *session);
 bool_t ksession_set_isatty_stdin(ksession_t *session, bool_t isatty_stdin);
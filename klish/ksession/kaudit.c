@@ -0,0 +1,432 @@
+/** @file kaudit.c
+ *
+ * Audit log. The records are stored within ring buffer of fixed size. The
+ * session process is single-threaded (event loop) so ring buffer doesn't
+ * need any locks. The buffer is flushed periodically by event loop's
+ * scheduled event or synchronously when buffer is full and policy is
+ * "block".
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kaudit.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+
+typedef struct kaudit_rec_s {
+	time_t time; // Wall clock time of record creation
+	uid_t uid;
+	char *user;
+	char *line; // Command line of pipeline stage
+	char *full_line; // Full pipeline line. NULL if single command
+	unsigned int stage;
+	int retcode;
+	unsigned long duration_ms;
+} kaudit_rec_t;
+
+
+struct kaudit_s {
+	kaudit_target_e target;
+	char *path; // For file and UNIX socket targets
+	int fd;
+	kaudit_policy_e policy;
+	kaudit_rec_t *ring;
+	size_t size; // Capacity of ring buffer
+	size_t head; // Index of the oldest record
+	size_t len; // Number of records within ring buffer
+	size_t records; // Number of written records
+	size_t dropped; // Number of dropped records
+	size_t flushes; // Number of flushes
+};
+
+
+// Statistics
+KGET(audit, size_t, len);
+KGET(audit, size_t, records);
+KGET(audit, size_t, dropped);
+KGET(audit, size_t, flushes);
+
+
+// Connects socket to receiver. Receiver can be started or restarted later
+// so it's not fatal.
+static bool_t kaudit_connect(kaudit_t *audit)
+{
+	struct sockaddr_un addr = {};
+
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, audit->path, sizeof(addr.sun_path) - 1);
+	if (connect(audit->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static void kaudit_rec_clean(kaudit_rec_t *rec)
+{
+	faux_str_free(rec->user);
+	faux_str_free(rec->line);
+	faux_str_free(rec->full_line);
+	memset(rec, 0, sizeof(*rec));
+}
+
+
+/** @brief Creates audit log.
+ *
+ * @param [in] target Target string: "syslog", "file:<path>" or
+ * "unix:<path>".
+ * @param [in] size Capacity of ring buffer (records). 0 - default.
+ * @param [in] policy What to do when buffer is full.
+ * @return Allocated audit log or NULL on error.
+ */
+kaudit_t *kaudit_new(const char *target, size_t size, kaudit_policy_e policy)
+{
+	kaudit_t *audit = NULL;
+
+	if (faux_str_is_empty(target))
+		return NULL;
+
+	audit = faux_zmalloc(sizeof(*audit));
+	assert(audit);
+	if (!audit)
+		return NULL;
+
+	audit->fd = -1;
+	audit->policy = (KAUDIT_POLICY_NONE == policy) ?
+		KAUDIT_POLICY_BLOCK : policy;
+	audit->size = (0 == size) ? KAUDIT_DEFAULT_SIZE : size;
+
+	if (faux_str_casecmp(target, "syslog") == 0) {
+		audit->target = KAUDIT_TARGET_SYSLOG;
+	} else if (faux_str_casecmpn(target, "file:", 5) == 0) {
+		audit->target = KAUDIT_TARGET_FILE;
+		audit->path = faux_str_dup(target + 5);
+	} else if (faux_str_casecmpn(target, "unix:", 5) == 0) {
+		audit->target = KAUDIT_TARGET_UNIX;
+		audit->path = faux_str_dup(target + 5);
+	} else {
+		faux_free(audit);
+		return NULL;
+	}
+
+	if ((audit->target != KAUDIT_TARGET_SYSLOG) &&
+		faux_str_is_empty(audit->path)) {
+		kaudit_free(audit);
+		return NULL;
+	}
+
+	if (KAUDIT_TARGET_FILE == audit->target) {
+		audit->fd = open(audit->path,
+			O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0640);
+	} else if (KAUDIT_TARGET_UNIX == audit->target) {
+		audit->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+		if (audit->fd >= 0)
+			kaudit_connect(audit);
+	}
+	if ((audit->target != KAUDIT_TARGET_SYSLOG) && (audit->fd < 0)) {
+		syslog(LOG_ERR, "Can't open audit target %s: %s",
+			audit->path, strerror(errno));
+		kaudit_free(audit);
+		return NULL;
+	}
+
+	audit->ring = faux_zmalloc(audit->size * sizeof(*audit->ring));
+	assert(audit->ring);
+	if (!audit->ring) {
+		kaudit_free(audit);
+		return NULL;
+	}
+
+	return audit;
+}
+
+
+void kaudit_free(kaudit_t *audit)
+{
+	size_t i = 0;
+
+	if (!audit)
+		return;
+
+	if (audit->ring) {
+		for (i = 0; i < audit->size; i++)
+			kaudit_rec_clean(&audit->ring[i]);
+		faux_free(audit->ring);
+	}
+	if (audit->fd >= 0)
+		close(audit->fd);
+	faux_str_free(audit->path);
+	faux_free(audit);
+}
+
+
+kaudit_policy_e kaudit_policy_from_str(const char *str)
+{
+	if (faux_str_is_empty(str))
+		return KAUDIT_POLICY_NONE;
+
+	if (faux_str_casecmp(str, "block") == 0)
+		return KAUDIT_POLICY_BLOCK;
+	if (faux_str_casecmp(str, "drop-new") == 0)
+		return KAUDIT_POLICY_DROP_NEW;
+	if (faux_str_casecmp(str, "drop-old") == 0)
+		return KAUDIT_POLICY_DROP_OLD;
+
+	return KAUDIT_POLICY_NONE;
+}
+
+
+const char *kaudit_policy_str(kaudit_policy_e policy)
+{
+	switch (policy) {
+	case KAUDIT_POLICY_BLOCK:
+		return "block";
+	case KAUDIT_POLICY_DROP_NEW:
+		return "drop-new";
+	case KAUDIT_POLICY_DROP_OLD:
+		return "drop-old";
+	default:
+		break;
+	}
+
+	return "none";
+}
+
+
+/** @brief Pushes record to audit log.
+ *
+ * The strings are copied. The record will be written by next flush.
+ *
+ * @param [in] audit Audit log.
+ * @param [in] uid Client's UID.
+ * @param [in] user Client's user name.
+ * @param [in] line Command line (pipeline stage).
+ * @param [in] full_line Full line of pipeline. NULL for single command.
+ * @param [in] stage Pipeline stage number.
+ * @param [in] retcode Command's retcode.
+ * @param [in] duration_ms Command's execution time.
+ * @return BOOL_TRUE - record is stored, BOOL_FALSE - record is dropped.
+ */
+bool_t kaudit_push(kaudit_t *audit, uid_t uid, const char *user,
+	const char *line, const char *full_line, unsigned int stage,
+	int retcode, unsigned long duration_ms)
+{
+	kaudit_rec_t *rec = NULL;
+
+	assert(audit);
+	if (!audit)
+		return BOOL_FALSE;
+
+	if (audit->len == audit->size) {
+		if (KAUDIT_POLICY_DROP_NEW == audit->policy) {
+			audit->dropped++;
+			return BOOL_FALSE;
+		} else if (KAUDIT_POLICY_DROP_OLD == audit->policy) {
+			kaudit_rec_clean(&audit->ring[audit->head]);
+			audit->head = (audit->head + 1) % audit->size;
+			audit->len--;
+			audit->dropped++;
+		} else {
+			kaudit_flush(audit);
+		}
+	}
+
+	rec = &audit->ring[(audit->head + audit->len) % audit->size];
+	rec->time = time(NULL);
+	rec->uid = uid;
+	rec->user = faux_str_dup(user);
+	rec->line = faux_str_dup(line);
+	rec->full_line = faux_str_dup(full_line);
+	rec->stage = stage;
+	rec->retcode = retcode;
+	rec->duration_ms = duration_ms;
+	audit->len++;
+
+	return BOOL_TRUE;
+}
+
+
+// Syslog record has the same format as old 'syslog' sym produced
+static char *kaudit_rec_format(const kaudit_t *audit, const kaudit_rec_t *rec)
+{
+	char *str = NULL;
+	char *full_line = NULL;
+
+	if (rec->full_line)
+		full_line = faux_str_sprintf(", (%s)#%u",
+			rec->full_line, rec->stage);
+
+	if (KAUDIT_TARGET_SYSLOG == audit->target) {
+		str = faux_str_sprintf("%u(%s) %s : %d%s",
+			rec->uid, rec->user ? rec->user : "",
+			rec->line ? rec->line : "", rec->retcode,
+			full_line ? full_line : "");
+	} else {
+		char tstr[32] = {};
+		struct tm tm = {};
+		localtime_r(&rec->time, &tm);
+		strftime(tstr, sizeof(tstr), "%Y-%m-%dT%H:%M:%S%z", &tm);
+		str = faux_str_sprintf("%s %u(%s) %s : %d%s : %lums\n",
+			tstr, rec->uid, rec->user ? rec->user : "",
+			rec->line ? rec->line : "", rec->retcode,
+			full_line ? full_line : "", rec->duration_ms);
+	}
+	faux_str_free(full_line);
+
+	return str;
+}
+
+
+// Writes all iovec entries. Handles partial writes so iovec array is
+// modified.
+static bool_t kaudit_writev(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt > 0) {
+		ssize_t r = writev(fd, iov, iovcnt);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return BOOL_FALSE;
+		}
+		while ((iovcnt > 0) && ((size_t)r >= iov->iov_len)) {
+			r -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+// Sends record to UNIX socket. The socket is reconnected if receiver was not
+// started yet or was restarted.
+static bool_t kaudit_send(kaudit_t *audit, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (send(audit->fd, str, len, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0)
+		return BOOL_TRUE;
+	if ((errno != ENOTCONN) && (errno != ECONNREFUSED) &&
+		(errno != EPIPE) && (errno != EDESTADDRREQ))
+		return BOOL_FALSE;
+	if (!kaudit_connect(audit))
+		return BOOL_FALSE;
+	if (send(audit->fd, str, len, MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Writes all buffered records to target.
+ *
+ * File target gets the whole batch by writev() without intermediate copying.
+ * The batch is splitted to IOV_MAX chunks if necessary. UNIX socket target
+ * gets one datagram per record. The socket is non-blocking so records are
+ * dropped if receiver is not ready. The socket is reconnected if receiver
+ * is not connected.
+ *
+ * @param [in] audit Audit log.
+ * @return Number of written records.
+ */
+size_t kaudit_flush(kaudit_t *audit)
+{
+	struct iovec *iov = NULL;
+	char **strs = NULL; // Keep pointers because kaudit_writev() modifies iovec
+	size_t num = 0;
+	size_t written = 0;
+
+	assert(audit);
+	if (!audit)
+		return 0;
+	if (0 == audit->len)
+		return 0;
+
+	// Records are kept within buffer if memory can't be allocated
+	if (KAUDIT_TARGET_FILE == audit->target) {
+		iov = faux_zmalloc(audit->len * sizeof(*iov));
+		assert(iov);
+		if (!iov)
+			return 0;
+		strs = faux_zmalloc(audit->len * sizeof(*strs));
+		assert(strs);
+		if (!strs) {
+			faux_free(iov);
+			return 0;
+		}
+	}
+
+	while (audit->len > 0) {
+		kaudit_rec_t *rec = &audit->ring[audit->head];
+		char *str = kaudit_rec_format(audit, rec);
+
+		if (!str) // Keep the rest of records for the next flush
+			break;
+		if (KAUDIT_TARGET_SYSLOG == audit->target) {
+			syslog(LOG_INFO, "%s", str);
+			written++;
+		} else if (KAUDIT_TARGET_FILE == audit->target) {
+			// String will be freed after writev()
+			iov[num].iov_base = str;
+			iov[num].iov_len = strlen(str);
+			strs[num] = str;
+			num++;
+			str = NULL;
+		} else if (KAUDIT_TARGET_UNIX == audit->target) {
+			if (kaudit_send(audit, str))
+				written++;
+			else
+				audit->dropped++;
+		}
+		faux_str_free(str);
+
+		kaudit_rec_clean(rec);
+		audit->head = (audit->head + 1) % audit->size;
+		audit->len--;
+	}
+
+	if (iov) {
+		size_t i = 0;
+		for (i = 0; i < num; i += IOV_MAX) {
+			size_t n = num - i;
+			if (n > IOV_MAX)
+				n = IOV_MAX;
+			if (kaudit_writev(audit->fd, &iov[i], n))
+				written += n;
+			else
+				audit->dropped += n;
+		}
+		for (i = 0; i < num; i++)
+			faux_str_free(strs[i]);
+		faux_free(strs);
+		faux_free(iov);
+	}
+
+	audit->records += written;
+	audit->flushes++;
+
+	return written;
+}
@@ -0,0 +1,428 @@
+/** @file kcompl.c
+ *
+ * Completion cache. The records are stored within sorted list. The key of
+ * record is COMPL entry and string built from candidate entry, values of
+ * already parsed arguments, prefix and limit. COMPL ACTIONs can filter their
+ * output by prefix and limit so output for one prefix is not suitable for
+ * another one. The exception is complete output (empty prefix, limit is not
+ * reached). It's suitable for any prefix. The candidates of each record are
+ * stored within sorted array so prefix filtering is a binary search.
+ *
+ * The cache belongs to the session. A daemon-wide cache is possible the same
+ * way as the command output cache (kocache.c) does: shared memory segment
+ * mapped before fork(). But its fixed size slots keep raw output so the
+ * sorted candidates would be rebuilt on each lookup. Also COMPL output can
+ * depend on session's user and compl_flush within one session would drop
+ * records of other sessions.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <faux/str.h>
+#include <faux/list.h>
+#include <klish/khelper.h>
+#include <klish/kentry.h>
+#include <klish/kpargv.h>
+#include <klish/kcompl.h>
+
+#define KCOMPL_MAX_RECORDS 64
+
+
+typedef struct kcompl_rec_s {
+	const kentry_t *entry; // COMPL entry
+	char *key;
+	time_t expire; // Monotonic time
+	char **cands; // Sorted unique candidates
+	size_t cands_num;
+	bool_t complete; // Output is not filtered by prefix or limit
+} kcompl_rec_t;
+
+
+// Search key for records list
+typedef struct kcompl_key_s {
+	const kentry_t *entry;
+	const char *key;
+} kcompl_key_t;
+
+
+struct kcompl_s {
+	faux_list_t *recs;
+	size_t hits;
+	size_t misses;
+};
+
+
+// Statistics
+KGET(compl, size_t, hits);
+KGET(compl, size_t, misses);
+
+
+static void kcompl_rec_free(void *data)
+{
+	kcompl_rec_t *rec = (kcompl_rec_t *)data;
+	size_t i = 0;
+
+	if (!rec)
+		return;
+
+	for (i = 0; i < rec->cands_num; i++)
+		faux_str_free(rec->cands[i]);
+	faux_free(rec->cands);
+	faux_str_free(rec->key);
+	faux_free(rec);
+}
+
+
+static int kcompl_rec_compare(const void *first, const void *second)
+{
+	const kcompl_rec_t *f = (const kcompl_rec_t *)first;
+	const kcompl_rec_t *s = (const kcompl_rec_t *)second;
+
+	if (f->entry != s->entry)
+		return (f->entry < s->entry) ? -1 : 1;
+
+	return strcmp(f->key, s->key);
+}
+
+
+static int kcompl_rec_kcompare(const void *key, const void *list_item)
+{
+	const kcompl_key_t *f = (const kcompl_key_t *)key;
+	const kcompl_rec_t *s = (const kcompl_rec_t *)list_item;
+
+	if (f->entry != s->entry)
+		return (f->entry < s->entry) ? -1 : 1;
+
+	return strcmp(f->key, s->key);
+}
+
+
+static int kcompl_str_compare(const void *first, const void *second)
+{
+	const char *f = *(char * const *)first;
+	const char *s = *(char * const *)second;
+
+	return strcmp(f, s);
+}
+
+
+static time_t kcompl_now(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec;
+}
+
+
+// The completion of shared PTYPE can depend on candidate so candidate is a
+// part of the key too.
+static char *kcompl_key(const kentry_t *candidate, const kpargv_t *pargv,
+	const char *prefix, size_t limit)
+{
+	char *key = NULL;
+	char *tmp = NULL;
+	kpargv_pargs_node_t *iter = NULL;
+	kparg_t *parg = NULL;
+
+	key = faux_str_sprintf("%p", candidate);
+	iter = kpargv_pargs_iter(pargv);
+	while ((parg = kpargv_pargs_each(&iter))) {
+		tmp = faux_str_sprintf("\n%p=%s", kparg_entry(parg),
+			kparg_value(parg) ? kparg_value(parg) : "");
+		faux_str_cat(&key, tmp);
+		faux_str_free(tmp);
+	}
+	tmp = faux_str_sprintf("\nlimit=%zu\nprefix=%s",
+		limit, prefix ? prefix : "");
+	faux_str_cat(&key, tmp);
+	faux_str_free(tmp);
+
+	return key;
+}
+
+
+// Finds record. Expired record is removed.
+static kcompl_rec_t *kcompl_find(kcompl_t *compl, const kentry_t *entry,
+	const char *key_str)
+{
+	kcompl_rec_t *rec = NULL;
+	kcompl_key_t key = {};
+
+	key.entry = entry;
+	key.key = key_str;
+	rec = (kcompl_rec_t *)faux_list_kfind(compl->recs, &key);
+	if (rec && (rec->expire <= kcompl_now())) {
+		faux_list_kdel(compl->recs, &key);
+		rec = NULL;
+	}
+
+	return rec;
+}
+
+
+kcompl_t *kcompl_new(void)
+{
+	kcompl_t *compl = NULL;
+
+	compl = faux_zmalloc(sizeof(*compl));
+	assert(compl);
+	if (!compl)
+		return NULL;
+
+	compl->recs = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+		kcompl_rec_compare, kcompl_rec_kcompare, kcompl_rec_free);
+	assert(compl->recs);
+	compl->hits = 0;
+	compl->misses = 0;
+
+	return compl;
+}
+
+
+void kcompl_free(kcompl_t *compl)
+{
+	if (!compl)
+		return;
+
+	faux_list_free(compl->recs);
+	faux_free(compl);
+}
+
+
+// Removes expired records. Removes the oldest record if cache is full.
+static void kcompl_purge(kcompl_t *compl, time_t now)
+{
+	faux_list_node_t *node = NULL;
+	faux_list_node_t *oldest = NULL;
+
+	node = faux_list_head(compl->recs);
+	while (node) {
+		faux_list_node_t *next = faux_list_next_node(node);
+		kcompl_rec_t *rec = (kcompl_rec_t *)faux_list_data(node);
+		if (rec->expire <= now)
+			faux_list_del(compl->recs, node);
+		else if (!oldest || (rec->expire <
+			((kcompl_rec_t *)faux_list_data(oldest))->expire))
+			oldest = node;
+		node = next;
+	}
+
+	if (faux_list_len(compl->recs) >= KCOMPL_MAX_RECORDS)
+		faux_list_del(compl->recs, oldest);
+}
+
+
+/** @brief Stores output of COMPL entry.
+ *
+ * Output contains one candidate per line. The output can be already
+ * filtered by prefix and limit (see kcontext_compl_prefix() and
+ * kcontext_compl_limit()) so they are parts of the key. The record lives for
+ * 'cache' seconds of COMPL entry.
+ *
+ * @param [in] compl Completion cache.
+ * @param [in] entry COMPL entry.
+ * @param [in] candidate Candidate entry.
+ * @param [in] pargv Parsed arguments.
+ * @param [in] out Output of COMPL entry's ACTIONs.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t kcompl_put(kcompl_t *compl, const kentry_t *entry,
+	const kentry_t *candidate, const kpargv_t *pargv, const char *out)
+{
+	kcompl_rec_t *rec = NULL;
+	kcompl_key_t key = {};
+	time_t now = 0;
+	const char *str = out;
+	char *l = NULL;
+	size_t allocated = 0;
+	size_t i = 0;
+	size_t j = 0;
+	const char *prefix = NULL;
+	size_t limit = 0;
+
+	assert(compl);
+	if (!compl)
+		return BOOL_FALSE;
+	if (!entry || (kentry_cache(entry) == 0))
+		return BOOL_FALSE;
+	if (!out)
+		return BOOL_FALSE;
+
+	now = kcompl_now();
+	kcompl_purge(compl, now);
+
+	rec = faux_zmalloc(sizeof(*rec));
+	assert(rec);
+	if (!rec)
+		return BOOL_FALSE;
+	prefix = kpargv_last_arg(pargv);
+	limit = kpargv_limit(pargv);
+	rec->entry = entry;
+	rec->key = kcompl_key(candidate, pargv, prefix, limit);
+	rec->expire = now + kentry_cache(entry);
+
+	while ((l = faux_str_getline(str, &str))) {
+		if (rec->cands_num == allocated) {
+			char **cands = NULL;
+			allocated = allocated ? (allocated * 2) : 16;
+			cands = realloc(rec->cands, allocated * sizeof(*cands));
+			if (!cands) {
+				faux_str_free(l);
+				kcompl_rec_free(rec);
+				return BOOL_FALSE;
+			}
+			rec->cands = cands;
+		}
+		rec->cands[rec->cands_num++] = l;
+	}
+	// ACTION that honors limit stops at limit so output can be truncated
+	rec->complete = faux_str_is_empty(prefix) &&
+		((0 == limit) || (rec->cands_num < limit));
+
+	// Sort once. Remove duplicates.
+	if (rec->cands_num > 1) {
+		qsort(rec->cands, rec->cands_num, sizeof(*rec->cands),
+			kcompl_str_compare);
+		for (i = 1, j = 0; i < rec->cands_num; i++) {
+			if (strcmp(rec->cands[i], rec->cands[j]) == 0) {
+				faux_str_free(rec->cands[i]);
+				continue;
+			}
+			rec->cands[++j] = rec->cands[i];
+		}
+		rec->cands_num = j + 1;
+	}
+
+	// Replace old record
+	key.entry = entry;
+	key.key = rec->key;
+	faux_list_kdel(compl->recs, &key);
+	if (!faux_list_add(compl->recs, rec)) {
+		kcompl_rec_free(rec);
+		return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets cached completions.
+ *
+ * Adds cached candidates that start with prefix to completions list. The
+ * prefix is removed from candidates. The record for the same prefix is used
+ * or the complete record (generated for empty prefix).
+ *
+ * @param [in] compl Completion cache.
+ * @param [in] entry COMPL entry.
+ * @param [in] candidate Candidate entry.
+ * @param [in] pargv Parsed arguments.
+ * @param [in] prefix Last unfinished word. Can be NULL.
+ * @param [out] completions List of strings to add completions to.
+ * @return BOOL_TRUE - cache hit, BOOL_FALSE - cache miss.
+ */
+bool_t kcompl_get(kcompl_t *compl, const kentry_t *entry,
+	const kentry_t *candidate, const kpargv_t *pargv,
+	const char *prefix, faux_list_t *completions)
+{
+	kcompl_rec_t *rec = NULL;
+	char *key_str = NULL;
+	size_t limit = 0;
+	size_t prefix_len = 0;
+	size_t lo = 0;
+	size_t hi = 0;
+	size_t i = 0;
+
+	assert(compl);
+	if (!compl)
+		return BOOL_FALSE;
+	if (!entry || (kentry_cache(entry) == 0))
+		return BOOL_FALSE;
+
+	limit = kpargv_limit(pargv);
+	key_str = kcompl_key(candidate, pargv, prefix, limit);
+	rec = kcompl_find(compl, entry, key_str);
+	faux_str_free(key_str);
+	if (!rec && !faux_str_is_empty(prefix)) {
+		key_str = kcompl_key(candidate, pargv, NULL, limit);
+		rec = kcompl_find(compl, entry, key_str);
+		faux_str_free(key_str);
+		if (rec && !rec->complete)
+			rec = NULL;
+	}
+	if (!rec) {
+		compl->misses++;
+		return BOOL_FALSE;
+	}
+	compl->hits++;
+
+	if (!faux_str_is_empty(prefix))
+		prefix_len = strlen(prefix);
+
+	// Find first candidate that is not less than prefix
+	hi = rec->cands_num;
+	if (prefix_len > 0) {
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (strcmp(rec->cands[mid], prefix) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+	}
+
+	for (i = lo; i < rec->cands_num; i++) {
+		char *str = NULL;
+		if ((prefix_len > 0) &&
+			(strncmp(rec->cands[i], prefix, prefix_len) != 0))
+			break;
+		str = faux_str_dup(rec->cands[i] + prefix_len);
+		if (!faux_list_add(completions, str))
+			faux_str_free(str);
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Invalidates cached completions.
+ *
+ * @param [in] compl Completion cache.
+ * @param [in] name Name of COMPL entry or its parent (PTYPE, PARAM). NULL -
+ * invalidate all records.
+ * @return Number of removed records.
+ */
+size_t kcompl_flush(kcompl_t *compl, const char *name)
+{
+	faux_list_node_t *node = NULL;
+	size_t num = 0;
+
+	assert(compl);
+	if (!compl)
+		return 0;
+
+	if (faux_str_is_empty(name)) {
+		num = faux_list_len(compl->recs);
+		faux_list_del_all(compl->recs);
+		return num;
+	}
+
+	node = faux_list_head(compl->recs);
+	while (node) {
+		faux_list_node_t *next = faux_list_next_node(node);
+		kcompl_rec_t *rec = (kcompl_rec_t *)faux_list_data(node);
+		const kentry_t *parent = kentry_parent(rec->entry);
+		if ((strcmp(kentry_name(rec->entry), name) == 0) ||
+			(parent && (strcmp(kentry_name(parent), name) == 0))) {
+			faux_list_del(compl->recs, node);
+			num++;
+		}
+		node = next;
+	}
+
+	return num;
+}
@@ -230,6 +230,40 @@ const char *kcontext_candidate_value(const kcontext_t *context)
 }
 
 
+// Last unfinished word of completion request. COMPL ACTIONs can use it to
+// don't generate unsuitable candidates.
+const char *kcontext_compl_prefix(const kcontext_t *context)
+{
+	const kpargv_t *pargv = NULL;
+
+	assert(context);
+	if (!context)
+		return NULL;
+	pargv = kcontext_parent_pargv(context);
+	if (!pargv)
+		return NULL;
+
+	return kpargv_last_arg(pargv);
+}
+
+
+// Max number of completions client will get. 0 - unlimited. COMPL ACTIONs
+// can stop to generate candidates after limit is reached.
+size_t kcontext_compl_limit(const kcontext_t *context)
+{
+	const kpargv_t *pargv = NULL;
+
+	assert(context);
+	if (!context)
+		return 0;
+	pargv = kcontext_parent_pargv(context);
+	if (!pargv)
+		return 0;
+
+	return kpargv_limit(pargv);
+}
+
+
 kaction_t *kcontext_action(const kcontext_t *context)
 {
 	faux_list_node_t *node = NULL;
@@ -1,6 +1,6 @@
 /** @file kexec.c
  */
-#define _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
 #define _XOPEN_SOURCE_EXTENDED
 #include <stdlib.h>
 #include <stdio.h>
@@ -14,6 +14,7 @@
 #include <termios.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
 #include <faux/list.h>
 #include <faux/buf.h>
@@ -22,6 +23,10 @@
 #include <klish/kcontext.h>
 #include <klish/kpath.h>
 #include <klish/kexec.h>
+#include <klish/ksession.h>
+#include <klish/ktrace.h>
+#include <klish/kmetrics.h>
+#include <klish/kslow.h>
 
 
 #define PTMX_PATH "/dev/ptmx"
@@ -45,6 +50,7 @@ struct kexec_s {
 	char *pts_fname; // Pseudoterminal slave file name
 	int pts; // Pseudoterminal slave handler
 	char *line; // Full command to execute (text)
+	struct timespec started; // Monotonic time of execution start
 };
 
 // Dry-run
@@ -204,6 +210,29 @@ bool_t kexec_done(const kexec_t *exec)
 }
 
 
+// Send signal to processes of all unfinished ACTIONs. It's used to cancel
+// execution. Terminated processes must be reaped by SIGCHLD handler as usual.
+bool_t kexec_kill(const kexec_t *exec, int sig)
+{
+	faux_list_node_t *iter = NULL;
+	kcontext_t *context = NULL;
+
+	assert(exec);
+	if (!exec)
+		return BOOL_FALSE;
+
+	iter = kexec_contexts_iter(exec);
+	while ((context = kexec_contexts_each(&iter))) {
+		pid_t pid = kcontext_pid(context);
+		if (kcontext_done(context) || (pid <= 0))
+			continue;
+		kill(pid, sig);
+	}
+
+	return BOOL_TRUE;
+}
+
+
 // Retcode of kexec is a 0 if all pipelined stages have retcode=0 or first
 // non-null retcode else.
 // Retcode valid if kexec is done. Else current
@@ -448,6 +477,15 @@ static bool_t kexec_prepare(kexec_t *exec)
 }
 
 
+// Name of command entry. It's used as argument of trace spans
+static const char *kexec_context_name(const kcontext_t *context)
+{
+	const kentry_t *entry = kpargv_command(kcontext_pargv(context));
+
+	return entry ? kentry_name(entry) : NULL;
+}
+
+
 // === SYNC symbol execution
 // The function will be executed right here. It's necessary for
 // navigation implementation for example. To grab function output the
@@ -463,6 +501,8 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 	int pipe_stdout[2] = {};
 	int pipe_stderr[2] = {};
 	ksym_t *sym = NULL;
+	ktrace_t *trace = ksession_trace(exec->session);
+	uint64_t start = 0;
 
 	sym = kaction_sym(action);
 	fn = ksym_function(kaction_sym(action));
@@ -472,7 +512,10 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 	// has bufout
 	if (ksym_silent(sym) && kcontext_is_last_pipeline_stage(context)) {
 //fprintf(stderr, "silent %s\n", ksym_name(sym));
+		start = ktrace_now(trace);
 		exitcode = fn(context);
+		ktrace_span(trace, ksym_name(sym), kexec_context_name(context),
+			start);
 		if (retcode)
 			*retcode = exitcode;
 		return BOOL_TRUE;
@@ -510,6 +553,9 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 		// Save pid of grabber
 		if (pid)
 			*pid = child_pid;
+		kmetrics_inc(ksession_metrics(exec->session),
+			KMETRICS_FORKS_GRABBER, 1);
+		kslow_inc(ksession_slow(exec->session), KSLOW_FORKS);
 
 		// Temporarily replace orig output streams by pipe
 		// stdout
@@ -524,7 +570,10 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 		close(pipe_stderr[1]);
 
 		// Execute sym function right here
+		start = ktrace_now(trace);
 		exitcode = fn(context);
+		ktrace_span(trace, ksym_name(sym), kexec_context_name(context),
+			start);
 		if (retcode)
 			*retcode = exitcode;
 
@@ -552,8 +601,6 @@ static bool_t exec_action_sync(const kexec_t *exec, kcontext_t *context,
 		grabber(fds); // Grabber will not return
 	}
 
-	exec = exec; // Happy compiler
-
 	return BOOL_TRUE;
 }
 
@@ -594,6 +641,12 @@ static bool_t exec_action_async(const kexec_t *exec, kcontext_t *context,
 	if (child_pid != 0) {
 		if (pid)
 			*pid = child_pid;
+		kmetrics_inc(ksession_metrics(exec->session),
+			KMETRICS_FORKS_ACTION, 1);
+		kslow_inc(ksession_slow(exec->session), KSLOW_FORKS);
+		ktrace_fork(ksession_trace(exec->session), child_pid,
+			ksym_name(kaction_sym(action)),
+			kexec_context_name(context));
 		return BOOL_TRUE;
 	}
 
@@ -704,10 +757,8 @@ static bool_t exec_action_sequence(const kexec_t *exec, kcontext_t *context,
 
 		// Get next ACTION from sequence
 		if (!iter) { // Is it the first ACTION within list
-			faux_list_t *actions =
-				kentry_actions(kpargv_command(kcontext_pargv(context)));
-			assert(actions);
-			iter = faux_list_head(actions);
+			iter = kentry_actions_iter(
+				kpargv_command(kcontext_pargv(context)));
 		} else {
 			iter = faux_list_next_node(iter);
 		}
@@ -774,6 +825,9 @@ bool_t kexec_continue_command_execution(kexec_t *exec, pid_t pid, int wstatus)
 	if (!exec)
 		return BOOL_FALSE;
 
+	if (pid != -1)
+		ktrace_reap(ksession_trace(exec->session), pid);
+
 	iter = kexec_contexts_iter(exec);
 	while ((context = kexec_contexts_each(&iter))) {
 		bool_t found = BOOL_FALSE;
@@ -792,15 +846,22 @@ bool_t kexec_exec(kexec_t *exec)
 	const kpargv_t *pargv = NULL;
 	const kentry_t *entry = NULL;
 	bool_t restore = BOOL_FALSE;
+	ktrace_t *trace = NULL;
+	uint64_t start = 0;
 
 	assert(exec);
 	if (!exec)
 		return BOOL_FALSE;
 
+	clock_gettime(CLOCK_MONOTONIC, &exec->started);
+
 	// Firsly prepare kexec object for execution. The file streams must
 	// be created for stdin, stdout, stderr of processes.
+	trace = ksession_trace(exec->session);
+	start = ktrace_now(trace);
 	if (!kexec_prepare(exec))
 		return BOOL_FALSE;
+	ktrace_span(trace, "kexec_prepare", exec->line, start);
 
 	// Pre-change VIEW if command has "restore" flag. Only first command in
 	// line (if many commands are piped) matters. Filters can't change the
@@ -825,6 +886,49 @@ bool_t kexec_exec(kexec_t *exec)
 }
 
 
+/** @brief Gets execution time in microseconds.
+ *
+ * @param [in] exec Kexec object.
+ * @return Microseconds passed since kexec_exec() call.
+ */
+unsigned long long kexec_duration_us(const kexec_t *exec)
+{
+	struct timespec now = {};
+	long sec = 0;
+	long nsec = 0;
+
+	assert(exec);
+	if (!exec)
+		return 0;
+	if ((0 == exec->started.tv_sec) && (0 == exec->started.tv_nsec))
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	sec = now.tv_sec - exec->started.tv_sec;
+	nsec = now.tv_nsec - exec->started.tv_nsec;
+	if (nsec < 0) {
+		sec--;
+		nsec += 1000000000l;
+	}
+	if (sec < 0)
+		return 0;
+
+	return (unsigned long long)sec * 1000000ull +
+		(unsigned long long)(nsec / 1000l);
+}
+
+
+/** @brief Gets execution time.
+ *
+ * @param [in] exec Kexec object.
+ * @return Milliseconds passed since kexec_exec() call.
+ */
+unsigned long kexec_duration_ms(const kexec_t *exec)
+{
+	return (unsigned long)(kexec_duration_us(exec) / 1000ull);
+}
+
+
 // If some kexec's kentry has tty as "out" then consider kexec as interactive
 bool_t kexec_interactive(const kexec_t *exec)
 {
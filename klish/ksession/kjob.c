@@ -0,0 +1,108 @@
+/** @file kjob.c
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <faux/buf.h>
+#include <klish/khelper.h>
+#include <klish/kexec.h>
+#include <klish/kjob.h>
+
+
+struct kjob_s {
+	unsigned int id;
+	kexec_t *exec;
+	bool_t done;
+};
+
+
+// ID
+KGET(job, unsigned int, id);
+
+// Exec
+KGET(job, kexec_t *, exec);
+
+// Done
+KGET_BOOL(job, done);
+KSET_BOOL(job, done);
+
+
+kjob_t *kjob_new(unsigned int id, kexec_t *exec)
+{
+	kjob_t *job = NULL;
+
+	assert(exec);
+	if (!exec)
+		return NULL;
+
+	job = faux_zmalloc(sizeof(*job));
+	assert(job);
+	if (!job)
+		return NULL;
+
+	// Initialization
+	job->id = id;
+	job->exec = exec;
+	job->done = BOOL_FALSE;
+
+	return job;
+}
+
+
+void kjob_free(kjob_t *job)
+{
+	if (!job)
+		return;
+
+	kexec_free(job->exec);
+
+	faux_free(job);
+}
+
+
+/** @brief Takes exec out of job.
+ *
+ * It's used when job is brought to foreground. Then exec is not owned by
+ * job and will not be freed by kjob_free().
+ */
+kexec_t *kjob_release_exec(kjob_t *job)
+{
+	kexec_t *exec = NULL;
+
+	assert(job);
+	if (!job)
+		return NULL;
+
+	exec = job->exec;
+	job->exec = NULL;
+
+	return exec;
+}
+
+
+const char *kjob_line(const kjob_t *job)
+{
+	assert(job);
+	if (!job)
+		return NULL;
+	if (!job->exec)
+		return NULL;
+
+	return kexec_line(job->exec);
+}
+
+
+// Length of stored but not delivered output
+size_t kjob_buffered(const kjob_t *job)
+{
+	assert(job);
+	if (!job)
+		return 0;
+	if (!job->exec)
+		return 0;
+
+	return faux_buf_len(kexec_bufout(job->exec)) +
+		faux_buf_len(kexec_buferr(job->exec));
+}
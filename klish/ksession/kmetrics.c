@@ -0,0 +1,456 @@
+/** @file kmetrics.c
+ *
+ * Metrics. The metrics are stored within anonymous shared memory segment
+ * mapped by klishd before fork() so all service processes see the same
+ * segment. All values are updated by atomic operations so there is no
+ * locks. The segment contains global counters, global latency histograms
+ * and the table of per-COMMAND histograms.
+ *
+ * The table of COMMANDs is an open addressing hash table. The slot is taken
+ * by compare-and-swap of its state so different processes can't take the
+ * same slot. The process that took slot fills the names and then marks slot
+ * as ready. The readers ignore unready slots. If the process dies while
+ * slot is busy then the slot stays busy forever. Other processes skip such
+ * slot after a bounded wait.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kmetrics.h>
+
+
+#define KMETRICS_VIEW_LEN 32
+#define KMETRICS_COMMAND_LEN 64
+#define KMETRICS_BUSY_SPINS 1000 // Max number of yields while slot is busy
+
+// Upper bounds of histogram buckets. The last bucket is +Inf
+static const uint64_t kmetrics_bounds[] = {
+	500, 1000, 5000, 10000, 50000, 100000, 500000,
+	1000000, 5000000, 10000000}; // Microseconds
+static const char *kmetrics_bounds_str[] = {
+	"0.0005", "0.001", "0.005", "0.01", "0.05", "0.1", "0.5",
+	"1", "5", "10", "+Inf"}; // Seconds
+#define KMETRICS_BUCKETS_NUM \
+	(sizeof(kmetrics_bounds) / sizeof(kmetrics_bounds[0]) + 1)
+
+
+typedef struct kmetrics_hist_s {
+	uint64_t buckets[KMETRICS_BUCKETS_NUM]; // Not cumulative
+	uint64_t count;
+	uint64_t sum; // Microseconds
+} kmetrics_hist_t;
+
+
+typedef enum {
+	KMETRICS_SLOT_FREE = 0, // Zeroed memory is a free slot
+	KMETRICS_SLOT_BUSY, // Names are being written
+	KMETRICS_SLOT_READY,
+} kmetrics_slot_e;
+
+
+typedef struct kmetrics_cmd_s {
+	volatile uint32_t state; // kmetrics_slot_e
+	uint32_t hash;
+	char view[KMETRICS_VIEW_LEN];
+	char command[KMETRICS_COMMAND_LEN];
+	kmetrics_hist_t hist;
+} kmetrics_cmd_t;
+
+
+// Shared memory segment
+typedef struct kmetrics_shm_s {
+	uint64_t counters[KMETRICS_COUNTER_MAX];
+	kmetrics_hist_t hists[KMETRICS_HIST_MAX];
+	size_t cmds_num;
+	kmetrics_cmd_t cmds[];
+} kmetrics_shm_t;
+
+
+struct kmetrics_s {
+	kmetrics_shm_t *shm;
+	size_t size; // Size of mapped segment
+};
+
+
+/** @brief Creates metrics within shared memory.
+ *
+ * @param [in] commands Max number of different COMMANDs to account.
+ * @return Allocated metrics or NULL on error.
+ */
+kmetrics_t *kmetrics_new(size_t commands)
+{
+	kmetrics_t *metrics = NULL;
+	void *shm = NULL;
+	size_t size = 0;
+
+	if (0 == commands)
+		commands = KMETRICS_DEFAULT_COMMANDS;
+	size = sizeof(kmetrics_shm_t) + commands * sizeof(kmetrics_cmd_t);
+
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == shm)
+		return NULL;
+
+	metrics = faux_zmalloc(sizeof(*metrics));
+	assert(metrics);
+	if (!metrics) {
+		munmap(shm, size);
+		return NULL;
+	}
+
+	// Initialization. Anonymous memory is zeroed.
+	metrics->shm = (kmetrics_shm_t *)shm;
+	metrics->size = size;
+	metrics->shm->cmds_num = commands;
+
+	return metrics;
+}
+
+
+void kmetrics_free(kmetrics_t *metrics)
+{
+	if (!metrics)
+		return;
+
+	munmap(metrics->shm, metrics->size);
+	faux_free(metrics);
+}
+
+
+/** @brief Gets current time for latency measurement.
+ *
+ * @param [in] metrics Metrics object. Can be NULL.
+ * @return Monotonic time in microseconds or 0 if metrics are disabled.
+ */
+uint64_t kmetrics_now(const kmetrics_t *metrics)
+{
+	struct timespec ts = {};
+
+	if (!metrics)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+void kmetrics_inc(kmetrics_t *metrics, kmetrics_counter_e counter,
+	uint64_t value)
+{
+	if (!metrics)
+		return;
+	if (counter >= KMETRICS_COUNTER_MAX)
+		return;
+
+	__sync_fetch_and_add(&metrics->shm->counters[counter], value);
+}
+
+
+static void kmetrics_hist_add(kmetrics_hist_t *hist, uint64_t usec)
+{
+	size_t i = 0;
+
+	for (i = 0; i < (KMETRICS_BUCKETS_NUM - 1); i++) {
+		if (usec <= kmetrics_bounds[i])
+			break;
+	}
+	__sync_fetch_and_add(&hist->buckets[i], 1);
+	__sync_fetch_and_add(&hist->count, 1);
+	__sync_fetch_and_add(&hist->sum, usec);
+}
+
+
+/** @brief Adds latency from start to current time to histogram.
+ *
+ * @param [in] metrics Metrics object. Can be NULL.
+ * @param [in] hist Histogram.
+ * @param [in] start Start time got by kmetrics_now().
+ */
+void kmetrics_observe(kmetrics_t *metrics, kmetrics_hist_e hist,
+	uint64_t start)
+{
+	uint64_t now = 0;
+
+	if (!metrics)
+		return;
+	if (hist >= KMETRICS_HIST_MAX)
+		return;
+
+	now = kmetrics_now(metrics);
+	kmetrics_hist_add(&metrics->shm->hists[hist],
+		(now > start) ? (now - start) : 0);
+}
+
+
+// FNV-1a
+static uint32_t kmetrics_hash(uint32_t hash, const char *str)
+{
+	const unsigned char *p = (const unsigned char *)str;
+
+	for (; *p; p++) {
+		hash ^= *p;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static void kmetrics_strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = strnlen(src, size - 1);
+
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+
+static bool_t kmetrics_cmd_is_equal(const kmetrics_cmd_t *cmd, uint32_t hash,
+	const char *view, const char *command)
+{
+	if (cmd->hash != hash)
+		return BOOL_FALSE;
+	if (strncmp(cmd->view, view, sizeof(cmd->view) - 1) != 0)
+		return BOOL_FALSE;
+	if (strncmp(cmd->command, command, sizeof(cmd->command) - 1) != 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static kmetrics_cmd_t *kmetrics_cmd_find(kmetrics_t *metrics,
+	const char *view, const char *command)
+{
+	kmetrics_shm_t *shm = metrics->shm;
+	uint32_t hash = 2166136261u;
+	size_t i = 0;
+
+	hash = kmetrics_hash(hash, view);
+	hash = kmetrics_hash(hash ^ '/', command);
+
+	for (i = 0; i < shm->cmds_num; i++) {
+		kmetrics_cmd_t *cmd = &shm->cmds[(hash + i) % shm->cmds_num];
+		unsigned int spins = 0;
+
+		// Take free slot
+		if ((KMETRICS_SLOT_FREE == cmd->state) &&
+			__sync_bool_compare_and_swap(&cmd->state,
+			KMETRICS_SLOT_FREE, KMETRICS_SLOT_BUSY)) {
+			cmd->hash = hash;
+			kmetrics_strlcpy(cmd->view, view, sizeof(cmd->view));
+			kmetrics_strlcpy(cmd->command, command,
+				sizeof(cmd->command));
+			__sync_synchronize();
+			cmd->state = KMETRICS_SLOT_READY;
+			return cmd;
+		}
+		// Another process fills the slot. It's very short operation.
+		// But the process can die within it.
+		while ((KMETRICS_SLOT_BUSY == cmd->state) &&
+			(spins++ < KMETRICS_BUSY_SPINS))
+			sched_yield();
+		if (cmd->state != KMETRICS_SLOT_READY)
+			continue;
+		if (kmetrics_cmd_is_equal(cmd, hash, view, command))
+			return cmd;
+	}
+
+	return NULL;
+}
+
+
+/** @brief Accounts execution of COMMAND.
+ *
+ * @param [in] metrics Metrics object. Can be NULL.
+ * @param [in] view Name of COMMAND's parent (VIEW or COMMAND).
+ * @param [in] command Name of COMMAND.
+ * @param [in] usec Execution time in microseconds.
+ */
+void kmetrics_command(kmetrics_t *metrics, const char *view,
+	const char *command, uint64_t usec)
+{
+	kmetrics_cmd_t *cmd = NULL;
+
+	if (!metrics)
+		return;
+	assert(command);
+	if (!command)
+		return;
+	if (!view)
+		view = "";
+
+	cmd = kmetrics_cmd_find(metrics, view, command);
+	if (!cmd) {
+		kmetrics_inc(metrics, KMETRICS_COMMANDS_DROPPED, 1);
+		return;
+	}
+	kmetrics_hist_add(&cmd->hist, usec);
+}
+
+
+// Escapes label value: backslash, double-quote and line feed
+static char *kmetrics_label(const char *str)
+{
+	char *res = NULL;
+	const char *p = str;
+
+	for (; *p; p++) {
+		const char *esc = NULL;
+		if ('\\' == *p)
+			esc = "\\\\";
+		else if ('"' == *p)
+			esc = "\\\"";
+		else if ('\n' == *p)
+			esc = "\\n";
+		if (esc)
+			faux_str_cat(&res, esc);
+		else
+			faux_str_catn(&res, p, 1);
+	}
+	if (!res)
+		res = faux_str_dup("");
+
+	return res;
+}
+
+
+static void kmetrics_hist_text(char **str, const char *name,
+	const char *labels, const kmetrics_hist_t *hist)
+{
+	uint64_t cumulative = 0;
+	size_t i = 0;
+	char *s = NULL;
+	const char *sep = labels[0] ? "," : "";
+
+	for (i = 0; i < KMETRICS_BUCKETS_NUM; i++) {
+		cumulative += hist->buckets[i];
+		s = faux_str_sprintf("%s_bucket{%s%sle=\"%s\"} %llu\n",
+			name, labels, sep, kmetrics_bounds_str[i],
+			(unsigned long long)cumulative);
+		faux_str_cat(str, s);
+		faux_str_free(s);
+	}
+	s = faux_str_sprintf("%s_sum%s%s%s %llu.%06llu\n"
+		"%s_count%s%s%s %llu\n",
+		name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+		(unsigned long long)(hist->sum / 1000000),
+		(unsigned long long)(hist->sum % 1000000),
+		name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "",
+		(unsigned long long)hist->count);
+	faux_str_cat(str, s);
+	faux_str_free(s);
+}
+
+
+/** @brief Generates text representation of metrics.
+ *
+ * The format is Prometheus text exposition format.
+ *
+ * @param [in] metrics Metrics object.
+ * @return Allocated string. Must be freed by faux_str_free().
+ */
+char *kmetrics_text(const kmetrics_t *metrics)
+{
+	const kmetrics_shm_t *shm = NULL;
+	const uint64_t *c = NULL;
+	char *str = NULL;
+	char *s = NULL;
+	size_t i = 0;
+
+	assert(metrics);
+	if (!metrics)
+		return NULL;
+	shm = metrics->shm;
+	c = shm->counters;
+
+	s = faux_str_sprintf(
+		"# HELP klish_sessions_total Number of started sessions.\n"
+		"# TYPE klish_sessions_total counter\n"
+		"klish_sessions_total %llu\n"
+		"# HELP klish_sessions_active Number of active sessions.\n"
+		"# TYPE klish_sessions_active gauge\n"
+		"klish_sessions_active %lld\n"
+		"# HELP klish_forks_total Number of forked processes.\n"
+		"# TYPE klish_forks_total counter\n"
+		"klish_forks_total{reason=\"session\"} %llu\n"
+		"klish_forks_total{reason=\"action\"} %llu\n"
+		"klish_forks_total{reason=\"grabber\"} %llu\n"
+		"klish_forks_total{reason=\"script\"} %llu\n"
+		"# HELP klish_ptype_validations_total Number of PTYPE checks.\n"
+		"# TYPE klish_ptype_validations_total counter\n"
+		"klish_ptype_validations_total %llu\n"
+		"# HELP klish_ktp_bytes_total KTP traffic in bytes.\n"
+		"# TYPE klish_ktp_bytes_total counter\n"
+		"klish_ktp_bytes_total{direction=\"in\"} %llu\n"
+		"klish_ktp_bytes_total{direction=\"out\"} %llu\n"
+		"# HELP klish_commands_dropped_total Executions not accounted "
+		"because COMMANDs table is full.\n"
+		"# TYPE klish_commands_dropped_total counter\n"
+		"klish_commands_dropped_total %llu\n",
+		(unsigned long long)c[KMETRICS_SESSIONS_TOTAL],
+		(long long)(c[KMETRICS_SESSIONS_TOTAL] -
+			c[KMETRICS_SESSIONS_CLOSED]),
+		(unsigned long long)c[KMETRICS_FORKS_SESSION],
+		(unsigned long long)c[KMETRICS_FORKS_ACTION],
+		(unsigned long long)c[KMETRICS_FORKS_GRABBER],
+		(unsigned long long)c[KMETRICS_FORKS_SCRIPT],
+		(unsigned long long)c[KMETRICS_PTYPE_VALIDATIONS],
+		(unsigned long long)c[KMETRICS_KTP_BYTES_IN],
+		(unsigned long long)c[KMETRICS_KTP_BYTES_OUT],
+		(unsigned long long)c[KMETRICS_COMMANDS_DROPPED]);
+	faux_str_cat(&str, s);
+	faux_str_free(s);
+
+	faux_str_cat(&str,
+		"# HELP klish_parse_duration_seconds Command line parsing time.\n"
+		"# TYPE klish_parse_duration_seconds histogram\n");
+	kmetrics_hist_text(&str, "klish_parse_duration_seconds", "",
+		&shm->hists[KMETRICS_HIST_PARSE]);
+	faux_str_cat(&str,
+		"# HELP klish_completion_duration_seconds Completion request "
+		"processing time.\n"
+		"# TYPE klish_completion_duration_seconds histogram\n");
+	kmetrics_hist_text(&str, "klish_completion_duration_seconds", "",
+		&shm->hists[KMETRICS_HIST_COMPLETION]);
+	faux_str_cat(&str,
+		"# HELP klish_help_duration_seconds Help request "
+		"processing time.\n"
+		"# TYPE klish_help_duration_seconds histogram\n");
+	kmetrics_hist_text(&str, "klish_help_duration_seconds", "",
+		&shm->hists[KMETRICS_HIST_HELP]);
+
+	faux_str_cat(&str,
+		"# HELP klish_command_duration_seconds COMMAND execution time.\n"
+		"# TYPE klish_command_duration_seconds histogram\n");
+	for (i = 0; i < shm->cmds_num; i++) {
+		const kmetrics_cmd_t *cmd = &shm->cmds[i];
+		char *view = NULL;
+		char *command = NULL;
+		char *labels = NULL;
+		if (cmd->state != KMETRICS_SLOT_READY)
+			continue;
+		view = kmetrics_label(cmd->view);
+		command = kmetrics_label(cmd->command);
+		labels = faux_str_sprintf("view=\"%s\",command=\"%s\"",
+			view, command);
+		kmetrics_hist_text(&str, "klish_command_duration_seconds",
+			labels, &cmd->hist);
+		faux_str_free(view);
+		faux_str_free(command);
+		faux_str_free(labels);
+	}
+
+	return str;
+}
@@ -0,0 +1,458 @@
+/** @file kocache.c
+ *
+ * Command output cache. The cache is an anonymous shared memory segment
+ * mapped by klishd before fork() so all service processes see the same
+ * segment. The segment is an array of fixed size slots. Each slot contains
+ * key and output of single command.
+ *
+ * The slot with PENDING state is a command that is being executed by
+ * another process (owner). The other processes with the same request wait
+ * for owner's output instead of executing command. If owner has died the
+ * slot is taken by the next process.
+ *
+ * The segment is protected by simple lock. The lock is an owner PID. The
+ * lock of died process is stolen. All operations under lock are short.
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kentry.h>
+#include <klish/kpargv.h>
+#include <klish/kocache.h>
+
+
+typedef enum {
+	KOCACHE_SLOT_FREE = 0, // Zeroed memory is a free slot
+	KOCACHE_SLOT_PENDING,
+	KOCACHE_SLOT_READY,
+} kocache_slot_e;
+
+
+typedef struct kocache_slot_s {
+	uint32_t state; // kocache_slot_e
+	uint32_t hash; // Hash of key
+	pid_t owner; // Process that executes command. PENDING slot
+	time_t expire; // Monotonic time. READY slot
+	size_t used; // Tick of last usage. For LRU
+	int retcode;
+	uint32_t key_len;
+	uint32_t out_len;
+	char data[]; // Key and then output
+} kocache_slot_t;
+
+
+// Header of shared memory segment
+typedef struct kocache_shm_s {
+	volatile pid_t lock; // Lock owner. 0 - unlocked
+	size_t slots_num;
+	size_t slot_size;
+	size_t tick;
+} kocache_shm_t;
+
+
+struct kocache_s {
+	kocache_shm_t *shm;
+	size_t size; // Size of mapped segment
+	size_t hits;
+	size_t misses;
+	size_t coalesced; // Number of waits for another process
+};
+
+
+// Statistics
+KGET(ocache, size_t, hits);
+KGET(ocache, size_t, misses);
+KGET(ocache, size_t, coalesced);
+
+
+/** @brief Creates cache within shared memory.
+ *
+ * Memory pages are really allocated on first usage.
+ *
+ * @param [in] size Size of shared segment in bytes.
+ * @return Allocated cache or NULL on error.
+ */
+kocache_t *kocache_new(size_t size)
+{
+	kocache_t *cache = NULL;
+	void *shm = NULL;
+
+	if (size < (sizeof(kocache_shm_t) + KOCACHE_SLOT_SIZE))
+		return NULL;
+
+	shm = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == shm)
+		return NULL;
+
+	cache = faux_zmalloc(sizeof(*cache));
+	assert(cache);
+	if (!cache) {
+		munmap(shm, size);
+		return NULL;
+	}
+
+	// Initialization
+	cache->shm = (kocache_shm_t *)shm;
+	cache->size = size;
+	cache->shm->lock = 0;
+	cache->shm->slot_size = KOCACHE_SLOT_SIZE;
+	cache->shm->slots_num = (size - sizeof(kocache_shm_t)) /
+		KOCACHE_SLOT_SIZE;
+	cache->shm->tick = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->coalesced = 0;
+
+	return cache;
+}
+
+
+void kocache_free(kocache_t *cache)
+{
+	if (!cache)
+		return;
+
+	munmap(cache->shm, cache->size);
+	faux_free(cache);
+}
+
+
+// Max length of key and output
+size_t kocache_max_len(const kocache_t *cache)
+{
+	assert(cache);
+	if (!cache)
+		return 0;
+
+	return cache->shm->slot_size - sizeof(kocache_slot_t);
+}
+
+
+static kocache_slot_t *kocache_slot(const kocache_t *cache, size_t i)
+{
+	return (kocache_slot_t *)((char *)cache->shm + sizeof(kocache_shm_t) +
+		i * cache->shm->slot_size);
+}
+
+
+static bool_t kocache_is_alive(pid_t pid)
+{
+	if (pid <= 0)
+		return BOOL_FALSE;
+	if ((kill(pid, 0) < 0) && (ESRCH == errno))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static void kocache_lock(kocache_t *cache)
+{
+	pid_t self = getpid();
+
+	while (!__sync_bool_compare_and_swap(&cache->shm->lock, 0, self)) {
+		pid_t owner = cache->shm->lock;
+		// Process has died while holding lock
+		if (owner && !kocache_is_alive(owner) &&
+			__sync_bool_compare_and_swap(&cache->shm->lock,
+			owner, self))
+			break;
+		sched_yield();
+	}
+}
+
+
+static void kocache_unlock(kocache_t *cache)
+{
+	__sync_lock_release(&cache->shm->lock);
+}
+
+
+static time_t kocache_now(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec;
+}
+
+
+// FNV-1a
+static uint32_t kocache_hash(const char *key, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static kocache_slot_t *kocache_find(kocache_t *cache, const char *key,
+	size_t key_len, uint32_t hash)
+{
+	size_t i = 0;
+
+	for (i = 0; i < cache->shm->slots_num; i++) {
+		kocache_slot_t *slot = kocache_slot(cache, i);
+		if (KOCACHE_SLOT_FREE == slot->state)
+			continue;
+		if ((slot->hash != hash) || (slot->key_len != key_len))
+			continue;
+		if (memcmp(slot->data, key, key_len) != 0)
+			continue;
+		return slot;
+	}
+
+	return NULL;
+}
+
+
+// Finds free or expired slot. Else the least recently used READY slot
+static kocache_slot_t *kocache_alloc(kocache_t *cache, time_t now)
+{
+	kocache_slot_t *lru = NULL;
+	size_t i = 0;
+
+	for (i = 0; i < cache->shm->slots_num; i++) {
+		kocache_slot_t *slot = kocache_slot(cache, i);
+		if (KOCACHE_SLOT_FREE == slot->state)
+			return slot;
+		if (KOCACHE_SLOT_PENDING == slot->state) {
+			if (!kocache_is_alive(slot->owner))
+				return slot;
+			continue;
+		}
+		if (slot->expire <= now)
+			return slot;
+		if (!lru || (slot->used < lru->used))
+			lru = slot;
+	}
+
+	return lru;
+}
+
+
+// Key contains full names of entries because entries can be allocated
+// after fork() (lazy scheme) so pointers are different within processes.
+static void kocache_key_entry(char **key, const kentry_t *entry)
+{
+	if (!entry)
+		return;
+	kocache_key_entry(key, kentry_parent(entry));
+	faux_str_cat(key, "/");
+	faux_str_cat(key, kentry_name(entry));
+}
+
+
+/** @brief Builds cache key.
+ *
+ * @param [in] entry COMMAND entry.
+ * @param [in] pargv Parsed arguments.
+ * @param [in] uid User ID. Different users can see different output.
+ * @return Allocated key string.
+ */
+char *kocache_key(const kentry_t *entry, const kpargv_t *pargv, uid_t uid)
+{
+	char *key = NULL;
+	kpargv_pargs_node_t *iter = NULL;
+	kparg_t *parg = NULL;
+
+	key = faux_str_sprintf("%u", uid);
+	kocache_key_entry(&key, entry);
+	iter = kpargv_pargs_iter(pargv);
+	while ((parg = kpargv_pargs_each(&iter))) {
+		char *tmp = faux_str_sprintf("\n%s=%s",
+			kentry_name(kparg_entry(parg)),
+			kparg_value(parg) ? kparg_value(parg) : "");
+		faux_str_cat(&key, tmp);
+		faux_str_free(tmp);
+	}
+
+	return key;
+}
+
+
+/** @brief Gets cached output.
+ *
+ * If output is not found the slot is reserved for the current process. The
+ * process must execute command and then call kocache_put() or
+ * kocache_abort(). The other processes get KOCACHE_PENDING for the same key
+ * meanwhile.
+ *
+ * @param [in] cache Output cache.
+ * @param [in] key Key of request. See kocache_key().
+ * @param [out] out Allocated copy of output. KOCACHE_HIT only.
+ * @param [out] out_len Length of output.
+ * @param [out] retcode Retcode of command.
+ * @return KOCACHE_HIT, KOCACHE_MISS or KOCACHE_PENDING.
+ */
+kocache_e kocache_get(kocache_t *cache, const char *key,
+	char **out, size_t *out_len, int *retcode)
+{
+	kocache_slot_t *slot = NULL;
+	size_t key_len = 0;
+	uint32_t hash = 0;
+	time_t now = 0;
+
+	assert(cache);
+	if (!cache)
+		return KOCACHE_MISS;
+	assert(key);
+	if (!key)
+		return KOCACHE_MISS;
+
+	key_len = strlen(key);
+	if (key_len > kocache_max_len(cache)) {
+		cache->misses++;
+		return KOCACHE_MISS;
+	}
+	hash = kocache_hash(key, key_len);
+	now = kocache_now();
+
+	kocache_lock(cache);
+	slot = kocache_find(cache, key, key_len, hash);
+
+	if (slot && (KOCACHE_SLOT_READY == slot->state) &&
+		(slot->expire > now)) {
+		slot->used = ++cache->shm->tick;
+		if (out) {
+			*out = faux_malloc(slot->out_len + 1);
+			assert(*out);
+			memcpy(*out, slot->data + slot->key_len, slot->out_len);
+			(*out)[slot->out_len] = '\0';
+		}
+		if (out_len)
+			*out_len = slot->out_len;
+		if (retcode)
+			*retcode = slot->retcode;
+		kocache_unlock(cache);
+		cache->hits++;
+		return KOCACHE_HIT;
+	}
+
+	if (slot && (KOCACHE_SLOT_PENDING == slot->state) &&
+		(slot->owner != getpid()) && kocache_is_alive(slot->owner)) {
+		kocache_unlock(cache);
+		cache->coalesced++;
+		return KOCACHE_PENDING;
+	}
+
+	// Reserve slot
+	if (!slot)
+		slot = kocache_alloc(cache, now);
+	if (slot) {
+		slot->state = KOCACHE_SLOT_PENDING;
+		slot->hash = hash;
+		slot->owner = getpid();
+		slot->expire = 0;
+		slot->used = ++cache->shm->tick;
+		slot->retcode = 0;
+		slot->key_len = key_len;
+		slot->out_len = 0;
+		memcpy(slot->data, key, key_len);
+	}
+	kocache_unlock(cache);
+	cache->misses++;
+
+	return KOCACHE_MISS;
+}
+
+
+/** @brief Stores output to the slot reserved by kocache_get().
+ *
+ * @param [in] cache Output cache.
+ * @param [in] key Key of request.
+ * @param [in] out Output.
+ * @param [in] out_len Length of output.
+ * @param [in] retcode Retcode of command.
+ * @param [in] ttl Time to live in seconds.
+ * @return BOOL_TRUE - stored, BOOL_FALSE - error or output is too long.
+ */
+bool_t kocache_put(kocache_t *cache, const char *key,
+	const char *out, size_t out_len, int retcode, size_t ttl)
+{
+	kocache_slot_t *slot = NULL;
+	size_t key_len = 0;
+	uint32_t hash = 0;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	assert(key);
+	if (!key)
+		return BOOL_FALSE;
+
+	key_len = strlen(key);
+	if ((key_len + out_len) > kocache_max_len(cache)) {
+		kocache_abort(cache, key);
+		return BOOL_FALSE;
+	}
+	hash = kocache_hash(key, key_len);
+
+	kocache_lock(cache);
+	slot = kocache_find(cache, key, key_len, hash);
+	// Slot can be taken by another process while command was executing
+	if (!slot || (KOCACHE_SLOT_PENDING != slot->state) ||
+		(slot->owner != getpid())) {
+		kocache_unlock(cache);
+		return BOOL_FALSE;
+	}
+	if (out_len > 0)
+		memcpy(slot->data + key_len, out, out_len);
+	slot->out_len = out_len;
+	slot->retcode = retcode;
+	slot->expire = kocache_now() + ttl;
+	slot->owner = 0;
+	slot->state = KOCACHE_SLOT_READY;
+	kocache_unlock(cache);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Releases the slot reserved by kocache_get().
+ *
+ * It's used when output is not cacheable (error, too long output). The
+ * waiting processes will execute command themselves.
+ */
+bool_t kocache_abort(kocache_t *cache, const char *key)
+{
+	kocache_slot_t *slot = NULL;
+	size_t key_len = 0;
+
+	assert(cache);
+	if (!cache)
+		return BOOL_FALSE;
+	assert(key);
+	if (!key)
+		return BOOL_FALSE;
+
+	key_len = strlen(key);
+	kocache_lock(cache);
+	slot = kocache_find(cache, key, key_len, kocache_hash(key, key_len));
+	if (slot && (KOCACHE_SLOT_PENDING == slot->state) &&
+		(slot->owner == getpid()))
+		slot->state = KOCACHE_SLOT_FREE;
+	kocache_unlock(cache);
+
+	return BOOL_TRUE;
+}
@@ -23,6 +23,7 @@ struct kpargv_s {
 	kpargv_purpose_e purpose; // Exec/Completion/Help
 	char *last_arg;
 	kparg_t *candidate_parg; // Don't free
+	size_t limit; // Max number of completions (hint). 0 - unlimited
 };
 
 // Status
@@ -49,6 +50,10 @@ KSET(pargv, kpargv_purpose_e, purpose);
 KSET_STR(pargv, last_arg);
 KGET_STR(pargv, last_arg);
 
+// Limit of completions
+KGET(pargv, size_t, limit);
+KSET(pargv, size_t, limit);
+
 // Level
 KGET(pargv, kparg_t *, candidate_parg);
 KSET(pargv, kparg_t *, candidate_parg);
@@ -106,6 +111,7 @@ kpargv_t *kpargv_new()
 	pargv->continuable = BOOL_FALSE;
 	pargv->purpose = KPURPOSE_EXEC;
 	pargv->last_arg = NULL;
+	pargv->limit = 0;
 	pargv->candidate_parg = NULL;
 
 	// Parsed arguments list
@@ -136,6 +142,44 @@ void kpargv_free(kpargv_t *pargv)
 }
 
 
+/** @brief Creates independent copy of pargv.
+ *
+ * Pargs are duplicated. Completions list and candidate parg are not copied
+ * because they are the hint-specific state. It's useful to execute several
+ * service ACTIONs with different candidates simultaneously.
+ */
+kpargv_t *kpargv_clone(const kpargv_t *pargv)
+{
+	kpargv_t *clone = NULL;
+	kpargv_pargs_node_t *iter = NULL;
+	kparg_t *parg = NULL;
+
+	assert(pargv);
+	if (!pargv)
+		return NULL;
+
+	clone = kpargv_new();
+	assert(clone);
+	if (!clone)
+		return NULL;
+
+	clone->status = pargv->status;
+	clone->level = pargv->level;
+	clone->command = pargv->command;
+	clone->continuable = pargv->continuable;
+	clone->purpose = pargv->purpose;
+	kpargv_set_last_arg(clone, pargv->last_arg);
+	clone->limit = pargv->limit;
+
+	iter = kpargv_pargs_iter(pargv);
+	while ((parg = kpargv_pargs_each(&iter)))
+		kpargv_add_pargs(clone,
+			kparg_new(kparg_entry(parg), kparg_value(parg)));
+
+	return clone;
+}
+
+
 kparg_t *kpargv_pargs_last(const kpargv_t *pargv)
 {
 	assert(pargv);
@@ -6,10 +6,18 @@
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <syslog.h>
 
+#include <faux/error.h>
 #include <klish/khelper.h>
 #include <klish/kscheme.h>
 #include <klish/kpath.h>
+#include <klish/kcompl.h>
+#include <klish/kaudit.h>
+#include <klish/ktrace.h>
+#include <klish/kmetrics.h>
+#include <klish/kslow.h>
+#include <klish/kjob.h>
 #include <klish/ksession.h>
 
 
@@ -26,6 +34,14 @@ struct ksession_s {
 	bool_t isatty_stdin;
 	bool_t isatty_stdout;
 	bool_t isatty_stderr;
+	kcompl_t *compl; // Completion cache
+	bool_t prompt_expired; // Cached prompt must be regenerated
+	kaudit_t *audit; // Audit log. Not owned by session
+	ktrace_t *trace; // Latency trace. Not owned by session. NULL - disabled
+	kmetrics_t *metrics; // Shared metrics. Not owned by session
+	kslow_t *slow; // Slow request log. Not owned by session. NULL - disabled
+	faux_list_t *jobs; // Background jobs sorted by ID
+	unsigned int fg_job; // Job to bring to foreground
 };
 
 
@@ -35,6 +51,29 @@ KGET(session, kscheme_t *, scheme);
 // Path
 KGET(session, kpath_t *, path);
 
+// Completion cache
+KGET(session, kcompl_t *, compl);
+
+// Audit log
+KGET(session, kaudit_t *, audit);
+KSET(session, kaudit_t *, audit);
+
+// Latency trace
+KGET(session, ktrace_t *, trace);
+KSET(session, ktrace_t *, trace);
+
+// Metrics
+KGET(session, kmetrics_t *, metrics);
+KSET(session, kmetrics_t *, metrics);
+
+// Slow request log
+KGET(session, kslow_t *, slow);
+KSET(session, kslow_t *, slow);
+
+// Prompt expiration flag
+KGET_BOOL(session, prompt_expired);
+KSET_BOOL(session, prompt_expired);
+
 // Done
 KGET_BOOL(session, done);
 KSET_BOOL(session, done);
@@ -63,6 +102,16 @@ KSET(session, uid_t, uid);
 KSET_STR(session, user);
 KGET_STR(session, user);
 
+// Background jobs
+KADD_NESTED(session, kjob_t *, jobs);
+KNESTED_LEN(session, jobs);
+KNESTED_ITER(session, jobs);
+KNESTED_EACH(session, kjob_t *, jobs);
+
+// Job to bring to foreground
+KGET(session, unsigned int, fg_job);
+KSET(session, unsigned int, fg_job);
+
 // isatty
 KGET_BOOL(session, isatty_stdin);
 KSET_BOOL(session, isatty_stdin);
@@ -72,11 +121,43 @@ KGET_BOOL(session, isatty_stderr);
 KSET_BOOL(session, isatty_stderr);
 
 
+static int ksession_job_compare(const void *first, const void *second)
+{
+	const kjob_t *f = (const kjob_t *)first;
+	const kjob_t *s = (const kjob_t *)second;
+
+	if (kjob_id(f) == kjob_id(s))
+		return 0;
+
+	return (kjob_id(f) < kjob_id(s)) ? -1 : 1;
+}
+
+
+static int ksession_job_kcompare(const void *key, const void *list_item)
+{
+	unsigned int id = *(const unsigned int *)key;
+	const kjob_t *s = (const kjob_t *)list_item;
+
+	if (id == kjob_id(s))
+		return 0;
+
+	return (id < kjob_id(s)) ? -1 : 1;
+}
+
+
+static void ksession_job_free(void *data)
+{
+	kjob_free((kjob_t *)data);
+}
+
+
 ksession_t *ksession_new(kscheme_t *scheme, const char *starting_entry)
 {
 	ksession_t *session = NULL;
 	kentry_t *entry = NULL;
 	klevel_t *level = NULL;
+	faux_error_t *error = NULL;
+	bool_t prepared = BOOL_FALSE;
 
 	assert(scheme);
 	if (!scheme)
@@ -87,6 +168,19 @@ ksession_t *ksession_new(kscheme_t *scheme, const char *starting_entry)
 	entry = kscheme_starting_entry(scheme, starting_entry);
 	if (!entry)
 		return NULL; // Can't find starting entry
+	// Lazy scheme prepares VIEWs on demand
+	error = faux_error_new();
+	prepared = kscheme_prepare_view(scheme, entry, error);
+	if (!prepared) {
+		// Error is empty if VIEW was failed before
+		char *err = faux_error_cstr(error);
+		syslog(LOG_ERR, "Can't prepare starting VIEW \"%s\"%s%s",
+			kentry_name(entry), err ? ": " : "", err ? err : "");
+		faux_str_free(err);
+	}
+	faux_error_free(error);
+	if (!prepared)
+		return NULL;
 
 	session = faux_zmalloc(sizeof(*session));
 	assert(session);
@@ -112,6 +206,17 @@ ksession_t *ksession_new(kscheme_t *scheme, const char *starting_entry)
 	session->isatty_stdout = BOOL_FALSE;
 	session->isatty_stderr = BOOL_FALSE;
 	session->spid = getpid(); // For forked processes
+	session->compl = kcompl_new();
+	assert(session->compl);
+	session->prompt_expired = BOOL_FALSE;
+	session->audit = NULL;
+	session->trace = NULL;
+	session->metrics = NULL;
+	session->slow = NULL;
+	session->jobs = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
+		ksession_job_compare, ksession_job_kcompare, ksession_job_free);
+	assert(session->jobs);
+	session->fg_job = 0;
 
 	return session;
 }
@@ -124,6 +229,66 @@ void ksession_free(ksession_t *session)
 
 	kpath_free(session->path);
 	faux_str_free(session->user);
+	kcompl_free(session->compl);
+	faux_list_free(session->jobs);
 
 	free(session);
 }
+
+
+kjob_t *ksession_find_job(const ksession_t *session, unsigned int id)
+{
+	assert(session);
+	if (!session)
+		return NULL;
+
+	return (kjob_t *)faux_list_kfind(session->jobs, &id);
+}
+
+
+// Removes job from session and frees it
+bool_t ksession_del_job(ksession_t *session, kjob_t *job)
+{
+	faux_list_node_t *iter = NULL;
+	kjob_t *cur = NULL;
+
+	assert(session);
+	if (!session)
+		return BOOL_FALSE;
+	assert(job);
+	if (!job)
+		return BOOL_FALSE;
+
+	iter = faux_list_head(session->jobs);
+	while (iter) {
+		faux_list_node_t *node = iter;
+		cur = (kjob_t *)faux_list_each(&iter);
+		if (cur == job)
+			return faux_list_del(session->jobs, node);
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// The smallest ID that is not used by any job. Like a shell does
+unsigned int ksession_free_job_id(const ksession_t *session)
+{
+	faux_list_node_t *iter = NULL;
+	kjob_t *job = NULL;
+	unsigned int id = 1;
+
+	assert(session);
+	if (!session)
+		return 0;
+
+	// List is sorted by ID
+	iter = faux_list_head(session->jobs);
+	while ((job = (kjob_t *)faux_list_each(&iter))) {
+		if (kjob_id(job) != id)
+			break;
+		id++;
+	}
+
+	return id;
+}
@@ -48,6 +48,8 @@ static bool_t ksession_validate_arg(ksession_t *session, kpargv_t *pargv)
 	if (!ptype_entry)
 		return BOOL_FALSE;
 
+	kmetrics_inc(ksession_metrics(session), KMETRICS_PTYPE_VALIDATIONS, 1);
+	kslow_inc(ksession_slow(session), KSLOW_VALIDATIONS);
 	if (!ksession_exec_locally(session, ptype_entry, pargv, NULL, NULL,
 		&retcode, &out)) {
 		return BOOL_FALSE;
@@ -802,15 +804,29 @@ static bool_t action_terminated_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data)
 {
 	int wstatus = 0;
-	pid_t child_pid = -1;
 	kexec_t *exec = (kexec_t *)user_data;
+	bool_t reaped = BOOL_FALSE;
 
 	if (!exec)
 		return BOOL_FALSE;
 
-	// Wait for any child process. Doesn't block.
-	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0)
-		kexec_continue_command_execution(exec, child_pid, wstatus);
+	// Wait for processes of this kexec only. Doesn't block. Other children
+	// (background jobs, completion jobs) belong to the session's main
+	// event loop. The reaped context can fork next ACTION so search again.
+	do {
+		kexec_contexts_node_t *iter = kexec_contexts_iter(exec);
+		kcontext_t *context = NULL;
+		reaped = BOOL_FALSE;
+		while ((context = kexec_contexts_each(&iter))) {
+			pid_t pid = kcontext_pid(context);
+			if (kcontext_done(context) || (pid <= 0))
+				continue;
+			if (waitpid(pid, &wstatus, WNOHANG) != pid)
+				continue;
+			kexec_continue_command_execution(exec, pid, wstatus);
+			reaped = BOOL_TRUE;
+		}
+	} while (reaped);
 
 	// Check if kexec is done now
 	if (kexec_done(exec)) {
@@ -842,7 +858,7 @@ static bool_t action_stdout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
-bool_t ksession_exec_locally(ksession_t *session, kentry_t *entry,
+static bool_t exec_locally(ksession_t *session, kentry_t *entry,
 	kpargv_t *parent_pargv, const kcontext_t *parent_context,
 	const kexec_t *parent_exec, int *retcode, char **out)
 {
@@ -890,6 +906,15 @@ bool_t ksession_exec_locally(ksession_t *session, kentry_t *entry,
 		faux_eloop_loop(eloop);
 		faux_eloop_free(eloop);
 		kexec_retcode(exec, retcode);
+		// Local loop could consume SIGCHLD of another child. The
+		// remaining zombie is not ours so main loop must reap it.
+		{
+			siginfo_t info = {};
+			if ((waitid(P_ALL, 0, &info,
+				WEXITED | WNOHANG | WNOWAIT) == 0) &&
+				(info.si_pid > 0))
+				raise(SIGCHLD);
+		}
 	}
 
 	if (!out) {
@@ -910,3 +935,23 @@ bool_t ksession_exec_locally(ksession_t *session, kentry_t *entry,
 
 	return BOOL_TRUE;
 }
+
+
+bool_t ksession_exec_locally(ksession_t *session, kentry_t *entry,
+	kpargv_t *parent_pargv, const kcontext_t *parent_context,
+	const kexec_t *parent_exec, int *retcode, char **out)
+{
+	ktrace_t *trace = ksession_trace(session);
+	uint64_t start = ktrace_now(trace);
+	kslow_t *slow = ksession_slow(session);
+	uint64_t slow_start = kslow_now(slow);
+	bool_t res = BOOL_FALSE;
+
+	res = exec_locally(session, entry, parent_pargv, parent_context,
+		parent_exec, retcode, out);
+	ktrace_span(trace, "exec_locally", entry ? kentry_name(entry) : NULL,
+		start);
+	kslow_exec(slow, entry, slow_start);
+
+	return res;
+}
@@ -0,0 +1,392 @@
+/** @file kslow.c
+ *
+ * Slow request log. Only one request is accounted at a time. The session
+ * process is single-threaded (event loop) and the newer request cancels
+ * unfinished completion or help. The most expensive executions are kept
+ * within small fixed array so accounting doesn't allocate memory. The
+ * entry's name is copied only if execution gets into the array.
+ *
+ * The records are rare so they are written synchronously.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <syslog.h>
+#include <sys/types.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/kentry.h>
+#include <klish/kslow.h>
+
+
+#define KSLOW_NAME_LEN 64
+
+
+typedef enum {
+	KSLOW_TARGET_SYSLOG,
+	KSLOW_TARGET_FILE, // Append records to file
+} kslow_target_e;
+
+
+typedef struct kslow_exec_s {
+	uint64_t usec;
+	char name[KSLOW_NAME_LEN]; // <parent>/<entry>
+} kslow_exec_t;
+
+
+struct kslow_s {
+	kslow_target_e target;
+	char *path; // For file target
+	int fd;
+	unsigned int threshold[KSLOW_TYPE_MAX]; // Milliseconds. 0 - disabled
+	size_t records; // Number of written records
+	// Current request
+	bool_t active;
+	kslow_type_e type;
+	char *line;
+	uint64_t started;
+	size_t counters[KSLOW_COUNTER_MAX];
+	size_t execs; // Number of accounted executions
+	kslow_exec_t top[KSLOW_TOP]; // Sorted by time. The most expensive first
+};
+
+
+static const char *kslow_type_names[KSLOW_TYPE_MAX] = {
+	"cmd",
+	"completion",
+	"help",
+};
+
+
+// Statistics
+KGET(slow, size_t, records);
+KGET(slow, uint64_t, started);
+
+
+/** @brief Creates slow log.
+ *
+ * @param [in] target Target string: "syslog" or "file:<path>".
+ * @return Allocated slow log or NULL on error.
+ */
+kslow_t *kslow_new(const char *target)
+{
+	kslow_t *slow = NULL;
+
+	if (faux_str_is_empty(target))
+		return NULL;
+
+	slow = faux_zmalloc(sizeof(*slow));
+	assert(slow);
+	if (!slow)
+		return NULL;
+
+	// Initialization
+	slow->fd = -1;
+	slow->records = 0;
+	slow->active = BOOL_FALSE;
+	slow->line = NULL;
+
+	if (faux_str_casecmp(target, "syslog") == 0) {
+		slow->target = KSLOW_TARGET_SYSLOG;
+	} else if (faux_str_casecmpn(target, "file:", 5) == 0) {
+		slow->target = KSLOW_TARGET_FILE;
+		slow->path = faux_str_dup(target + 5);
+	} else {
+		faux_free(slow);
+		return NULL;
+	}
+
+	if (KSLOW_TARGET_FILE == slow->target) {
+		if (!faux_str_is_empty(slow->path))
+			slow->fd = open(slow->path,
+				O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+				0640);
+		if (slow->fd < 0) {
+			syslog(LOG_ERR, "Can't open slow log %s: %s",
+				slow->path ? slow->path : "", strerror(errno));
+			kslow_free(slow);
+			return NULL;
+		}
+	}
+
+	return slow;
+}
+
+
+void kslow_free(kslow_t *slow)
+{
+	if (!slow)
+		return;
+
+	if (slow->fd >= 0)
+		close(slow->fd);
+	faux_str_free(slow->path);
+	faux_str_free(slow->line);
+	faux_free(slow);
+}
+
+
+/** @brief Sets threshold for request type.
+ *
+ * @param [in] slow Slow log.
+ * @param [in] type Request type.
+ * @param [in] ms Threshold in milliseconds. 0 - don't log this type.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t kslow_set_threshold(kslow_t *slow, kslow_type_e type,
+	unsigned int ms)
+{
+	assert(slow);
+	if (!slow)
+		return BOOL_FALSE;
+	if (type >= KSLOW_TYPE_MAX)
+		return BOOL_FALSE;
+
+	slow->threshold[type] = ms;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets current time for execution start.
+ *
+ * @param [in] slow Slow log. Can be NULL.
+ * @return Monotonic time in microseconds or 0 if slow log is disabled.
+ */
+uint64_t kslow_now(const kslow_t *slow)
+{
+	struct timespec ts = {};
+
+	if (!slow)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+/** @brief Starts accounting of new request.
+ *
+ * Unfinished request is dropped.
+ */
+void kslow_begin(kslow_t *slow, kslow_type_e type, const char *line)
+{
+	if (!slow)
+		return;
+	if (type >= KSLOW_TYPE_MAX)
+		return;
+
+	// Don't account request that is never logged
+	if (0 == slow->threshold[type]) {
+		kslow_cancel(slow);
+		return;
+	}
+
+	slow->active = BOOL_TRUE;
+	slow->type = type;
+	faux_str_free(slow->line);
+	slow->line = faux_str_dup(line);
+	slow->started = kslow_now(slow);
+	memset(slow->counters, 0, sizeof(slow->counters));
+	slow->execs = 0;
+	memset(slow->top, 0, sizeof(slow->top));
+}
+
+
+void kslow_cancel(kslow_t *slow)
+{
+	if (!slow)
+		return;
+
+	slow->active = BOOL_FALSE;
+	faux_str_free(slow->line);
+	slow->line = NULL;
+}
+
+
+/** @brief Accounts execution of entry.
+ *
+ * @param [in] slow Slow log. Can be NULL.
+ * @param [in] entry Executed entry.
+ * @param [in] start Start time got by kslow_now().
+ */
+void kslow_exec(kslow_t *slow, const kentry_t *entry, uint64_t start)
+{
+	uint64_t usec = 0;
+	size_t len = 0;
+	size_t i = 0;
+	const kentry_t *parent = NULL;
+
+	if (!slow || !slow->active)
+		return;
+
+	usec = kslow_now(slow) - start;
+	slow->execs++;
+	len = (slow->execs < KSLOW_TOP) ? slow->execs : KSLOW_TOP;
+
+	// Find position. The last one is dropped.
+	i = len - 1;
+	if ((slow->execs > KSLOW_TOP) && (usec <= slow->top[i].usec))
+		return;
+	while ((i > 0) && (usec > slow->top[i - 1].usec)) {
+		slow->top[i] = slow->top[i - 1];
+		i--;
+	}
+
+	slow->top[i].usec = usec;
+	parent = entry ? kentry_parent(entry) : NULL;
+	snprintf(slow->top[i].name, sizeof(slow->top[i].name), "%s%s%s",
+		parent ? kentry_name(parent) : "", parent ? "/" : "",
+		entry ? kentry_name(entry) : "");
+}
+
+
+void kslow_inc(kslow_t *slow, kslow_counter_e counter)
+{
+	if (!slow || !slow->active)
+		return;
+	if (counter >= KSLOW_COUNTER_MAX)
+		return;
+
+	slow->counters[counter]++;
+}
+
+
+/** @brief Checks if current request exceeds threshold.
+ *
+ * It allows to capture additional data (like trace) before kslow_end().
+ */
+bool_t kslow_exceeded(const kslow_t *slow)
+{
+	if (!slow || !slow->active)
+		return BOOL_FALSE;
+
+	if ((kslow_now(slow) - slow->started) <
+		(uint64_t)slow->threshold[slow->type] * 1000)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static void kslow_add_str(char **str, const char *name, const char *val)
+{
+	const char *p = NULL;
+
+	faux_str_cat(str, " ");
+	faux_str_cat(str, name);
+	faux_str_cat(str, "=\"");
+	for (p = val ? val : ""; *p; p++) {
+		if (('"' == *p) || ('\\' == *p)) {
+			faux_str_catn(str, "\\", 1);
+			faux_str_catn(str, p, 1);
+		} else if ((unsigned char)*p < 0x20) {
+			faux_str_catn(str, " ", 1);
+		} else {
+			faux_str_catn(str, p, 1);
+		}
+	}
+	faux_str_cat(str, "\"");
+}
+
+
+static char *kslow_format(const kslow_t *slow, uint64_t usec, uid_t uid,
+	const char *user, const char *path, const char *trace)
+{
+	char *str = NULL;
+	char *tmp = NULL;
+	char *top = NULL;
+	size_t i = 0;
+	size_t len = (slow->execs < KSLOW_TOP) ? slow->execs : KSLOW_TOP;
+
+	if (KSLOW_TARGET_FILE == slow->target) {
+		char tstr[32] = {};
+		struct tm tm = {};
+		time_t t = time(NULL);
+		localtime_r(&t, &tm);
+		strftime(tstr, sizeof(tstr), "%Y-%m-%dT%H:%M:%S%z ", &tm);
+		faux_str_cat(&str, tstr);
+	}
+
+	tmp = faux_str_sprintf("slow type=%s uid=%u",
+		kslow_type_names[slow->type], uid);
+	faux_str_cat(&str, tmp);
+	faux_str_free(tmp);
+	kslow_add_str(&str, "user", user);
+	kslow_add_str(&str, "path", path);
+	kslow_add_str(&str, "line", slow->line);
+	tmp = faux_str_sprintf(" ms=%.1f validations=%zu forks=%zu execs=%zu",
+		usec / 1000.0, slow->counters[KSLOW_VALIDATIONS],
+		slow->counters[KSLOW_FORKS], slow->execs);
+	faux_str_cat(&str, tmp);
+	faux_str_free(tmp);
+	for (i = 0; i < len; i++) {
+		tmp = faux_str_sprintf("%s%s:%.1fms", (i > 0) ? "," : "",
+			slow->top[i].name, slow->top[i].usec / 1000.0);
+		faux_str_cat(&top, tmp);
+		faux_str_free(tmp);
+	}
+	kslow_add_str(&str, "top", top);
+	faux_str_free(top);
+	if (trace)
+		kslow_add_str(&str, "trace", trace);
+
+	if (KSLOW_TARGET_FILE == slow->target)
+		faux_str_cat(&str, "\n");
+
+	return str;
+}
+
+
+/** @brief Finishes accounting of current request.
+ *
+ * The record is written if request's time exceeds threshold.
+ *
+ * @param [in] slow Slow log. Can be NULL.
+ * @param [in] uid User ID.
+ * @param [in] user User name.
+ * @param [in] path Current path within scheme.
+ * @param [in] trace File with captured trace. NULL if there is no trace.
+ * @return BOOL_TRUE - record is written, BOOL_FALSE - no record.
+ */
+bool_t kslow_end(kslow_t *slow, uid_t uid, const char *user,
+	const char *path, const char *trace)
+{
+	uint64_t usec = 0;
+	char *str = NULL;
+	bool_t rc = BOOL_TRUE;
+
+	if (!slow || !slow->active)
+		return BOOL_FALSE;
+
+	usec = kslow_now(slow) - slow->started;
+	if (usec < (uint64_t)slow->threshold[slow->type] * 1000) {
+		kslow_cancel(slow);
+		return BOOL_FALSE;
+	}
+
+	str = kslow_format(slow, usec, uid, user, path, trace);
+	if (KSLOW_TARGET_SYSLOG == slow->target) {
+		syslog(LOG_WARNING, "%s", str);
+	} else {
+		size_t len = strlen(str);
+		// Single write() keeps records of several processes entire
+		if (write(slow->fd, str, len) != (ssize_t)len)
+			rc = BOOL_FALSE;
+	}
+	faux_str_free(str);
+	if (rc)
+		slow->records++;
+	kslow_cancel(slow);
+
+	return rc;
+}
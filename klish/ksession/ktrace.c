@@ -0,0 +1,314 @@
+/** @file ktrace.c
+ *
+ * Latency tracing. The events are stored within ring buffer of fixed size.
+ * The oldest events are overwritten. Event's strings are truncated and
+ * copied to event itself so tracing doesn't allocate memory. The session
+ * process is single-threaded (event loop) so ring buffer doesn't need any
+ * locks.
+ *
+ * The forked ACTION processes are traced from fork() to waitpid(). The
+ * start of such span is saved to small table of pending processes. Each
+ * process gets its own row (tid) within trace viewer.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <faux/str.h>
+#include <klish/khelper.h>
+#include <klish/ktrace.h>
+
+
+#define KTRACE_NAME_LEN 32
+#define KTRACE_ARG_LEN 96
+#define KTRACE_PENDING_MAX 32 // Max number of simultaneously traced processes
+
+
+typedef struct ktrace_event_s {
+	uint64_t ts; // Microseconds. Monotonic
+	uint64_t dur; // Microseconds
+	pid_t tid;
+	char name[KTRACE_NAME_LEN];
+	char arg[KTRACE_ARG_LEN];
+} ktrace_event_t;
+
+
+struct ktrace_s {
+	pid_t pid; // Service process
+	ktrace_event_t *ring;
+	size_t size; // Capacity of ring buffer
+	size_t head; // Index of the oldest event
+	size_t len; // Number of events within ring buffer
+	size_t dropped; // Number of overwritten events
+	ktrace_event_t pending[KTRACE_PENDING_MAX]; // Forked processes
+};
+
+
+// Statistics
+KGET(trace, size_t, len);
+KGET(trace, size_t, dropped);
+
+
+/** @brief Creates trace.
+ *
+ * @param [in] size Capacity of ring buffer (number of events).
+ * @return Allocated trace or NULL on error.
+ */
+ktrace_t *ktrace_new(size_t size)
+{
+	ktrace_t *trace = NULL;
+
+	if (0 == size)
+		return NULL;
+
+	trace = faux_zmalloc(sizeof(*trace));
+	assert(trace);
+	if (!trace)
+		return NULL;
+
+	trace->ring = faux_zmalloc(size * sizeof(*trace->ring));
+	assert(trace->ring);
+	if (!trace->ring) {
+		faux_free(trace);
+		return NULL;
+	}
+
+	// Initialization
+	trace->pid = getpid();
+	trace->size = size;
+	trace->head = 0;
+	trace->len = 0;
+	trace->dropped = 0;
+
+	return trace;
+}
+
+
+void ktrace_free(ktrace_t *trace)
+{
+	if (!trace)
+		return;
+
+	faux_free(trace->ring);
+	faux_free(trace);
+}
+
+
+/** @brief Gets current time for span start.
+ *
+ * @param [in] trace Trace object. Can be NULL.
+ * @return Monotonic time in microseconds or 0 if trace is disabled.
+ */
+uint64_t ktrace_now(const ktrace_t *trace)
+{
+	struct timespec ts = {};
+
+	if (!trace)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void ktrace_strlcpy(char *dst, const char *src, size_t size)
+{
+	size_t len = 0;
+
+	if (!src) {
+		dst[0] = '\0';
+		return;
+	}
+	len = strnlen(src, size - 1);
+	// Don't cut UTF-8 character. JSON must be valid UTF-8
+	while ((len > 0) && (((unsigned char)src[len] & 0xC0) == 0x80))
+		len--;
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
+
+
+static void ktrace_add(ktrace_t *trace, pid_t tid, const char *name,
+	const char *arg, uint64_t start, uint64_t end)
+{
+	ktrace_event_t *ev = NULL;
+
+	if (trace->len < trace->size) {
+		ev = &trace->ring[(trace->head + trace->len) % trace->size];
+		trace->len++;
+	} else { // Overwrite the oldest event
+		ev = &trace->ring[trace->head];
+		trace->head = (trace->head + 1) % trace->size;
+		trace->dropped++;
+	}
+
+	ev->ts = start;
+	ev->dur = (end > start) ? (end - start) : 0;
+	ev->tid = tid;
+	ktrace_strlcpy(ev->name, name, sizeof(ev->name));
+	ktrace_strlcpy(ev->arg, arg, sizeof(ev->arg));
+}
+
+
+/** @brief Stores span from start to current time.
+ *
+ * @param [in] trace Trace object. Can be NULL.
+ * @param [in] name Name of phase.
+ * @param [in] arg Additional info (command line, entry name etc.). Can be NULL.
+ * @param [in] start Start of span got by ktrace_now().
+ */
+void ktrace_span(ktrace_t *trace, const char *name, const char *arg,
+	uint64_t start)
+{
+	if (!trace)
+		return;
+
+	ktrace_add(trace, trace->pid, name, arg, start, ktrace_now(trace));
+}
+
+
+/** @brief Starts span of forked process.
+ *
+ * The span will be stored by ktrace_reap(). If there are too many pending
+ * processes then process is not traced.
+ */
+void ktrace_fork(ktrace_t *trace, pid_t pid, const char *name,
+	const char *arg)
+{
+	size_t i = 0;
+
+	if (!trace)
+		return;
+
+	for (i = 0; i < KTRACE_PENDING_MAX; i++) {
+		ktrace_event_t *ev = &trace->pending[i];
+		if (ev->tid != 0)
+			continue;
+		ev->tid = pid;
+		ev->ts = ktrace_now(trace);
+		ktrace_strlcpy(ev->name, name, sizeof(ev->name));
+		ktrace_strlcpy(ev->arg, arg, sizeof(ev->arg));
+		return;
+	}
+	trace->dropped++;
+}
+
+
+/** @brief Finishes span of forked process.
+ *
+ * It's called on waitpid() completion. Unknown PIDs are ignored.
+ */
+void ktrace_reap(ktrace_t *trace, pid_t pid)
+{
+	size_t i = 0;
+
+	if (!trace)
+		return;
+
+	for (i = 0; i < KTRACE_PENDING_MAX; i++) {
+		ktrace_event_t *ev = &trace->pending[i];
+		if (ev->tid != pid)
+			continue;
+		ktrace_add(trace, pid, ev->name, ev->arg, ev->ts,
+			ktrace_now(trace));
+		ev->tid = 0;
+		return;
+	}
+}
+
+
+static void ktrace_fput_json_str(FILE *f, const char *str)
+{
+	const unsigned char *p = (const unsigned char *)str;
+
+	fputc('"', f);
+	for (; *p; p++) {
+		if (('"' == *p) || ('\\' == *p))
+			fprintf(f, "\\%c", *p);
+		else if (*p < 0x20)
+			fprintf(f, "\\u%04x", *p);
+		else
+			fputc(*p, f);
+	}
+	fputc('"', f);
+}
+
+
+/** @brief Writes trace to file in Chrome trace-event JSON format.
+ *
+ * The file can be opened by chrome://tracing or https://ui.perfetto.dev.
+ * The ring buffer is not cleared. The file contains command lines so it's
+ * created with 0600 permissions. The existing file (previous dump) is
+ * removed first. The new one is created exclusively and symlinks are not
+ * followed so planted file can't redirect the dump.
+ *
+ * @param [in] trace Trace object.
+ * @param [in] path Path to output file.
+ * @param [in] since Only events started since this time are written. Value
+ * "0" means all events.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t ktrace_dump(const ktrace_t *trace, const char *path,
+	uint64_t since)
+{
+	FILE *f = NULL;
+	int fd = -1;
+	size_t i = 0;
+	bool_t first = BOOL_TRUE;
+
+	assert(trace);
+	if (!trace)
+		return BOOL_FALSE;
+	assert(path);
+	if (!path)
+		return BOOL_FALSE;
+
+	if ((unlink(path) < 0) && (errno != ENOENT))
+		return BOOL_FALSE;
+	fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+		0600);
+	if (fd < 0)
+		return BOOL_FALSE;
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		return BOOL_FALSE;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (i = 0; i < trace->len; i++) {
+		const ktrace_event_t *ev =
+			&trace->ring[(trace->head + i) % trace->size];
+		if (ev->ts < since)
+			continue;
+		fprintf(f, "%s{\"name\":", first ? "" : ",\n");
+		first = BOOL_FALSE;
+		ktrace_fput_json_str(f, ev->name);
+		fprintf(f, ",\"cat\":\"klish\",\"ph\":\"X\","
+			"\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d",
+			(unsigned long long)ev->ts, (unsigned long long)ev->dur,
+			trace->pid, ev->tid);
+		if (ev->arg[0] != '\0') {
+			fprintf(f, ",\"args\":{\"arg\":");
+			ktrace_fput_json_str(f, ev->arg);
+			fputc('}', f);
+		}
+		fputc('}', f);
+	}
+	fprintf(f, "\n]}\n");
+
+	if (fclose(f) != 0)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
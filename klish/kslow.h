@@ -0,0 +1,63 @@
+/** @file kslow.h
+ *
+ * @brief Klish slow request log
+ *
+ * The slow log accounts the expensive parts of single request (command,
+ * completion or help): the most expensive local executions of entries
+ * (PTYPEs, CONDs, COMPLs etc.), number of PTYPE validations and number of
+ * forks. When request's total time exceeds threshold the structured record
+ * is written to target (syslog or file). The slow log is disabled when
+ * there is no slow log object so all functions accept NULL object and do
+ * nothing.
+ */
+
+#ifndef _klish_kslow_h
+#define _klish_kslow_h
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <faux/faux.h>
+#include <klish/kentry.h>
+
+
+typedef struct kslow_s kslow_t;
+
+typedef enum {
+	KSLOW_CMD,
+	KSLOW_COMPLETION,
+	KSLOW_HELP,
+	KSLOW_TYPE_MAX,
+} kslow_type_e;
+
+typedef enum {
+	KSLOW_VALIDATIONS, // PTYPE checks
+	KSLOW_FORKS,
+	KSLOW_COUNTER_MAX,
+} kslow_counter_e;
+
+#define KSLOW_TOP 5 // Number of the most expensive executions within record
+
+
+C_DECL_BEGIN
+
+kslow_t *kslow_new(const char *target);
+void kslow_free(kslow_t *slow);
+bool_t kslow_set_threshold(kslow_t *slow, kslow_type_e type,
+	unsigned int ms);
+
+uint64_t kslow_now(const kslow_t *slow);
+uint64_t kslow_started(const kslow_t *slow);
+void kslow_begin(kslow_t *slow, kslow_type_e type, const char *line);
+void kslow_cancel(kslow_t *slow);
+void kslow_exec(kslow_t *slow, const kentry_t *entry, uint64_t start);
+void kslow_inc(kslow_t *slow, kslow_counter_e counter);
+bool_t kslow_exceeded(const kslow_t *slow);
+bool_t kslow_end(kslow_t *slow, uid_t uid, const char *user,
+	const char *path, const char *trace);
+
+// Statistics
+size_t kslow_records(const kslow_t *slow);
+
+C_DECL_END
+
+#endif // _klish_kslow_h
@@ -0,0 +1,33 @@
+/** @file kstrpool.h
+ *
+ * @brief Klish string pool. Storage for interned scheme strings.
+ *
+ * Big schemes contain a lot of identical strings: help strings, PTYPE
+ * references, symbol names etc. The pool stores single copy of each string.
+ * The strings are owned by the pool and live until the pool is freed.
+ */
+
+#ifndef _klish_kstrpool_h
+#define _klish_kstrpool_h
+
+#include <faux/faux.h>
+
+
+typedef struct kstrpool_s kstrpool_t;
+
+C_DECL_BEGIN
+
+kstrpool_t *kstrpool_new(void);
+void kstrpool_free(kstrpool_t *pool);
+
+const char *kstrpool_intern(kstrpool_t *pool, const char *str);
+
+// Statistics
+size_t kstrpool_len(const kstrpool_t *pool);
+size_t kstrpool_bytes(const kstrpool_t *pool);
+size_t kstrpool_dups(const kstrpool_t *pool);
+size_t kstrpool_dups_bytes(const kstrpool_t *pool);
+
+C_DECL_END
+
+#endif // _klish_kstrpool_h
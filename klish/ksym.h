@@ -67,6 +67,13 @@ bool_t ksym_set_sync(ksym_t *sym, tri_t sync);
 bool_t ksym_silent(const ksym_t *sym);
 bool_t ksym_set_silent(ksym_t *sym, bool_t silent);
 
+// Optional hook to build sym's udata (for ACTION or ENTRY) within klishd
+// before fork(). So the service processes don't write to scheme's memory and
+// don't break copy-on-write sharing. The hook gets the same context fields
+// (action, candidate entry) as the sym itself.
+ksym_fn ksym_prepare(const ksym_t *sym);
+bool_t ksym_set_prepare(ksym_t *sym, ksym_fn fn);
+
 C_DECL_END
 
 #endif // _klish_ksym_h
@@ -30,6 +30,8 @@ typedef enum {
 	KTP_STDIN_CLOSE = 'I',
 	KTP_STDOUT_CLOSE = 'O',
 	KTP_STDERR_CLOSE = 'E',
+	KTP_CMD_BATCH = 'b', // Several commands. Each one is acked by KTP_CMD_ACK
+	KTP_CMD_BATCH_ACK = 'B', // The rest of batch is dropped on error
 } ktp_cmd_e;
 
 
@@ -42,6 +44,11 @@ typedef enum {
 	KTP_PARAM_WINCH = 'W', // <width><space><height>
 	KTP_PARAM_ERROR = 'E',
 	KTP_PARAM_RETCODE = 'R',
+	KTP_PARAM_MORE = 'M', // Number of omitted completions
+	KTP_PARAM_TOKEN = 'K', // Hint cache token
+	KTP_PARAM_ID = 'I', // Request ID. Machine session
+	KTP_PARAM_DURATION = 'D', // Command execution time, microseconds
+	KTP_PARAM_JOB = 'J', // Background job ID
 } ktp_param_e;
 
 
@@ -56,6 +63,8 @@ typedef enum {
 	KTP_STATUS_NEED_STDIN =		(uint32_t)0x00001000, // Server's cmd need stdin
 	KTP_STATUS_INTERACTIVE =	(uint32_t)0x00002000, // Server's stdout is for tty
 	KTP_STATUS_DRY_RUN =		(uint32_t)0x00010000,
+	KTP_STATUS_STOP_ON_ERROR =	(uint32_t)0x00020000, // Batch mode
+	KTP_STATUS_MACHINE =		(uint32_t)0x00040000, // Machine session
 	KTP_STATUS_EXIT =		(uint32_t)0x80000000,
 } ktp_status_e;
 
@@ -67,6 +76,8 @@ typedef enum {
 #define KTP_STATUS_IS_NEED_STDIN(status) (status & KTP_STATUS_NEED_STDIN)
 #define KTP_STATUS_IS_INTERACTIVE(status) (status & KTP_STATUS_INTERACTIVE)
 #define KTP_STATUS_IS_DRY_RUN(status) (status & KTP_STATUS_DRY_RUN)
+#define KTP_STATUS_IS_STOP_ON_ERROR(status) (status & KTP_STATUS_STOP_ON_ERROR)
+#define KTP_STATUS_IS_MACHINE(status) (status & KTP_STATUS_MACHINE)
 #define KTP_STATUS_IS_EXIT(status) (status & KTP_STATUS_EXIT)
 
 
@@ -10,11 +10,13 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <syslog.h>
+#include <arpa/inet.h>
 
 #include <faux/str.h>
 #include <faux/msg.h>
 #include <faux/eloop.h>
 #include <faux/async.h>
+#include <faux/buf.h>
 #include <klish/ktp_session.h>
 
 
@@ -187,3 +189,180 @@ bool_t ktp_stall_cb(faux_async_t *async, size_t len, void *user_data)
 
 	return BOOL_TRUE;
 }
+
+
+/** @brief Receives KTP message from async input buffer.
+ *
+ * It's a low-level function to use within faux_async_t read callback. The
+ * header is received into ktp_rx_t structure itself so no allocations are
+ * needed. The message body is not copied if it's stored within single chunk
+ * of async input buffer (the usual case). The body points to the buffer's
+ * memory directly. Only if message spans several chunks then it's linearized
+ * into reusable internal buffer. The body is valid until ktp_rx_done() call.
+ *
+ * @param [in] rx Receive state.
+ * @param [in] async Async object.
+ * @param [in] buf Async input buffer.
+ * @param [in] len Length of data to read (from read callback).
+ * @param [out] body Message body. NULL for body of zero length.
+ * @param [out] body_len Length of message body.
+ * @return -1 on broken header, 0 if only header is received, 1 if whole
+ * message is received.
+ */
+int ktp_rx_recv(ktp_rx_t *rx, faux_async_t *async, faux_buf_t *buf,
+	size_t len, const char **body, size_t *body_len)
+{
+	void *data = NULL;
+	ssize_t avail = 0;
+
+	assert(rx);
+	assert(async);
+	assert(buf);
+	if (!rx || !async || !buf)
+		return -1;
+
+	// Receive header
+	if (!rx->hdr_received) {
+		size_t msg_wo_hdr = 0;
+
+		faux_buf_read(buf, &rx->hdr, sizeof(rx->hdr));
+		// Check for broken header
+		if (!ktp_check_header(&rx->hdr))
+			return -1;
+		rx->msgs++;
+		// msg_wo_hdr >= 0 because ktp_check_header() validates whole_len
+		msg_wo_hdr = faux_hdr_len(&rx->hdr) - sizeof(faux_hdr_t);
+		// Plan to receive message body
+		if (msg_wo_hdr > 0) {
+			rx->hdr_received = BOOL_TRUE;
+			faux_async_set_read_limits(async, msg_wo_hdr, msg_wo_hdr);
+			return 0;
+		}
+		// Here message is completed (msg body has zero length)
+		rx->body_len = 0;
+		*body = NULL;
+		*body_len = 0;
+		return 1;
+	}
+
+	// Receive message body. Try to use buffer's memory directly
+	avail = faux_buf_dread_lock_easy(buf, &data);
+	if ((avail > 0) && ((size_t)avail >= len)) {
+		rx->locked = BOOL_TRUE;
+		rx->inplace++;
+		*body = (const char *)data;
+	} else {
+		if (avail > 0)
+			faux_buf_dread_unlock_easy(buf, 0);
+		// Message spans several chunks so linearize it
+		if (rx->scratch_size < len) {
+			char *scratch = realloc(rx->scratch, len);
+			if (!scratch)
+				return -1;
+			rx->scratch = scratch;
+			rx->scratch_size = len;
+			rx->allocs++;
+		}
+		faux_buf_read(buf, rx->scratch, len);
+		rx->linearized++;
+		*body = rx->scratch;
+	}
+	rx->body_len = len;
+	*body_len = len;
+
+	return 1;
+}
+
+
+/** @brief Finishes message receiving and plans to receive next header.
+ *
+ * Releases the async input buffer locked by ktp_rx_recv(). The body got by
+ * ktp_rx_recv() is invalid after this call.
+ */
+void ktp_rx_done(ktp_rx_t *rx, faux_async_t *async, faux_buf_t *buf)
+{
+	assert(rx);
+	if (!rx)
+		return;
+
+	if (rx->locked) {
+		faux_buf_dread_unlock_easy(buf, rx->body_len);
+		rx->locked = BOOL_FALSE;
+	}
+	// Don't keep huge linearization buffer
+	if (rx->scratch_size > KTP_RX_SCRATCH_KEEP) {
+		faux_free(rx->scratch);
+		rx->scratch = NULL;
+		rx->scratch_size = 0;
+	}
+	rx->hdr_received = BOOL_FALSE;
+	rx->body_len = 0;
+	faux_async_set_read_limits(async,
+		sizeof(faux_hdr_t), sizeof(faux_hdr_t));
+}
+
+
+void ktp_rx_fini(ktp_rx_t *rx)
+{
+	if (!rx)
+		return;
+
+	faux_free(rx->scratch);
+	rx->scratch = NULL;
+	rx->scratch_size = 0;
+}
+
+
+ktp_cmd_e ktp_rx_cmd(const ktp_rx_t *rx)
+{
+	assert(rx);
+	if (!rx)
+		return KTP_NULL;
+
+	return (ktp_cmd_e)ntohs(rx->hdr.cmd);
+}
+
+
+/** @brief Finds parameter within received message body without copying.
+ *
+ * The serialized message body contains array of parameter headers and then
+ * the data of all parameters.
+ */
+bool_t ktp_rx_param(const ktp_rx_t *rx, const char *body, size_t body_len,
+	ktp_param_e type, const char **data, size_t *len)
+{
+	uint32_t param_num = 0;
+	uint32_t i = 0;
+	size_t phdrs_len = 0;
+	size_t offset = 0;
+
+	assert(rx);
+	if (!rx || !body)
+		return BOOL_FALSE;
+
+	param_num = ntohl(rx->hdr.param_num);
+	phdrs_len = param_num * sizeof(faux_phdr_t);
+	if (phdrs_len > body_len)
+		return BOOL_FALSE;
+	offset = phdrs_len;
+	for (i = 0; i < param_num; i++) {
+		faux_phdr_t phdr = {};
+		size_t param_len = 0;
+
+		// Body is not aligned so copy header
+		memcpy(&phdr, body + i * sizeof(phdr), sizeof(phdr));
+		param_len = ntohl(phdr.param_len);
+		if (param_len > (body_len - offset))
+			return BOOL_FALSE;
+		if (ntohs(phdr.param_type) == type) {
+			if (data)
+				*data = body + offset;
+			if (len)
+				*len = param_len;
+			return BOOL_TRUE;
+		}
+		offset += param_len;
+	}
+
+	return BOOL_FALSE;
+}
@@ -0,0 +1,467 @@
+/** @file ktp_rec.c
+ *
+ * Recording of KTP session. See ktp_rec.h for file format. The file is
+ * written by buffered stdio. The buffer is flushed on each incoming message
+ * so the file contains all completed requests even if service process is
+ * killed.
+ *
+ * The recording contains stdin of ACTIONs as is (including passwords typed
+ * into interactive ACTIONs). So the file is created by owner-only
+ * permissions. It's never overwritten and symlinks are not followed.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include <faux/str.h>
+#include <faux/list.h>
+#include <klish/ktp.h>
+#include <klish/ktp_rec.h>
+
+
+#define KTP_REC_FHDR_LEN 8 // Magic + '\0' + version
+#define KTP_REC_HDR_LEN 16 // Direction, reserved, length, timestamp
+#define KTP_REC_MSG_HDR_LEN 10 // Command, status, number of params
+#define KTP_REC_PARAM_HDR_LEN 6 // Type, length
+#define KTP_REC_MAX_LEN 0x10000000 // Sanity limit of single record
+
+
+struct ktp_rec_s {
+	char *path;
+	FILE *f;
+	bool_t write;
+	uint64_t started; // Microseconds. Monotonic
+	size_t records;
+	char *buf; // Data of last read record
+	size_t buf_size;
+};
+
+
+static uint64_t ktp_rec_now(void)
+{
+	struct timespec ts = {};
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static void ktp_rec_put16(char *p, uint16_t val)
+{
+	val = htons(val);
+	memcpy(p, &val, sizeof(val));
+}
+
+
+static void ktp_rec_put32(char *p, uint32_t val)
+{
+	val = htonl(val);
+	memcpy(p, &val, sizeof(val));
+}
+
+
+static uint16_t ktp_rec_get16(const char *p)
+{
+	uint16_t val = 0;
+
+	memcpy(&val, p, sizeof(val));
+
+	return ntohs(val);
+}
+
+
+static uint32_t ktp_rec_get32(const char *p)
+{
+	uint32_t val = 0;
+
+	memcpy(&val, p, sizeof(val));
+
+	return ntohl(val);
+}
+
+
+/** @brief Opens recording file.
+ *
+ * @param [in] path File path.
+ * @param [in] write BOOL_TRUE - create new recording, BOOL_FALSE - read.
+ * The new recording file must not exist.
+ * @return Allocated recording object or NULL on error.
+ */
+ktp_rec_t *ktp_rec_new(const char *path, bool_t write)
+{
+	ktp_rec_t *rec = NULL;
+	char fhdr[KTP_REC_FHDR_LEN] = {};
+	int fd = -1;
+
+	assert(path);
+	if (!path)
+		return NULL;
+
+	rec = faux_zmalloc(sizeof(*rec));
+	assert(rec);
+	if (!rec)
+		return NULL;
+
+	// Initialization
+	rec->path = faux_str_dup(path);
+	rec->write = write;
+	rec->started = ktp_rec_now();
+	rec->records = 0;
+	rec->buf = NULL;
+	rec->buf_size = 0;
+
+	if (write) {
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW |
+			O_CLOEXEC, 0600);
+		if (fd >= 0) {
+			rec->f = fdopen(fd, "w");
+			if (!rec->f)
+				close(fd);
+		}
+	} else {
+		rec->f = fopen(path, "r");
+	}
+	if (!rec->f) {
+		ktp_rec_free(rec);
+		return NULL;
+	}
+
+	if (write) {
+		memcpy(fhdr, KTP_REC_MAGIC, strlen(KTP_REC_MAGIC));
+		fhdr[KTP_REC_FHDR_LEN - 1] = KTP_REC_VERSION;
+		if (fwrite(fhdr, sizeof(fhdr), 1, rec->f) != 1) {
+			ktp_rec_free(rec);
+			return NULL;
+		}
+	} else {
+		if ((fread(fhdr, sizeof(fhdr), 1, rec->f) != 1) ||
+			(memcmp(fhdr, KTP_REC_MAGIC, strlen(KTP_REC_MAGIC)) != 0) ||
+			(fhdr[KTP_REC_FHDR_LEN - 1] != KTP_REC_VERSION)) {
+			ktp_rec_free(rec);
+			return NULL;
+		}
+	}
+
+	return rec;
+}
+
+
+void ktp_rec_free(ktp_rec_t *rec)
+{
+	if (!rec)
+		return;
+
+	if (rec->f)
+		fclose(rec->f);
+	faux_str_free(rec->path);
+	faux_free(rec->buf);
+	faux_free(rec);
+}
+
+
+const char *ktp_rec_path(const ktp_rec_t *rec)
+{
+	assert(rec);
+	if (!rec)
+		return NULL;
+
+	return rec->path;
+}
+
+
+size_t ktp_rec_records(const ktp_rec_t *rec)
+{
+	assert(rec);
+	if (!rec)
+		return 0;
+
+	return rec->records;
+}
+
+
+static bool_t ktp_rec_write(ktp_rec_t *rec, ktp_rec_dir_e dir,
+	const char *data1, size_t len1, const char *data2, size_t len2)
+{
+	char hdr[KTP_REC_HDR_LEN] = {};
+	uint64_t ts = ktp_rec_now() - rec->started;
+
+	hdr[0] = dir;
+	ktp_rec_put32(hdr + 4, len1 + len2);
+	ktp_rec_put32(hdr + 8, (uint32_t)(ts >> 32));
+	ktp_rec_put32(hdr + 12, (uint32_t)ts);
+
+	if (fwrite(hdr, sizeof(hdr), 1, rec->f) != 1)
+		return BOOL_FALSE;
+	if ((len1 > 0) && (fwrite(data1, len1, 1, rec->f) != 1))
+		return BOOL_FALSE;
+	if ((len2 > 0) && (fwrite(data2, len2, 1, rec->f) != 1))
+		return BOOL_FALSE;
+	rec->records++;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Records incoming message.
+ *
+ * The message is stored as it was received: raw header and body.
+ *
+ * @param [in] rec Recording object. Can be NULL.
+ * @param [in] hdr Message header in network byte order.
+ * @param [in] body Message body. Can be NULL for empty body.
+ * @param [in] body_len Length of body.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t ktp_rec_in(ktp_rec_t *rec, const faux_hdr_t *hdr,
+	const char *body, size_t body_len)
+{
+	if (!rec || !rec->write)
+		return BOOL_TRUE;
+	assert(hdr);
+	if (!hdr)
+		return BOOL_FALSE;
+
+	// The answers to previous request are completed
+	fflush(rec->f);
+
+	return ktp_rec_write(rec, KTP_REC_IN, (const char *)hdr, sizeof(*hdr),
+		body, body ? body_len : 0);
+}
+
+
+/** @brief Records outgoing message.
+ *
+ * @param [in] rec Recording object. Can be NULL.
+ * @param [in] msg Message to send.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t ktp_rec_out(ktp_rec_t *rec, faux_msg_t *msg)
+{
+	char *data = NULL;
+	size_t len = 0;
+	bool_t rc = BOOL_FALSE;
+
+	if (!rec || !rec->write)
+		return BOOL_TRUE;
+	assert(msg);
+	if (!msg)
+		return BOOL_FALSE;
+
+	data = ktp_rec_msg_encode(msg, &len);
+	if (!data)
+		return BOOL_FALSE;
+	rc = ktp_rec_write(rec, KTP_REC_OUT, data, len, NULL, 0);
+	faux_free(data);
+
+	return rc;
+}
+
+
+/** @brief Reads next record.
+ *
+ * The data is valid until next call.
+ *
+ * @param [in] rec Recording object opened for reading.
+ * @param [out] dir Direction of message.
+ * @param [out] ts Timestamp (microseconds since recording start).
+ * @param [out] data Record data.
+ * @param [out] len Length of data.
+ * @return 1 - record is read, 0 - end of file, -1 - error.
+ */
+int ktp_rec_next(ktp_rec_t *rec, ktp_rec_dir_e *dir, uint64_t *ts,
+	const char **data, size_t *len)
+{
+	char hdr[KTP_REC_HDR_LEN] = {};
+	size_t rlen = 0;
+
+	assert(rec);
+	if (!rec || rec->write)
+		return -1;
+
+	if (fread(hdr, sizeof(hdr), 1, rec->f) != 1)
+		return feof(rec->f) ? 0 : -1;
+	if ((hdr[0] != KTP_REC_IN) && (hdr[0] != KTP_REC_OUT))
+		return -1;
+	rlen = ktp_rec_get32(hdr + 4);
+	if (rlen > KTP_REC_MAX_LEN)
+		return -1;
+	if (rlen > rec->buf_size) {
+		faux_free(rec->buf);
+		rec->buf = faux_malloc(rlen);
+		assert(rec->buf);
+		if (!rec->buf) {
+			rec->buf_size = 0;
+			return -1;
+		}
+		rec->buf_size = rlen;
+	}
+	if ((rlen > 0) && (fread(rec->buf, rlen, 1, rec->f) != 1))
+		return -1;
+	rec->records++;
+
+	if (dir)
+		*dir = hdr[0];
+	if (ts)
+		*ts = ((uint64_t)ktp_rec_get32(hdr + 8) << 32) |
+			ktp_rec_get32(hdr + 12);
+	if (data)
+		*data = rec->buf;
+	if (len)
+		*len = rlen;
+
+	return 1;
+}
+
+
+/** @brief Normalizes parameter of outgoing message.
+ *
+ * The execution time differs for each run so it's omitted. The hint cache
+ * token is "<pid>.<generation>". The PID of service process differs for
+ * each run too so only generation is kept.
+ *
+ * @return BOOL_TRUE - keep parameter, BOOL_FALSE - omit it.
+ */
+static bool_t ktp_rec_norm_param(uint16_t type, void **data, uint32_t *len)
+{
+	if (KTP_PARAM_DURATION == type)
+		return BOOL_FALSE;
+
+	if (KTP_PARAM_TOKEN == type) {
+		char *dot = memchr(*data, '.', *len);
+		if (dot) {
+			*len -= dot + 1 - (char *)*data;
+			*data = dot + 1;
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Encodes message to normalized form.
+ *
+ * The encoded messages can be compared by memcmp().
+ *
+ * @param [in] msg Message.
+ * @param [out] len Length of encoded message.
+ * @return Allocated encoded message. Must be freed by faux_free().
+ */
+char *ktp_rec_msg_encode(faux_msg_t *msg, size_t *len)
+{
+	faux_list_node_t *iter = NULL;
+	uint16_t param_type = 0;
+	void *param_data = NULL;
+	uint32_t param_len = 0;
+	uint32_t param_num = 0;
+	size_t size = KTP_REC_MSG_HDR_LEN;
+	char *data = NULL;
+	char *p = NULL;
+
+	assert(msg);
+	if (!msg)
+		return NULL;
+
+	// Calculate size
+	iter = faux_msg_init_param_iter(msg);
+	while (faux_msg_get_param_each(&iter, &param_type,
+		&param_data, &param_len)) {
+		if (!ktp_rec_norm_param(param_type, &param_data, &param_len))
+			continue;
+		size += KTP_REC_PARAM_HDR_LEN + param_len;
+		param_num++;
+	}
+
+	data = faux_malloc(size);
+	assert(data);
+	if (!data)
+		return NULL;
+	ktp_rec_put16(data, faux_msg_get_cmd(msg));
+	ktp_rec_put32(data + 2, faux_msg_get_status(msg));
+	ktp_rec_put32(data + 6, param_num);
+	p = data + KTP_REC_MSG_HDR_LEN;
+	iter = faux_msg_init_param_iter(msg);
+	while (faux_msg_get_param_each(&iter, &param_type,
+		&param_data, &param_len)) {
+		if (!ktp_rec_norm_param(param_type, &param_data, &param_len))
+			continue;
+		ktp_rec_put16(p, param_type);
+		ktp_rec_put32(p + 2, param_len);
+		p += KTP_REC_PARAM_HDR_LEN;
+		if (param_len > 0)
+			memcpy(p, param_data, param_len);
+		p += param_len;
+	}
+
+	if (len)
+		*len = size;
+
+	return data;
+}
+
+
+/** @brief Gets command of normalized message.
+ *
+ * @return Command or -1 on broken message.
+ */
+int ktp_rec_msg_cmd(const char *data, size_t len)
+{
+	if (!data || (len < KTP_REC_MSG_HDR_LEN))
+		return -1;
+
+	return ktp_rec_get16(data);
+}
+
+
+/** @brief Gets first parameter of specified type from normalized message.
+ *
+ * @param [in] data Normalized message.
+ * @param [in] len Length of normalized message.
+ * @param [in] type Parameter type.
+ * @param [out] param Parameter data. Points into message.
+ * @param [out] param_len Length of parameter data.
+ * @return BOOL_TRUE - found, BOOL_FALSE - not found or broken message.
+ */
+bool_t ktp_rec_msg_param(const char *data, size_t len, uint16_t type,
+	const char **param, size_t *param_len)
+{
+	uint32_t param_num = 0;
+	uint32_t i = 0;
+	const char *p = NULL;
+	const char *end = data + len;
+
+	if (!data || (len < KTP_REC_MSG_HDR_LEN))
+		return BOOL_FALSE;
+
+	param_num = ktp_rec_get32(data + 6);
+	p = data + KTP_REC_MSG_HDR_LEN;
+	for (i = 0; i < param_num; i++) {
+		uint16_t ptype = 0;
+		uint32_t plen = 0;
+		if ((size_t)(end - p) < KTP_REC_PARAM_HDR_LEN)
+			return BOOL_FALSE;
+		ptype = ktp_rec_get16(p);
+		plen = ktp_rec_get32(p + 2);
+		p += KTP_REC_PARAM_HDR_LEN;
+		if ((size_t)(end - p) < plen)
+			return BOOL_FALSE;
+		if (ptype == type) {
+			if (param)
+				*param = p;
+			if (param_len)
+				*param_len = plen;
+			return BOOL_TRUE;
+		}
+		p += plen;
+	}
+
+	return BOOL_FALSE;
+}
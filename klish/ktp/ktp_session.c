@@ -12,6 +12,7 @@
 #include <syslog.h>
 
 #include <faux/str.h>
+#include <faux/conv.h>
 #include <klish/ktp_session.h>
 
 
@@ -24,7 +25,7 @@ typedef struct cb_s {
 struct ktp_session_s {
 	ktp_session_state_e state;
 	faux_async_t *async;
-	faux_hdr_t *hdr; // Service var: engine will receive header and then msg
+	ktp_rx_t rx; // Service var: engine will receive header and then msg
 	bool_t done;
 	faux_eloop_t *eloop; // External eloop object
 	cb_t cb[KTP_SESSION_CB_MAX];
@@ -38,6 +39,10 @@ struct ktp_session_s {
 	bool_t stdout_need_newline; // Does stdout has final line feed. If no then newline is needed
 	bool_t stderr_need_newline; // Does stderr has final line feed. If no then newline is needed
 	int last_stream; // Last active stream: stdout or stderr
+	size_t batch_outstanding; // Number of batched commands are not acked yet
+	bool_t machine; // Machine session: no prompts, hotkeys, tty
+	char *req_id; // Request ID of the last received answer
+	unsigned long long cmd_duration; // Execution time (usec) of last command
 };
 
 
@@ -45,6 +50,7 @@ static bool_t server_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t ktp_session_read_cb(faux_async_t *async,
 	faux_buf_t *buf, size_t len, void *user_data);
+static bool_t ktp_session_drop_state(ktp_session_t *ktp, faux_error_t *error);
 
 
 ktp_session_t *ktp_session_new(int sock, faux_eloop_t *eloop)
@@ -76,6 +82,10 @@ ktp_session_t *ktp_session_new(int sock, faux_eloop_t *eloop)
 	ktp->stdout_need_newline = BOOL_FALSE;
 	ktp->stderr_need_newline = BOOL_FALSE;
 	ktp->last_stream = STDOUT_FILENO;
+	ktp->batch_outstanding = 0;
+	ktp->machine = BOOL_FALSE;
+	ktp->req_id = NULL;
+	ktp->cmd_duration = 0;
 
 	// Async object
 	ktp->async = faux_async_new(sock);
@@ -84,7 +94,7 @@ ktp_session_t *ktp_session_new(int sock, faux_eloop_t *eloop)
 	faux_async_set_read_limits(ktp->async,
 		sizeof(faux_hdr_t), sizeof(faux_hdr_t));
 	faux_async_set_read_cb(ktp->async, ktp_session_read_cb, ktp);
-	ktp->hdr = NULL;
+	// ktp->rx is zeroed by faux_zmalloc()
 	faux_async_set_stall_cb(ktp->async, ktp_stall_cb, ktp->eloop);
 
 	// Event loop handlers
@@ -105,7 +115,11 @@ void ktp_session_free(ktp_session_t *ktp)
 
 	// Remove socket from eloop but don't free eloop because it's external
 	faux_eloop_del_fd(ktp->eloop, ktp_session_fd(ktp));
-	faux_free(ktp->hdr);
+	// Error object for next batched command is owned by session
+	if (ktp->batch_outstanding > 0)
+		faux_error_free(ktp->error);
+	faux_str_free(ktp->req_id);
+	ktp_rx_fini(&ktp->rx);
 	close(ktp_session_fd(ktp));
 	faux_async_free(ktp->async);
 	faux_free(ktp);
@@ -186,6 +200,90 @@ ktp_status_e ktp_session_cmd_features(const ktp_session_t *ktp)
 }
 
 
+bool_t ktp_session_machine(const ktp_session_t *ktp)
+{
+	assert(ktp);
+	if (!ktp)
+		return BOOL_FALSE;
+
+	return ktp->machine;
+}
+
+
+/** @brief Sets machine session mode.
+ *
+ * Machine session is intended for automation clients. Server doesn't send
+ * prompts, hotkeys and hint tokens. It doesn't wait for stdin and terminal.
+ * Each answer contains request ID (see ktp_session_batch_ids()) and CMD_ACK
+ * contains execution time. The mode must be set before ktp_session_auth().
+ */
+bool_t ktp_session_set_machine(ktp_session_t *ktp, bool_t machine)
+{
+	assert(ktp);
+	if (!ktp)
+		return BOOL_FALSE;
+
+	ktp->machine = machine;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Gets request ID of the last received answer.
+ *
+ * It's valid within STDOUT, STDERR and CMD_ACK callbacks.
+ */
+const char *ktp_session_req_id(const ktp_session_t *ktp)
+{
+	assert(ktp);
+	if (!ktp)
+		return NULL;
+
+	return ktp->req_id;
+}
+
+
+unsigned long long ktp_session_cmd_duration(const ktp_session_t *ktp)
+{
+	assert(ktp);
+	if (!ktp)
+		return 0;
+
+	return ktp->cmd_duration;
+}
+
+
+// Request ID changes rarely (output usually consists of several chunks) so
+// don't reallocate the same string
+static void ktp_session_set_req_id(ktp_session_t *ktp,
+	const char *id, size_t len)
+{
+	if (!id) {
+		faux_str_free(ktp->req_id);
+		ktp->req_id = NULL;
+		return;
+	}
+	if (ktp->req_id && (strlen(ktp->req_id) == len) &&
+		(memcmp(ktp->req_id, id, len) == 0))
+		return;
+	faux_str_free(ktp->req_id);
+	ktp->req_id = faux_str_dupn(id, len);
+}
+
+
+static void ktp_session_get_req_id(ktp_session_t *ktp, const faux_msg_t *msg)
+{
+	char *id = NULL;
+	uint32_t len = 0;
+
+	if (!ktp->machine)
+		return;
+	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_ID, (void **)&id, &len))
+		id = NULL;
+	ktp_session_set_req_id(ktp, id, len);
+}
+
+
 faux_error_t *ktp_session_error(const ktp_session_t *ktp)
 {
 	assert(ktp);
@@ -297,20 +395,14 @@ static bool_t server_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 }
 
 
-static bool_t ktp_session_process_stdout(ktp_session_t *ktp, const faux_msg_t *msg)
+static bool_t ktp_session_stdout_data(ktp_session_t *ktp,
+	const char *line, size_t len)
 {
-	char *line = NULL;
-	unsigned int len = 0;
-
 	assert(ktp);
-	assert(msg);
 
 	if (!ktp->cb[KTP_SESSION_CB_STDOUT].fn)
 		return BOOL_TRUE; // Just ignore stdout. It's not a bug
 
-	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE, (void **)&line, &len))
-		return BOOL_TRUE; // It's strange but not a bug
-
 	if (len > 0) {
 		if (line[len - 1] == '\n')
 			ktp->stdout_need_newline = BOOL_FALSE;
@@ -324,7 +416,7 @@ static bool_t ktp_session_process_stdout(ktp_session_t *ktp, const faux_msg_t *m
 }
 
 
-static bool_t ktp_session_process_stderr(ktp_session_t *ktp, const faux_msg_t *msg)
+static bool_t ktp_session_process_stdout(ktp_session_t *ktp, const faux_msg_t *msg)
 {
 	char *line = NULL;
 	unsigned int len = 0;
@@ -332,13 +424,22 @@ static bool_t ktp_session_process_stderr(ktp_session_t *ktp, const faux_msg_t *m
 	assert(ktp);
 	assert(msg);
 
+	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE, (void **)&line, &len))
+		return BOOL_TRUE; // It's strange but not a bug
+	ktp_session_get_req_id(ktp, msg);
+
+	return ktp_session_stdout_data(ktp, line, len);
+}
+
+
+static bool_t ktp_session_stderr_data(ktp_session_t *ktp,
+	const char *line, size_t len)
+{
+	assert(ktp);
+
 	if (!ktp->cb[KTP_SESSION_CB_STDERR].fn)
 		return BOOL_TRUE; // Just ignore message. It's not a bug
 
-	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE,
-			(void **)&line, &len))
-		return BOOL_TRUE; // It's strange but not a bug
-
 	if (len > 0) {
 		if (line[len - 1] == '\n')
 			ktp->stderr_need_newline = BOOL_FALSE;
@@ -352,6 +453,23 @@ static bool_t ktp_session_process_stderr(ktp_session_t *ktp, const faux_msg_t *m
 }
 
 
+static bool_t ktp_session_process_stderr(ktp_session_t *ktp, const faux_msg_t *msg)
+{
+	char *line = NULL;
+	unsigned int len = 0;
+
+	assert(ktp);
+	assert(msg);
+
+	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE,
+			(void **)&line, &len))
+		return BOOL_TRUE; // It's strange but not a bug
+	ktp_session_get_req_id(ktp, msg);
+
+	return ktp_session_stderr_data(ktp, line, len);
+}
+
+
 static bool_t ktp_session_process_auth_ack(ktp_session_t *ktp, const faux_msg_t *msg)
 {
 	uint8_t *retcode8bit = NULL;
@@ -372,6 +490,15 @@ static bool_t ktp_session_process_auth_ack(ktp_session_t *ktp, const faux_msg_t
 		faux_str_free(error_str);
 	}
 
+	// Old server doesn't know about machine sessions
+	if (ktp->machine && !KTP_STATUS_IS_MACHINE(status)) {
+		if (ktp->error)
+			faux_error_add(ktp->error,
+				"Server doesn't support machine sessions");
+		ktp->cmd_retcode = -1;
+		status |= KTP_STATUS_EXIT;
+	}
+
 	ktp->cmd_retcode_available = BOOL_TRUE; // Answer from server was received
 	ktp->request_done = BOOL_TRUE;
 	ktp->state = KTP_SESSION_STATE_IDLE;
@@ -395,6 +522,7 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 	uint8_t *retcode8bit = NULL;
 	ktp_status_e status = KTP_STATUS_NONE;
 	char *error_str = NULL;
+	bool_t batched = BOOL_FALSE;
 
 	assert(ktp);
 	assert(msg);
@@ -434,6 +562,18 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 		faux_error_add(ktp->error, error_str);
 		faux_str_free(error_str);
 	}
+	// Machine session info
+	if (ktp->machine) {
+		char *duration = NULL;
+		ktp_session_get_req_id(ktp, msg);
+		ktp->cmd_duration = 0;
+		duration = faux_msg_get_str_param_by_type(msg,
+			KTP_PARAM_DURATION);
+		if (duration) {
+			faux_conv_atoull(duration, &ktp->cmd_duration, 10);
+			faux_str_free(duration);
+		}
+	}
 
 	ktp->cmd_retcode_available = BOOL_TRUE; // Answer from server was received
 	ktp->request_done = BOOL_TRUE;
@@ -441,6 +581,10 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 	// Get exit flag from message
 	if (KTP_STATUS_IS_EXIT(status))
 		ktp_session_set_done(ktp, BOOL_TRUE);
+	if (ktp->batch_outstanding > 0) {
+		batched = BOOL_TRUE;
+		ktp->batch_outstanding--;
+	}
 
 	// Execute external callback
 	if (ktp->cb[KTP_SESSION_CB_CMD_ACK].fn)
@@ -449,6 +593,39 @@ static bool_t ktp_session_process_cmd_ack(ktp_session_t *ktp, const faux_msg_t *
 			ktp, msg,
 			ktp->cb[KTP_SESSION_CB_CMD_ACK].udata);
 
+	// Prepare for the next batched command. Callback can send new batch
+	// itself so check the state.
+	if (batched && (KTP_SESSION_STATE_IDLE == ktp->state)) {
+		if ((ktp->batch_outstanding > 0) && !ktp->done) {
+			ktp_session_drop_state(ktp, faux_error_new());
+			ktp->state = KTP_SESSION_STATE_WAIT_FOR_CMD;
+		} else {
+			ktp->error = NULL; // Callback is owner of error object
+		}
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t ktp_session_process_batch_ack(ktp_session_t *ktp,
+	const faux_msg_t *msg)
+{
+	assert(ktp);
+	assert(msg);
+
+	// Server dropped the rest of batch due to error
+	if (KTP_STATUS_IS_ERROR(faux_msg_get_status(msg))) {
+		if (ktp->batch_outstanding > 0) {
+			faux_error_free(ktp->error);
+			ktp->error = NULL;
+		}
+		ktp->batch_outstanding = 0;
+		ktp->request_done = BOOL_TRUE;
+		ktp->state = KTP_SESSION_STATE_IDLE;
+		ktp_session_set_done(ktp, BOOL_TRUE);
+	}
+
 	return BOOL_TRUE;
 }
 
@@ -591,6 +768,9 @@ static bool_t ktp_session_dispatch(ktp_session_t *ktp, faux_msg_t *msg)
 		}
 		rc = ktp_session_process_stderr(ktp, msg);
 		break;
+	case KTP_CMD_BATCH_ACK:
+		rc = ktp_session_process_batch_ack(ktp, msg);
+		break;
 	case KTP_NOTIFICATION:
 		rc = ktp_session_process_notification(ktp, msg);
 		break;
@@ -608,52 +788,51 @@ static bool_t ktp_session_read_cb(faux_async_t *async,
 {
 	ktp_session_t *ktp = (ktp_session_t *)user_data;
 	faux_msg_t *completed_msg = NULL;
-	char *data = NULL;
+	const char *body = NULL;
+	size_t body_len = 0;
+	ktp_cmd_e cmd = KTP_NULL;
+	int rc = 0;
 
 	assert(async);
 	assert(buf);
 	assert(ktp);
 
-	// Linearize buffer
-	data = malloc(len);
-	faux_buf_read(buf, data, len);
-
-	// Receive header
-	if (!ktp->hdr) {
-		size_t whole_len = 0;
-		size_t msg_wo_hdr = 0;
-
-		ktp->hdr = (faux_hdr_t *)data;
-		// Check for broken header
-		if (!ktp_check_header(ktp->hdr)) {
-			faux_free(ktp->hdr);
-			ktp->hdr = NULL;
-			return BOOL_FALSE;
+	rc = ktp_rx_recv(&ktp->rx, async, buf, len, &body, &body_len);
+	if (rc < 0)
+		return BOOL_FALSE;
+	if (0 == rc)
+		return BOOL_TRUE; // Header is received. Wait for body
+
+	// Fast path. Command output is passed to callbacks right from the
+	// receive buffer without intermediate message object
+	cmd = ktp_rx_cmd(&ktp->rx);
+	if (((KTP_STDOUT == cmd) || (KTP_STDERR == cmd)) &&
+		(ktp->state == KTP_SESSION_STATE_WAIT_FOR_CMD)) {
+		const char *line = NULL;
+		size_t line_len = 0;
+		if (ktp->machine) {
+			const char *id = NULL;
+			size_t id_len = 0;
+			if (!ktp_rx_param(&ktp->rx, body, body_len,
+				KTP_PARAM_ID, &id, &id_len))
+				id = NULL;
+			ktp_session_set_req_id(ktp, id, id_len);
 		}
-
-		whole_len = faux_hdr_len(ktp->hdr);
-		// msg_wo_hdr >= 0 because ktp_check_header() validates whole_len
-		msg_wo_hdr = whole_len - sizeof(faux_hdr_t);
-		// Plan to receive message body
-		if (msg_wo_hdr > 0) {
-			faux_async_set_read_limits(async,
-				msg_wo_hdr, msg_wo_hdr);
-			return BOOL_TRUE;
+		if (ktp_rx_param(&ktp->rx, body, body_len, KTP_PARAM_LINE,
+			&line, &line_len)) {
+			if (KTP_STDOUT == cmd)
+				ktp_session_stdout_data(ktp, line, line_len);
+			else
+				ktp_session_stderr_data(ktp, line, line_len);
 		}
-		// Here message is completed (msg body has zero length)
-		completed_msg = faux_msg_deserialize_parts(ktp->hdr, NULL, 0);
-
-	// Receive message body
-	} else {
-		completed_msg = faux_msg_deserialize_parts(ktp->hdr, data, len);
-		faux_free(data);
+		ktp_rx_done(&ktp->rx, async, buf);
+		return BOOL_TRUE;
 	}
 
+	completed_msg = faux_msg_deserialize_parts(&ktp->rx.hdr,
+		body, body_len);
 	// Plan to receive msg header
-	faux_async_set_read_limits(ktp->async,
-		sizeof(faux_hdr_t), sizeof(faux_hdr_t));
-	faux_free(ktp->hdr);
-	ktp->hdr = NULL; // Ready to recv new header
+	ktp_rx_done(&ktp->rx, async, buf);
 
 	// Here message is completed
 #ifdef DEBUG
@@ -675,6 +854,7 @@ static bool_t ktp_session_drop_state(ktp_session_t *ktp, faux_error_t *error)
 	ktp->error = error;
 	ktp->cmd_retcode = 0;
 	ktp->cmd_retcode_available = BOOL_FALSE;
+	ktp->cmd_duration = 0;
 	ktp->request_done = BOOL_FALSE;
 	ktp->cmd_features = KTP_STATUS_NONE;
 	ktp->cmd_features_available = BOOL_FALSE;
@@ -730,6 +910,94 @@ bool_t ktp_session_cmd(ktp_session_t *ktp, const char *line,
 }
 
 
+/** @brief Sends several commands within single KTP_CMD_BATCH request.
+ *
+ * Server executes commands sequentially and acknowledges each of them by
+ * separate KTP_CMD_ACK so CMD_ACK callback is executed for each command.
+ * The next batch can be sent before previous one is completed. The error
+ * object for each batched command is allocated by session and CMD_ACK
+ * callback is responsible for freeing it (see ktp_session_error()) like
+ * for single command.
+ *
+ * @param [in] ktp KTP session.
+ * @param [in] lines Array of command lines.
+ * @param [in] lines_num Number of command lines.
+ * @param [in] dry_run Dry-run flag.
+ * @param [in] stop_on_error Server will drop the rest of batch on error.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t ktp_session_batch(ktp_session_t *ktp, const char **lines,
+	size_t lines_num, bool_t dry_run, bool_t stop_on_error)
+{
+	return ktp_session_batch_ids(ktp, NULL, lines, lines_num,
+		dry_run, stop_on_error);
+}
+
+
+/** @brief Sends batch of commands with request IDs.
+ *
+ * The same as ktp_session_batch() but each command has its own request ID.
+ * Server returns ID within all answers for the command so client can find
+ * out which command the output belongs to (see ktp_session_req_id()).
+ *
+ * @param [in] ktp KTP session.
+ * @param [in] ids Array of request IDs. NULL or NULL element - no ID.
+ * @param [in] lines Array of command lines.
+ * @param [in] lines_num Number of command lines.
+ * @param [in] dry_run Dry-run flag.
+ * @param [in] stop_on_error Server will drop the rest of batch on error.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t ktp_session_batch_ids(ktp_session_t *ktp, const char **ids,
+	const char **lines, size_t lines_num, bool_t dry_run,
+	bool_t stop_on_error)
+{
+	faux_msg_t *req = NULL;
+	ktp_status_e status = KTP_STATUS_NONE;
+	size_t i = 0;
+
+	assert(ktp);
+	if (!ktp)
+		return BOOL_FALSE;
+	if (!lines || (0 == lines_num))
+		return BOOL_FALSE;
+
+	if (dry_run)
+		status |= KTP_STATUS_DRY_RUN;
+	if (stop_on_error)
+		status |= KTP_STATUS_STOP_ON_ERROR;
+	req = ktp_msg_preform(KTP_CMD_BATCH, status);
+	for (i = 0; i < lines_num; i++) {
+		if (ids && ids[i])
+			faux_msg_add_param(req, KTP_PARAM_ID, ids[i],
+				strlen(ids[i]));
+		faux_msg_add_param(req, KTP_PARAM_LINE, lines[i],
+			strlen(lines[i]));
+	}
+	faux_msg_send_async(req, ktp->async);
+	faux_msg_free(req);
+
+	// Nothing is waiting for answer so prepare for the first command
+	if (0 == ktp->batch_outstanding) {
+		ktp_session_drop_state(ktp, faux_error_new());
+		ktp->state = KTP_SESSION_STATE_WAIT_FOR_CMD;
+	}
+	ktp->batch_outstanding += lines_num;
+
+	return BOOL_TRUE;
+}
+
+
+size_t ktp_session_batch_outstanding(const ktp_session_t *ktp)
+{
+	assert(ktp);
+	if (!ktp)
+		return 0;
+
+	return ktp->batch_outstanding;
+}
+
+
 bool_t ktp_session_auth(ktp_session_t *ktp, faux_error_t *error)
 {
 	faux_msg_t *req = NULL;
@@ -740,13 +1008,17 @@ bool_t ktp_session_auth(ktp_session_t *ktp, faux_error_t *error)
 		return BOOL_FALSE;
 
 	// This request starts session. It must send some client's environment
-	// to server
-	if (isatty(STDIN_FILENO))
-		status |= KTP_STATUS_TTY_STDIN;
-	if (isatty(STDOUT_FILENO))
-		status |= KTP_STATUS_TTY_STDOUT;
-	if (isatty(STDERR_FILENO))
-		status |= KTP_STATUS_TTY_STDERR;
+	// to server. Machine session never uses terminal.
+	if (ktp->machine) {
+		status |= KTP_STATUS_MACHINE;
+	} else {
+		if (isatty(STDIN_FILENO))
+			status |= KTP_STATUS_TTY_STDIN;
+		if (isatty(STDOUT_FILENO))
+			status |= KTP_STATUS_TTY_STDOUT;
+		if (isatty(STDERR_FILENO))
+			status |= KTP_STATUS_TTY_STDERR;
+	}
 
 	// Send request
 	req = ktp_msg_preform(KTP_AUTH, status);
@@ -14,6 +14,8 @@
 #include <poll.h>
 #include <sys/wait.h>
 #include <ctype.h>
+#include <time.h>
+#include <signal.h>
 
 #include <faux/str.h>
 #include <faux/conv.h>
@@ -23,10 +25,24 @@
 #include <faux/sysdb.h>
 #include <klish/ksession.h>
 #include <klish/ksession_parse.h>
+#include <klish/kjob.h>
+#include <klish/kocache.h>
+#include <klish/kmetrics.h>
+#include <klish/kslow.h>
+#include <klish/ktp_rec.h>
 #include <klish/ktp.h>
 #include <klish/ktp_session.h>
 
 #define BUF_LIMIT 65536
+#define KTPD_HINT_DEADLINE 2 // Seconds to wait for completion/help ACTIONs
+#define KTPD_HINT_SCHED_ID 1
+#define KTPD_AUDIT_SCHED_ID 2
+#define KTPD_OCACHE_SCHED_ID 3
+#define KTPD_COMPL_LIMIT 1000 // Max number of completions within answer
+#define KTPD_JOBS_LIMIT 16 // Max number of background jobs
+#define KTPD_JOB_BUF_LIMIT 1048576 // Max stored output of background job
+#define KTPD_OCACHE_POLL_NSEC 50000000 // Check for output of another session
+#define KTPD_SLOW_TRACES_MAX 16 // Max number of slow request traces
 
 
 typedef enum {
@@ -37,18 +53,92 @@ typedef enum {
 } ktpd_session_state_e;
 
 
+typedef struct ktpd_hint_s ktpd_hint_t;
+
+
 struct ktpd_session_s {
 	ksession_t *session;
 	ktpd_session_state_e state;
 	faux_async_t *async; // Object for data exchange with client (KTP)
-	faux_hdr_t *hdr; // Engine will receive header and then msg
+	ktp_rx_t rx; // Engine will receive header and then msg
 	faux_eloop_t *eloop; // External link, dont's free()
 	kexec_t *exec;
 	bool_t exit;
 	bool_t stdin_must_be_closed;
+	faux_list_t *batch; // Queue of batched commands
+	bool_t batch_running; // Batched command is being executed
+	uint32_t batch_status; // Request status of running batched command
+	bool_t batch_aborted; // Batch was dropped due to error
+	ktpd_hint_t *hint; // In-flight completion or help request
+	char *prompt; // Cached prompt
+	const kentry_t *prompt_entry; // PROMPT entry of cached prompt
+	kpath_t *prompt_path; // Path of cached prompt
+	size_t prompt_execs; // Number of PROMPT executions
+	size_t prompt_hits; // Number of cached prompt usages
+	kaudit_t *audit; // Audit log
+	size_t generation; // Incremented by each command. Part of hint token
+	bool_t machine; // Machine session: no prompts and hotkeys
+	char *cmd_id; // Request ID of current command. Machine session
+	struct timespec cmd_started; // Start time of current command
+	unsigned int exec_job; // Job ID if current exec was in background
+	size_t jobs_started; // Number of started background jobs
+	kocache_t *ocache; // Shared output cache. Not owned by session
+	char *ocache_key; // Key of current command's output
+	char *ocache_out; // Stored stdout of current command
+	size_t ocache_len;
+	unsigned int ocache_ttl; // TTL of current command's output
+	bool_t ocache_fail; // Output of current command can't be cached
+	bool_t ocache_wait; // Wait for output of another session
+	ktrace_t *trace; // Latency trace. NULL - disabled
+	char *trace_path; // File to dump trace to
+	uint64_t trace_started; // Start of current command's span
+	size_t slow_traces; // Number of captured slow request traces
+	char *trace_line; // Current command line for trace
+	kmetrics_t *metrics; // Shared metrics. Not owned by session
+	ktp_rec_t *rec; // Session recording. NULL - disabled
+	kslow_t *slow; // Slow request log. NULL - disabled
+};
+
+
+// Completion or help request
+struct ktpd_hint_s {
+	ktpd_session_t *ktpd;
+	ktp_cmd_e cmd; // KTP_COMPLETION_ACK or KTP_HELP_ACK
+	uint32_t status;
+	kpargv_t *pargv;
+	const char *prefix; // Last unfinished word. Points into pargv
+	faux_list_t *jobs;
+	size_t running; // Number of unfinished jobs
+	bool_t deadline; // Deadline sched event is registered
+	bool_t cacheable; // Client can cache the answer
+	uint64_t started; // Time of request for metrics
+	faux_list_t *results; // Completion strings or help_t structures
 };
 
 
+// Completion or help ACTIONs of single candidate
+typedef struct ktpd_hint_job_s {
+	ktpd_hint_t *hint;
+	kentry_t *entry; // COMPL or HELP entry
+	kentry_t *candidate;
+	kpargv_t *pargv; // Own pargv with own candidate
+	kparg_t *parg; // Candidate
+	kexec_t *exec;
+	uint64_t started; // For slow log
+	bool_t running;
+	bool_t polled; // Stdout is watched by event loop
+	bool_t done;
+} ktpd_hint_job_t;
+
+
+// Batched command
+typedef struct ktpd_batch_cmd_s {
+	char *id; // Request ID
+	char *line;
+	uint32_t status; // Status of KTP_CMD_BATCH request
+} ktpd_batch_cmd_t;
+
+
 // Static declarations
 static bool_t ktpd_session_read_cb(faux_async_t *async,
 	faux_buf_t *buf, size_t len, void *user_data);
@@ -59,13 +149,66 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec);
 static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 	int *retcode, faux_error_t *error,
-	bool_t dry_run, bool_t *view_was_changed);
+	bool_t dry_run, bool_t *view_was_changed, bool_t background);
 static bool_t action_stdout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t action_stderr_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_stderr,
 	bool_t process_all_data);
+static bool_t ktpd_session_batch_run(ktpd_session_t *ktpd);
+static void ktpd_session_batch_done(ktpd_session_t *ktpd, bool_t ok);
+static void ktpd_hint_cancel(ktpd_session_t *ktpd);
+static void ktpd_hint_child(ktpd_session_t *ktpd, pid_t pid, int wstatus);
+static void ktpd_hint_check(ktpd_session_t *ktpd);
+static bool_t ktpd_session_fg(ktpd_session_t *ktpd, int *retcode);
+static bool_t ktpd_session_run(ktpd_session_t *ktpd, kexec_t *exec,
+	int *retcode, bool_t *view_was_changed_p, bool_t background);
+static bool_t ktpd_session_cmd_done(ktpd_session_t *ktpd, int retcode,
+	const faux_error_t *error, bool_t view_was_changed);
+static void ktpd_ocache_end(ktpd_session_t *ktpd, int retcode);
+static bool_t ocache_wait_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+static bool_t send_stream(ktpd_session_t *ktpd, bool_t is_stderr,
+	const char *buf, size_t len);
+static bool_t job_stream_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data);
+
+
+static void ktpd_batch_cmd_free(void *data)
+{
+	ktpd_batch_cmd_t *bcmd = (ktpd_batch_cmd_t *)data;
+
+	if (!bcmd)
+		return;
+	faux_str_free(bcmd->id);
+	faux_str_free(bcmd->line);
+	faux_free(bcmd);
+}
+
+
+// All messages to client go through this function to be recorded
+static ssize_t ktpd_send(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	ktp_rec_out(ktpd->rec, msg);
+
+	return faux_msg_send_async(msg, ktpd->async);
+}
+
+
+static bool_t ktpd_send_error(ktpd_session_t *ktpd, ktp_cmd_e cmd,
+	const char *error)
+{
+	faux_msg_t *msg = NULL;
+
+	msg = ktp_msg_preform(cmd, KTP_STATUS_ERROR);
+	if (error)
+		faux_msg_add_param(msg, KTP_PARAM_ERROR, error, strlen(error));
+	ktpd_send(ktpd, msg);
+	faux_msg_free(msg);
+
+	return BOOL_TRUE;
+}
 
 
 ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
@@ -103,6 +246,38 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	// function must use ksession done flag. This exit flag is internal
 	// feature of KTPD session.
 	ktpd->exit = BOOL_FALSE;
+	ktpd->batch = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, ktpd_batch_cmd_free);
+	ktpd->batch_running = BOOL_FALSE;
+	ktpd->batch_status = KTP_STATUS_NONE;
+	ktpd->batch_aborted = BOOL_FALSE;
+	ktpd->hint = NULL;
+	ktpd->prompt = NULL;
+	ktpd->prompt_entry = NULL;
+	ktpd->prompt_path = NULL;
+	ktpd->prompt_execs = 0;
+	ktpd->prompt_hits = 0;
+	ktpd->audit = NULL;
+	ktpd->generation = 0;
+	ktpd->machine = BOOL_FALSE;
+	ktpd->cmd_id = NULL;
+	ktpd->exec_job = 0;
+	ktpd->jobs_started = 0;
+	ktpd->ocache = NULL;
+	ktpd->ocache_key = NULL;
+	ktpd->ocache_out = NULL;
+	ktpd->ocache_len = 0;
+	ktpd->ocache_ttl = 0;
+	ktpd->ocache_fail = BOOL_FALSE;
+	ktpd->ocache_wait = BOOL_FALSE;
+	ktpd->trace = NULL;
+	ktpd->trace_path = NULL;
+	ktpd->trace_started = 0;
+	ktpd->slow_traces = 0;
+	ktpd->trace_line = NULL;
+	ktpd->metrics = NULL;
+	ktpd->rec = NULL;
+	ktpd->slow = NULL;
 
 	// Async object
 	ktpd->async = faux_async_new(sock);
@@ -111,7 +286,7 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 	faux_async_set_read_limits(ktpd->async,
 		sizeof(faux_hdr_t), sizeof(faux_hdr_t));
 	faux_async_set_read_cb(ktpd->async, ktpd_session_read_cb, ktpd);
-	ktpd->hdr = NULL;
+	// ktpd->rx is zeroed by faux_zmalloc()
 	faux_async_set_stall_cb(ktpd->async, ktp_stall_cb, ktpd->eloop);
 
 	// Eloop callbacks
@@ -123,10 +298,67 @@ ktpd_session_t *ktpd_session_new(int sock, kscheme_t *scheme,
 }
 
 
+/** @brief Logs session statistics as a single debug message.
+ *
+ * Optional subsystems are reported only if they are enabled.
+ */
+static void ktpd_session_log_stats(const ktpd_session_t *ktpd)
+{
+	const kcompl_t *compl = ksession_compl(ktpd->session);
+	char *stats = NULL;
+	char *str = NULL;
+
+	stats = faux_str_sprintf("Session stats: KTP messages %zu "
+		"(zero-copy %zu, linearized %zu), "
+		"completion cache hits %zu misses %zu, "
+		"prompt executions %zu hits %zu, jobs started %zu active %zd",
+		ktpd->rx.msgs, ktpd->rx.inplace, ktpd->rx.linearized,
+		kcompl_hits(compl), kcompl_misses(compl),
+		ktpd->prompt_execs, ktpd->prompt_hits,
+		ktpd->jobs_started, ksession_jobs_len(ktpd->session));
+	if (ktpd->audit) {
+		str = faux_str_sprintf(", audit records %zu dropped %zu flushes %zu",
+			kaudit_records(ktpd->audit), kaudit_dropped(ktpd->audit),
+			kaudit_flushes(ktpd->audit));
+		faux_str_cat(&stats, str);
+		faux_str_free(str);
+	}
+	if (ktpd->ocache) {
+		str = faux_str_sprintf(", output cache hits %zu misses %zu coalesced %zu",
+			kocache_hits(ktpd->ocache), kocache_misses(ktpd->ocache),
+			kocache_coalesced(ktpd->ocache));
+		faux_str_cat(&stats, str);
+		faux_str_free(str);
+	}
+	if (ktpd->rec) {
+		str = faux_str_sprintf(", recorded KTP messages %zu",
+			ktp_rec_records(ktpd->rec));
+		faux_str_cat(&stats, str);
+		faux_str_free(str);
+	}
+	if (ktpd->slow) {
+		str = faux_str_sprintf(", slow log records %zu",
+			kslow_records(ktpd->slow));
+		faux_str_cat(&stats, str);
+		faux_str_free(str);
+	}
+	if (ktpd->trace) {
+		str = faux_str_sprintf(", trace events %zu dropped %zu",
+			ktrace_len(ktpd->trace), ktrace_dropped(ktpd->trace));
+		faux_str_cat(&stats, str);
+		faux_str_free(str);
+	}
+	syslog(LOG_DEBUG, "%s", stats);
+	faux_str_free(stats);
+}
+
+
 void ktpd_session_free(ktpd_session_t *ktpd)
 {
 	kcontext_t *context = NULL;
 	kscheme_t *scheme = NULL;
+	ksession_jobs_node_t *iter = NULL;
+	kjob_t *job = NULL;
 
 	if (!ktpd)
 		return;
@@ -141,16 +373,66 @@ void ktpd_session_free(ktpd_session_t *ktpd)
 		kcontext_free(context);
 	}
 
+	// Background jobs don't survive the session. Like a shell sends
+	// SIGHUP to jobs on exit.
+	iter = ksession_jobs_iter(ktpd->session);
+	while ((job = ksession_jobs_each(&iter))) {
+		if (!kjob_done(job))
+			kexec_kill(kjob_exec(job), SIGHUP);
+	}
+
+	if (ktpd->audit) {
+		faux_eloop_del_sched(ktpd->eloop, KTPD_AUDIT_SCHED_ID);
+		kaudit_flush(ktpd->audit);
+	}
+
+	if (ktpd->ocache) {
+		if (ktpd->ocache_wait)
+			faux_eloop_del_sched(ktpd->eloop, KTPD_OCACHE_SCHED_ID);
+		// Other sessions must not wait for this one
+		ktpd_ocache_end(ktpd, -1);
+	}
+
+	ktpd_session_log_stats(ktpd);
+
+	if (ktpd->audit) {
+		ksession_set_audit(ktpd->session, NULL);
+		kaudit_free(ktpd->audit);
+	}
+
+	if (ktpd->metrics)
+		ksession_set_metrics(ktpd->session, NULL);
+
+	if (ktpd->rec)
+		ktp_rec_free(ktpd->rec);
+
+	if (ktpd->slow) {
+		ksession_set_slow(ktpd->session, NULL);
+		kslow_free(ktpd->slow);
+	}
+
+	if (ktpd->trace) {
+		ksession_set_trace(ktpd->session, NULL);
+		ktrace_free(ktpd->trace);
+		faux_str_free(ktpd->trace_path);
+		faux_str_free(ktpd->trace_line);
+	}
+
+	ktpd_hint_cancel(ktpd);
+	faux_str_free(ktpd->prompt);
+	kpath_free(ktpd->prompt_path);
+	faux_str_free(ktpd->cmd_id);
+	faux_list_free(ktpd->batch);
 	kexec_free(ktpd->exec);
 	ksession_free(ktpd->session);
-	faux_free(ktpd->hdr);
+	ktp_rx_fini(&ktpd->rx);
 	close(ktpd_session_fd(ktpd));
 	faux_async_free(ktpd->async);
 	faux_free(ktpd);
 }
 
 
-static char *generate_prompt(ktpd_session_t *ktpd)
+static char *render_prompt(ktpd_session_t *ktpd)
 {
 	kpath_levels_node_t *iter = NULL;
 	klevel_t *level = NULL;
@@ -169,6 +451,7 @@ static char *generate_prompt(ktpd_session_t *ktpd)
 			int rc = -1;
 			bool_t res = BOOL_FALSE;
 
+			ktpd->prompt_execs++;
 			res = ksession_exec_locally(ktpd->session,
 				prompt_entry, NULL, NULL, NULL, &rc, &prompt);
 			if (!res || (rc != 0) || !prompt) {
@@ -191,6 +474,93 @@ static char *generate_prompt(ktpd_session_t *ktpd)
 }
 
 
+// Gets PROMPT entry of the deepest level that has prompt
+static const kentry_t *find_prompt_entry(ktpd_session_t *ktpd)
+{
+	kpath_levels_node_t *iter = NULL;
+	klevel_t *level = NULL;
+
+	iter = kpath_iterr(ksession_path(ktpd->session));
+	while ((level = kpath_eachr(&iter))) {
+		const kentry_t *prompt_entry = kentry_nested_by_purpose(
+			klevel_entry(level), KENTRY_PURPOSE_PROMPT);
+		if (prompt_entry)
+			return prompt_entry;
+	}
+
+	return NULL;
+}
+
+
+static void drop_prompt(ktpd_session_t *ktpd)
+{
+	faux_str_free(ktpd->prompt);
+	ktpd->prompt = NULL;
+	ktpd->prompt_entry = NULL;
+	kpath_free(ktpd->prompt_path);
+	ktpd->prompt_path = NULL;
+}
+
+
+/** @brief Generates prompt.
+ *
+ * The PROMPT entry can be executed every time (default) or the result can
+ * be cached according to 'cache' attribute of PROMPT. The "path" policy
+ * means the prompt is regenerated when the path is changed. The "static"
+ * policy means the prompt is generated once for each PROMPT entry. The
+ * ACTION can force prompt regeneration by ksession_set_prompt_expired().
+ */
+static char *generate_prompt(ktpd_session_t *ktpd)
+{
+	const kentry_t *prompt_entry = NULL;
+	kpath_t *path = ksession_path(ktpd->session);
+	kentry_cache_e policy = KENTRY_CACHE_ALWAYS;
+	bool_t valid = BOOL_FALSE;
+	char *prompt = NULL;
+	uint64_t start = 0;
+
+	if (ksession_prompt_expired(ktpd->session)) {
+		drop_prompt(ktpd);
+		ksession_set_prompt_expired(ktpd->session, BOOL_FALSE);
+	}
+
+	prompt_entry = find_prompt_entry(ktpd);
+	if (prompt_entry)
+		policy = kentry_cache_policy(prompt_entry);
+
+	if (ktpd->prompt && (ktpd->prompt_entry == prompt_entry)) {
+		switch (policy) {
+		case KENTRY_CACHE_STATIC:
+			valid = BOOL_TRUE;
+			break;
+		case KENTRY_CACHE_PATH:
+			valid = kpath_is_equal(ktpd->prompt_path, path);
+			break;
+		default:
+			break;
+		}
+	}
+	if (valid) {
+		ktpd->prompt_hits++;
+		return faux_str_dup(ktpd->prompt);
+	}
+
+	drop_prompt(ktpd);
+	start = ktrace_now(ktpd->trace);
+	prompt = render_prompt(ktpd);
+	ktrace_span(ktpd->trace, "generate_prompt", NULL, start);
+	if (!prompt || (KENTRY_CACHE_ALWAYS == policy))
+		return prompt;
+
+	ktpd->prompt = faux_str_dup(prompt);
+	ktpd->prompt_entry = prompt_entry;
+	if (KENTRY_CACHE_PATH == policy)
+		ktpd->prompt_path = kpath_clone(path);
+
+	return prompt;
+}
+
+
 // Format: <key>'\0'<cmd>
 static bool_t add_hotkey(faux_msg_t *msg, khotkey_t *hotkey)
 {
@@ -216,6 +586,25 @@ static bool_t add_hotkey(faux_msg_t *msg, khotkey_t *hotkey)
 }
 
 
+/** @brief Adds hint cache token to message.
+ *
+ * Client can cache completion and help answers that have the same token as
+ * the last CMD_ACK. The token changes after each command because command
+ * can change the path or anything that completions depend on. The PID
+ * distinguishes service processes (and schemes they loaded).
+ */
+static bool_t add_token_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	char *token = NULL;
+
+	token = faux_str_sprintf("%x.%zx", getpid(), ktpd->generation);
+	faux_msg_add_param(msg, KTP_PARAM_TOKEN, token, strlen(token));
+	faux_str_free(token);
+
+	return BOOL_TRUE;
+}
+
+
 static bool_t add_hotkeys_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg)
 {
 	faux_list_t *list = NULL;
@@ -252,7 +641,9 @@ static bool_t add_hotkeys_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg)
 		}
 	}
 
-	// Add found hotkeys to msg
+	// Add found hotkeys to msg. VIEW without hotkeys has no list at all.
+	if (!list)
+		return BOOL_TRUE;
 	l_iter = faux_list_head(list);
 	while ((hotkey = (khotkey_t *)faux_list_each(&l_iter)))
 		add_hotkey(msg, hotkey);
@@ -264,6 +655,140 @@ static bool_t add_hotkeys_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg)
 }
 
 
+static bool_t add_job_to_msg(faux_msg_t *msg, unsigned int job_id)
+{
+	char *str = NULL;
+
+	if (0 == job_id)
+		return BOOL_TRUE;
+
+	str = faux_str_sprintf("%u", job_id);
+	faux_msg_add_param(msg, KTP_PARAM_JOB, str, strlen(str));
+	faux_str_free(str);
+
+	return BOOL_TRUE;
+}
+
+
+// Stores span of whole command from request to acknowledgement
+static void ktpd_trace_cmd_done(ktpd_session_t *ktpd)
+{
+	if (!ktpd->trace)
+		return;
+
+	ktrace_span(ktpd->trace, "command", ktpd->trace_line,
+		ktpd->trace_started);
+	faux_str_free(ktpd->trace_line);
+	ktpd->trace_line = NULL;
+}
+
+
+// Current path as "<view>/<nested view>..."
+static char *ktpd_path_str(ktpd_session_t *ktpd)
+{
+	kpath_levels_node_t *iter = NULL;
+	klevel_t *level = NULL;
+	char *str = NULL;
+
+	iter = kpath_iter(ksession_path(ktpd->session));
+	while ((level = kpath_each(&iter))) {
+		if (str)
+			faux_str_cat(&str, "/");
+		faux_str_cat(&str, kentry_name(klevel_entry(level)));
+	}
+
+	return str;
+}
+
+
+/** @brief Finishes slow log accounting of request.
+ *
+ * If request is slow and latency trace is enabled then trace is captured
+ * automatically. Each slow request gets its own trace file that contains
+ * events of this request only. The number of captured traces is limited
+ * per session so repeated slow requests (like Tab pressing) can't fill the
+ * disk.
+ */
+static void ktpd_slow_done(ktpd_session_t *ktpd)
+{
+	char *trace_path = NULL;
+	char *path = NULL;
+
+	if (!kslow_exceeded(ktpd->slow)) {
+		kslow_cancel(ktpd->slow);
+		return;
+	}
+
+	if (ktpd->trace && (ktpd->slow_traces < KTPD_SLOW_TRACES_MAX)) {
+		ktpd->slow_traces++;
+		trace_path = faux_str_sprintf("%s.slow-%zu",
+			ktpd->trace_path, ktpd->slow_traces);
+		if (!ktrace_dump(ktpd->trace, trace_path,
+			kslow_started(ktpd->slow))) {
+			faux_str_free(trace_path);
+			trace_path = NULL;
+		}
+	}
+	path = ktpd_path_str(ktpd);
+	kslow_end(ktpd->slow, ksession_uid(ktpd->session),
+		ksession_user(ktpd->session), path, trace_path);
+	faux_str_free(path);
+	faux_str_free(trace_path);
+}
+
+
+static bool_t add_id_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	if (!ktpd->cmd_id)
+		return BOOL_TRUE;
+
+	faux_msg_add_param(msg, KTP_PARAM_ID,
+		ktpd->cmd_id, strlen(ktpd->cmd_id));
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Adds session state to CMD_ACK message.
+ *
+ * Regular session gets prompt, hint cache token and hotkeys (if VIEW was
+ * changed). Machine session doesn't need any of them. It gets request ID and
+ * command execution time instead.
+ */
+static bool_t add_cmd_info_to_msg(ktpd_session_t *ktpd, faux_msg_t *msg,
+	bool_t view_was_changed)
+{
+	char *prompt = NULL;
+
+	if (ktpd->machine) {
+		struct timespec now = {};
+		unsigned long long usec = 0;
+		char *duration = NULL;
+
+		add_id_to_msg(ktpd, msg);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		usec = (now.tv_sec - ktpd->cmd_started.tv_sec) * 1000000ULL +
+			(now.tv_nsec - ktpd->cmd_started.tv_nsec) / 1000;
+		duration = faux_str_sprintf("%llu", usec);
+		faux_msg_add_param(msg, KTP_PARAM_DURATION,
+			duration, strlen(duration));
+		faux_str_free(duration);
+		return BOOL_TRUE;
+	}
+
+	prompt = generate_prompt(ktpd);
+	if (prompt) {
+		faux_msg_add_param(msg, KTP_PARAM_PROMPT, prompt, strlen(prompt));
+		faux_str_free(prompt);
+	}
+	add_token_to_msg(ktpd, msg);
+	if (view_was_changed)
+		add_hotkeys_to_msg(ktpd, msg);
+
+	return BOOL_TRUE;
+}
+
+
 // Now it's not really an auth function. Just a hand-shake with client and
 // passing prompt to client.
 static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
@@ -291,7 +816,7 @@ static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
 		syslog(LOG_ERR, "%s for connection %d", err, sock);
 		ack = ktp_msg_preform(cmd, KTP_STATUS_ERROR | KTP_STATUS_EXIT);
 		faux_msg_add_param(ack, KTP_PARAM_ERROR, err, strlen(err));
-		faux_msg_send_async(ack, ktpd->async);
+		ktpd_send(ktpd, ack);
 		faux_msg_free(ack);
 		ktpd->exit = BOOL_TRUE;
 		return BOOL_FALSE;
@@ -312,6 +837,15 @@ static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
 		KTP_STATUS_IS_TTY_STDOUT(client_status));
 	ksession_set_isatty_stderr(ktpd->session,
 		KTP_STATUS_IS_TTY_STDERR(client_status));
+	// Machine session. Confirm it to client by the same flag. Machine
+	// session never uses terminal.
+	if (KTP_STATUS_IS_MACHINE(client_status)) {
+		ktpd->machine = BOOL_TRUE;
+		status |= KTP_STATUS_MACHINE;
+		ksession_set_isatty_stdin(ktpd->session, BOOL_FALSE);
+		ksession_set_isatty_stdout(ktpd->session, BOOL_FALSE);
+		ksession_set_isatty_stderr(ktpd->session, BOOL_FALSE);
+	}
 
 	// init session for plugins
 	scheme = ksession_scheme(ktpd->session);
@@ -324,14 +858,18 @@ static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
 	// Prepare ACK message
 	ack = ktp_msg_preform(cmd, status);
 	faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
-	// Generate prompt
-	prompt = generate_prompt(ktpd);
-	if (prompt) {
-		faux_msg_add_param(ack, KTP_PARAM_PROMPT, prompt, strlen(prompt));
-		faux_str_free(prompt);
+	if (!ktpd->machine) {
+		// Generate prompt
+		prompt = generate_prompt(ktpd);
+		if (prompt) {
+			faux_msg_add_param(ack, KTP_PARAM_PROMPT,
+				prompt, strlen(prompt));
+			faux_str_free(prompt);
+		}
+		add_token_to_msg(ktpd, ack);
+		add_hotkeys_to_msg(ktpd, ack);
 	}
-	add_hotkeys_to_msg(ktpd, ack);
-	faux_msg_send_async(ack, ktpd->async);
+	ktpd_send(ktpd, ack);
 	faux_msg_free(ack);
 
 	ktpd->state = KTPD_SESSION_STATE_IDLE;
@@ -340,9 +878,61 @@ static bool_t ktpd_session_process_auth(ktpd_session_t *ktpd, faux_msg_t *msg)
 }
 
 
-static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
+/** @brief Checks if command line has background suffix.
+ *
+ * The suffix is a "&" at the end of line. It must be separated from the
+ * command by space. The quoted "&" is an argument but not a suffix.
+ *
+ * @param [in] line Command line.
+ * @return Line without suffix (must be freed) or NULL if there is no suffix.
+ */
+static char *ktpd_background_line(const char *line)
+{
+	size_t len = 0;
+	size_t i = 0;
+	bool_t quoted = BOOL_FALSE;
+
+	if (!line)
+		return NULL;
+
+	len = strlen(line);
+	while ((len > 0) && isspace((unsigned char)line[len - 1]))
+		len--;
+	if ((len < 2) || (line[len - 1] != '&') ||
+		!isspace((unsigned char)line[len - 2]))
+		return NULL;
+	len--;
+	for (i = 0; i < len; i++) {
+		if (('\\' == line[i]) && (i + 1 < len)) {
+			i++;
+			continue;
+		}
+		if ('"' == line[i])
+			quoted = !quoted;
+	}
+	if (quoted)
+		return NULL;
+	while ((len > 0) && isspace((unsigned char)line[len - 1]))
+		len--;
+
+	return faux_str_dupn(line, len);
+}
+
+
+/** @brief Executes command line and sends KTP_CMD_ACK to client.
+ *
+ * It's used for single command (KTP_CMD) and for each command of batch
+ * (KTP_CMD_BATCH).
+ *
+ * @param [in] ktpd KTPD session.
+ * @param [in] line Command line.
+ * @param [in] req_status Status field of request message.
+ * @param [out] retcode_p Retcode of command if it's already known.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+static bool_t ktpd_session_cmd_line(ktpd_session_t *ktpd, const char *line,
+	uint32_t req_status, int *retcode_p)
 {
-	char *line = NULL;
 	int retcode = -1;
 	ktp_cmd_e cmd = KTP_CMD_ACK;
 	faux_error_t *error = NULL;
@@ -350,45 +940,53 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 	bool_t dry_run = BOOL_FALSE;
 	uint32_t status = KTP_STATUS_NONE;
 	bool_t ret = BOOL_TRUE;
-	char *prompt = NULL;
 	bool_t view_was_changed = BOOL_FALSE;
 	faux_msg_t *ack = NULL;
+	char *bg_line = NULL;
 
 	assert(ktpd);
-	assert(msg);
 
-	// Get line from message
-	line = faux_msg_get_str_param_by_type(msg, KTP_PARAM_LINE);
+	if (retcode_p)
+		*retcode_p = -1;
+	clock_gettime(CLOCK_MONOTONIC, &ktpd->cmd_started);
+	kslow_begin(ktpd->slow, KSLOW_CMD, line);
+	if (ktpd->trace) {
+		ktpd->trace_started = ktrace_now(ktpd->trace);
+		faux_str_free(ktpd->trace_line);
+		ktpd->trace_line = faux_str_dup(line);
+	}
+
 	if (!faux_str_has_content(line)) {
-		faux_str_free(line);
+		if (retcode_p)
+			*retcode_p = 0;
 		// Line is not specified. User sent empty command.
 		// It's not bug. Send OK to user and regenerate prompt
 		ack = ktp_msg_preform(cmd, KTP_STATUS_NONE);
-		// Generate prompt
-		prompt = generate_prompt(ktpd);
-		if (prompt) {
-			faux_msg_add_param(ack, KTP_PARAM_PROMPT, prompt, strlen(prompt));
-			faux_str_free(prompt);
-		}
-		faux_msg_send_async(ack, ktpd->async);
+		add_cmd_info_to_msg(ktpd, ack, BOOL_FALSE);
+		ktpd_trace_cmd_done(ktpd);
+		ktpd_slow_done(ktpd);
+		ktpd_send(ktpd, ack);
 		faux_msg_free(ack);
 		return BOOL_TRUE;
 	}
 
 	// Get dry-run flag from message
-	if (KTP_STATUS_IS_DRY_RUN(faux_msg_get_status(msg)))
+	if (KTP_STATUS_IS_DRY_RUN(req_status))
 		dry_run = BOOL_TRUE;
 
 	error = faux_error_new();
 
+	// Command with "&" suffix is executed in background
+	bg_line = ktpd_background_line(line);
 	ktpd->exec = NULL;
-	rc = ktpd_session_exec(ktpd, line, &retcode, error,
-		dry_run, &view_was_changed);
-	faux_str_free(line);
+	rc = ktpd_session_exec(ktpd, bg_line ? bg_line : line, &retcode, error,
+		dry_run, &view_was_changed, bg_line ? BOOL_TRUE : BOOL_FALSE);
+	faux_str_free(bg_line);
 
 	// Command is scheduled. Eloop will wait for ACTION completion.
 	// So inform client about it and about command features like
-	// interactive/non-interactive.
+	// interactive/non-interactive. Machine session doesn't send stdin
+	// and doesn't need a terminal so it doesn't need this message.
 	if (ktpd->exec) {
 		faux_msg_t *ack = NULL;
 		ktp_status_e status = KTP_STATUS_INCOMPLETED;
@@ -396,9 +994,11 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 			status |= KTP_STATUS_INTERACTIVE;
 		if (kexec_need_stdin(ktpd->exec))
 			status |= KTP_STATUS_NEED_STDIN;
-		ack = ktp_msg_preform(cmd, status);
-		faux_msg_send_async(ack, ktpd->async);
-		faux_msg_free(ack);
+		if (!ktpd->machine) {
+			ack = ktp_msg_preform(cmd, status);
+			ktpd_send(ktpd, ack);
+			faux_msg_free(ack);
+		}
 		faux_error_free(error);
 		return BOOL_TRUE; // Continue and wait for ACTION
 	}
@@ -413,6 +1013,8 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 	ack = ktp_msg_preform(cmd, status);
 	if (rc) {
 		uint8_t retcode8bit = 0;
+		if (retcode_p)
+			*retcode_p = retcode;
 		retcode8bit = (uint8_t)(retcode & 0xff);
 		faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
 	} else {
@@ -422,16 +1024,10 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 		faux_str_free(err);
 		ret = BOOL_FALSE;
 	}
-	// Generate prompt
-	prompt = generate_prompt(ktpd);
-	if (prompt) {
-		faux_msg_add_param(ack, KTP_PARAM_PROMPT, prompt, strlen(prompt));
-		faux_str_free(prompt);
-	}
-	// Add hotkeys
-	if (view_was_changed)
-		add_hotkeys_to_msg(ktpd, ack);
-	faux_msg_send_async(ack, ktpd->async);
+	add_cmd_info_to_msg(ktpd, ack, view_was_changed);
+	ktpd_trace_cmd_done(ktpd);
+	ktpd_slow_done(ktpd);
+	ktpd_send(ktpd, ack);
 	faux_msg_free(ack);
 
 	faux_error_free(error);
@@ -440,59 +1036,357 @@ static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 }
 
 
-static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
-	int *retcode, faux_error_t *error,
-	bool_t dry_run, bool_t *view_was_changed_p)
+static bool_t ktpd_session_process_cmd(ktpd_session_t *ktpd, faux_msg_t *msg)
 {
-	kexec_t *exec = NULL;
+	char *line = NULL;
+	bool_t ret = BOOL_FALSE;
 
 	assert(ktpd);
-	if (!ktpd)
-		return BOOL_FALSE;
+	assert(msg);
 
-	// Parsing
-	exec = ksession_parse_for_exec(ktpd->session, line, error);
-	if (!exec)
-		return BOOL_FALSE;
+	// Single command breaks dropping of aborted batch
+	ktpd->batch_aborted = BOOL_FALSE;
+	// Client doesn't wait for completion or help any more
+	ktpd_hint_cancel(ktpd);
 
-	// Set dry-run flag
-	kexec_set_dry_run(exec, dry_run);
+	faux_str_free(ktpd->cmd_id);
+	ktpd->cmd_id = faux_msg_get_str_param_by_type(msg, KTP_PARAM_ID);
 
-	// Session status can be changed while parsing
-// NOTE: kexec_t is atomic now
-//	if (ksession_done(ktpd->session)) {
-//		kexec_free(exec);
-//		return BOOL_FALSE; // Because action is not completed
-//	}
+	// Get line from message
+	line = faux_msg_get_str_param_by_type(msg, KTP_PARAM_LINE);
+	ret = ktpd_session_cmd_line(ktpd, line, faux_msg_get_status(msg), NULL);
+	faux_str_free(line);
 
-	// Execute kexec and then wait for completion using global Eloop
-	if (!kexec_exec(exec)) {
-		kexec_free(exec);
-		return BOOL_FALSE; // Something went wrong
-	}
-	// If kexec contains only non-exec (for example dry-run) ACTIONs then
-	// we don't need event loop and can return here.
-	if (kexec_retcode(exec, retcode)) {
-		if (view_was_changed_p)
-			*view_was_changed_p = !kpath_is_equal(
-				ksession_path(ktpd->session),
-				kexec_saved_path(exec));
-		// 'Silent' sym can write directly to stdout/stderr buffer
-		get_stream(ktpd, exec, -1, BOOL_FALSE, BOOL_TRUE);
-		get_stream(ktpd, exec, -1, BOOL_TRUE, BOOL_TRUE);
-		ktpd_session_log(ktpd, exec);
+	return ret;
+}
+
+
+/** @brief Queues commands of KTP_CMD_BATCH request.
+ *
+ * Each KTP_PARAM_LINE parameter is a separate command. Commands are executed
+ * sequentially and each one is acknowledged by its own KTP_CMD_ACK. So
+ * client can send next batch before previous one is completed (pipelining).
+ * If request has KTP_STATUS_STOP_ON_ERROR flag then the failed command drops
+ * the rest of queue. Client is informed by KTP_CMD_BATCH_ACK with error
+ * status. The stop-on-error batches received after that (they can be already
+ * sent by client) are dropped too until single command or batch without
+ * stop-on-error flag is received.
+ *
+ * The KTP_PARAM_ID parameter before KTP_PARAM_LINE is an ID of request. It's
+ * returned within all answers for this command (machine session).
+ */
+static bool_t ktpd_session_process_batch(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	faux_list_node_t *iter = NULL;
+	uint32_t param_len = 0;
+	char *param_data = NULL;
+	uint16_t param_type = 0;
+	uint32_t status = KTP_STATUS_NONE;
+	char *id = NULL;
+
+	assert(ktpd);
+	assert(msg);
+
+	status = faux_msg_get_status(msg);
+	if (ktpd->batch_aborted) {
+		if (KTP_STATUS_IS_STOP_ON_ERROR(status))
+			return BOOL_TRUE;
+		ktpd->batch_aborted = BOOL_FALSE;
+	}
+
+	iter = faux_msg_init_param_iter(msg);
+	while (faux_msg_get_param_each(&iter, &param_type,
+		(void **)&param_data, &param_len)) {
+		ktpd_batch_cmd_t *bcmd = NULL;
+		if (KTP_PARAM_ID == param_type) {
+			faux_str_free(id);
+			id = faux_str_dupn(param_data, param_len);
+			continue;
+		}
+		if (KTP_PARAM_LINE != param_type)
+			continue;
+		bcmd = faux_zmalloc(sizeof(*bcmd));
+		assert(bcmd);
+		bcmd->id = id;
+		id = NULL;
+		bcmd->line = faux_str_dupn(param_data, param_len);
+		bcmd->status = status;
+		faux_list_add(ktpd->batch, bcmd);
+	}
+	faux_str_free(id);
+
+	return ktpd_session_batch_run(ktpd);
+}
+
+
+/** @brief Executes queued batched commands.
+ *
+ * The command that needs event loop (really executed ACTIONs) breaks the
+ * loop. The wait_for_actions_ev() continues batch processing when command
+ * is completed.
+ */
+static bool_t ktpd_session_batch_run(ktpd_session_t *ktpd)
+{
+	faux_list_node_t *node = NULL;
+
+	assert(ktpd);
+
+	while ((KTPD_SESSION_STATE_IDLE == ktpd->state) && !ktpd->exit &&
+		(node = faux_list_head(ktpd->batch))) {
+		ktpd_batch_cmd_t *bcmd = (ktpd_batch_cmd_t *)faux_list_data(node);
+		int retcode = -1;
+		bool_t rc = BOOL_FALSE;
+
+		ktpd->batch_running = BOOL_TRUE;
+		ktpd->batch_status = bcmd->status;
+		faux_str_free(ktpd->cmd_id);
+		ktpd->cmd_id = bcmd->id;
+		bcmd->id = NULL;
+		rc = ktpd_session_cmd_line(ktpd, bcmd->line, bcmd->status,
+			&retcode);
+		faux_list_del(ktpd->batch, node);
+		// Command is scheduled. Wait for completion.
+		if (ktpd->exec)
+			return BOOL_TRUE;
+		ktpd_session_batch_done(ktpd, rc && (0 == retcode));
+	}
+
+	// Session is going to exit so the rest of commands are useless
+	if (ktpd->exit)
+		faux_list_del_all(ktpd->batch);
+
+	return BOOL_TRUE;
+}
+
+
+static void ktpd_session_batch_done(ktpd_session_t *ktpd, bool_t ok)
+{
+	faux_msg_t *ack = NULL;
+
+	assert(ktpd);
+
+	if (!ktpd->batch_running)
+		return;
+	ktpd->batch_running = BOOL_FALSE;
+	if (ok || !KTP_STATUS_IS_STOP_ON_ERROR(ktpd->batch_status))
+		return;
+
+	// Stop-on-error
+	faux_list_del_all(ktpd->batch);
+	ktpd->batch_aborted = BOOL_TRUE;
+	ack = ktp_msg_preform(KTP_CMD_BATCH_ACK, KTP_STATUS_ERROR);
+	ktpd_send(ktpd, ack);
+	faux_msg_free(ack);
+}
+
+
+// The command served from cache is not executed but it's logged, audited and
+// accounted by metrics like executed one.
+static void ktpd_ocache_log(ktpd_session_t *ktpd, kexec_t *exec, int retcode)
+{
+	kexec_contexts_node_t *iter = NULL;
+	kcontext_t *context = NULL;
+
+	iter = kexec_contexts_iter(exec);
+	while ((context = kexec_contexts_each(&iter)))
+		kcontext_set_retcode(context, retcode);
+	ktpd_session_log(ktpd, exec);
+}
+
+
+/** @brief Checks shared output cache for command's output.
+ *
+ * Only single (not pipelined) non-interactive COMMAND with non-zero
+ * 'cache' attribute is cacheable. The cached output is sent to client
+ * immediately. On cache miss the output of command is stored while
+ * command is executing (see get_stream()) and is put to cache when command
+ * is completed successfully.
+ *
+ * @param [in] ktpd KTPD session.
+ * @param [in] exec Parsed command.
+ * @param [out] retcode Retcode of cached command.
+ * @return KOCACHE_HIT, KOCACHE_MISS or KOCACHE_PENDING.
+ */
+static kocache_e ktpd_ocache_begin(ktpd_session_t *ktpd, kexec_t *exec,
+	int *retcode)
+{
+	kcontext_t *context = NULL;
+	const kentry_t *entry = NULL;
+	char *key = NULL;
+	char *out = NULL;
+	size_t out_len = 0;
+	kocache_e cached = KOCACHE_MISS;
+
+	if (!ktpd->ocache)
+		return KOCACHE_MISS;
+	if (kexec_contexts_len(exec) != 1)
+		return KOCACHE_MISS;
+	if (kexec_interactive(exec) || kexec_need_stdin(exec))
+		return KOCACHE_MISS;
+	context = (kcontext_t *)faux_list_data(kexec_contexts_iter(exec));
+	entry = kcontext_command(context);
+	if (!entry || (kentry_cache(entry) == 0))
+		return KOCACHE_MISS;
+
+	key = kocache_key(entry, kcontext_pargv(context),
+		ksession_uid(ktpd->session));
+	cached = kocache_get(ktpd->ocache, key, &out, &out_len, retcode);
+	if (KOCACHE_HIT == cached) {
+		if (out_len > 0)
+			send_stream(ktpd, BOOL_FALSE, out, out_len);
+		faux_free(out);
+		faux_str_free(key);
+		return KOCACHE_HIT;
+	}
+
+	faux_str_free(ktpd->ocache_key);
+	ktpd->ocache_key = key;
+	ktpd->ocache_ttl = kentry_cache(entry);
+	ktpd->ocache_fail = BOOL_FALSE;
+
+	return cached;
+}
+
+
+/** @brief Puts stored output of completed command to cache.
+ *
+ * Output is not cached if command has failed or has written to stderr.
+ * The reserved slot is released then so other sessions don't wait.
+ */
+static void ktpd_ocache_end(ktpd_session_t *ktpd, int retcode)
+{
+	if (!ktpd->ocache_key)
+		return;
+
+	if (!ktpd->ocache_fail && (0 == retcode))
+		kocache_put(ktpd->ocache, ktpd->ocache_key, ktpd->ocache_out,
+			ktpd->ocache_len, retcode, ktpd->ocache_ttl);
+	else
+		kocache_abort(ktpd->ocache, ktpd->ocache_key);
+
+	faux_str_free(ktpd->ocache_key);
+	ktpd->ocache_key = NULL;
+	faux_free(ktpd->ocache_out);
+	ktpd->ocache_out = NULL;
+	ktpd->ocache_len = 0;
+	ktpd->ocache_fail = BOOL_FALSE;
+}
+
+
+// Stores chunk of command's stdout to put it to cache later
+static void ktpd_ocache_record(ktpd_session_t *ktpd, const char *buf,
+	size_t len)
+{
+	char *out = NULL;
+
+	if (!ktpd->ocache_key || ktpd->ocache_fail)
+		return;
+
+	// Too long output can't be cached
+	if ((strlen(ktpd->ocache_key) + ktpd->ocache_len + len) >
+		kocache_max_len(ktpd->ocache)) {
+		ktpd->ocache_fail = BOOL_TRUE;
+		return;
+	}
+	out = realloc(ktpd->ocache_out, ktpd->ocache_len + len);
+	assert(out);
+	memcpy(out + ktpd->ocache_len, buf, len);
+	ktpd->ocache_out = out;
+	ktpd->ocache_len += len;
+}
+
+
+static void ktpd_ocache_schedule(ktpd_session_t *ktpd)
+{
+	struct timespec delay = {};
+
+	delay.tv_nsec = KTPD_OCACHE_POLL_NSEC;
+	faux_eloop_add_sched_once_delayed(ktpd->eloop, &delay,
+		KTPD_OCACHE_SCHED_ID, ocache_wait_ev, ktpd);
+	ktpd->ocache_wait = BOOL_TRUE;
+}
+
+
+/** @brief Checks if another session has completed the same command.
+ *
+ * If another session has died or its output is not cacheable then this
+ * session executes command itself.
+ */
+static bool_t ocache_wait_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+	kexec_t *exec = ktpd->exec;
+	int retcode = -1;
+	char *out = NULL;
+	size_t out_len = 0;
+	kocache_e cached = KOCACHE_MISS;
+	bool_t rc = BOOL_FALSE;
+	bool_t view_was_changed = BOOL_FALSE;
+	faux_error_t *error = NULL;
+
+	ktpd->ocache_wait = BOOL_FALSE;
+	if (!exec)
+		return BOOL_TRUE;
+
+	cached = kocache_get(ktpd->ocache, ktpd->ocache_key,
+		&out, &out_len, &retcode);
+	if (KOCACHE_PENDING == cached) {
+		ktpd_ocache_schedule(ktpd);
+		return BOOL_TRUE;
+	}
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	if (KOCACHE_HIT == cached) {
+		if (out_len > 0)
+			send_stream(ktpd, BOOL_FALSE, out, out_len);
+		faux_free(out);
+		faux_str_free(ktpd->ocache_key);
+		ktpd->ocache_key = NULL;
+		ktpd_ocache_log(ktpd, exec, retcode);
 		kexec_free(exec);
+		ktpd->exec = NULL;
+		ktpd->state = KTPD_SESSION_STATE_IDLE;
+		return ktpd_session_cmd_done(ktpd, retcode, NULL, BOOL_FALSE);
+	}
+
+	// Slot is reserved for this session now. Execute command itself.
+	ktpd->exec = NULL;
+	ktpd->state = KTPD_SESSION_STATE_IDLE;
+	error = faux_error_new();
+	if (!ktpd_session_run(ktpd, exec, &retcode, &view_was_changed,
+		BOOL_FALSE))
+		faux_error_add(error, "Can't execute command");
+	if (ktpd->exec) { // Wait for ACTIONs
+		faux_error_free(error);
 		return BOOL_TRUE;
 	}
+	rc = ktpd_session_cmd_done(ktpd, retcode, error, view_was_changed);
+	faux_error_free(error);
+
+	return rc;
+}
+
 
+/** @brief Starts waiting for command completion.
+ *
+ * Command becomes current one. Its streams are polled by event loop.
+ */
+static bool_t ktpd_session_set_exec(ktpd_session_t *ktpd, kexec_t *exec)
+{
 	// Save kexec pointer to use later
 	ktpd->state = KTPD_SESSION_STATE_WAIT_FOR_PROCESS;
 	ktpd->exec = exec;
 
 	// Set stdin, stdout, stderr handlers. It's so complex because stdin,
-	// stdout and stderr actually can be the same fd
-	faux_eloop_add_fd(ktpd->eloop, kexec_stdin(exec), 0,
-		action_stdout_ev, ktpd);
+	// stdout and stderr actually can be the same fd. Stdin of machine
+	// session is already closed.
+	if (kexec_stdin(exec) >= 0)
+		faux_eloop_add_fd(ktpd->eloop, kexec_stdin(exec), 0,
+			action_stdout_ev, ktpd);
 	faux_eloop_add_fd(ktpd->eloop, kexec_stdout(exec), 0,
 		action_stdout_ev, ktpd);
 	faux_eloop_add_fd(ktpd->eloop, kexec_stderr(exec), 0,
@@ -504,431 +1398,1315 @@ static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
 }
 
 
-static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
-	void *associated_data, void *user_data)
+/** @brief Moves just started command to background.
+ *
+ * The job's output is stored within kexec's buffers until user brings job
+ * to foreground. The job's stdin is not polled so job that reads stdin
+ * will wait for "fg".
+ */
+static bool_t ktpd_job_start(ktpd_session_t *ktpd, kexec_t *exec)
 {
-	int wstatus = 0;
-	pid_t child_pid = -1;
-	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
-	int retcode = -1;
-	uint8_t retcode8bit = 0;
-	faux_msg_t *ack = NULL;
-	ktp_cmd_e cmd = KTP_CMD_ACK;
-	uint32_t status = KTP_STATUS_NONE;
-	char *prompt = NULL;
-	bool_t view_was_changed = BOOL_FALSE;
+	kjob_t *job = NULL;
+	char *str = NULL;
+	faux_msg_t *msg = NULL;
+
+	job = kjob_new(ksession_free_job_id(ktpd->session), exec);
+	assert(job);
+	ksession_add_jobs(ktpd->session, job);
+	ktpd->jobs_started++;
+
+	faux_eloop_add_fd(ktpd->eloop, kexec_stdout(exec), POLLIN,
+		job_stream_ev, ktpd);
+	faux_eloop_add_fd(ktpd->eloop, kexec_stderr(exec), POLLIN,
+		job_stream_ev, ktpd);
+
+	// Inform user about job ID like a shell does
+	str = faux_str_sprintf("[%u] %s\n", kjob_id(job), kexec_line(exec));
+	msg = ktp_msg_preform(KTP_STDOUT, KTP_STATUS_NONE);
+	if (ktpd->machine)
+		add_id_to_msg(ktpd, msg);
+	add_job_to_msg(msg, kjob_id(job));
+	faux_msg_add_param(msg, KTP_PARAM_LINE, str, strlen(str));
+	ktpd_send(ktpd, msg);
+	faux_msg_free(msg);
+	faux_str_free(str);
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t ktpd_session_exec(ktpd_session_t *ktpd, const char *line,
+	int *retcode, faux_error_t *error,
+	bool_t dry_run, bool_t *view_was_changed_p, bool_t background)
+{
+	kexec_t *exec = NULL;
+	uint64_t start = 0;
+	uint64_t parse_start = 0;
 
+	assert(ktpd);
 	if (!ktpd)
 		return BOOL_FALSE;
 
-	// Wait for any child process. Doesn't block.
-	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
-		if (ktpd->exec)
-			kexec_continue_command_execution(ktpd->exec, child_pid,
-				wstatus);
+	// Cached hints are not valid after any command
+	ktpd->generation++;
+
+	if (background &&
+		(ksession_jobs_len(ktpd->session) >= KTPD_JOBS_LIMIT)) {
+		faux_error_add(error, "Too many background jobs");
+		return BOOL_FALSE;
 	}
-	if (!ktpd->exec)
+
+	// Parsing
+	start = ktrace_now(ktpd->trace);
+	parse_start = kmetrics_now(ktpd->metrics);
+	exec = ksession_parse_for_exec(ktpd->session, line, error);
+	kmetrics_observe(ktpd->metrics, KMETRICS_HIST_PARSE, parse_start);
+	ktrace_span(ktpd->trace, "parse", line, start);
+	if (!exec)
+		return BOOL_FALSE;
+
+	// Background command has no terminal so user can't interact with it
+	if (background && kexec_interactive(exec)) {
+		faux_error_add(error,
+			"Interactive command can't be executed in background");
+		kexec_free(exec);
+		return BOOL_FALSE;
+	}
+
+	// Set dry-run flag
+	kexec_set_dry_run(exec, dry_run);
+
+	// Session status can be changed while parsing
+// NOTE: kexec_t is atomic now
+//	if (ksession_done(ktpd->session)) {
+//		kexec_free(exec);
+//		return BOOL_FALSE; // Because action is not completed
+//	}
+
+	// Cached output of command
+	if (!dry_run && !background) {
+		kocache_e cached = ktpd_ocache_begin(ktpd, exec, retcode);
+		if (KOCACHE_HIT == cached) {
+			ktpd_ocache_log(ktpd, exec, *retcode);
+			kexec_free(exec);
+			return BOOL_TRUE;
+		}
+		// Another session executes the same command. Wait for it.
+		if (KOCACHE_PENDING == cached) {
+			ktpd->state = KTPD_SESSION_STATE_WAIT_FOR_PROCESS;
+			ktpd->exec = exec;
+			ktpd_ocache_schedule(ktpd);
+			return BOOL_TRUE;
+		}
+	}
+
+	return ktpd_session_run(ktpd, exec, retcode, view_was_changed_p,
+		background);
+}
+
+
+/** @brief Executes parsed command.
+ *
+ * Command is executed immediately if it contains sync ACTIONs only. Else
+ * session waits for command completion or command becomes background job.
+ */
+static bool_t ktpd_session_run(ktpd_session_t *ktpd, kexec_t *exec,
+	int *retcode, bool_t *view_was_changed_p, bool_t background)
+{
+	// Execute kexec and then wait for completion using global Eloop
+	if (!kexec_exec(exec)) {
+		ktpd_ocache_end(ktpd, -1);
+		kexec_free(exec);
+		return BOOL_FALSE; // Something went wrong
+	}
+	// Machine client never sends stdin. Action reading stdin gets EOF
+	// instead of waiting forever. Stdin is a pipe here (no terminal).
+	if (ktpd->machine && (kexec_stdin(exec) >= 0)) {
+		close(kexec_stdin(exec));
+		kexec_set_stdin(exec, -1);
+	}
+	// If kexec contains only non-exec (for example dry-run) ACTIONs then
+	// we don't need event loop and can return here.
+	if (kexec_retcode(exec, retcode)) {
+		if (view_was_changed_p)
+			*view_was_changed_p = !kpath_is_equal(
+				ksession_path(ktpd->session),
+				kexec_saved_path(exec));
+		// 'Silent' sym can write directly to stdout/stderr buffer
+		get_stream(ktpd, exec, -1, BOOL_FALSE, BOOL_TRUE);
+		get_stream(ktpd, exec, -1, BOOL_TRUE, BOOL_TRUE);
+		ktpd_ocache_end(ktpd, *retcode);
+		ktpd_session_log(ktpd, exec);
+		kexec_free(exec);
+		// The "fg" sym can request background job
+		ktpd_session_fg(ktpd, retcode);
 		return BOOL_TRUE;
+	}
 
-	// Check if kexec is done now
-	if (!kexec_retcode(ktpd->exec, &retcode))
-		return BOOL_TRUE; // Continue
+	// Background job is acknowledged immediately
+	if (background) {
+		*retcode = 0;
+		return ktpd_job_start(ktpd, exec);
+	}
+
+	return ktpd_session_set_exec(ktpd, exec);
+}
+
+
+/** @brief Brings background job to foreground.
+ *
+ * The "fg" sym can't do it itself because it's executed as a current
+ * command. So sym just leaves request within session. The stored output of
+ * job is sent to client. Running job becomes current command and session
+ * waits for its completion. Completed job gives its retcode immediately.
+ *
+ * @param [in] ktpd KTPD session.
+ * @param [out] retcode Retcode of job if it's already completed.
+ * @return BOOL_TRUE - job became current command, BOOL_FALSE - else.
+ */
+static bool_t ktpd_session_fg(ktpd_session_t *ktpd, int *retcode)
+{
+	unsigned int id = 0;
+	kjob_t *job = NULL;
+	kexec_t *exec = NULL;
+
+	id = ksession_fg_job(ktpd->session);
+	if (0 == id)
+		return BOOL_FALSE;
+	ksession_set_fg_job(ktpd->session, 0);
+	job = ksession_find_job(ktpd->session, id);
+	if (!job)
+		return BOOL_FALSE;
+
+	exec = kjob_exec(job);
+	ktpd->exec_job = id;
+	get_stream(ktpd, exec, -1, BOOL_FALSE, BOOL_TRUE);
+	get_stream(ktpd, exec, -1, BOOL_TRUE, BOOL_TRUE);
+	if (kjob_done(job)) {
+		kexec_retcode(exec, retcode);
+		ksession_del_job(ktpd->session, job);
+		ktpd->exec_job = 0;
+		return BOOL_FALSE;
+	}
+
+	// Replace background stream handlers by foreground ones
+	faux_eloop_del_fd(ktpd->eloop, kexec_stdout(exec));
+	faux_eloop_del_fd(ktpd->eloop, kexec_stderr(exec));
+	kjob_release_exec(job);
+	ksession_del_job(ktpd->session, job);
+
+	return ktpd_session_set_exec(ktpd, exec);
+}
+
+
+/** @brief Reads process output to buffer.
+ *
+ * The fd is non-blocked. It became non-blocked while kexec_prepare().
+ */
+static void read_stream(int fd, faux_buf_t *faux_buf, bool_t process_all_data)
+{
+	ssize_t r = -1;
+
+	if (fd < 0)
+		return;
+
+	do {
+		void *linear_buf = NULL;
+		ssize_t really_readed = 0;
+		ssize_t linear_len =
+			faux_buf_dwrite_lock_easy(faux_buf, &linear_buf);
+		r = read(fd, linear_buf, linear_len);
+		if (r > 0)
+			really_readed = r;
+		faux_buf_dwrite_unlock_easy(faux_buf, really_readed);
+	} while ((r > 0) && process_all_data);
+}
+
+
+// Stores output of background job to job's buffers. Reading is paused when
+// too much data is stored so job's process will be blocked on write.
+static bool_t job_stream_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+	ksession_jobs_node_t *iter = NULL;
+	kjob_t *job = NULL;
+
+	iter = ksession_jobs_iter(ktpd->session);
+	while ((job = ksession_jobs_each(&iter))) {
+		kexec_t *exec = kjob_exec(job);
+		faux_buf_t *buf = NULL;
+		if (info->fd == kexec_stdout(exec))
+			buf = kexec_bufout(exec);
+		else if (info->fd == kexec_stderr(exec))
+			buf = kexec_buferr(exec);
+		else
+			continue;
+		if (info->revents & POLLIN)
+			read_stream(info->fd, buf, BOOL_FALSE);
+		if (kjob_buffered(job) > KTPD_JOB_BUF_LIMIT)
+			faux_eloop_exclude_fd_event(eloop, info->fd, POLLIN);
+		break;
+	}
+
+	// Some errors or fd is closed so remove it from polling
+	// EOF || POLERR || POLLNVAL
+	if (!job || (info->revents & (POLLHUP | POLLERR | POLLNVAL)))
+		faux_eloop_del_fd(eloop, info->fd);
+
+	type = type; // Happy compiler
+
+	return BOOL_TRUE;
+}
+
+
+// Passes terminated child to background jobs
+static void ktpd_jobs_child(ktpd_session_t *ktpd, pid_t pid, int wstatus)
+{
+	ksession_jobs_node_t *iter = NULL;
+	kjob_t *job = NULL;
+
+	iter = ksession_jobs_iter(ktpd->session);
+	while ((job = ksession_jobs_each(&iter))) {
+		if (kjob_done(job))
+			continue;
+		kexec_continue_command_execution(kjob_exec(job), pid, wstatus);
+	}
+}
+
+
+/** @brief Finds completed background jobs.
+ *
+ * User is notified about completion by KTP_NOTIFICATION. The job without
+ * output is removed. The job with output is kept until user brings it to
+ * foreground (to get output) or kills it.
+ */
+static void ktpd_jobs_check(ktpd_session_t *ktpd)
+{
+	ksession_jobs_node_t *iter = NULL;
+	kjob_t *job = NULL;
+
+	iter = ksession_jobs_iter(ktpd->session);
+	while ((job = ksession_jobs_each(&iter))) {
+		kexec_t *exec = kjob_exec(job);
+		int retcode = -1;
+		char *str = NULL;
+		faux_msg_t *msg = NULL;
+
+		if (kjob_done(job))
+			continue;
+		if (!kexec_retcode(exec, &retcode))
+			continue;
+		kjob_set_done(job, BOOL_TRUE);
+
+		// Get the rest of output
+		read_stream(kexec_stdout(exec), kexec_bufout(exec), BOOL_TRUE);
+		read_stream(kexec_stderr(exec), kexec_buferr(exec), BOOL_TRUE);
+		faux_eloop_del_fd(ktpd->eloop, kexec_stdout(exec));
+		faux_eloop_del_fd(ktpd->eloop, kexec_stderr(exec));
+		ktpd_session_log(ktpd, exec);
+
+		str = faux_str_sprintf("[%u] Done(%d)  %s%s", kjob_id(job),
+			retcode, kjob_line(job),
+			kjob_buffered(job) > 0 ? " (has output)" : "");
+		msg = ktp_msg_preform(KTP_NOTIFICATION, KTP_STATUS_NONE);
+		faux_msg_add_param(msg, KTP_PARAM_ERROR, str, strlen(str));
+		add_job_to_msg(msg, kjob_id(job));
+		ktpd_send(ktpd, msg);
+		faux_msg_free(msg);
+		faux_str_free(str);
+
+		if (0 == kjob_buffered(job))
+			ksession_del_job(ktpd->session, job);
+	}
+}
+
+
+static bool_t wait_for_actions_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	int wstatus = 0;
+	pid_t child_pid = -1;
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+	int retcode = -1;
+	bool_t view_was_changed = BOOL_FALSE;
+
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	// Wait for any child process. Doesn't block.
+	while ((child_pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+		if (ktpd->exec)
+			kexec_continue_command_execution(ktpd->exec, child_pid,
+				wstatus);
+		ktpd_jobs_child(ktpd, child_pid, wstatus);
+		ktpd_hint_child(ktpd, child_pid, wstatus);
+	}
+	// Completion and help jobs
+	ktpd_hint_check(ktpd);
+	// Background jobs
+	ktpd_jobs_check(ktpd);
+	if (!ktpd->exec)
+		return BOOL_TRUE;
+	// Command is not executed yet. It waits for cached output.
+	if (ktpd->ocache_wait)
+		return BOOL_TRUE;
+
+	// Check if kexec is done now
+	if (!kexec_retcode(ktpd->exec, &retcode))
+		return BOOL_TRUE; // Continue
+
+	// Sometimes SIGCHILD signal can appear before all data were really read
+	// from process stdout buffer. So read the least data before closing
+	// file descriptors and send it to client.
+	get_stream(ktpd, ktpd->exec, kexec_stdout(ktpd->exec), BOOL_FALSE, BOOL_TRUE);
+	get_stream(ktpd, ktpd->exec, kexec_stderr(ktpd->exec), BOOL_TRUE, BOOL_TRUE);
+	if (kexec_stdin(ktpd->exec) >= 0)
+		faux_eloop_del_fd(eloop, kexec_stdin(ktpd->exec));
+	faux_eloop_del_fd(eloop, kexec_stdout(ktpd->exec));
+	faux_eloop_del_fd(eloop, kexec_stderr(ktpd->exec));
+
+	ktpd_ocache_end(ktpd, retcode);
+	ktpd_session_log(ktpd, ktpd->exec);
+	view_was_changed = !kpath_is_equal(
+		ksession_path(ktpd->session), kexec_saved_path(ktpd->exec));
+
+	kexec_free(ktpd->exec);
+	ktpd->exec = NULL;
+	ktpd->exec_job = 0;
+	ktpd->state = KTPD_SESSION_STATE_IDLE;
+
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return ktpd_session_cmd_done(ktpd, retcode, NULL, view_was_changed);
+}
+
+
+/** @brief Acknowledges completion of command the session has waited for.
+ *
+ * Sends CMD_ACK and continues batch processing.
+ *
+ * @return BOOL_FALSE if session must exit, else BOOL_TRUE.
+ */
+static bool_t ktpd_session_cmd_done(ktpd_session_t *ktpd, int retcode,
+	const faux_error_t *error, bool_t view_was_changed)
+{
+	faux_msg_t *ack = NULL;
+	uint32_t status = KTP_STATUS_NONE;
+	bool_t ok = BOOL_TRUE;
+
+	// All kexec_t actions are done so can break the loop if needed.
+	if (ksession_done(ktpd->session)) {
+		ktpd->exit = BOOL_TRUE;
+		status |= KTP_STATUS_EXIT; // Notify client about exiting
+	}
+
+	// Send ACK message
+	ack = ktp_msg_preform(KTP_CMD_ACK, status);
+	if (error && (faux_error_len(error) > 0)) {
+		char *err = faux_error_cstr(error);
+		faux_msg_set_status(ack, status | KTP_STATUS_ERROR);
+		faux_msg_add_param(ack, KTP_PARAM_ERROR, err, strlen(err));
+		faux_str_free(err);
+		ok = BOOL_FALSE;
+	} else {
+		uint8_t retcode8bit = (uint8_t)(retcode & 0xff);
+		faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
+	}
+	add_cmd_info_to_msg(ktpd, ack, view_was_changed);
+	ktpd_trace_cmd_done(ktpd);
+	ktpd_slow_done(ktpd);
+	ktpd_send(ktpd, ack);
+	faux_msg_free(ack);
+
+	// Continue batch processing
+	ktpd_session_batch_done(ktpd, ok && (0 == retcode));
+	ktpd_session_batch_run(ktpd);
+
+	if (ktpd->exit)
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t audit_flush_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+
+	kaudit_flush(ktpd->audit);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Enables audit log.
+ *
+ * KTPd session becomes an owner of audit log. The records are flushed
+ * periodically by event loop and when session is freed.
+ *
+ * @param [in] ktpd KTPd session.
+ * @param [in] audit Audit log.
+ * @param [in] interval Flush interval in seconds. 0 - default.
+ * @return BOOL_TRUE - success, BOOL_FALSE - error.
+ */
+bool_t ktpd_session_set_audit(ktpd_session_t *ktpd, kaudit_t *audit,
+	unsigned int interval)
+{
+	struct timespec period = {};
+
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+	assert(audit);
+	if (!audit)
+		return BOOL_FALSE;
+	if (ktpd->audit)
+		return BOOL_FALSE;
+
+	period.tv_sec = (0 == interval) ? KAUDIT_DEFAULT_INTERVAL : interval;
+	ktpd->audit = audit;
+	ksession_set_audit(ktpd->session, audit);
+	faux_eloop_add_sched_periodic_delayed(ktpd->eloop, KTPD_AUDIT_SCHED_ID,
+		audit_flush_ev, ktpd, &period, FAUX_SCHED_INFINITE);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Sets klishd-wide shared cache of command's output.
+ *
+ * The cache is created by parent klishd process and it's shared by all
+ * sessions. Session doesn't own it.
+ */
+bool_t ktpd_session_set_ocache(ktpd_session_t *ktpd, kocache_t *ocache)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	ktpd->ocache = ocache;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Enables metrics.
+ *
+ * The metrics are shared by all sessions so session doesn't own it.
+ */
+bool_t ktpd_session_set_metrics(ktpd_session_t *ktpd, kmetrics_t *metrics)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+
+	ktpd->metrics = metrics;
+	ksession_set_metrics(ktpd->session, metrics);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Enables session recording.
+ *
+ * The session owns recording object. All incoming and outgoing KTP messages
+ * are written to recording. See ktp_rec.h.
+ */
+bool_t ktpd_session_set_rec(ktpd_session_t *ktpd, ktp_rec_t *rec)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+	assert(rec);
+	if (!rec)
+		return BOOL_FALSE;
+	if (ktpd->rec)
+		return BOOL_FALSE;
+
+	ktpd->rec = rec;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Sets slow request log.
+ *
+ * Session owns the slow log object.
+ */
+bool_t ktpd_session_set_slow(ktpd_session_t *ktpd, kslow_t *slow)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+	assert(slow);
+	if (!slow)
+		return BOOL_FALSE;
+	if (ktpd->slow)
+		return BOOL_FALSE;
+
+	ktpd->slow = slow;
+	ksession_set_slow(ktpd->session, slow);
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t trace_dump_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+
+	if (ktrace_dump(ktpd->trace, ktpd->trace_path, 0))
+		syslog(LOG_INFO, "Trace is dumped to %s", ktpd->trace_path);
+	else
+		syslog(LOG_ERR, "Can't dump trace to %s", ktpd->trace_path);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Enables latency tracing.
+ *
+ * The session owns trace. The trace is dumped to specified file in Chrome
+ * trace-event JSON format on SIGUSR2.
+ */
+bool_t ktpd_session_set_trace(ktpd_session_t *ktpd, ktrace_t *trace,
+	const char *path)
+{
+	assert(ktpd);
+	if (!ktpd)
+		return BOOL_FALSE;
+	assert(trace);
+	if (!trace)
+		return BOOL_FALSE;
+	assert(path);
+	if (!path)
+		return BOOL_FALSE;
+	if (ktpd->trace)
+		return BOOL_FALSE;
+
+	ktpd->trace = trace;
+	ktpd->trace_path = faux_str_dup(path);
+	ksession_set_trace(ktpd->session, trace);
+	faux_eloop_add_signal(ktpd->eloop, SIGUSR2, trace_dump_ev, ktpd);
+
+	return BOOL_TRUE;
+}
+
+
+// LOG entry that contains "syslog" ACTIONs only can be processed without
+// any kexec. The record is pushed to audit log directly.
+static bool_t ktpd_log_is_audit(const kentry_t *log_entry)
+{
+	kentry_actions_node_t *iter = NULL;
+	kaction_t *action = NULL;
+
+	iter = kentry_actions_iter(log_entry);
+	while ((action = kentry_actions_each(&iter))) {
+		const ksym_t *sym = kaction_sym(action);
+		const kplugin_t *plugin = kaction_plugin(action);
+		if (!sym || !plugin)
+			return BOOL_FALSE;
+		if (strcmp(ksym_name(sym), "syslog") != 0)
+			return BOOL_FALSE;
+		if (strcmp(kplugin_name(plugin), "klish") != 0)
+			return BOOL_FALSE;
+	}
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec)
+{
+	kexec_contexts_node_t *iter = NULL;
+	kcontext_t *context = NULL;
+	const char *full_line = NULL;
+	uint64_t start = ktrace_now(ktpd->trace);
+
+	if (kexec_contexts_len(exec) > 1)
+		full_line = kexec_line(exec);
+
+	iter = kexec_contexts_iter(exec);
+	while ((context = kexec_contexts_each(&iter))) {
+		kentry_t *entry = kcontext_command(context);
+		kentry_t *log_entry = NULL;
+
+		if (!entry)
+			continue;
+		if (ktpd->metrics) {
+			kentry_t *parent = kentry_parent(entry);
+			kmetrics_command(ktpd->metrics,
+				parent ? kentry_name(parent) : NULL,
+				kentry_name(entry), kexec_duration_us(exec));
+		}
+		log_entry = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_LOG);
+		if (!log_entry)
+			continue;
+		if (kentry_actions_len(log_entry) == 0)
+			continue;
+		if (ktpd->audit && ktpd_log_is_audit(log_entry)) {
+			kaudit_push(ktpd->audit, ksession_uid(ktpd->session),
+				ksession_user(ktpd->session),
+				kcontext_line(context), full_line,
+				kcontext_pipeline_stage(context),
+				kcontext_retcode(context),
+				kexec_duration_ms(exec));
+			continue;
+		}
+		ksession_exec_locally(ktpd->session, log_entry,
+			kcontext_pargv(context), context, exec, NULL, NULL);
+	}
+	ktrace_span(ktpd->trace, "ktpd_session_log", kexec_line(exec), start);
+
+	return BOOL_TRUE;
+}
+
+
+static int compl_compare(const void *first, const void *second)
+{
+	const char *f = *(char * const *)first;
+	const char *s = *(char * const *)second;
+
+	return strcmp(f, s);
+}
+
+
+/** @brief Puts completions to answer.
+ *
+ * Completions are collected unsorted so they are sorted and deduplicated
+ * here by single pass. No more than limit completions are put to message.
+ * The number of omitted completions is sent within KTP_PARAM_MORE.
+ */
+static void ktpd_hint_put_completions(ktpd_hint_t *hint, faux_msg_t *ack)
+{
+	size_t num = 0;
+	char **compls = NULL;
+	faux_list_node_t *iter = NULL;
+	char *compl_str = NULL;
+	const char *last = NULL;
+	size_t uniq = 0;
+	size_t limit = kpargv_limit(hint->pargv);
+	size_t i = 0;
+
+	num = faux_list_len(hint->results);
+	if (0 == num)
+		return;
+	compls = faux_zmalloc(num * sizeof(*compls));
+	assert(compls);
+	if (!compls)
+		return;
+	iter = faux_list_head(hint->results);
+	while ((compl_str = faux_list_each(&iter)))
+		compls[i++] = compl_str;
+	qsort(compls, num, sizeof(*compls), compl_compare);
+
+	for (i = 0; i < num; i++) {
+		if (last && (strcmp(last, compls[i]) == 0))
+			continue;
+		last = compls[i];
+		uniq++;
+		if ((limit > 0) && (uniq > limit))
+			continue;
+		faux_msg_add_param(ack, KTP_PARAM_LINE,
+			compls[i], strlen(compls[i]));
+	}
+	faux_free(compls);
+
+	if ((limit > 0) && (uniq > limit)) {
+		char *more = faux_str_sprintf("%zu", uniq - limit);
+		faux_msg_add_param(ack, KTP_PARAM_MORE, more, strlen(more));
+		faux_str_free(more);
+	}
+}
+
+
+/** @brief Gets service ENTRY to generate completion or help for candidate.
+ *
+ * If candidate entry doesn't contain completion (help) then try to get
+ * completion (help) from entry's PTYPE.
+ */
+static kentry_t *ktpd_hint_entry(const kentry_t *candidate,
+	kentry_purpose_e purpose)
+{
+	kentry_t *entry = NULL;
+	const kentry_t *ptype = NULL;
+
+	entry = kentry_nested_by_purpose(candidate, purpose);
+	if (entry)
+		return entry;
+	ptype = kentry_nested_by_purpose(candidate, KENTRY_PURPOSE_PTYPE);
+	if (!ptype)
+		return NULL;
+
+	return kentry_nested_by_purpose(ptype, purpose);
+}
+
+
+// Completion output contains one completion per line
+static void ktpd_hint_add_completions(ktpd_hint_t *hint, const char *out)
+{
+	const char *str = out;
+	char *l = NULL; // One line of completion
+	size_t prefix_len = 0;
+
+	if (!faux_str_is_empty(hint->prefix))
+		prefix_len = strlen(hint->prefix);
+
+	// Get all completions one by one
+	while ((l = faux_str_getline(str, &str))) {
+		// Compare prefix
+		if ((prefix_len > 0) &&
+			(faux_str_cmpn(hint->prefix, l, prefix_len) != 0)) {
+			faux_str_free(l);
+			continue;
+		}
+		faux_list_add(hint->results, faux_str_dup(l + prefix_len));
+		faux_str_free(l);
+	}
+}
+
+
+// Help output contains two lines for each help item: prefix and text
+static void ktpd_hint_add_help(ktpd_hint_t *hint, const char *out)
+{
+	const char *str = out;
+	char *prefix_str = NULL;
+	char *line_str = NULL;
+	help_t *help_struct = NULL;
+
+	do {
+		prefix_str = faux_str_getline(str, &str);
+		if (!prefix_str)
+			break;
+		line_str = faux_str_getline(str, &str);
+		if (!line_str) {
+			faux_str_free(prefix_str);
+			break;
+		}
+		help_struct = help_new(prefix_str, line_str);
+		if (!faux_list_add(hint->results, help_struct))
+			help_free(help_struct);
+	} while (line_str);
+}
+
+
+// The most priority source of help is candidate's help ACTION output. Next
+// source is candidate's PTYPE help ACTION output.
+// Function generates two lines for one resulting help line. The first
+// component is a 'prefix' and the second component is 'text'.
+// The 'prefix' can be something like 'ip', 'filter' i.e.
+// subcommand or '3..89', '<STRING>' i.e. description of type. The 'text'
+// field is description of current parameter. For example 'Interface IP
+// address'. So the full help can be:
+// AAA.BBB.CCC.DDD Interface IP address
+// [ first field ] [ second field     ]
+//
+// If not candidate parameter nor PTYPE contains the help functions the engine
+// tries to construct help itself.
+//
+// It uses the following sources for 'prefix':
+//  * 'help' field of PTYPE
+//  * 'value' field of PTYPE
+//  * 'name' field of PTYPE
+//  * 'value' field of parameter
+//  * 'name' field of parameter
+//
+// Engine uses the following sources for 'text':
+//  * 'help' field of parameter
+//  * 'value' field of parameter
+//  * 'name' field of parameter
+static void ktpd_hint_add_static_help(ktpd_hint_t *hint,
+	const kentry_t *candidate)
+{
+	const kentry_t *ptype = NULL;
+	const char *prefix_str = NULL;
+	const char *line_str = NULL;
+	help_t *help_struct = NULL;
+
+	// Get PTYPE of parameter
+	ptype = kentry_nested_by_purpose(candidate, KENTRY_PURPOSE_PTYPE);
+
+	// Prefix_str
+	if (ptype) {
+		prefix_str = kentry_help(ptype);
+		if (!prefix_str)
+			prefix_str = kentry_value(ptype);
+		if (!prefix_str)
+			prefix_str = kentry_name(ptype);
+	} else {
+		prefix_str = kentry_value(candidate);
+		if (!prefix_str)
+			prefix_str = kentry_name(candidate);
+	}
+	assert(prefix_str);
+
+	// Line_str
+	line_str = kentry_help(candidate);
+	if (!line_str)
+		line_str = kentry_value(candidate);
+	if (!line_str)
+		line_str = kentry_name(candidate);
+	assert(line_str);
+
+	help_struct = help_new(faux_str_dup(prefix_str), faux_str_dup(line_str));
+	if (!faux_list_add(hint->results, help_struct))
+		help_free(help_struct);
+}
+
+
+// Non-blocking read of all available job's output
+static void ktpd_hint_job_read(ktpd_hint_job_t *job)
+{
+	ssize_t r = -1;
+	faux_buf_t *faux_buf = NULL;
+	void *linear_buf = NULL;
+	int fd = -1;
+
+	fd = kexec_stdout(job->exec);
+	if (fd < 0)
+		return;
+	faux_buf = kexec_bufout(job->exec);
+	assert(faux_buf);
+
+	do {
+		ssize_t really_readed = 0;
+		ssize_t linear_len =
+			faux_buf_dwrite_lock_easy(faux_buf, &linear_buf);
+		// Non-blocked read. The fd became non-blocked while
+		// kexec_prepare().
+		r = read(fd, linear_buf, linear_len);
+		if (r > 0)
+			really_readed = r;
+		faux_buf_dwrite_unlock_easy(faux_buf, really_readed);
+	} while (r > 0);
+
+	// EOF. Don't poll fd any more
+	if (0 == r && job->polled) {
+		faux_eloop_del_fd(job->hint->ktpd->eloop, fd);
+		job->polled = BOOL_FALSE;
+	}
+}
 
-	// Sometimes SIGCHILD signal can appear before all data were really read
-	// from process stdout buffer. So read the least data before closing
-	// file descriptors and send it to client.
-	get_stream(ktpd, ktpd->exec, kexec_stdout(ktpd->exec), BOOL_FALSE, BOOL_TRUE);
-	get_stream(ktpd, ktpd->exec, kexec_stderr(ktpd->exec), BOOL_TRUE, BOOL_TRUE);
-	faux_eloop_del_fd(eloop, kexec_stdin(ktpd->exec));
-	faux_eloop_del_fd(eloop, kexec_stdout(ktpd->exec));
-	faux_eloop_del_fd(eloop, kexec_stderr(ktpd->exec));
 
-	ktpd_session_log(ktpd, ktpd->exec);
-	view_was_changed = !kpath_is_equal(
-		ksession_path(ktpd->session), kexec_saved_path(ktpd->exec));
+static void ktpd_hint_job_free(void *data)
+{
+	ktpd_hint_job_t *job = (ktpd_hint_job_t *)data;
 
-	kexec_free(ktpd->exec);
-	ktpd->exec = NULL;
-	ktpd->state = KTPD_SESSION_STATE_IDLE;
+	if (!job)
+		return;
 
-	// All kexec_t actions are done so can break the loop if needed.
-	if (ksession_done(ktpd->session)) {
-		ktpd->exit = BOOL_TRUE;
-		status |= KTP_STATUS_EXIT; // Notify client about exiting
+	if (job->exec) {
+		if (job->polled)
+			faux_eloop_del_fd(job->hint->ktpd->eloop,
+				kexec_stdout(job->exec));
+		// Cancel unfinished ACTIONs. Processes will be reaped by
+		// common SIGCHLD handler.
+		if (!kexec_done(job->exec))
+			kexec_kill(job->exec, SIGKILL);
+		kexec_free(job->exec);
 	}
+	kpargv_free(job->pargv);
+	kparg_free(job->parg);
+	faux_free(job);
+}
 
-	// Send ACK message
-	ack = ktp_msg_preform(cmd, status);
-	retcode8bit = (uint8_t)(retcode & 0xff);
-	faux_msg_add_param(ack, KTP_PARAM_RETCODE, &retcode8bit, 1);
-	// Generate prompt
-	prompt = generate_prompt(ktpd);
-	if (prompt) {
-		faux_msg_add_param(ack, KTP_PARAM_PROMPT, prompt, strlen(prompt));
-		faux_str_free(prompt);
-	}
-	// Add hotkeys
-	if (view_was_changed)
-		add_hotkeys_to_msg(ktpd, ack);
-	faux_msg_send_async(ack, ktpd->async);
-	faux_msg_free(ack);
 
-	type = type; // Happy compiler
-	associated_data = associated_data; // Happy compiler
+// Gets output of finished job
+static void ktpd_hint_job_collect(ktpd_hint_job_t *job)
+{
+	ktpd_hint_t *hint = job->hint;
+	int rc = -1;
+	faux_buf_t *buf = NULL;
+	ssize_t len = 0;
+	char *out = NULL;
 
-	if (ktpd->exit)
-		return BOOL_FALSE;
+	if (job->done)
+		return;
+	job->done = BOOL_TRUE;
+	kslow_exec(hint->ktpd->slow, job->entry, job->started);
+	if (job->running) {
+		job->running = BOOL_FALSE;
+		hint->running--;
+	}
 
-	return BOOL_TRUE;
+	// Buffer may still contain data
+	ktpd_hint_job_read(job);
+	if (job->polled) {
+		faux_eloop_del_fd(hint->ktpd->eloop, kexec_stdout(job->exec));
+		job->polled = BOOL_FALSE;
+	}
+
+	if (!kexec_retcode(job->exec, &rc) || (rc != 0))
+		return;
+	buf = kexec_bufout(job->exec);
+	if ((len = faux_buf_len(buf)) <= 0)
+		return;
+	out = faux_malloc(len + 1);
+	faux_buf_read(buf, out, len);
+	out[len] = '\0';
+
+	if (KTP_COMPLETION_ACK == hint->cmd) {
+		// Cache output. The key includes prefix and limit because
+		// ACTIONs can filter output by them.
+		if (kentry_cache(job->entry) > 0)
+			kcompl_put(ksession_compl(hint->ktpd->session),
+				job->entry, job->candidate, hint->pargv, out);
+		ktpd_hint_add_completions(hint, out);
+	} else
+		ktpd_hint_add_help(hint, out);
+	faux_str_free(out);
 }
 
 
-static bool_t ktpd_session_log(ktpd_session_t *ktpd, const kexec_t *exec)
+static bool_t hint_stdout_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
 {
-	kexec_contexts_node_t *iter = NULL;
-	kcontext_t *context = NULL;
+	ktpd_hint_job_t *job = (ktpd_hint_job_t *)user_data;
 
-	iter = kexec_contexts_iter(exec);
-	while ((context = kexec_contexts_each(&iter))) {
-		kentry_t *entry = kcontext_command(context);
-		kentry_t *log_entry = NULL;
+	ktpd_hint_job_read(job);
 
-		if (!entry)
-			continue;
-		log_entry = kentry_nested_by_purpose(entry, KENTRY_PURPOSE_LOG);
-		if (!log_entry)
-			continue;
-		if (kentry_actions_len(log_entry) == 0)
-			continue;
-		ksession_exec_locally(ktpd->session, log_entry,
-			kcontext_pargv(context), context, exec, NULL, NULL);
-	}
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
 
 	return BOOL_TRUE;
 }
 
 
-static int compl_compare(const void *first, const void *second)
+static void ktpd_hint_free(ktpd_hint_t *hint)
 {
-	const char *f = (const char *)first;
-	const char *s = (const char *)second;
+	if (!hint)
+		return;
 
-	return strcmp(f, s);
+	faux_list_free(hint->jobs);
+	faux_list_free(hint->results);
+	kpargv_free(hint->pargv);
+	faux_free(hint);
 }
 
 
-static int compl_kcompare(const void *key, const void *list_item)
+/** @brief Cancels in-flight completion or help request.
+ *
+ * The processes of unfinished jobs are killed. No answer is sent to client.
+ */
+static void ktpd_hint_cancel(ktpd_session_t *ktpd)
 {
-	const char *f = (const char *)key;
-	const char *s = (const char *)list_item;
+	if (!ktpd->hint)
+		return;
 
-	return strcmp(f, s);
+	if (ktpd->hint->deadline)
+		faux_eloop_del_sched(ktpd->eloop, KTPD_HINT_SCHED_ID);
+	if (ktpd->hint->running > 0)
+		syslog(LOG_DEBUG, "Hint request is cancelled by newer request");
+	kslow_cancel(ktpd->slow);
+	ktpd_hint_free(ktpd->hint);
+	ktpd->hint = NULL;
 }
 
 
-static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *msg)
+// Sends answer with all available results
+static bool_t ktpd_hint_finish(ktpd_session_t *ktpd)
 {
-	char *line = NULL;
+	ktpd_hint_t *hint = ktpd->hint;
 	faux_msg_t *ack = NULL;
-	kpargv_t *pargv = NULL;
-	ktp_cmd_e cmd = KTP_COMPLETION_ACK;
-	uint32_t status = KTP_STATUS_NONE;
-	const char *prefix = NULL;
-	size_t prefix_len = 0;
-
-	assert(ktpd);
-	assert(msg);
+	faux_list_node_t *iter = NULL;
 
-	// Get line from message
-	if (!(line = faux_msg_get_str_param_by_type(msg, KTP_PARAM_LINE))) {
-		ktp_send_error(ktpd->async, cmd, NULL);
+	if (!hint)
 		return BOOL_FALSE;
-	}
 
-	// Parsing
-	pargv = ksession_parse_for_hint(ktpd->session, line,
-		KPURPOSE_COMPLETION);
-	faux_str_free(line);
-	if (!pargv) {
-		ktp_send_error(ktpd->async, cmd, NULL);
-		return BOOL_FALSE;
+	if (hint->deadline)
+		faux_eloop_del_sched(ktpd->eloop, KTPD_HINT_SCHED_ID);
+
+	// Unfinished jobs are the slowest ones
+	if (ktpd->slow) {
+		ktpd_hint_job_t *job = NULL;
+		iter = faux_list_head(hint->jobs);
+		while ((job = (ktpd_hint_job_t *)faux_list_each(&iter))) {
+			if (!job->done)
+				kslow_exec(ktpd->slow, job->entry,
+					job->started);
+		}
 	}
-	kpargv_debug(pargv);
 
-	if (ksession_done(ktpd->session)) {
-		ktpd->exit = BOOL_TRUE;
-		status |= KTP_STATUS_EXIT; // Notify client about exiting
+	// Prepare ACK message
+	ack = ktp_msg_preform(hint->cmd, hint->status);
+	iter = faux_list_head(hint->results);
+	if (KTP_COMPLETION_ACK == hint->cmd) {
+		// Last unfinished word. Common prefix for all completions
+		if (!faux_str_is_empty(hint->prefix))
+			faux_msg_add_param(ack, KTP_PARAM_PREFIX,
+				hint->prefix, strlen(hint->prefix));
+		// Put completion list to message
+		ktpd_hint_put_completions(hint, ack);
+	} else {
+		help_t *help_struct = NULL;
+		// Put help list to message
+		while ((help_struct = (help_t *)faux_list_each(&iter))) {
+			faux_msg_add_param(ack, KTP_PARAM_PREFIX,
+				help_struct->prefix, strlen(help_struct->prefix));
+			faux_msg_add_param(ack, KTP_PARAM_LINE,
+				help_struct->line, strlen(help_struct->line));
+		}
 	}
+	// Partial results (deadline is reached) can't be cached
+	if (hint->cacheable && (0 == hint->running) && !ktpd->machine)
+		add_token_to_msg(ktpd, ack);
+	ktpd_send(ktpd, ack);
+	faux_msg_free(ack);
+	kmetrics_observe(ktpd->metrics, (KTP_COMPLETION_ACK == hint->cmd) ?
+		KMETRICS_HIST_COMPLETION : KMETRICS_HIST_HELP, hint->started);
 
-	// Prepare ACK message
-	ack = ktp_msg_preform(cmd, status);
+	ktpd_hint_free(hint);
+	ktpd->hint = NULL;
+	ktpd_slow_done(ktpd);
+
+	return BOOL_TRUE;
+}
+
+
+// Passes terminated child to hint jobs
+static void ktpd_hint_child(ktpd_session_t *ktpd, pid_t pid, int wstatus)
+{
+	faux_list_node_t *iter = NULL;
+	ktpd_hint_job_t *job = NULL;
 
-	// Last unfinished word. Common prefix for all completions
-	prefix = kpargv_last_arg(pargv);
-	if (!faux_str_is_empty(prefix)) {
-		prefix_len = strlen(prefix);
-		faux_msg_add_param(ack, KTP_PARAM_PREFIX, prefix, prefix_len);
+	if (!ktpd->hint)
+		return;
+
+	iter = faux_list_head(ktpd->hint->jobs);
+	while ((job = (ktpd_hint_job_t *)faux_list_each(&iter))) {
+		if (job->done)
+			continue;
+		kexec_continue_command_execution(job->exec, pid, wstatus);
 	}
+}
 
-	// Fill msg with possible completions
-	if (!kpargv_completions_is_empty(pargv)) {
-		kentry_t *candidate = NULL;
-		kpargv_completions_node_t *citer = kpargv_completions_iter(pargv);
-		faux_list_node_t *compl_iter = NULL;
-		faux_list_t *completions = NULL;
-		char *compl_str = NULL;
 
-		completions = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-			compl_compare, compl_kcompare,
-			(void (*)(void *))faux_str_free);
-		while ((candidate = kpargv_completions_each(&citer))) {
-			kentry_t *completion = NULL;
-			kparg_t *parg = NULL;
-			int rc = -1;
-			char *out = NULL;
-			bool_t res = BOOL_FALSE;
-			char *l = NULL; // One line of completion
-			const char *str = NULL;
-
-			// Get completion entry from candidate entry
-			completion = kentry_nested_by_purpose(candidate,
-				KENTRY_PURPOSE_COMPLETION);
-			// If candidate entry doesn't contain completion then try
-			// to get completion from entry's PTYPE
-			if (!completion) {
-				const kentry_t *ptype = NULL;
-				ptype = kentry_nested_by_purpose(candidate,
-					KENTRY_PURPOSE_PTYPE);
-				if (!ptype)
-					continue;
-				completion = kentry_nested_by_purpose(ptype,
-					KENTRY_PURPOSE_COMPLETION);
-			}
-			if (!completion)
-				continue;
-			parg = kparg_new(candidate, prefix);
-			kpargv_set_candidate_parg(pargv, parg);
-			res = ksession_exec_locally(ktpd->session, completion,
-				pargv, NULL, NULL, &rc, &out);
-			kparg_free(parg);
-			if (!res || (rc != 0) || !out) {
-				if (out)
-					faux_str_free(out);
-				continue;
-			}
+// Collects finished jobs and sends answer when all jobs are done
+static void ktpd_hint_check(ktpd_session_t *ktpd)
+{
+	faux_list_node_t *iter = NULL;
+	ktpd_hint_job_t *job = NULL;
 
-			// Get all completions one by one
-			str = out;
-			while ((l = faux_str_getline(str, &str))) {
-				// Compare prefix
-				if ((prefix_len > 0) &&
-					(faux_str_cmpn(prefix, l, prefix_len) != 0)) {
-					faux_str_free(l);
-					continue;
-				}
-				compl_str = l + prefix_len;
-				faux_list_add(completions, faux_str_dup(compl_str));
-				faux_str_free(l);
-			}
-			faux_str_free(out);
-		}
+	if (!ktpd->hint)
+		return;
 
-		// Put completion list to message
-		compl_iter = faux_list_head(completions);
-		while ((compl_str = faux_list_each(&compl_iter))) {
-			faux_msg_add_param(ack, KTP_PARAM_LINE,
-				compl_str, strlen(compl_str));
-		}
-		faux_list_free(completions);
+	iter = faux_list_head(ktpd->hint->jobs);
+	while ((job = (ktpd_hint_job_t *)faux_list_each(&iter))) {
+		if (job->done)
+			continue;
+		if (kexec_done(job->exec))
+			ktpd_hint_job_collect(job);
 	}
 
-	faux_msg_send_async(ack, ktpd->async);
-	faux_msg_free(ack);
+	if (0 == ktpd->hint->running)
+		ktpd_hint_finish(ktpd);
+}
+
 
-	kpargv_free(pargv);
+static bool_t hint_deadline_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
+	void *associated_data, void *user_data)
+{
+	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
+
+	if (!ktpd->hint)
+		return BOOL_TRUE;
+
+	syslog(LOG_DEBUG, "Hint deadline: %zu ACTION(s) are not completed",
+		ktpd->hint->running);
+	// Don't remove sched event within its own callback
+	ktpd->hint->deadline = BOOL_FALSE;
+	// Unfinished jobs will be killed by ktpd_hint_free()
+	ktpd_hint_finish(ktpd);
+
+	// Happy compiler
+	eloop = eloop;
+	type = type;
+	associated_data = associated_data;
 
 	return BOOL_TRUE;
 }
 
 
-// The most priority source of help is candidate's help ACTION output. Next
-// source is candidate's PTYPE help ACTION output.
-// Function generates two lines for one resulting help line. The first
-// component is a 'prefix' and the second component is 'text'.
-// The 'prefix' can be something like 'ip', 'filter' i.e.
-// subcommand or '3..89', '<STRING>' i.e. description of type. The 'text'
-// field is description of current parameter. For example 'Interface IP
-// address'. So the full help can be:
-// AAA.BBB.CCC.DDD Interface IP address
-// [ first field ] [ second field     ]
-//
-// If not candidate parameter nor PTYPE contains the help functions the engine
-// tries to construct help itself.
-//
-// It uses the following sources for 'prefix':
-//  * 'help' field of PTYPE
-//  * 'value' field of PTYPE
-//  * 'name' field of PTYPE
-//  * 'value' field of parameter
-//  * 'name' field of parameter
-//
-// Engine uses the following sources for 'text':
-//  * 'help' field of parameter
-//  * 'value' field of parameter
-//  * 'name' field of parameter
-static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
+/** @brief Processes completion or help request.
+ *
+ * The completion (help) ACTIONs of all candidates are executed
+ * simultaneously as jobs within main event loop. So session still receives
+ * messages from client while ACTIONs are executing. The answer is sent when
+ * all jobs are done or when deadline is reached. In the last case answer
+ * contains partial results. The newer completion or help request (or
+ * command) cancels current one.
+ */
+static bool_t ktpd_session_process_hint(ktpd_session_t *ktpd, faux_msg_t *msg,
+	ktp_cmd_e cmd)
 {
 	char *line = NULL;
-	faux_msg_t *ack = NULL;
 	kpargv_t *pargv = NULL;
-	ktp_cmd_e cmd = KTP_HELP_ACK;
-	uint32_t status = KTP_STATUS_NONE;
-	const char *prefix = NULL;
+	ktpd_hint_t *hint = NULL;
+	kentry_t *candidate = NULL;
+	kpargv_completions_node_t *citer = NULL;
+	kpargv_purpose_e purpose = KPURPOSE_COMPLETION;
+	kentry_purpose_e entry_purpose = KENTRY_PURPOSE_COMPLETION;
+	uint64_t started = kmetrics_now(ktpd->metrics);
 
 	assert(ktpd);
 	assert(msg);
 
+	if (KTP_HELP_ACK == cmd) {
+		purpose = KPURPOSE_HELP;
+		entry_purpose = KENTRY_PURPOSE_HELP;
+	}
+
+	// Newer request cancels in-flight one
+	ktpd_hint_cancel(ktpd);
+
 	// Get line from message
 	if (!(line = faux_msg_get_str_param_by_type(msg, KTP_PARAM_LINE))) {
-		ktp_send_error(ktpd->async, cmd, NULL);
+		ktpd_send_error(ktpd, cmd, NULL);
 		return BOOL_FALSE;
 	}
+	kslow_begin(ktpd->slow, (KPURPOSE_HELP == purpose) ?
+		KSLOW_HELP : KSLOW_COMPLETION, line);
 
 	// Parsing
-	pargv = ksession_parse_for_hint(ktpd->session, line, KPURPOSE_HELP);
+	pargv = ksession_parse_for_hint(ktpd->session, line, purpose);
 	faux_str_free(line);
 	if (!pargv) {
-		ktp_send_error(ktpd->async, cmd, NULL);
+		kslow_cancel(ktpd->slow);
+		ktpd_send_error(ktpd, cmd, NULL);
 		return BOOL_FALSE;
 	}
+	if (KPURPOSE_COMPLETION == purpose) {
+		kpargv_debug(pargv);
+		kpargv_set_limit(pargv, KTPD_COMPL_LIMIT);
+	}
+
+	hint = faux_zmalloc(sizeof(*hint));
+	assert(hint);
+	hint->ktpd = ktpd;
+	hint->cmd = cmd;
+	hint->status = KTP_STATUS_NONE;
+	hint->pargv = pargv;
+	// Last unfinished word. Common prefix for all entries
+	hint->prefix = kpargv_last_arg(pargv);
+	hint->running = 0;
+	hint->cacheable = BOOL_TRUE;
+	hint->started = started;
+	hint->jobs = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, ktpd_hint_job_free);
+	// Completions can be numerous so they are sorted at once later
+	if (KTP_COMPLETION_ACK == cmd)
+		hint->results = faux_list_new(FAUX_LIST_UNSORTED,
+			FAUX_LIST_NONUNIQUE, NULL, NULL,
+			(void (*)(void *))faux_str_free);
+	else
+		hint->results = faux_list_new(FAUX_LIST_SORTED,
+			FAUX_LIST_UNIQUE, help_compare, NULL, help_free);
+	ktpd->hint = hint;
 
 	if (ksession_done(ktpd->session)) {
 		ktpd->exit = BOOL_TRUE;
-		status |= KTP_STATUS_EXIT; // Notify client about exiting
+		hint->status |= KTP_STATUS_EXIT; // Notify client about exiting
 	}
 
-	// Prepare ACK message
-	ack = ktp_msg_preform(cmd, status);
-
-	// Last unfinished word. Common prefix for all entries
-	prefix = kpargv_last_arg(pargv);
-
-	// Fill msg with possible help messages
-	if (!kpargv_completions_is_empty(pargv)) {
-		kentry_t *candidate = NULL;
-		kpargv_completions_node_t *citer = kpargv_completions_iter(pargv);
-		faux_list_node_t *help_iter = NULL;
-		faux_list_t *help_list = NULL;
-		help_t *help_struct = NULL;
-
-		help_list = faux_list_new(FAUX_LIST_SORTED, FAUX_LIST_UNIQUE,
-			help_compare, NULL, help_free);
-		while ((candidate = kpargv_completions_each(&citer))) {
-			kentry_t *help = NULL;
-			kentry_t *ptype = NULL;
-
-			// Get PTYPE of parameter
-			ptype = kentry_nested_by_purpose(candidate,
-				KENTRY_PURPOSE_PTYPE);
-			// Try to get help fn from parameter itself
-			help = kentry_nested_by_purpose(candidate,
-				KENTRY_PURPOSE_HELP);
-			if (!help && ptype)
-				help = kentry_nested_by_purpose(ptype,
-					KENTRY_PURPOSE_HELP);
-
-			// Generate help with found ACTION
-			if (help) {
-				char *out = NULL;
-				kparg_t *parg = NULL;
-				bool_t res = BOOL_FALSE;
-				int rc = -1;
-				const char *str = NULL;
-				char *prefix_str = NULL;
-				char *line_str = NULL;
-
-				parg = kparg_new(candidate, prefix);
-				kpargv_set_candidate_parg(pargv, parg);
-				res = ksession_exec_locally(ktpd->session,
-					help, pargv, NULL, NULL, &rc, &out);
-				kparg_free(parg);
-				if (!res || (rc != 0) || !out) {
-					if (out)
-						faux_str_free(out);
-					continue;
-				}
-
-				str = out;
-				do {
-					prefix_str = faux_str_getline(str, &str);
-					if (!prefix_str)
-						break;
-					line_str = faux_str_getline(str, &str);
-					if (!line_str) {
-						faux_str_free(prefix_str);
-						break;
-					}
-					help_struct = help_new(prefix_str, line_str);
-					if (!faux_list_add(help_list, help_struct))
-						help_free(help_struct);
-				} while (line_str);
-				faux_str_free(out);
+	// Start jobs for all candidates
+	citer = kpargv_completions_iter(pargv);
+	while ((candidate = kpargv_completions_each(&citer))) {
+		kentry_t *entry = NULL;
+		ktpd_hint_job_t *job = NULL;
 
+		entry = ktpd_hint_entry(candidate, entry_purpose);
+		if (!entry) {
 			// Generate help with available information
-			} else {
-				const char *prefix_str = NULL;
-				const char *line_str = NULL;
-
-				// Prefix_str
-				if (ptype) {
-					prefix_str = kentry_help(ptype);
-					if (!prefix_str)
-						prefix_str = kentry_value(ptype);
-					if (!prefix_str)
-						prefix_str = kentry_name(ptype);
-				} else {
-					prefix_str = kentry_value(candidate);
-					if (!prefix_str)
-						prefix_str = kentry_name(candidate);
-				}
-				assert(prefix_str);
-
-				// Line_str
-				line_str = kentry_help(candidate);
-				if (!line_str)
-					line_str = kentry_value(candidate);
-				if (!line_str)
-					line_str = kentry_name(candidate);
-				assert(line_str);
-
-				help_struct = help_new(
-					faux_str_dup(prefix_str),
-					faux_str_dup(line_str));
-				if (!faux_list_add(help_list, help_struct))
-					help_free(help_struct);
-			}
+			if (KPURPOSE_HELP == purpose)
+				ktpd_hint_add_static_help(hint, candidate);
+			continue;
 		}
+		// Output of ACTIONs can change any time. But entry can declare
+		// it depends on path (or nothing) only.
+		if ((kentry_cache_policy(entry) != KENTRY_CACHE_PATH) &&
+			(kentry_cache_policy(entry) != KENTRY_CACHE_STATIC))
+			hint->cacheable = BOOL_FALSE;
+		// Cached completions don't need ACTIONs execution
+		if ((KPURPOSE_COMPLETION == purpose) &&
+			(kentry_cache(entry) > 0) &&
+			kcompl_get(ksession_compl(ktpd->session), entry,
+			candidate, pargv, hint->prefix, hint->results))
+			continue;
 
-		// Put help list to message
-		help_iter = faux_list_head(help_list);
-		while ((help_struct = (help_t *)faux_list_each(&help_iter))) {
-			faux_msg_add_param(ack, KTP_PARAM_PREFIX,
-				help_struct->prefix, strlen(help_struct->prefix));
-			faux_msg_add_param(ack, KTP_PARAM_LINE,
-				help_struct->line, strlen(help_struct->line));
+		job = faux_zmalloc(sizeof(*job));
+		assert(job);
+		job->hint = hint;
+		job->entry = entry;
+		job->candidate = candidate;
+		// Each job has its own candidate so it needs own pargv
+		job->pargv = kpargv_clone(pargv);
+		job->parg = kparg_new(candidate, hint->prefix);
+		kpargv_set_candidate_parg(job->pargv, job->parg);
+		job->started = kslow_now(ktpd->slow);
+		job->exec = ksession_parse_for_local_exec(ktpd->session, entry,
+			job->pargv, NULL, NULL);
+		if (!job->exec || !kexec_exec(job->exec)) {
+			ktpd_hint_job_free(job);
+			continue;
+		}
+		faux_list_add(hint->jobs, job);
+		// Only sync ACTIONs. Job is already done.
+		if (kexec_done(job->exec)) {
+			ktpd_hint_job_collect(job);
+			continue;
 		}
-		faux_list_free(help_list);
+		job->running = BOOL_TRUE;
+		hint->running++;
+		job->polled = BOOL_TRUE;
+		faux_eloop_add_fd(ktpd->eloop, kexec_stdout(job->exec), POLLIN,
+			hint_stdout_ev, job);
 	}
 
-	faux_msg_send_async(ack, ktpd->async);
-	faux_msg_free(ack);
+	if (0 == hint->running)
+		return ktpd_hint_finish(ktpd);
 
-	kpargv_free(pargv);
+	// Wait for jobs
+	{
+		struct timespec deadline = {};
+		deadline.tv_sec = KTPD_HINT_DEADLINE;
+		faux_eloop_add_sched_once_delayed(ktpd->eloop, &deadline,
+			KTPD_HINT_SCHED_ID, hint_deadline_ev, ktpd);
+		hint->deadline = BOOL_TRUE;
+	}
 
 	return BOOL_TRUE;
 }
 
 
+static bool_t ktpd_session_process_completion(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	return ktpd_session_process_hint(ktpd, msg, KTP_COMPLETION_ACK);
+}
+
+
+static bool_t ktpd_session_process_help(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	return ktpd_session_process_hint(ktpd, msg, KTP_HELP_ACK);
+}
+
+
 static ssize_t stdin_out(int fd, faux_buf_t *buf, bool_t process_all_data)
 {
 	ssize_t total_written = 0;
@@ -1007,17 +2785,20 @@ static bool_t push_stdin(ktpd_session_t *ktpd)
 }
 
 
-static bool_t ktpd_session_process_stdin(ktpd_session_t *ktpd, faux_msg_t *msg)
+/** @brief Writes data received from client to action's stdin.
+ *
+ * The line can point directly to async input buffer so it's used in place
+ * and doesn't need to be allocated.
+ */
+static bool_t ktpd_session_stdin_data(ktpd_session_t *ktpd,
+	const char *line, size_t len)
 {
-	char *line = NULL;
-	unsigned int len = 0;
 	faux_buf_t *bufin = NULL;
 	int fd = -1;
 	bool_t interrupt = BOOL_FALSE;
 	const kaction_t *action = NULL;
 
 	assert(ktpd);
-	assert(msg);
 
 	if (!ktpd->exec)
 		return BOOL_FALSE;
@@ -1025,8 +2806,6 @@ static bool_t ktpd_session_process_stdin(ktpd_session_t *ktpd, faux_msg_t *msg)
 	if (fd < 0)
 		return BOOL_FALSE;
 
-	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE, (void **)&line, &len))
-		return BOOL_TRUE; // It's strange but not a bug
 	if (len == 0)
 		return BOOL_TRUE;
 	bufin = kexec_bufin(ktpd->exec);
@@ -1073,6 +2852,21 @@ static bool_t ktpd_session_process_stdin(ktpd_session_t *ktpd, faux_msg_t *msg)
 }
 
 
+static bool_t ktpd_session_process_stdin(ktpd_session_t *ktpd, faux_msg_t *msg)
+{
+	char *line = NULL;
+	unsigned int len = 0;
+
+	assert(ktpd);
+	assert(msg);
+
+	if (!faux_msg_get_param_by_type(msg, KTP_PARAM_LINE, (void **)&line, &len))
+		return BOOL_TRUE; // It's strange but not a bug
+
+	return ktpd_session_stdin_data(ktpd, line, len);
+}
+
+
 static bool_t ktpd_session_process_winch(ktpd_session_t *ktpd, faux_msg_t *msg)
 {
 	char *line = NULL;
@@ -1162,6 +2956,8 @@ static bool_t ktpd_session_process_stdout_close(ktpd_session_t *ktpd,
 	// Remove already generated data from out buffer. This data is not
 	// needed now
 	faux_buf_empty(kexec_bufout(ktpd->exec));
+	// Output is incomplete so it can't be cached
+	ktpd->ocache_fail = BOOL_TRUE;
 
 	return BOOL_TRUE;
 }
@@ -1237,6 +3033,17 @@ static bool_t ktpd_session_dispatch(ktpd_session_t *ktpd, faux_msg_t *msg)
 		}
 		ktpd_session_process_help(ktpd, msg);
 		break;
+	case KTP_CMD_BATCH:
+		// Batch can be received while previous batched command is
+		// executing
+		if ((ktpd->state != KTPD_SESSION_STATE_IDLE) &&
+			(ktpd->state != KTPD_SESSION_STATE_WAIT_FOR_PROCESS)) {
+			ecmd = KTP_CMD_ACK;
+			err = "Server illegal state for command batch";
+			break;
+		}
+		ktpd_session_process_batch(ktpd, msg);
+		break;
 	case KTP_STDIN:
 		if (ktpd->state != KTPD_SESSION_STATE_WAIT_FOR_PROCESS) {
 			err = "Nobody is waiting for stdin";
@@ -1277,7 +3084,7 @@ static bool_t ktpd_session_dispatch(ktpd_session_t *ktpd, faux_msg_t *msg)
 	// On error
 	if (err) {
 		syslog(LOG_WARNING, "Protocol problem: %s", err);
-		ktp_send_error(ktpd->async, ecmd, err);
+		ktpd_send_error(ktpd, ecmd, err);
 	}
 
 	return BOOL_TRUE;
@@ -1288,59 +3095,46 @@ static bool_t ktpd_session_dispatch(ktpd_session_t *ktpd, faux_msg_t *msg)
  *
  * Firstly function gets the header of message. Then it checks and parses
  * header and find out the length of whole message. Then it receives the rest
- * of message.
+ * of message. The body is parsed within async input buffer if possible (see
+ * ktp_rx_recv()).
  */
 static bool_t ktpd_session_read_cb(faux_async_t *async,
 	faux_buf_t *buf, size_t len, void *user_data)
 {
 	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
 	faux_msg_t *completed_msg = NULL;
-	char *data = NULL;
+	const char *body = NULL;
+	size_t body_len = 0;
+	int rc = 0;
 
 	assert(async);
 	assert(buf);
 	assert(ktpd);
 
-	// Linearize buffer
-	data = malloc(len);
-	faux_buf_read(buf, data, len);
-
-	// Receive header
-	if (!ktpd->hdr) {
-		size_t whole_len = 0;
-		size_t msg_wo_hdr = 0;
-
-		ktpd->hdr = (faux_hdr_t *)data;
-		// Check for broken header
-		if (!ktp_check_header(ktpd->hdr)) {
-			faux_free(ktpd->hdr);
-			ktpd->hdr = NULL;
-			return BOOL_FALSE;
-		}
-
-		whole_len = faux_hdr_len(ktpd->hdr);
-		// msg_wo_hdr >= 0 because ktp_check_header() validates whole_len
-		msg_wo_hdr = whole_len - sizeof(faux_hdr_t);
-		// Plan to receive message body
-		if (msg_wo_hdr > 0) {
-			faux_async_set_read_limits(async,
-				msg_wo_hdr, msg_wo_hdr);
-			return BOOL_TRUE;
-		}
-		// Here message is completed (msg body has zero length)
-		completed_msg = faux_msg_deserialize_parts(ktpd->hdr, NULL, 0);
-
-	// Receive message body
-	} else {
-		completed_msg = faux_msg_deserialize_parts(ktpd->hdr, data, len);
-		faux_free(data);
+	rc = ktp_rx_recv(&ktpd->rx, async, buf, len, &body, &body_len);
+	if (rc < 0)
+		return BOOL_FALSE;
+	if (0 == rc)
+		return BOOL_TRUE; // Header is received. Wait for body
+	ktp_rec_in(ktpd->rec, &ktpd->rx.hdr, body, body_len);
+
+	// Fast path. Stdin data is written to action's stdin right from
+	// the receive buffer without intermediate message object
+	if ((ktp_rx_cmd(&ktpd->rx) == KTP_STDIN) &&
+		(ktpd->state == KTPD_SESSION_STATE_WAIT_FOR_PROCESS)) {
+		const char *line = NULL;
+		size_t line_len = 0;
+		if (ktp_rx_param(&ktpd->rx, body, body_len, KTP_PARAM_LINE,
+			&line, &line_len))
+			ktpd_session_stdin_data(ktpd, line, line_len);
+		ktp_rx_done(&ktpd->rx, async, buf);
+		return BOOL_TRUE;
 	}
 
+	completed_msg = faux_msg_deserialize_parts(&ktpd->rx.hdr,
+		body, body_len);
 	// Plan to receive msg header
-	faux_async_set_read_limits(ktpd->async,
-		sizeof(faux_hdr_t), sizeof(faux_hdr_t));
-	faux_free(ktpd->hdr);
-	ktpd->hdr = NULL; // Ready to recv new header
+	ktp_rx_done(&ktpd->rx, async, buf);
 
 	// Here message is completed
 	ktpd_session_dispatch(ktpd, completed_msg);
@@ -1372,19 +3166,39 @@ int ktpd_session_fd(const ktpd_session_t *ktpd)
 }
 
 
+// Sends KTP_STDOUT/KTP_STDERR message to client
+static bool_t send_stream(ktpd_session_t *ktpd, bool_t is_stderr,
+	const char *buf, size_t len)
+{
+	faux_msg_t *msg = NULL;
+
+	msg = ktp_msg_preform(is_stderr ? KTP_STDERR : KTP_STDOUT,
+		KTP_STATUS_NONE);
+	if (ktpd->machine)
+		add_id_to_msg(ktpd, msg);
+	// Output of job that was in background
+	add_job_to_msg(msg, ktpd->exec_job);
+	faux_msg_add_param(msg, KTP_PARAM_LINE, buf, len);
+	ktpd_send(ktpd, msg);
+	faux_msg_free(msg);
+
+	return BOOL_TRUE;
+}
+
+
 static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_stderr,
 	bool_t process_all_data)
 {
-	ssize_t r = -1;
 	faux_buf_t *faux_buf = NULL;
 	char *buf = NULL;
 	ssize_t len = 0;
-	faux_msg_t *ack = NULL;
+	uint64_t start = 0;
 
 	if (!ktpd)
 		return BOOL_TRUE;
 	if (!exec)
 		return BOOL_TRUE;
+	start = ktrace_now(ktpd->trace);
 
 	if (is_stderr)
 		faux_buf = kexec_buferr(exec);
@@ -1393,20 +3207,7 @@ static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_
 	assert(faux_buf);
 
 	// Don't read stream if fd == -1
-	if (fd >= 0) {
-		do {
-			void *linear_buf = NULL;
-			ssize_t really_readed = 0;
-			ssize_t linear_len =
-				faux_buf_dwrite_lock_easy(faux_buf, &linear_buf);
-			// Non-blocked read. The fd became non-blocked while
-			// kexec_prepare().
-			r = read(fd, linear_buf, linear_len);
-			if (r > 0)
-				really_readed = r;
-			faux_buf_dwrite_unlock_easy(faux_buf, really_readed);
-		} while ((r > 0) && process_all_data);
-	}
+	read_stream(fd, faux_buf, process_all_data);
 
 	len = faux_buf_len(faux_buf);
 	if (0 == len)
@@ -1415,14 +3216,22 @@ static bool_t get_stream(ktpd_session_t *ktpd, kexec_t *exec, int fd, bool_t is_
 	buf = malloc(len);
 	faux_buf_read(faux_buf, buf, len);
 
-	// Create KTP_STDOUT/KTP_STDERR message to send to client
-	ack = ktp_msg_preform(is_stderr ? KTP_STDERR : KTP_STDOUT, KTP_STATUS_NONE);
-	faux_msg_add_param(ack, KTP_PARAM_LINE, buf, len);
-	faux_msg_send_async(ack, ktpd->async);
-	faux_msg_free(ack);
+	// Command that writes to stderr is not cacheable
+	if (is_stderr)
+		ktpd->ocache_fail = BOOL_TRUE;
+	else
+		ktpd_ocache_record(ktpd, buf, len);
+	send_stream(ktpd, is_stderr, buf, len);
 
 	free(buf);
 
+	if (ktpd->trace) {
+		char bytes[32] = {};
+		snprintf(bytes, sizeof(bytes), "%zd bytes", len);
+		ktrace_span(ktpd->trace, is_stderr ? "stderr" : "stdout",
+			bytes, start);
+	}
+
 	// Pause stdout/stderr receiving because buffer (to send to client)
 	// is full
 	if (faux_buf_len(faux_async_obuf(ktpd->async)) > BUF_LIMIT)
@@ -1484,18 +3293,20 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	faux_eloop_info_fd_t *info = (faux_eloop_info_fd_t *)associated_data;
 	ktpd_session_t *ktpd = (ktpd_session_t *)user_data;
 	faux_async_t *async = ktpd->async;
+	ssize_t bytes = 0;
 
 	assert(async);
 
 	// Write data
 	if (info->revents & POLLOUT) {
 		faux_eloop_exclude_fd_event(eloop, info->fd, POLLOUT);
-		if (faux_async_out_easy(async) < 0) {
+		if ((bytes = faux_async_out_easy(async)) < 0) {
 			// Someting went wrong
 			faux_eloop_del_fd(eloop, info->fd);
 			syslog(LOG_ERR, "Can't send data to client");
 			return BOOL_FALSE; // Stop event loop
 		}
+		kmetrics_inc(ktpd->metrics, KMETRICS_KTP_BYTES_OUT, bytes);
 		// Restore stdout and stderr receiving if out buffer is not
 		// full
 		if (ktpd->exec &&
@@ -1509,12 +3320,13 @@ bool_t client_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 
 	// Read data
 	if (info->revents & POLLIN) {
-		if (faux_async_in_easy(async) < 0) {
+		if ((bytes = faux_async_in_easy(async)) < 0) {
 			// Someting went wrong
 			faux_eloop_del_fd(eloop, info->fd);
 			syslog(LOG_ERR, "Can't get data from client");
 			return BOOL_FALSE; // Stop event loop
 		}
+		kmetrics_inc(ktpd->metrics, KMETRICS_KTP_BYTES_IN, bytes);
 	}
 
 	// EOF
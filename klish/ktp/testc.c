@@ -0,0 +1,442 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <faux/str.h>
+#include <faux/msg.h>
+#include <faux/eloop.h>
+#include <faux/async.h>
+#include <klish/ktp.h>
+#include <klish/ktp_session.h>
+#include <klish/ktp_rec.h>
+#include <klish/kscheme.h>
+#include <klish/kentry.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+#include <klish/kcontext.h>
+
+
+// Answer of service process. Process with another PID and the next run
+// produce the same answer except the execution time and the PID.
+static faux_msg_t *testc_ktp_ack(const char *token, const char *duration)
+{
+	faux_msg_t *msg = ktp_msg_preform(KTP_CMD_ACK, KTP_STATUS_NONE);
+
+	faux_msg_add_param(msg, KTP_PARAM_RETCODE, "0", 1);
+	faux_msg_add_param(msg, KTP_PARAM_DURATION,
+		duration, strlen(duration));
+	faux_msg_add_param(msg, KTP_PARAM_TOKEN, token, strlen(token));
+
+	return msg;
+}
+
+
+static bool_t testc_ktp_equal(faux_msg_t *msg1, faux_msg_t *msg2)
+{
+	char *data1 = NULL;
+	char *data2 = NULL;
+	size_t len1 = 0;
+	size_t len2 = 0;
+	bool_t equal = BOOL_FALSE;
+
+	data1 = ktp_rec_msg_encode(msg1, &len1);
+	data2 = ktp_rec_msg_encode(msg2, &len2);
+	if (data1 && data2 && (len1 == len2) &&
+		(memcmp(data1, data2, len1) == 0))
+		equal = BOOL_TRUE;
+	faux_free(data1);
+	faux_free(data2);
+
+	return equal;
+}
+
+
+int testc_ktp_rec_norm(void)
+{
+	int ret = -1;
+	faux_msg_t *orig = testc_ktp_ack("1a2b.3", "120");
+	faux_msg_t *other_pid = testc_ktp_ack("4c5d.3", "98");
+	faux_msg_t *other_gen = testc_ktp_ack("1a2b.4", "120");
+	const char *token = NULL;
+	size_t len = 0;
+	char *data = NULL;
+	size_t data_len = 0;
+
+	if (!testc_ktp_equal(orig, other_pid)) {
+		printf("Answers of different processes differ\n");
+		goto err;
+	}
+	if (testc_ktp_equal(orig, other_gen)) {
+		printf("Answers of different generations are equal\n");
+		goto err;
+	}
+
+	data = ktp_rec_msg_encode(orig, &data_len);
+	if (ktp_rec_msg_param(data, data_len, KTP_PARAM_DURATION,
+		NULL, NULL)) {
+		printf("Duration is not removed\n");
+		goto err;
+	}
+	if (!ktp_rec_msg_param(data, data_len, KTP_PARAM_TOKEN,
+		&token, &len) || (len != 1) || (token[0] != '3')) {
+		printf("Token is not normalized\n");
+		goto err;
+	}
+
+	ret = 0;
+err:
+	faux_free(data);
+	faux_msg_free(orig);
+	faux_msg_free(other_pid);
+	faux_msg_free(other_gen);
+
+	return ret;
+}
+
+
+// Recorded answer must match the same answer of replayed session
+int testc_ktp_rec_replay(void)
+{
+	int ret = -1;
+	char tmpdir[] = "/tmp/testc_ktp_rec_XXXXXX";
+	char *path = NULL;
+	ktp_rec_t *rec = NULL;
+	faux_msg_t *recorded = testc_ktp_ack("1a2b.1", "120");
+	faux_msg_t *replayed = testc_ktp_ack("7e8f.1", "75");
+	char *exp = NULL;
+	size_t exp_len = 0;
+	ktp_rec_dir_e dir = KTP_REC_IN;
+	const char *data = NULL;
+	size_t len = 0;
+
+	// Recording file must not exist
+	if (!mkdtemp(tmpdir))
+		goto err;
+	path = faux_str_sprintf("%s/rec", tmpdir);
+
+	rec = ktp_rec_new(path, BOOL_TRUE);
+	if (!rec || !ktp_rec_out(rec, recorded)) {
+		printf("Can't record message\n");
+		goto err;
+	}
+	ktp_rec_free(rec);
+
+	rec = ktp_rec_new(path, BOOL_FALSE);
+	if (!rec || (ktp_rec_next(rec, &dir, NULL, &data, &len) != 1) ||
+		(dir != KTP_REC_OUT)) {
+		printf("Can't read recorded message\n");
+		goto err;
+	}
+	exp = ktp_rec_msg_encode(replayed, &exp_len);
+	if (!exp || (exp_len != len) || (memcmp(exp, data, len) != 0)) {
+		printf("Replayed answer doesn't match recorded one\n");
+		goto err;
+	}
+	if (ktp_rec_next(rec, NULL, NULL, NULL, NULL) != 0) {
+		printf("Extra record\n");
+		goto err;
+	}
+
+	ret = 0;
+err:
+	ktp_rec_free(rec);
+	if (path) {
+		unlink(path);
+		rmdir(tmpdir);
+	}
+	faux_str_free(path);
+	faux_free(exp);
+	faux_msg_free(recorded);
+	faux_msg_free(replayed);
+
+	return ret;
+}
+
+
+#define TESTC_KTP_RX_MSGS 1000
+
+
+typedef struct {
+	ktp_rx_t rx;
+	size_t msgs; // Received KTP_STDIN messages
+	size_t bytes; // Received stdin data
+	bool_t broken;
+} testc_ktp_rx_t;
+
+
+// The same as KTP_STDIN fast path of server's read callback
+static bool_t testc_ktp_rx_read_cb(faux_async_t *async, faux_buf_t *buf,
+	size_t len, void *user_data)
+{
+	testc_ktp_rx_t *t = (testc_ktp_rx_t *)user_data;
+	const char *body = NULL;
+	size_t body_len = 0;
+	const char *line = NULL;
+	size_t line_len = 0;
+	int rc = 0;
+
+	rc = ktp_rx_recv(&t->rx, async, buf, len, &body, &body_len);
+	if (rc < 0) {
+		t->broken = BOOL_TRUE;
+		return BOOL_FALSE;
+	}
+	if (0 == rc)
+		return BOOL_TRUE;
+	if ((ktp_rx_cmd(&t->rx) != KTP_STDIN) ||
+		!ktp_rx_param(&t->rx, body, body_len, KTP_PARAM_LINE,
+		&line, &line_len))
+		t->broken = BOOL_TRUE;
+	t->msgs++;
+	t->bytes += line_len;
+	ktp_rx_done(&t->rx, async, buf);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Pushes KTP_STDIN messages through receive fast path.
+ *
+ * @param [in] data_len Length of stdin data within each message.
+ * @param [out] allocs Allocations of receive path.
+ * @return BOOL_TRUE - all messages are received, BOOL_FALSE - else.
+ */
+static bool_t testc_ktp_rx_push(size_t data_len, size_t *allocs)
+{
+	int sv[2] = {-1, -1};
+	faux_async_t *tx = NULL;
+	faux_async_t *rx = NULL;
+	testc_ktp_rx_t t = {};
+	char *data = NULL;
+	size_t i = 0;
+	bool_t ret = BOOL_FALSE;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return BOOL_FALSE;
+	tx = faux_async_new(sv[0]);
+	rx = faux_async_new(sv[1]);
+	faux_async_set_read_limits(rx, sizeof(faux_hdr_t), sizeof(faux_hdr_t));
+	faux_async_set_read_cb(rx, testc_ktp_rx_read_cb, &t);
+	data = faux_zmalloc(data_len);
+	memset(data, 'a', data_len);
+
+	for (i = 0; i < TESTC_KTP_RX_MSGS; i++) {
+		faux_msg_t *msg = ktp_msg_preform(KTP_STDIN, KTP_STATUS_NONE);
+		faux_msg_add_param(msg, KTP_PARAM_LINE, data, data_len);
+		faux_msg_send_async(msg, tx);
+		faux_msg_free(msg);
+		// Socket buffer is limited so receive while sending
+		while (faux_async_out_easy(tx) > 0 || t.msgs <= i) {
+			if ((faux_async_in_easy(rx) < 0) || t.broken)
+				goto err;
+		}
+	}
+	if (t.bytes != (data_len * TESTC_KTP_RX_MSGS)) {
+		printf("Received %zu bytes, expected %zu\n",
+			t.bytes, data_len * TESTC_KTP_RX_MSGS);
+		goto err;
+	}
+	printf("stdin data %6zu bytes: %zu messages, in place %zu, "
+		"linearized %zu, allocations %zu\n", data_len, t.rx.msgs,
+		t.rx.inplace, t.rx.linearized, t.rx.allocs);
+	*allocs = t.rx.allocs;
+
+	ret = BOOL_TRUE;
+err:
+	ktp_rx_fini(&t.rx);
+	faux_free(data);
+	faux_async_free(tx);
+	faux_async_free(rx);
+	close(sv[0]);
+	close(sv[1]);
+
+	return ret;
+}
+
+
+// Receive path doesn't allocate memory per KTP_STDIN message. The only
+// allocation is the linearization buffer for messages that span chunks of
+// input buffer. The buffer is reused by the following messages.
+int testc_ktp_rx_allocs(void)
+{
+	// Typical line of pasted config, big message spanning chunks
+	const size_t lens[] = {64, 4000, 20000};
+	size_t i = 0;
+
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		size_t allocs = 0;
+
+		if (!testc_ktp_rx_push(lens[i], &allocs)) {
+			printf("Can't receive messages of %zu bytes\n",
+				lens[i]);
+			return -1;
+		}
+		if (allocs > 1) {
+			printf("%zu allocations for %u messages of %zu bytes, "
+				"expected 1 at most\n", allocs,
+				TESTC_KTP_RX_MSGS, lens[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+#define TESTC_KTPD_TIMEOUT 3 // Seconds
+#define TESTC_KTPD_SCHED_ID 1
+
+
+// PTYPE of command "cat"
+static int testc_ktpd_command(kcontext_t *context)
+{
+	return faux_str_cmp(kcontext_candidate_value(context), "cat") ? -1 : 0;
+}
+
+
+// Reads stdin until EOF like "cat" does
+static int testc_ktpd_cat(kcontext_t *context)
+{
+	char buf[64] = {};
+
+	context = context; // Happy compiler
+
+	while (read(STDIN_FILENO, buf, sizeof(buf)) > 0);
+
+	return 0;
+}
+
+
+// Service process with single "cat" command
+static void testc_ktpd_serve(int sock)
+{
+	kscheme_t *scheme = kscheme_new();
+	ksym_t *ptype_sym = ksym_new_fast("command", testc_ktpd_command);
+	ksym_t *cat_sym = ksym_new("cat", testc_ktpd_cat);
+	faux_eloop_t *eloop = NULL;
+	ktpd_session_t *ktpd = NULL;
+	kentry_t *view = NULL;
+	kentry_t *cmd = NULL;
+	kentry_t *ptype = NULL;
+	kaction_t *action = NULL;
+
+	view = kentry_new("main");
+	kentry_set_container(view, BOOL_TRUE);
+	kentry_set_mode(view, KENTRY_MODE_SWITCH);
+	kentry_set_prepared(view, BOOL_TRUE);
+	kscheme_add_entrys(scheme, view);
+
+	cmd = kentry_new("cat");
+	action = kaction_new();
+	kaction_set_sym(action, cat_sym);
+	kentry_add_actions(cmd, action);
+	kentry_add_entrys(view, cmd);
+
+	ptype = kentry_new("PTYPE");
+	kentry_set_purpose(ptype, KENTRY_PURPOSE_PTYPE);
+	action = kaction_new();
+	kaction_set_sym(action, ptype_sym);
+	kentry_add_actions(ptype, action);
+	kentry_add_entrys(cmd, ptype);
+	kentry_set_nested_by_purpose(cmd, KENTRY_PURPOSE_PTYPE, ptype);
+
+	eloop = faux_eloop_new(NULL);
+	ktpd = ktpd_session_new(sock, scheme, "main", eloop);
+	if (ktpd)
+		faux_eloop_loop(eloop);
+
+	ktpd_session_free(ktpd);
+	faux_eloop_free(eloop);
+	kscheme_free(scheme);
+	ksym_free(ptype_sym);
+	ksym_free(cat_sym);
+}
+
+
+static bool_t testc_ktpd_timeout_ev(faux_eloop_t *eloop,
+	faux_eloop_type_e type, void *associated_data, void *user_data)
+{
+	bool_t *timeout = (bool_t *)user_data;
+
+	*timeout = BOOL_TRUE;
+
+	eloop = eloop; // Happy compiler
+	type = type; // Happy compiler
+	associated_data = associated_data; // Happy compiler
+
+	return BOOL_FALSE; // Stop event loop
+}
+
+
+// Machine client never sends stdin. Command that reads stdin must get EOF
+// and complete instead of waiting forever.
+int testc_ktpd_machine_stdin(void)
+{
+	int ret = -1;
+	int sv[2] = {-1, -1};
+	pid_t pid = -1;
+	faux_eloop_t *eloop = NULL;
+	ktp_session_t *ktp = NULL;
+	struct timespec delay = {};
+	bool_t timeout = BOOL_FALSE;
+	int retcode = -1;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		return -1;
+	pid = fork();
+	if (pid < 0) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if (0 == pid) {
+		close(sv[0]);
+		testc_ktpd_serve(sv[1]);
+		_exit(0);
+	}
+	close(sv[1]);
+
+	eloop = faux_eloop_new(NULL);
+	ktp = ktp_session_new(sv[0], eloop);
+	ktp_session_set_machine(ktp, BOOL_TRUE);
+	delay.tv_sec = TESTC_KTPD_TIMEOUT;
+	faux_eloop_add_sched_once_delayed(eloop, &delay, TESTC_KTPD_SCHED_ID,
+		testc_ktpd_timeout_ev, &timeout);
+
+	// Loop stops on answer
+	if (!ktp_session_auth(ktp, NULL)) {
+		printf("Can't send auth request\n");
+		goto err;
+	}
+	faux_eloop_loop(eloop);
+	if (timeout || !ktp_session_retcode(ktp, &retcode) || (retcode < 0)) {
+		printf("Machine session is not authorized\n");
+		goto err;
+	}
+
+	if (!ktp_session_cmd(ktp, "cat", NULL, BOOL_FALSE)) {
+		printf("Can't send command\n");
+		goto err;
+	}
+	faux_eloop_loop(eloop);
+	if (timeout) {
+		printf("Command reading stdin is blocked\n");
+		goto err;
+	}
+	if (!ktp_session_retcode(ktp, &retcode) || (retcode != 0)) {
+		printf("Command is failed: %d\n", retcode);
+		goto err;
+	}
+
+	ret = 0;
+err:
+	ktp_session_free(ktp); // Closes socket
+	faux_eloop_free(eloop);
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	return ret;
+}
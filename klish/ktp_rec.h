@@ -0,0 +1,68 @@
+/** @file ktp_rec.h
+ *
+ * @brief KTP session recording
+ *
+ * The recording is a binary file that contains all KTP messages of single
+ * session with timestamps. The incoming messages are stored as is (raw
+ * message in network byte order) so they can be sent to server again. The
+ * outgoing messages are stored in normalized form to compare them with the
+ * answers of replayed session. The recording is disabled when there is no
+ * recording object so record functions accept NULL object and do nothing.
+ *
+ * File format (all numbers are in network byte order):
+ * - File header: "KTPREC" magic, zero byte, version byte.
+ * - Records: direction byte ('I' or 'O'), 3 reserved bytes, 32-bit length of
+ * data, 64-bit timestamp (microseconds since recording start), data.
+ *
+ * Normalized message: 16-bit command, 32-bit status, 32-bit number of
+ * parameters, then parameters: 16-bit type, 32-bit length, data. The
+ * KTP_PARAM_DURATION parameter is omitted because it's different for each
+ * run. The KTP_PARAM_TOKEN parameter keeps generation only, without PID of
+ * service process.
+ */
+
+#ifndef _klish_ktp_rec_h
+#define _klish_ktp_rec_h
+
+#include <stdint.h>
+#include <faux/faux.h>
+#include <faux/msg.h>
+
+
+typedef struct ktp_rec_s ktp_rec_t;
+
+typedef enum {
+	KTP_REC_IN = 'I', // Message from client to server
+	KTP_REC_OUT = 'O', // Message from server to client
+} ktp_rec_dir_e;
+
+#define KTP_REC_MAGIC "KTPREC"
+#define KTP_REC_VERSION 1
+#define KTP_REC_DEFAULT_DIR "/tmp"
+
+
+C_DECL_BEGIN
+
+ktp_rec_t *ktp_rec_new(const char *path, bool_t write);
+void ktp_rec_free(ktp_rec_t *rec);
+const char *ktp_rec_path(const ktp_rec_t *rec);
+size_t ktp_rec_records(const ktp_rec_t *rec);
+
+// Write
+bool_t ktp_rec_in(ktp_rec_t *rec, const faux_hdr_t *hdr,
+	const char *body, size_t body_len);
+bool_t ktp_rec_out(ktp_rec_t *rec, faux_msg_t *msg);
+
+// Read
+int ktp_rec_next(ktp_rec_t *rec, ktp_rec_dir_e *dir, uint64_t *ts,
+	const char **data, size_t *len);
+
+// Normalized messages
+char *ktp_rec_msg_encode(faux_msg_t *msg, size_t *len);
+int ktp_rec_msg_cmd(const char *data, size_t len);
+bool_t ktp_rec_msg_param(const char *data, size_t len, uint16_t type,
+	const char **param, size_t *param_len);
+
+C_DECL_END
+
+#endif // _klish_ktp_rec_h
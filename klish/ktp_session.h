@@ -5,8 +5,15 @@
 #include <faux/list.h>
 #include <faux/eloop.h>
 #include <faux/error.h>
+#include <faux/buf.h>
+#include <faux/msg.h>
 #include <klish/ksession.h>
+#include <klish/kocache.h>
+#include <klish/ktrace.h>
+#include <klish/kmetrics.h>
 #include <klish/ktp.h>
+#include <klish/ktp_rec.h>
+#include <klish/kslow.h>
 
 #define USOCK_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
 
@@ -31,6 +38,32 @@ bool_t ktp_peer_ev(faux_eloop_t *eloop, faux_eloop_type_e type,
 	void *associated_data, void *user_data);
 bool_t ktp_stall_cb(faux_async_t *async, size_t len, void *user_data);
 
+// Zero-copy message receiving
+// Linearization buffer bigger than this is freed after use
+#define KTP_RX_SCRATCH_KEEP 65536
+
+typedef struct ktp_rx_s {
+	faux_hdr_t hdr; // Header of message is being received
+	bool_t hdr_received;
+	bool_t locked; // Body is a view into async input buffer
+	size_t body_len;
+	char *scratch; // Linearization buffer for fragmented messages
+	size_t scratch_size;
+	// Statistics
+	size_t msgs; // Number of received messages
+	size_t inplace; // Bodies parsed within async buffer
+	size_t linearized; // Bodies copied to linearization buffer
+	size_t allocs; // Allocations of linearization buffer
+} ktp_rx_t;
+
+int ktp_rx_recv(ktp_rx_t *rx, faux_async_t *async, faux_buf_t *buf,
+	size_t len, const char **body, size_t *body_len);
+void ktp_rx_done(ktp_rx_t *rx, faux_async_t *async, faux_buf_t *buf);
+void ktp_rx_fini(ktp_rx_t *rx);
+ktp_cmd_e ktp_rx_cmd(const ktp_rx_t *rx);
+bool_t ktp_rx_param(const ktp_rx_t *rx, const char *body, size_t body_len,
+	ktp_param_e type, const char **data, size_t *len);
+
 // Help structure
 typedef struct help_s {
 	char *prefix;
@@ -94,6 +127,16 @@ ktp_session_state_e ktp_session_state(const ktp_session_t *ktp);
 
 bool_t ktp_session_cmd(ktp_session_t *ktp, const char *line,
 	faux_error_t *error, bool_t dry_run);
+bool_t ktp_session_batch(ktp_session_t *ktp, const char **lines,
+	size_t lines_num, bool_t dry_run, bool_t stop_on_error);
+bool_t ktp_session_batch_ids(ktp_session_t *ktp, const char **ids,
+	const char **lines, size_t lines_num, bool_t dry_run,
+	bool_t stop_on_error);
+size_t ktp_session_batch_outstanding(const ktp_session_t *ktp);
+bool_t ktp_session_machine(const ktp_session_t *ktp);
+bool_t ktp_session_set_machine(ktp_session_t *ktp, bool_t machine);
+const char *ktp_session_req_id(const ktp_session_t *ktp);
+unsigned long long ktp_session_cmd_duration(const ktp_session_t *ktp);
 bool_t ktp_session_auth(ktp_session_t *ktp, faux_error_t *error);
 bool_t ktp_session_completion(ktp_session_t *ktp, const char *line,
 	bool_t dry_run);
@@ -120,6 +163,14 @@ bool_t ktpd_session_connected(ktpd_session_t *session);
 int ktpd_session_fd(const ktpd_session_t *session);
 bool_t ktpd_session_async_in(ktpd_session_t *session);
 bool_t ktpd_session_async_out(ktpd_session_t *session);
+bool_t ktpd_session_set_audit(ktpd_session_t *session, kaudit_t *audit,
+	unsigned int interval);
+bool_t ktpd_session_set_ocache(ktpd_session_t *session, kocache_t *ocache);
+bool_t ktpd_session_set_trace(ktpd_session_t *session, ktrace_t *trace,
+	const char *path);
+bool_t ktpd_session_set_metrics(ktpd_session_t *session, kmetrics_t *metrics);
+bool_t ktpd_session_set_rec(ktpd_session_t *session, ktp_rec_t *rec);
+bool_t ktpd_session_set_slow(ktpd_session_t *session, kslow_t *slow);
 
 C_DECL_END
 
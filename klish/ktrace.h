@@ -0,0 +1,46 @@
+/** @file ktrace.h
+ *
+ * @brief Klish latency tracing
+ *
+ * The trace stores timestamped spans of command processing phases (parsing,
+ * PTYPE and COND checks, stream preparation, ACTIONs, output transfer, log,
+ * prompt) within ring buffer. The buffer is dumped in Chrome trace-event
+ * JSON format on demand. The trace is disabled when there is no trace object
+ * so all functions accept NULL trace and do nothing.
+ */
+
+#ifndef _klish_ktrace_h
+#define _klish_ktrace_h
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <faux/faux.h>
+
+
+typedef struct ktrace_s ktrace_t;
+
+#define KTRACE_DEFAULT_SIZE 4096 // Events
+#define KTRACE_DEFAULT_DIR "/run/klish"
+
+
+C_DECL_BEGIN
+
+ktrace_t *ktrace_new(size_t size);
+void ktrace_free(ktrace_t *trace);
+
+uint64_t ktrace_now(const ktrace_t *trace);
+void ktrace_span(ktrace_t *trace, const char *name, const char *arg,
+	uint64_t start);
+void ktrace_fork(ktrace_t *trace, pid_t pid, const char *name,
+	const char *arg);
+void ktrace_reap(ktrace_t *trace, pid_t pid);
+bool_t ktrace_dump(const ktrace_t *trace, const char *path,
+	uint64_t since);
+
+// Statistics
+size_t ktrace_len(const ktrace_t *trace);
+size_t ktrace_dropped(const ktrace_t *trace);
+
+C_DECL_END
+
+#endif // _klish_ktrace_h
@@ -0,0 +1,25 @@
+#include <stdlib.h>
+
+
+const unsigned char testc_version_major = 1;
+const unsigned char testc_version_minor = 0;
+
+
+const char *testc_module[][2] = {
+
+	// KTP session recording
+	{"testc_ktp_rec_norm", "Normalization of recorded answers"},
+	{"testc_ktp_rec_replay", "Recorded answer matches replayed one"},
+
+	// KTP receiving
+	{"testc_ktp_rx_allocs", "No allocations per KTP_STDIN message"},
+
+	// KTP server session
+	{"testc_ktpd_machine_stdin", "Machine session: command reading stdin gets EOF"},
+
+	// Scheme
+	{"testc_kscheme_finalize", "Prepare hooks of top-level PTYPEs and lazy VIEWs"},
+
+	// End of list
+	{NULL, NULL}
+	};
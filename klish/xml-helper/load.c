@@ -540,6 +540,8 @@ static bool_t process_entry(const kxml_node_t *element, void *parent,
 	ientry.transparent = kxml_node_attr(element, "transparent");
 	ientry.order = kxml_node_attr(element, "order");
 	ientry.filter = kxml_node_attr(element, "filter");
+	ientry.cache = kxml_node_attr(element, "cache");
+	ientry.cache_policy = kxml_node_attr(element, "cache_policy");
 
 	if (!(entry = add_entry_to_hierarchy(element, parent, &ientry, error)))
 		goto err;
@@ -562,6 +564,8 @@ err:
 	kxml_node_attr_free(ientry.transparent);
 	kxml_node_attr_free(ientry.order);
 	kxml_node_attr_free(ientry.filter);
+	kxml_node_attr_free(ientry.cache);
+	kxml_node_attr_free(ientry.cache_policy);
 
 	return res;
 }
@@ -891,6 +895,12 @@ static bool_t process_command(const kxml_node_t *element, void *parent,
 		else
 			ientry.filter = "false";
 	}
+	// Output TTL is meaningful for commands and completions only
+	if ((KTAG_COMMAND == tag) || (KTAG_COMPL == tag))
+		ientry.cache = kxml_node_attr(element, "cache");
+	// Cache policy is meaningful for completions, help and prompts only
+	if ((KTAG_COMPL == tag) || (KTAG_HELP == tag) || (KTAG_PROMPT == tag))
+		ientry.cache_policy = kxml_node_attr(element, "cache_policy");
 
 	if (!(entry = add_entry_to_hierarchy(element, parent, &ientry, error)))
 		goto err;
@@ -934,6 +944,8 @@ err:
 	}
 	if (is_filter)
 		kxml_node_attr_free(ientry.filter);
+	kxml_node_attr_free(ientry.cache);
+	kxml_node_attr_free(ientry.cache_policy);
 
 	return res;
 }
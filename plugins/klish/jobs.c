@@ -0,0 +1,129 @@
+/** @file jobs.c
+ * @brief Background jobs control
+ *
+ * The command with "&" at the end of line is executed in background. These
+ * syms manage session's background jobs. Job ID is taken from the last
+ * argument of command. If command has no numeric argument then the job with
+ * max ID is used.
+ *
+ * Example:
+ * <COMMAND name="fg" help="Bring job to foreground">
+ *     <PARAM name="id" ptype="/UINT" min="0" help="Job ID"/>
+ *     <ACTION sym="fg"/>
+ * </COMMAND>
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+
+#include <faux/str.h>
+#include <faux/conv.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+#include <klish/kexec.h>
+#include <klish/kjob.h>
+
+
+// Finds job specified by command's argument or the job with max ID
+static kjob_t *klish_job_by_arg(kcontext_t *context)
+{
+	ksession_t *session = NULL;
+	kparg_t *parg = NULL;
+	unsigned int id = 0;
+	kjob_t *job = NULL;
+	kjob_t *last = NULL;
+	ksession_jobs_node_t *iter = NULL;
+
+	session = kcontext_session(context);
+	if (!session)
+		return NULL;
+
+	parg = kpargv_pargs_last(kcontext_pargv(context));
+	if (parg && faux_conv_atoui(kparg_value(parg), &id, 0))
+		return ksession_find_job(session, id);
+
+	// Jobs are sorted by ID. Use the job with max ID
+	iter = ksession_jobs_iter(session);
+	while ((job = ksession_jobs_each(&iter)))
+		last = job;
+
+	return last;
+}
+
+
+int klish_jobs(kcontext_t *context)
+{
+	ksession_t *session = NULL;
+	ksession_jobs_node_t *iter = NULL;
+	kjob_t *job = NULL;
+
+	session = kcontext_session(context);
+	if (!session)
+		return -1;
+
+	iter = ksession_jobs_iter(session);
+	while ((job = ksession_jobs_each(&iter))) {
+		int retcode = -1;
+		kexec_t *exec = kjob_exec(job);
+		if (!kjob_done(job)) {
+			kcontext_printf(context, "[%u] Running %lus  %s\n",
+				kjob_id(job), kexec_duration_ms(exec) / 1000,
+				kjob_line(job));
+			continue;
+		}
+		kexec_retcode(exec, &retcode);
+		kcontext_printf(context, "[%u] Done(%d)  %s\n",
+			kjob_id(job), retcode, kjob_line(job));
+	}
+
+	return 0;
+}
+
+
+// The job will be brought to foreground by KTP server when current
+// command is completed.
+int klish_fg(kcontext_t *context)
+{
+	ksession_t *session = NULL;
+	kjob_t *job = NULL;
+
+	session = kcontext_session(context);
+	if (!session)
+		return -1;
+	job = klish_job_by_arg(context);
+	if (!job) {
+		kcontext_printf(context, "No such job\n");
+		return -1;
+	}
+	ksession_set_fg_job(session, kjob_id(job));
+
+	return 0;
+}
+
+
+// Terminates job. The job that is already done is just removed with its
+// buffered output.
+int klish_kill(kcontext_t *context)
+{
+	ksession_t *session = NULL;
+	kjob_t *job = NULL;
+
+	session = kcontext_session(context);
+	if (!session)
+		return -1;
+	job = klish_job_by_arg(context);
+	if (!job) {
+		kcontext_printf(context, "No such job\n");
+		return -1;
+	}
+	if (kjob_done(job))
+		return ksession_del_job(session, job) ? 0 : -1;
+	if (!kexec_kill(kjob_exec(job), SIGTERM))
+		return -1;
+
+	return 0;
+}
@@ -19,6 +19,7 @@
 #include <klish/ksession.h>
 #include <klish/kexec.h>
 #include <klish/kpath.h>
+#include <klish/kaudit.h>
 
 
 int klish_syslog(kcontext_t *context)
@@ -26,6 +27,7 @@ int klish_syslog(kcontext_t *context)
 	const kcontext_t *parent_context = NULL;
 	const ksession_t *session = NULL;
 	const kexec_t *parent_exec = NULL;
+	kaudit_t *audit = NULL;
 	char *log_full_line = NULL;
 
 	assert(context);
@@ -36,6 +38,21 @@ int klish_syslog(kcontext_t *context)
 	if (!session)
 		return -1;
 	parent_exec = kcontext_parent_exec(context);
+
+	// Audit log is enabled. Don't write to syslog synchronously.
+	audit = ksession_audit(session);
+	if (audit) {
+		const char *full_line = NULL;
+		if (parent_exec && (kexec_contexts_len(parent_exec) > 1))
+			full_line = kexec_line(parent_exec);
+		kaudit_push(audit, ksession_uid(session),
+			ksession_user(session), kcontext_line(parent_context),
+			full_line, kcontext_pipeline_stage(parent_context),
+			kcontext_retcode(parent_context),
+			parent_exec ? kexec_duration_ms(parent_exec) : 0);
+		return 0;
+	}
+
 	if (parent_exec && (kexec_contexts_len(parent_exec) > 1)) {
 		log_full_line = faux_str_sprintf(", (%s)#%u",
 			kexec_line(parent_exec),
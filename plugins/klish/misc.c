@@ -14,6 +14,7 @@
 #include <faux/conv.h>
 #include <faux/str.h>
 #include <faux/list.h>
+#include <faux/argv.h>
 #include <faux/sysdb.h>
 #include <klish/kcontext.h>
 #include <klish/ksession.h>
@@ -162,3 +163,49 @@ int klish_prompt(kcontext_t *context)
 
 	return 0;
 }
+
+
+// Invalidate cached completions. Script contains names of COMPL entries or
+// its parents (PTYPE, PARAM). Empty script invalidates all completions.
+int klish_compl_flush(kcontext_t *context)
+{
+	const char *script = NULL;
+	kcompl_t *compl = NULL;
+	faux_argv_t *argv = NULL;
+	faux_argv_node_t *iter = NULL;
+	const char *name = NULL;
+
+	compl = ksession_compl(kcontext_session(context));
+	if (!compl)
+		return -1;
+
+	script = kcontext_script(context);
+	if (faux_str_is_empty(script)) {
+		kcompl_flush(compl, NULL);
+		return 0;
+	}
+
+	argv = faux_argv_new();
+	faux_argv_parse(argv, script);
+	iter = faux_argv_iter(argv);
+	while ((name = faux_argv_each(&iter)))
+		kcompl_flush(compl, name);
+	faux_argv_free(argv);
+
+	return 0;
+}
+
+
+// Force prompt regeneration. It's useful for PROMPTs with 'cache'
+// attribute when ACTION changes something prompt depends on.
+int klish_prompt_flush(kcontext_t *context)
+{
+	ksession_t *session = NULL;
+
+	session = kcontext_session(context);
+	if (!session)
+		return -1;
+	ksession_set_prompt_expired(session, BOOL_TRUE);
+
+	return 0;
+}
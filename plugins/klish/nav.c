@@ -23,10 +23,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <syslog.h>
 
 #include <faux/str.h>
 #include <faux/list.h>
 #include <faux/conv.h>
+#include <faux/error.h>
 #include <klish/kcontext.h>
 #include <klish/kentry.h>
 #include <klish/ksession.h>
@@ -34,6 +36,33 @@
 #include <klish/kscheme.h>
 
 
+// Find VIEW by path and prepare it if scheme is lazy
+static kentry_t *klish_nav_find_view(kscheme_t *scheme, const char *view_name)
+{
+	kentry_t *view = NULL;
+	faux_error_t *error = NULL;
+	bool_t prepared = BOOL_FALSE;
+
+	view = kscheme_find_entry_by_path(scheme, view_name);
+	if (!view)
+		return NULL;
+	error = faux_error_new();
+	prepared = kscheme_prepare_view(scheme, view, error);
+	if (!prepared) {
+		// Error is empty if VIEW was failed before
+		char *err = faux_error_cstr(error);
+		syslog(LOG_ERR, "Can't prepare VIEW \"%s\"%s%s", view_name,
+			err ? ": " : "", err ? err : "");
+		faux_str_free(err);
+	}
+	faux_error_free(error);
+	if (!prepared)
+		return NULL;
+
+	return view;
+}
+
+
 int klish_nav(kcontext_t *context)
 {
 	const char *script = NULL;
@@ -122,7 +151,7 @@ int klish_nav(kcontext_t *context)
 				faux_argv_free(argv);
 				return -1;
 			}
-			new_view = kscheme_find_entry_by_path(
+			new_view = klish_nav_find_view(
 				ksession_scheme(session), view_name);
 			if (!new_view) {
 				faux_argv_free(argv);
@@ -141,7 +170,7 @@ int klish_nav(kcontext_t *context)
 				faux_argv_free(argv);
 				return -1;
 			}
-			new_view = kscheme_find_entry_by_path(
+			new_view = klish_nav_find_view(
 				ksession_scheme(session), view_name);
 			if (!new_view) {
 				faux_argv_free(argv);
@@ -20,6 +20,7 @@ const uint8_t kplugin_klish_minor = KPLUGIN_MINOR;
 int kplugin_klish_init(kcontext_t *context)
 {
 	kplugin_t *plugin = NULL;
+	ksym_t *sym = NULL;
 
 	assert(context);
 	plugin = kcontext_plugin(context);
@@ -31,6 +32,11 @@ int kplugin_klish_init(kcontext_t *context)
 	kplugin_add_syms(plugin, ksym_new_fast("print", klish_print));
 	kplugin_add_syms(plugin, ksym_new_fast("printl", klish_printl));
 	kplugin_add_syms(plugin, ksym_new_fast("prompt", klish_prompt));
+	// Caches belong to session so flush syms must be sync
+	kplugin_add_syms(plugin, ksym_new_ext("compl_flush", klish_compl_flush,
+		KSYM_NONPERMANENT, KSYM_SYNC, KSYM_SILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("prompt_flush", klish_prompt_flush,
+		KSYM_NONPERMANENT, KSYM_SYNC, KSYM_SILENT));
 
 	// Log
 	kplugin_add_syms(plugin, ksym_new_fast("syslog", klish_syslog));
@@ -43,18 +49,57 @@ int kplugin_klish_init(kcontext_t *context)
 	kplugin_add_syms(plugin, ksym_new_ext("pwd", klish_pwd,
 		KSYM_PERMANENT, KSYM_SYNC, KSYM_SILENT));
 
+	// Jobs
+	// Jobs belong to session so syms must be sync
+	kplugin_add_syms(plugin, ksym_new_ext("jobs", klish_jobs,
+		KSYM_PERMANENT, KSYM_SYNC, KSYM_SILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("fg", klish_fg,
+		KSYM_PERMANENT, KSYM_SYNC, KSYM_SILENT));
+	kplugin_add_syms(plugin, ksym_new_ext("kill", klish_kill,
+		KSYM_PERMANENT, KSYM_SYNC, KSYM_SILENT));
+
 	// PTYPEs
-	// These PTYPEs are simple and fast so set SYNC flag
-	kplugin_add_syms(plugin, ksym_new_fast("COMMAND", klish_ptype_COMMAND));
-	kplugin_add_syms(plugin, ksym_new_fast("completion_COMMAND",
-		klish_completion_COMMAND));
-	kplugin_add_syms(plugin, ksym_new_fast("help_COMMAND",
-		klish_help_COMMAND));
-	kplugin_add_syms(plugin, ksym_new_fast("COMMAND_CASE",
-		klish_ptype_COMMAND_CASE));
-	kplugin_add_syms(plugin, ksym_new_fast("INT", klish_ptype_INT));
-	kplugin_add_syms(plugin, ksym_new_fast("UINT", klish_ptype_UINT));
-	kplugin_add_syms(plugin, ksym_new_fast("STRING", klish_ptype_STRING));
+	// These PTYPEs are simple and fast so set SYNC flag.
+	// The udata is built by prepare hooks within klishd so forked sessions
+	// share it.
+	sym = ksym_new_fast("COMMAND", klish_ptype_COMMAND);
+	ksym_set_prepare(sym, klish_prepare_COMMAND);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("completion_COMMAND", klish_completion_COMMAND);
+	ksym_set_prepare(sym, klish_prepare_COMMAND);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("help_COMMAND", klish_help_COMMAND);
+	ksym_set_prepare(sym, klish_prepare_COMMAND);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("COMMAND_CASE", klish_ptype_COMMAND_CASE);
+	ksym_set_prepare(sym, klish_prepare_COMMAND);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("INT", klish_ptype_INT);
+	ksym_set_prepare(sym, klish_prepare_INT);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("UINT", klish_ptype_UINT);
+	ksym_set_prepare(sym, klish_prepare_UINT);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("STRING", klish_ptype_STRING);
+	ksym_set_prepare(sym, klish_prepare_STRING);
+	kplugin_add_syms(plugin, sym);
+	kplugin_add_syms(plugin, ksym_new_fast("IPV4", klish_ptype_IPV4));
+	kplugin_add_syms(plugin, ksym_new_fast("IPV4_PREFIX",
+		klish_ptype_IPV4_PREFIX));
+	kplugin_add_syms(plugin, ksym_new_fast("IPV6", klish_ptype_IPV6));
+	kplugin_add_syms(plugin, ksym_new_fast("IPV6_PREFIX",
+		klish_ptype_IPV6_PREFIX));
+	kplugin_add_syms(plugin, ksym_new_fast("MAC", klish_ptype_MAC));
+	sym = ksym_new_fast("RANGE_LIST", klish_ptype_RANGE_LIST);
+	ksym_set_prepare(sym, klish_prepare_RANGE_LIST);
+	kplugin_add_syms(plugin, sym);
+	kplugin_add_syms(plugin, ksym_new_fast("help_PTYPE", klish_help_PTYPE));
+	sym = ksym_new_fast("ENUM", klish_ptype_ENUM);
+	ksym_set_prepare(sym, klish_prepare_ENUM);
+	kplugin_add_syms(plugin, sym);
+	kplugin_add_syms(plugin, ksym_new_fast("completion_ENUM",
+		klish_completion_ENUM));
+	kplugin_add_syms(plugin, ksym_new_fast("help_ENUM", klish_help_ENUM));
 
 	return 0;
 }
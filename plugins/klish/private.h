@@ -17,6 +17,8 @@ int klish_tsym(kcontext_t *context);
 int klish_print(kcontext_t *context);
 int klish_printl(kcontext_t *context);
 int klish_prompt(kcontext_t *context);
+int klish_compl_flush(kcontext_t *context);
+int klish_prompt_flush(kcontext_t *context);
 
 // Log
 int klish_syslog(kcontext_t *context);
@@ -25,6 +27,11 @@ int klish_syslog(kcontext_t *context);
 int klish_nav(kcontext_t *context);
 int klish_pwd(kcontext_t *context);
 
+// Jobs
+int klish_jobs(kcontext_t *context);
+int klish_fg(kcontext_t *context);
+int klish_kill(kcontext_t *context);
+
 // PTYPEs
 int klish_ptype_COMMAND(kcontext_t *context);
 int klish_completion_COMMAND(kcontext_t *context);
@@ -38,6 +45,33 @@ int klish_ptype_UINT(kcontext_t *context);
 
 int klish_ptype_STRING(kcontext_t *context);
 
+int klish_ptype_IPV4(kcontext_t *context);
+int klish_ptype_IPV4_PREFIX(kcontext_t *context);
+int klish_ptype_IPV6(kcontext_t *context);
+int klish_ptype_IPV6_PREFIX(kcontext_t *context);
+int klish_ptype_MAC(kcontext_t *context);
+int klish_ptype_RANGE_LIST(kcontext_t *context);
+int klish_help_PTYPE(kcontext_t *context);
+
+int klish_ptype_ENUM(kcontext_t *context);
+int klish_completion_ENUM(kcontext_t *context);
+int klish_help_ENUM(kcontext_t *context);
+
+// Prepare hooks (build PTYPE's udata while scheme finalizing)
+int klish_prepare_COMMAND(kcontext_t *context);
+int klish_prepare_INT(kcontext_t *context);
+int klish_prepare_UINT(kcontext_t *context);
+int klish_prepare_STRING(kcontext_t *context);
+int klish_prepare_RANGE_LIST(kcontext_t *context);
+int klish_prepare_ENUM(kcontext_t *context);
+
+// Regular expressions for STRING PTYPE
+typedef struct klish_regex_s klish_regex_t;
+klish_regex_t *klish_regex_get(const char *pattern);
+void klish_regex_put(klish_regex_t *re);
+bool_t klish_regex_match(klish_regex_t *re, const char *value);
+bool_t klish_regex_is_dfa(const klish_regex_t *re);
+
 
 C_DECL_END
 
@@ -104,6 +104,27 @@ klish_ptype_COMMAND_t *klish_ptype_COMMAND_init(kentry_t *entry)
 }
 
 
+/** @brief PREPARE: Build COMMAND's udata while scheme finalizing
+ *
+ * The same udata is used by COMMAND, COMMAND_CASE and by COMMAND's
+ * completion and help.
+ */
+int klish_prepare_COMMAND(kcontext_t *context)
+{
+	kentry_t *entry = NULL;
+
+	entry = kcontext_candidate_entry(context);
+	if (!entry)
+		return -1;
+	if (kentry_udata(entry))
+		return 0;
+	if (!klish_ptype_COMMAND_init(entry))
+		return -1;
+
+	return 0;
+}
+
+
 /** @brief PTYPE: Consider ENTRY's name (or "value" field) as a command
  */
 int klish_ptype_COMMAND(kcontext_t *context)
@@ -0,0 +1,400 @@
+/*
+ * Implementation of ENUM PTYPE.
+ *
+ * The ACTION's script contains the list of valid values. If script is a single
+ * line then values are whitespace separated words:
+ *
+ * <ACTION sym="ENUM">tcp udp icmp</ACTION>
+ *
+ * Else the each non-empty line contains value and optional help text for it:
+ *
+ * <ACTION sym="ENUM">
+ *     tcp  Transmission Control Protocol
+ *     udp  User Datagram Protocol
+ * </ACTION>
+ *
+ * The list is parsed once (by prepare hook within klishd) and stored as
+ * ACTION's udata. Values are indexed by hash table so validation doesn't
+ * depend on number of values. The COMPL and HELP companions
+ * "completion_ENUM" and "help_ENUM" find ENUM's ACTION within parameter's
+ * PTYPE and use the same udata.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+#include <faux/str.h>
+#include <klish/kcontext.h>
+#include <klish/kentry.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+
+#include "private.h"
+
+
+typedef struct {
+	char *value;
+	size_t len;
+	char *help; // Can be NULL
+} klish_enum_item_t;
+
+typedef struct {
+	klish_enum_item_t *items;
+	size_t items_num;
+	size_t items_max; // Allocated items
+	size_t *hash; // Open addressing. Index of item + 1 or 0 for empty slot
+	size_t hash_mask;
+} klish_ptype_ENUM_t;
+
+
+// FNV-1a
+static size_t enum_hash(const char *str, size_t len)
+{
+	uint32_t h = 2166136261u;
+	size_t i = 0;
+
+	for (i = 0; i < len; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+
+static const klish_enum_item_t *enum_find(const klish_ptype_ENUM_t *udata,
+	const char *value)
+{
+	size_t len = strlen(value);
+	size_t slot = enum_hash(value, len) & udata->hash_mask;
+
+	while (udata->hash[slot] != 0) {
+		const klish_enum_item_t *item = &udata->items[udata->hash[slot] - 1];
+		if ((item->len == len) && (memcmp(item->value, value, len) == 0))
+			return item;
+		slot = (slot + 1) & udata->hash_mask;
+	}
+
+	return NULL;
+}
+
+
+static void klish_ptype_ENUM_free(void *data)
+{
+	klish_ptype_ENUM_t *udata = (klish_ptype_ENUM_t *)data;
+	size_t i = 0;
+
+	if (!udata)
+		return;
+	for (i = 0; i < udata->items_num; i++) {
+		faux_str_free(udata->items[i].value);
+		faux_str_free(udata->items[i].help);
+	}
+	faux_free(udata->items);
+	faux_free(udata->hash);
+	faux_free(udata);
+}
+
+
+static const char *skip_space(const char *p, const char *end)
+{
+	while ((p < end) && isspace((unsigned char)*p))
+		p++;
+
+	return p;
+}
+
+
+static const char *skip_word(const char *p, const char *end)
+{
+	while ((p < end) && !isspace((unsigned char)*p))
+		p++;
+
+	return p;
+}
+
+
+// The items array grows twice to avoid reallocation for each item
+static bool_t enum_add(klish_ptype_ENUM_t *udata, const char *value,
+	size_t len, const char *help, size_t help_len)
+{
+	klish_enum_item_t *item = NULL;
+
+	if (udata->items_num == udata->items_max) {
+		size_t max = udata->items_max ? (udata->items_max * 2) : 16;
+		klish_enum_item_t *items = faux_zmalloc(max * sizeof(*items));
+		assert(items);
+		if (!items)
+			return BOOL_FALSE;
+		if (udata->items)
+			memcpy(items, udata->items,
+				udata->items_num * sizeof(*items));
+		faux_free(udata->items);
+		udata->items = items;
+		udata->items_max = max;
+	}
+	item = &udata->items[udata->items_num];
+	item->value = faux_str_dupn(value, len);
+	item->len = len;
+	item->help = (help_len > 0) ? faux_str_dupn(help, help_len) : NULL;
+	udata->items_num++;
+
+	return BOOL_TRUE;
+}
+
+
+static klish_ptype_ENUM_t *klish_ptype_ENUM_init(kaction_t *action)
+{
+	klish_ptype_ENUM_t *udata = NULL;
+	const char *script = NULL;
+	const char *p = NULL;
+	const char *end = NULL;
+	bool_t multiline = BOOL_FALSE;
+	size_t i = 0;
+	size_t num = 0;
+
+	udata = faux_zmalloc(sizeof(*udata));
+	assert(udata);
+	if (!udata)
+		return NULL;
+
+	script = kaction_script(action);
+	if (!script)
+		script = "";
+	multiline = strchr(script, '\n') ? BOOL_TRUE : BOOL_FALSE;
+
+	p = script;
+	end = script + strlen(script);
+	while (p < end) {
+		const char *value = NULL;
+		const char *value_end = NULL;
+		const char *line_end = end;
+
+		if (multiline) {
+			line_end = strchr(p, '\n');
+			if (!line_end)
+				line_end = end;
+		}
+		p = skip_space(p, line_end);
+		if (p == line_end) {
+			p = line_end + (line_end < end ? 1 : 0);
+			continue;
+		}
+		value = p;
+		value_end = skip_word(p, line_end);
+		if (multiline) {
+			const char *help = skip_space(value_end, line_end);
+			const char *help_end = line_end;
+			while ((help_end > help) &&
+				isspace((unsigned char)help_end[-1]))
+				help_end--;
+			if (!enum_add(udata, value, value_end - value,
+				help, help_end - help))
+				goto err;
+			p = line_end + (line_end < end ? 1 : 0);
+		} else {
+			if (!enum_add(udata, value, value_end - value,
+				NULL, 0))
+				goto err;
+			p = value_end;
+		}
+	}
+
+	if (0 == udata->items_num)
+		goto err;
+
+	// Hash table is at least twice bigger than number of items
+	udata->hash_mask = 1;
+	while (udata->hash_mask < udata->items_num * 2)
+		udata->hash_mask <<= 1;
+	udata->hash = faux_zmalloc(udata->hash_mask * sizeof(*udata->hash));
+	assert(udata->hash);
+	if (!udata->hash)
+		goto err;
+	udata->hash_mask--;
+	// Duplicates are removed so completion and help don't show them. The
+	// first item wins.
+	for (i = 0; i < udata->items_num; i++) {
+		klish_enum_item_t item = udata->items[i];
+		size_t slot = 0;
+		if (enum_find(udata, item.value)) {
+			faux_str_free(item.value);
+			faux_str_free(item.help);
+			continue;
+		}
+		udata->items[num] = item;
+		slot = enum_hash(item.value, item.len) & udata->hash_mask;
+		while (udata->hash[slot] != 0)
+			slot = (slot + 1) & udata->hash_mask;
+		udata->hash[slot] = num + 1;
+		num++;
+	}
+	udata->items_num = num;
+
+	kaction_set_udata(action, udata, klish_ptype_ENUM_free);
+
+	return udata;
+
+err:
+	klish_ptype_ENUM_free(udata);
+
+	return NULL;
+}
+
+
+static klish_ptype_ENUM_t *klish_ptype_ENUM_udata(kaction_t *action)
+{
+	klish_ptype_ENUM_t *udata = NULL;
+
+	udata = (klish_ptype_ENUM_t *)kaction_udata(action);
+	if (udata)
+		return udata;
+
+	return klish_ptype_ENUM_init(action);
+}
+
+
+/** @brief PREPARE: Build ENUM's udata while scheme finalizing
+ */
+int klish_prepare_ENUM(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return -1;
+	if (kaction_udata(action))
+		return 0;
+	if (!klish_ptype_ENUM_init(action))
+		return -1;
+
+	return 0;
+}
+
+
+/** @brief PTYPE: One of predefined values
+ */
+int klish_ptype_ENUM(kcontext_t *context)
+{
+	klish_ptype_ENUM_t *udata = NULL;
+
+	udata = klish_ptype_ENUM_udata(kcontext_action(context));
+	if (!udata)
+		return -1;
+	if (!enum_find(udata, kcontext_candidate_value(context)))
+		return -1;
+
+	return 0;
+}
+
+
+/** @brief Find udata of ENUM ACTION within candidate's PTYPE
+ *
+ * The completion and help functions are called for parameter ENTRY. The
+ * PTYPE entry is nested:
+ *
+ * param (COMMON ENTRY) - candidate entry
+ *     ptype (PTYPE ENTRY)
+ *         ACTION sym="ENUM"
+ */
+static klish_ptype_ENUM_t *enum_by_candidate(kcontext_t *context)
+{
+	kentry_t *ptype = NULL;
+	kentry_actions_node_t *iter = NULL;
+	kaction_t *action = NULL;
+
+	ptype = kentry_nested_by_purpose(kcontext_candidate_entry(context),
+		KENTRY_PURPOSE_PTYPE);
+	if (!ptype)
+		return NULL;
+
+	iter = kentry_actions_iter(ptype);
+	while ((action = kentry_actions_each(&iter))) {
+		ksym_t *sym = kaction_sym(action);
+		if (sym && (ksym_function(sym) == klish_ptype_ENUM))
+			return klish_ptype_ENUM_udata(action);
+	}
+
+	return NULL;
+}
+
+
+/** @brief COMPL: Values of ENUM starting with typed prefix
+ */
+int klish_completion_ENUM(kcontext_t *context)
+{
+	klish_ptype_ENUM_t *udata = NULL;
+	const char *prefix = NULL;
+	size_t prefix_len = 0;
+	size_t limit = 0;
+	size_t num = 0;
+	size_t i = 0;
+
+	udata = enum_by_candidate(context);
+	if (!udata)
+		return -1;
+
+	prefix = kcontext_compl_prefix(context);
+	if (prefix)
+		prefix_len = strlen(prefix);
+	limit = kcontext_compl_limit(context);
+
+	for (i = 0; i < udata->items_num; i++) {
+		const klish_enum_item_t *item = &udata->items[i];
+		if ((item->len < prefix_len) ||
+			(memcmp(item->value, prefix, prefix_len) != 0))
+			continue;
+		kcontext_fwrite(context, stdout, item->value, item->len);
+		kcontext_fwrite(context, stdout, "\n", 1);
+		num++;
+		if ((limit > 0) && (num >= limit))
+			break;
+	}
+
+	return 0;
+}
+
+
+/** @brief HELP: Values of ENUM starting with typed prefix and their help
+ *
+ * The value without its own help gets the help of parameter.
+ */
+int klish_help_ENUM(kcontext_t *context)
+{
+	kentry_t *entry = NULL;
+	klish_ptype_ENUM_t *udata = NULL;
+	const char *prefix = NULL;
+	size_t prefix_len = 0;
+	const char *entry_help = NULL;
+	size_t i = 0;
+
+	udata = enum_by_candidate(context);
+	if (!udata)
+		return -1;
+
+	entry = kcontext_candidate_entry(context);
+	entry_help = kentry_help(entry);
+	if (!entry_help)
+		entry_help = kentry_name(entry);
+	assert(entry_help);
+
+	prefix = kcontext_compl_prefix(context);
+	if (prefix)
+		prefix_len = strlen(prefix);
+
+	for (i = 0; i < udata->items_num; i++) {
+		const klish_enum_item_t *item = &udata->items[i];
+		if ((item->len < prefix_len) ||
+			(memcmp(item->value, prefix, prefix_len) != 0))
+			continue;
+		kcontext_fwrite(context, stdout, item->value, item->len);
+		kcontext_printf(context, "\n%s\n",
+			item->help ? item->help : entry_help);
+	}
+
+	return 0;
+}
@@ -81,6 +81,24 @@ err:
 }
 
 
+/** @brief PREPARE: Build INT's udata while scheme finalizing
+ */
+int klish_prepare_INT(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return -1;
+	if (kaction_udata(action))
+		return 0;
+	if (!klish_ptype_INT_init(action))
+		return -1;
+
+	return 0;
+}
+
+
 /** @brief PTYPE: Signed int with optional range
  *
  * Use long long int for conversion from text.
@@ -169,6 +187,24 @@ err:
 }
 
 
+/** @brief PREPARE: Build UINT's udata while scheme finalizing
+ */
+int klish_prepare_UINT(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return -1;
+	if (kaction_udata(action))
+		return 0;
+	if (!klish_ptype_UINT_init(action))
+		return -1;
+
+	return 0;
+}
+
+
 /** @brief PTYPE: Unsigned int with optional range
  *
  * Use unsigned long long int for conversion from text.
@@ -0,0 +1,424 @@
+/*
+ * Implementation of network PTYPEs: IPV4, IPV4_PREFIX, IPV6, IPV6_PREFIX,
+ * MAC and RANGE_LIST.
+ *
+ * The PTYPEs parse value in place without memory allocation and write
+ * canonical form of value to stdout. The output becomes parameter's value
+ * so ACTIONs get the same text for all equivalent user's inputs. For example
+ * "00-1A-2B-3C-4D-5E", "001a.2b3c.4d5e" and "00:1a:2b:3c:4d:5e" will be
+ * stored as "00:1a:2b:3c:4d:5e".
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <arpa/inet.h>
+
+#include <faux/str.h>
+#include <faux/conv.h>
+#include <faux/argv.h>
+#include <klish/kcontext.h>
+#include <klish/kentry.h>
+
+#include "private.h"
+
+
+typedef struct {
+	bool_t is_range;
+	unsigned long int min;
+	unsigned long int max;
+} klish_ptype_RANGE_LIST_t;
+
+
+/** @brief Parse decimal number
+ *
+ * Parses digits until first non-digit char. The end of number is returned
+ * within "end" argument. Leading zeros are ambiguous for addresses (some
+ * parsers consider it as octal) so "strict" flag forbids them.
+ */
+static bool_t parse_dec(const char *str, const char **end, bool_t strict,
+	unsigned long int max, unsigned long int *res)
+{
+	const char *p = str;
+	unsigned long int val = 0;
+
+	if (!isdigit((unsigned char)*p))
+		return BOOL_FALSE;
+	if (strict && ('0' == *p) && isdigit((unsigned char)p[1]))
+		return BOOL_FALSE;
+	while (isdigit((unsigned char)*p)) {
+		val = val * 10 + (*p - '0');
+		if (val > max)
+			return BOOL_FALSE;
+		p++;
+	}
+	*end = p;
+	*res = val;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t parse_ipv4(const char *str, const char **end, uint8_t addr[4])
+{
+	const char *p = str;
+	unsigned int i = 0;
+
+	for (i = 0; i < 4; i++) {
+		unsigned long int octet = 0;
+		if ((i > 0) && ('.' != *p++))
+			return BOOL_FALSE;
+		if (!parse_dec(p, &p, BOOL_TRUE, 255, &octet))
+			return BOOL_FALSE;
+		addr[i] = (uint8_t)octet;
+	}
+	*end = p;
+
+	return BOOL_TRUE;
+}
+
+
+static void print_ipv4(kcontext_t *context, const uint8_t addr[4])
+{
+	kcontext_printf(context, "%u.%u.%u.%u",
+		addr[0], addr[1], addr[2], addr[3]);
+}
+
+
+/** @brief PTYPE: IPv4 address in dotted-decimal form
+ */
+int klish_ptype_IPV4(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *end = NULL;
+	uint8_t addr[4] = {};
+
+	value = kcontext_candidate_value(context);
+	if (!parse_ipv4(value, &end, addr) || (*end != '\0'))
+		return -1;
+	print_ipv4(context, addr);
+
+	return 0;
+}
+
+
+/** @brief PTYPE: IPv4 prefix in "A.B.C.D/M" form
+ */
+int klish_ptype_IPV4_PREFIX(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *end = NULL;
+	uint8_t addr[4] = {};
+	unsigned long int len = 0;
+
+	value = kcontext_candidate_value(context);
+	if (!parse_ipv4(value, &end, addr) || (*end != '/'))
+		return -1;
+	if (!parse_dec(end + 1, &end, BOOL_TRUE, 32, &len) || (*end != '\0'))
+		return -1;
+	print_ipv4(context, addr);
+	kcontext_printf(context, "/%lu", len);
+
+	return 0;
+}
+
+
+static bool_t parse_ipv6(const char *str, const char **end,
+	struct in6_addr *addr)
+{
+	char buf[INET6_ADDRSTRLEN];
+	size_t len = 0;
+
+	// inet_pton() needs NUL-terminated string so copy address to buffer
+	len = strcspn(str, "/");
+	if ((0 == len) || (len >= sizeof(buf)))
+		return BOOL_FALSE;
+	memcpy(buf, str, len);
+	buf[len] = '\0';
+	if (inet_pton(AF_INET6, buf, addr) != 1)
+		return BOOL_FALSE;
+	*end = str + len;
+
+	return BOOL_TRUE;
+}
+
+
+static bool_t print_ipv6(kcontext_t *context, const struct in6_addr *addr)
+{
+	char buf[INET6_ADDRSTRLEN];
+
+	if (!inet_ntop(AF_INET6, addr, buf, sizeof(buf)))
+		return BOOL_FALSE;
+	kcontext_fwrite(context, stdout, buf, strlen(buf));
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief PTYPE: IPv6 address
+ *
+ * The canonical form is RFC 5952 text representation i.e. lowercase
+ * hexadecimal digits with zeros compressed.
+ */
+int klish_ptype_IPV6(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *end = NULL;
+	struct in6_addr addr = {};
+
+	value = kcontext_candidate_value(context);
+	if (!parse_ipv6(value, &end, &addr) || (*end != '\0'))
+		return -1;
+	if (!print_ipv6(context, &addr))
+		return -1;
+
+	return 0;
+}
+
+
+/** @brief PTYPE: IPv6 prefix in "X:X::X/M" form
+ */
+int klish_ptype_IPV6_PREFIX(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *end = NULL;
+	struct in6_addr addr = {};
+	unsigned long int len = 0;
+
+	value = kcontext_candidate_value(context);
+	if (!parse_ipv6(value, &end, &addr) || (*end != '/'))
+		return -1;
+	if (!parse_dec(end + 1, &end, BOOL_TRUE, 128, &len) || (*end != '\0'))
+		return -1;
+	if (!print_ipv6(context, &addr))
+		return -1;
+	kcontext_printf(context, "/%lu", len);
+
+	return 0;
+}
+
+
+static int hex_digit(char c)
+{
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'a') && (c <= 'f'))
+		return c - 'a' + 10;
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+
+/** @brief PTYPE: MAC address
+ *
+ * Supported forms are:
+ * "00:1a:2b:3c:4d:5e", "00-1a-2b-3c-4d-5e", "001a.2b3c.4d5e" (Cisco style)
+ * and "001a2b3c4d5e". The canonical form is colon separated lowercase.
+ */
+int klish_ptype_MAC(kcontext_t *context)
+{
+	const char *value = NULL;
+	const char *p = NULL;
+	uint8_t mac[6] = {};
+	unsigned int group = 0; // Number of hex digits between separators
+	char sep = '\0';
+	unsigned int i = 0;
+
+	value = kcontext_candidate_value(context);
+	switch (strlen(value)) {
+	case 17: // 00:1a:2b:3c:4d:5e
+		group = 2;
+		sep = value[2];
+		if ((sep != ':') && (sep != '-'))
+			return -1;
+		break;
+	case 14: // 001a.2b3c.4d5e
+		group = 4;
+		sep = '.';
+		break;
+	case 12: // 001a2b3c4d5e
+		group = 12;
+		break;
+	default:
+		return -1;
+	}
+
+	p = value;
+	for (i = 0; i < 12; i++) {
+		int d = 0;
+		if ((i > 0) && ((i % group) == 0) && (*p++ != sep))
+			return -1;
+		d = hex_digit(*p++);
+		if (d < 0)
+			return -1;
+		mac[i / 2] = (mac[i / 2] << 4) | d;
+	}
+	if (*p != '\0')
+		return -1;
+
+	kcontext_printf(context, "%02x:%02x:%02x:%02x:%02x:%02x",
+		mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+	return 0;
+}
+
+
+klish_ptype_RANGE_LIST_t *klish_ptype_RANGE_LIST_init(kaction_t *action)
+{
+	klish_ptype_RANGE_LIST_t *udata = NULL;
+	const char *line = NULL;
+	faux_argv_t *argv = NULL;
+
+	udata = faux_malloc(sizeof(*udata));
+	assert(udata);
+	if (!udata)
+		return NULL;
+
+	line = kaction_script(action);
+
+	if (faux_str_is_empty(line)) {
+		udata->is_range = BOOL_FALSE;
+
+	} else {
+		const char *str = NULL;
+
+		udata->is_range = BOOL_TRUE;
+
+		argv = faux_argv_new();
+		faux_argv_parse(argv, line);
+		if (faux_argv_len(argv) < 2)
+			goto err;
+
+		// Min
+		str = faux_argv_index(argv, 0);
+		if (!faux_conv_atoul(str, &udata->min, 0))
+			goto err;
+
+		// Max
+		str = faux_argv_index(argv, 1);
+		if (!faux_conv_atoul(str, &udata->max, 0))
+			goto err;
+
+		faux_argv_free(argv);
+	}
+
+	kaction_set_udata(action, udata, faux_free);
+
+	return udata;
+
+err:
+	faux_argv_free(argv);
+	faux_free(udata);
+
+	return NULL;
+}
+
+
+/** @brief PREPARE: Build RANGE_LIST's udata while scheme finalizing
+ */
+int klish_prepare_RANGE_LIST(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return -1;
+	if (kaction_udata(action))
+		return 0;
+	if (!klish_ptype_RANGE_LIST_init(action))
+		return -1;
+
+	return 0;
+}
+
+
+/** @brief PTYPE: Comma separated list of numbers and ranges
+ *
+ * The value looks like "1-10,20,30-40". The start of range can't be greater
+ * than end of range. Leading zeros are removed within canonical form. The
+ * optional ACTION's script defines the bounds for all numbers:
+ *
+ * <ACTION sym="RANGE_LIST">1 4094</ACTION>
+ */
+int klish_ptype_RANGE_LIST(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+	klish_ptype_RANGE_LIST_t *udata = NULL;
+	const char *p = NULL;
+	unsigned long int min = 0;
+	unsigned long int max = UINT32_MAX;
+
+	action = kcontext_action(context);
+	udata = (klish_ptype_RANGE_LIST_t *)kaction_udata(action);
+	if (!udata) {
+		udata = klish_ptype_RANGE_LIST_init(action);
+		if (!udata)
+			return -1;
+	}
+	if (udata->is_range) {
+		min = udata->min;
+		max = udata->max;
+	}
+
+	// The output of failed PTYPE is dropped so it's safe to write
+	// canonical form while parsing
+	p = kcontext_candidate_value(context);
+	while (BOOL_TRUE) {
+		unsigned long int start = 0;
+		unsigned long int end = 0;
+
+		if (!parse_dec(p, &p, BOOL_FALSE, max, &start) || (start < min))
+			return -1;
+		kcontext_printf(context, "%lu", start);
+		if ('-' == *p) {
+			if (!parse_dec(p + 1, &p, BOOL_FALSE, max, &end) ||
+				(end < start))
+				return -1;
+			kcontext_printf(context, "-%lu", end);
+		}
+		if (*p != ',')
+			break;
+		kcontext_fwrite(context, stdout, ",", 1);
+		p++;
+	}
+	if (*p != '\0')
+		return -1;
+
+	return 0;
+}
+
+
+/** @brief HELP: Show ACTION's script as a format of value
+ *
+ * The help string is a help of parameter. It's useful for PTYPEs that
+ * can't generate completions like IPV4.
+ *
+ * <HELP>
+ *     <ACTION sym="help_PTYPE">A.B.C.D</ACTION>
+ * </HELP>
+ */
+int klish_help_PTYPE(kcontext_t *context)
+{
+	kentry_t *entry = NULL;
+	const char *format = NULL;
+	const char *help_text = NULL;
+
+	format = kcontext_script(context);
+	if (faux_str_is_empty(format))
+		return -1;
+
+	entry = kcontext_candidate_entry(context);
+	help_text = kentry_help(entry);
+	if (!help_text)
+		help_text = kentry_name(entry);
+	assert(help_text);
+
+	kcontext_printf(context, "%s\n%s\n", format, help_text);
+
+	return 0;
+}
@@ -3,6 +3,8 @@
  *
  * It gets any string by default. The regular expression can be defined within
  * PTYPE body. In this case input string will be validated using this regexp.
+ * The compiled regexps are shared by PTYPEs with the same pattern (see
+ * regex_dfa.c).
  */
 
 #include <assert.h>
@@ -11,7 +13,6 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
-#include <regex.h>
 
 #include <faux/str.h>
 #include <faux/list.h>
@@ -20,10 +21,12 @@
 #include <klish/kcontext.h>
 #include <klish/kentry.h>
 
+#include "private.h"
+
 
 typedef struct {
 	bool_t is_regex;
-	regex_t compiled_regex;
+	klish_regex_t *regex;
 } klish_ptype_STRING_t;
 
 
@@ -32,7 +35,7 @@ static void klish_ptype_STRING_free(void *data)
 	klish_ptype_STRING_t *udata = (klish_ptype_STRING_t *)data;
 
 	if (udata->is_regex)
-		regfree(&udata->compiled_regex);
+		klish_regex_put(udata->regex);
 
 	faux_free(udata);
 }
@@ -54,9 +57,8 @@ klish_ptype_STRING_t *klish_ptype_STRING_init(kaction_t *action)
 		udata->is_regex = BOOL_FALSE;
 	} else {
 		udata->is_regex = BOOL_TRUE;
-		if (regcomp(&udata->compiled_regex, pattern,
-			REG_NOSUB | REG_EXTENDED))
-		{
+		udata->regex = klish_regex_get(pattern);
+		if (!udata->regex) {
 			faux_free(udata);
 			return NULL;
 		}
@@ -68,6 +70,27 @@ klish_ptype_STRING_t *klish_ptype_STRING_init(kaction_t *action)
 }
 
 
+/** @brief PREPARE: Build STRING's udata while scheme finalizing
+ *
+ * The regular expression compilation is relatively expensive. So it's better
+ * to do it once within klishd than within each forked session.
+ */
+int klish_prepare_STRING(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+
+	action = kcontext_action(context);
+	if (!action)
+		return -1;
+	if (kaction_udata(action))
+		return 0;
+	if (!klish_ptype_STRING_init(action))
+		return -1;
+
+	return 0;
+}
+
+
 /** @brief PTYPE: String
  */
 int klish_ptype_STRING(kcontext_t *context)
@@ -90,7 +113,7 @@ int klish_ptype_STRING(kcontext_t *context)
 	if (!udata->is_regex)
 		return 0;
 
-	if (regexec(&udata->compiled_regex, value, 0, NULL, 0))
+	if (!klish_regex_match(udata->regex, value))
 		return -1;
 
 	return 0;
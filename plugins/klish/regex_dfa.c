@@ -0,0 +1,902 @@
+/*
+ * Regular expressions for STRING PTYPE.
+ *
+ * The POSIX extended regular expression is compiled to DFA so the value is
+ * validated in linear time without allocations. Only subset of ERE syntax
+ * is supported by DFA compiler: literals, ".", bracket expressions (with
+ * common character classes), grouping, alternation, "*", "+", "?" and
+ * bounds. The "^" and "$" anchors are supported at the begin and the end of
+ * pattern. The patterns with other constructs are compiled by regcomp().
+ * The values with non-ASCII characters are always validated by regexec()
+ * because it knows about locale's multibyte characters.
+ *
+ * The compiled patterns are cached by pattern text. So PTYPEs with the same
+ * pattern share the same compiled object. Patterns are compiled by klishd
+ * before fork() (see STRING's prepare hook) so the cache is shared by all
+ * service processes.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <regex.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+#include <faux/list.h>
+
+#include "private.h"
+
+
+#define NFA_MAX_STATES 4096
+#define DFA_MAX_STATES 512
+#define DFA_DEAD 0 // DFA state without any way to the accept state
+#define REPEAT_MAX 255 // Like RE_DUP_MAX
+
+
+// Set of bytes. Bitmap.
+typedef struct {
+	uint32_t bits[8];
+} cset_t;
+
+
+typedef enum {
+	NODE_EMPTY,
+	NODE_CSET,
+	NODE_CAT,
+	NODE_ALT,
+	NODE_REPEAT
+} node_e;
+
+
+// Parsed pattern
+typedef struct node_s node_t;
+struct node_s {
+	node_e type;
+	int cset; // Index of cset for NODE_CSET
+	node_t *left;
+	node_t *right; // For NODE_CAT and NODE_ALT
+	int min; // For NODE_REPEAT
+	int max; // -1 - infinite
+};
+
+
+typedef struct {
+	int cset; // Index of cset or -1 for epsilon-only state
+	int next; // Target of cset transition
+	int eps[2]; // Epsilon transitions
+	int neps;
+} nfa_state_t;
+
+
+typedef struct {
+	// Parser
+	const char *pattern;
+	const char *pos;
+	bool_t failed; // Unsupported syntax or limit is exceeded
+	cset_t *csets;
+	int csets_num;
+	faux_list_t *nodes; // All allocated nodes
+	// NFA
+	nfa_state_t *states;
+	int states_num;
+	int start;
+	int accept;
+} compiler_t;
+
+
+struct klish_regex_s {
+	char *pattern;
+	size_t refs;
+	// DFA
+	uint16_t *table; // [state * classes_num + class]
+	uint8_t *accept; // Accepting states
+	uint8_t classes[256]; // Byte to class
+	int classes_num;
+	int states_num;
+	int start;
+	// Fallback
+	bool_t posix_compiled;
+	regex_t posix;
+	klish_regex_t *next; // Cache list
+};
+
+
+// Cache of compiled patterns
+static klish_regex_t *regex_cache = NULL;
+
+
+static void cset_add(cset_t *set, unsigned char c)
+{
+	set->bits[c >> 5] |= (1u << (c & 31));
+}
+
+
+static bool_t cset_has(const cset_t *set, unsigned char c)
+{
+	return (set->bits[c >> 5] & (1u << (c & 31))) ? BOOL_TRUE : BOOL_FALSE;
+}
+
+
+static int new_cset(compiler_t *c)
+{
+	cset_t *csets = NULL;
+
+	csets = realloc(c->csets, (c->csets_num + 1) * sizeof(*csets));
+	assert(csets);
+	c->csets = csets;
+	memset(&c->csets[c->csets_num], 0, sizeof(cset_t));
+
+	return c->csets_num++;
+}
+
+
+static node_t *new_node(compiler_t *c, node_e type)
+{
+	node_t *node = faux_zmalloc(sizeof(*node));
+
+	assert(node);
+	node->type = type;
+	node->cset = -1;
+	faux_list_add(c->nodes, node);
+
+	return node;
+}
+
+
+static node_t *new_node2(compiler_t *c, node_e type,
+	node_t *left, node_t *right)
+{
+	node_t *node = new_node(c, type);
+
+	node->left = left;
+	node->right = right;
+
+	return node;
+}
+
+
+static node_t *any_node(compiler_t *c)
+{
+	node_t *node = new_node(c, NODE_CSET);
+	int i = 0;
+
+	node->cset = new_cset(c);
+	for (i = 1; i < 256; i++) // Any except '\0'
+		cset_add(&c->csets[node->cset], (unsigned char)i);
+
+	return node;
+}
+
+
+// Adds character class like "[:alpha:]" to set
+static bool_t parse_class(compiler_t *c, cset_t *set)
+{
+	static const struct {
+		const char *name;
+		int (*fn)(int);
+	} classes[] = {
+		{ "alpha", isalpha },
+		{ "digit", isdigit },
+		{ "alnum", isalnum },
+		{ "upper", isupper },
+		{ "lower", islower },
+		{ "space", isspace },
+		{ "blank", isblank },
+		{ "xdigit", isxdigit },
+		{ "punct", ispunct },
+		{ NULL, NULL }
+	};
+	const char *end = strstr(c->pos, ":]");
+	size_t len = 0;
+	int i = 0;
+
+	if (!end)
+		return BOOL_FALSE;
+	len = end - c->pos;
+	for (i = 0; classes[i].name; i++) {
+		int ch = 0;
+		if ((strlen(classes[i].name) != len) ||
+			(strncmp(classes[i].name, c->pos, len) != 0))
+			continue;
+		for (ch = 0; ch < 128; ch++)
+			if (classes[i].fn(ch))
+				cset_add(set, (unsigned char)ch);
+		c->pos = end + 2;
+		return BOOL_TRUE;
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Bracket expression. The c->pos points after '['
+static node_t *parse_bracket(compiler_t *c)
+{
+	node_t *node = new_node(c, NODE_CSET);
+	cset_t set = {};
+	bool_t negate = BOOL_FALSE;
+	bool_t first = BOOL_TRUE;
+	int i = 0;
+
+	if ('^' == *c->pos) {
+		negate = BOOL_TRUE;
+		c->pos++;
+	}
+
+	while (*c->pos && ((']' != *c->pos) || first)) {
+		unsigned char from = (unsigned char)*c->pos;
+		unsigned char to = from;
+
+		first = BOOL_FALSE;
+		if (from >= 0x80) // Multibyte characters
+			goto unsupported;
+		if ('[' == *c->pos) {
+			if (':' == c->pos[1]) {
+				c->pos += 2;
+				if (!parse_class(c, &set))
+					goto unsupported;
+				continue;
+			}
+			// Collating elements and equivalence classes
+			if (('.' == c->pos[1]) || ('=' == c->pos[1]))
+				goto unsupported;
+		}
+		c->pos++;
+		if (('-' == *c->pos) && c->pos[1] && (']' != c->pos[1])) {
+			to = (unsigned char)c->pos[1];
+			if (('[' == c->pos[1]) || (to < from) || (to >= 0x80))
+				goto unsupported;
+			c->pos += 2;
+		}
+		for (i = from; i <= to; i++)
+			cset_add(&set, (unsigned char)i);
+	}
+	if (']' != *c->pos)
+		goto unsupported;
+	c->pos++;
+
+	node->cset = new_cset(c);
+	for (i = 1; i < 256; i++) {
+		bool_t has = cset_has(&set, (unsigned char)i);
+		if (negate ? !has : has)
+			cset_add(&c->csets[node->cset], (unsigned char)i);
+	}
+
+	return node;
+
+unsupported:
+	c->failed = BOOL_TRUE;
+	return node;
+}
+
+
+static node_t *parse_alt(compiler_t *c, int depth);
+
+
+static node_t *parse_atom(compiler_t *c, int depth)
+{
+	node_t *node = NULL;
+	unsigned char ch = (unsigned char)*c->pos;
+
+	switch (ch) {
+	case '(':
+		c->pos++;
+		node = parse_alt(c, depth + 1);
+		if (')' != *c->pos) {
+			c->failed = BOOL_TRUE;
+			return node;
+		}
+		c->pos++;
+		return node;
+	case '[':
+		c->pos++;
+		return parse_bracket(c);
+	case '.':
+		c->pos++;
+		return any_node(c);
+	case '\\':
+		ch = (unsigned char)c->pos[1];
+		// Only escaped punctuation is a literal. Other escapes
+		// (back-references, GNU extensions like "\w", "\<") are not
+		// supported.
+		if (!ch || !ispunct(ch) || strchr("<>`'", ch)) {
+			c->failed = BOOL_TRUE;
+			return new_node(c, NODE_EMPTY);
+		}
+		c->pos += 2;
+		break;
+	case '*':
+	case '+':
+	case '?':
+	case '{':
+	case '^':
+	case '$':
+		c->failed = BOOL_TRUE;
+		return new_node(c, NODE_EMPTY);
+	default:
+		if (ch >= 0x80) { // Multibyte characters
+			c->failed = BOOL_TRUE;
+			return new_node(c, NODE_EMPTY);
+		}
+		c->pos++;
+		break;
+	}
+
+	node = new_node(c, NODE_CSET);
+	node->cset = new_cset(c);
+	cset_add(&c->csets[node->cset], ch);
+
+	return node;
+}
+
+
+// Bound like "{2}", "{2,}", "{2,5}". The c->pos points after '{'
+static bool_t parse_bound(compiler_t *c, int *min, int *max)
+{
+	char *end = NULL;
+	long n = 0;
+
+	if (!isdigit((unsigned char)*c->pos))
+		return BOOL_FALSE;
+	n = strtol(c->pos, &end, 10);
+	if (n > REPEAT_MAX)
+		return BOOL_FALSE;
+	*min = *max = (int)n;
+	c->pos = end;
+	if (',' == *c->pos) {
+		c->pos++;
+		*max = -1;
+		if (isdigit((unsigned char)*c->pos)) {
+			n = strtol(c->pos, &end, 10);
+			if ((n > REPEAT_MAX) || (n < *min))
+				return BOOL_FALSE;
+			*max = (int)n;
+			c->pos = end;
+		}
+	}
+	if ('}' != *c->pos)
+		return BOOL_FALSE;
+	c->pos++;
+
+	return BOOL_TRUE;
+}
+
+
+static node_t *parse_repeat(compiler_t *c, int depth)
+{
+	node_t *node = parse_atom(c, depth);
+
+	while (!c->failed) {
+		node_t *rep = NULL;
+		int min = 0;
+		int max = -1;
+
+		switch (*c->pos) {
+		case '*':
+			c->pos++;
+			break;
+		case '+':
+			c->pos++;
+			min = 1;
+			break;
+		case '?':
+			c->pos++;
+			max = 1;
+			break;
+		case '{':
+			c->pos++;
+			if (!parse_bound(c, &min, &max)) {
+				c->failed = BOOL_TRUE;
+				return node;
+			}
+			break;
+		default:
+			return node;
+		}
+		rep = new_node2(c, NODE_REPEAT, node, NULL);
+		rep->min = min;
+		rep->max = max;
+		node = rep;
+	}
+
+	return node;
+}
+
+
+static node_t *parse_cat(compiler_t *c, int depth)
+{
+	node_t *node = NULL;
+
+	while (!c->failed && *c->pos && ('|' != *c->pos) &&
+		!((')' == *c->pos) && (depth > 0))) {
+		node_t *rep = parse_repeat(c, depth);
+		node = node ? new_node2(c, NODE_CAT, node, rep) : rep;
+	}
+	if (!node)
+		node = new_node(c, NODE_EMPTY);
+
+	return node;
+}
+
+
+static node_t *parse_alt(compiler_t *c, int depth)
+{
+	node_t *node = parse_cat(c, depth);
+
+	while (!c->failed && ('|' == *c->pos)) {
+		c->pos++;
+		node = new_node2(c, NODE_ALT, node, parse_cat(c, depth));
+	}
+
+	return node;
+}
+
+
+static int nfa_new(compiler_t *c)
+{
+	nfa_state_t *st = NULL;
+
+	if (c->states_num >= NFA_MAX_STATES) {
+		c->failed = BOOL_TRUE;
+		return 0;
+	}
+	st = &c->states[c->states_num];
+	st->cset = -1;
+	st->next = -1;
+	st->neps = 0;
+
+	return c->states_num++;
+}
+
+
+static void nfa_eps(compiler_t *c, int from, int to)
+{
+	nfa_state_t *st = &c->states[from];
+
+	assert(st->neps < 2);
+	st->eps[st->neps++] = to;
+}
+
+
+// Thompson's construction. Each fragment has single start and end states.
+// The end state has no outgoing transitions.
+static void nfa_build(compiler_t *c, const node_t *node, int *start, int *end)
+{
+	int s1 = 0, e1 = 0, s2 = 0, e2 = 0;
+	int i = 0;
+
+	*start = *end = 0;
+	if (c->failed)
+		return;
+
+	switch (node->type) {
+	case NODE_EMPTY:
+		*start = *end = nfa_new(c);
+		break;
+	case NODE_CSET:
+		*start = nfa_new(c);
+		*end = nfa_new(c);
+		if (c->failed)
+			return;
+		c->states[*start].cset = node->cset;
+		c->states[*start].next = *end;
+		break;
+	case NODE_CAT:
+		nfa_build(c, node->left, &s1, &e1);
+		nfa_build(c, node->right, &s2, &e2);
+		if (c->failed)
+			return;
+		nfa_eps(c, e1, s2);
+		*start = s1;
+		*end = e2;
+		break;
+	case NODE_ALT:
+		*start = nfa_new(c);
+		*end = nfa_new(c);
+		nfa_build(c, node->left, &s1, &e1);
+		nfa_build(c, node->right, &s2, &e2);
+		if (c->failed)
+			return;
+		nfa_eps(c, *start, s1);
+		nfa_eps(c, *start, s2);
+		nfa_eps(c, e1, *end);
+		nfa_eps(c, e2, *end);
+		break;
+	case NODE_REPEAT:
+		*start = *end = nfa_new(c);
+		// Mandatory copies
+		for (i = 0; i < node->min; i++) {
+			nfa_build(c, node->left, &s1, &e1);
+			if (c->failed)
+				return;
+			nfa_eps(c, *end, s1);
+			*end = e1;
+		}
+		// Infinite tail
+		if (node->max < 0) {
+			int loop = nfa_new(c);
+			int out = nfa_new(c);
+			nfa_build(c, node->left, &s1, &e1);
+			if (c->failed)
+				return;
+			nfa_eps(c, *end, loop);
+			nfa_eps(c, loop, s1);
+			nfa_eps(c, loop, out);
+			nfa_eps(c, e1, loop);
+			*end = out;
+			break;
+		}
+		// Optional copies
+		for (i = node->min; i < node->max; i++) {
+			int out = nfa_new(c);
+			nfa_build(c, node->left, &s1, &e1);
+			if (c->failed)
+				return;
+			nfa_eps(c, *end, s1);
+			nfa_eps(c, *end, out);
+			nfa_eps(c, e1, out);
+			*end = out;
+		}
+		break;
+	}
+}
+
+
+static void closure(const compiler_t *c, uint8_t *set, int *stack)
+{
+	int sp = 0;
+	int i = 0;
+
+	for (i = 0; i < c->states_num; i++)
+		if (set[i])
+			stack[sp++] = i;
+	while (sp > 0) {
+		const nfa_state_t *st = &c->states[stack[--sp]];
+		for (i = 0; i < st->neps; i++) {
+			if (set[st->eps[i]])
+				continue;
+			set[st->eps[i]] = 1;
+			stack[sp++] = st->eps[i];
+		}
+	}
+}
+
+
+// Splits bytes to classes. Bytes of the same class are not distinguished by
+// any cset of pattern.
+static void build_classes(const compiler_t *c, klish_regex_t *re)
+{
+	int i = 0, b = 0;
+
+	memset(re->classes, 0, sizeof(re->classes));
+	re->classes_num = 1;
+	for (i = 0; i < c->csets_num; i++) {
+		int map[256][2];
+		int num = 0;
+		memset(map, -1, sizeof(map));
+		for (b = 0; b < 256; b++) {
+			int in = cset_has(&c->csets[i], (unsigned char)b) ? 1 : 0;
+			int *cls = &map[re->classes[b]][in];
+			if (*cls < 0)
+				*cls = num++;
+			re->classes[b] = (uint8_t)*cls;
+		}
+		re->classes_num = num;
+	}
+}
+
+
+// Subset construction
+static bool_t dfa_build(const compiler_t *c, klish_regex_t *re)
+{
+	size_t set_size = c->states_num;
+	uint8_t *sets = NULL; // DFA states as sets of NFA states
+	int *stack = NULL;
+	uint8_t *cur = NULL;
+	int rep[256]; // Representative byte of class
+	int num = 0;
+	int s = 0, cls = 0, i = 0;
+	bool_t rc = BOOL_FALSE;
+
+	build_classes(c, re);
+	for (i = 255; i >= 0; i--)
+		rep[re->classes[i]] = i;
+
+	sets = faux_zmalloc(DFA_MAX_STATES * set_size);
+	stack = faux_zmalloc(c->states_num * sizeof(*stack));
+	cur = faux_zmalloc(set_size);
+	re->table = faux_zmalloc(DFA_MAX_STATES * re->classes_num *
+		sizeof(*re->table));
+	re->accept = faux_zmalloc(DFA_MAX_STATES);
+	assert(sets && stack && cur && re->table && re->accept);
+
+	// State 0 is a dead state (empty set)
+	num = 1;
+	sets[set_size + c->start] = 1;
+	closure(c, &sets[set_size], stack);
+	re->start = num++;
+
+	for (s = 1; s < num; s++) {
+		const uint8_t *set = &sets[s * set_size];
+		re->accept[s] = set[c->accept];
+		for (cls = 0; cls < re->classes_num; cls++) {
+			unsigned char b = (unsigned char)rep[cls];
+			bool_t empty = BOOL_TRUE;
+			int target = 0;
+			memset(cur, 0, set_size);
+			for (i = 0; i < c->states_num; i++) {
+				const nfa_state_t *st = &c->states[i];
+				if (!set[i] || (st->cset < 0))
+					continue;
+				if (!cset_has(&c->csets[st->cset], b))
+					continue;
+				cur[st->next] = 1;
+				empty = BOOL_FALSE;
+			}
+			if (empty) {
+				re->table[s * re->classes_num + cls] = DFA_DEAD;
+				continue;
+			}
+			closure(c, cur, stack);
+			for (target = 1; target < num; target++)
+				if (!memcmp(&sets[target * set_size], cur, set_size))
+					break;
+			if (target == num) {
+				if (num >= DFA_MAX_STATES)
+					goto out;
+				memcpy(&sets[num * set_size], cur, set_size);
+				num++;
+			}
+			re->table[s * re->classes_num + cls] = (uint16_t)target;
+		}
+	}
+	re->states_num = num;
+	rc = BOOL_TRUE;
+
+out:
+	faux_free(sets);
+	faux_free(stack);
+	faux_free(cur);
+
+	return rc;
+}
+
+
+// Compiles pattern to DFA. Returns BOOL_FALSE if pattern is not supported.
+static bool_t compile_dfa(klish_regex_t *re)
+{
+	compiler_t c = {};
+	node_t *node = NULL;
+	bool_t anchor_start = BOOL_FALSE;
+	bool_t anchor_end = BOOL_FALSE;
+	size_t len = strlen(re->pattern);
+	char *body = NULL;
+	const char *p = NULL;
+	int depth = 0;
+	bool_t rc = BOOL_FALSE;
+
+	// Anchors. The "^" and "$" are supported at the edges only. With
+	// top-level alternation they belong to the first and the last
+	// alternative so such patterns are not supported too.
+	body = faux_str_dup(re->pattern);
+	if ('^' == body[0])
+		anchor_start = BOOL_TRUE;
+	if ((len > (anchor_start ? 1 : 0)) && ('$' == body[len - 1]) &&
+		!((len > 1) && ('\\' == body[len - 2]))) {
+		anchor_end = BOOL_TRUE;
+		body[len - 1] = '\0';
+	}
+	for (p = body; *p; p++) {
+		if ('\\' == *p) {
+			if (p[1])
+				p++;
+			continue;
+		}
+		if ('[' == *p) { // Skip bracket expression
+			const char *e = p + 1;
+			if ('^' == *e)
+				e++;
+			if (']' == *e)
+				e++;
+			while (*e && (']' != *e)) {
+				if (('[' == *e) && (':' == e[1])) {
+					const char *ce = strstr(e, ":]");
+					e = ce ? ce + 1 : e;
+				}
+				e++;
+			}
+			if (!*e)
+				break;
+			p = e;
+			continue;
+		}
+		if ('(' == *p)
+			depth++;
+		else if (')' == *p)
+			depth--;
+		else if (('|' == *p) && (0 == depth) &&
+			(anchor_start || anchor_end))
+			goto out;
+	}
+
+	c.pattern = body;
+	c.pos = body + (anchor_start ? 1 : 0);
+	c.nodes = faux_list_new(FAUX_LIST_UNSORTED, FAUX_LIST_NONUNIQUE,
+		NULL, NULL, faux_free);
+	c.states = faux_zmalloc(NFA_MAX_STATES * sizeof(*c.states));
+	assert(c.states);
+
+	node = parse_alt(&c, 0);
+	if (c.failed || *c.pos) // Unbalanced ')' or unsupported syntax
+		goto out;
+
+	// The regexec() searches for substring. So unanchored pattern is
+	// ".*pattern.*"
+	if (!anchor_start) {
+		node_t *any = new_node2(&c, NODE_REPEAT, any_node(&c), NULL);
+		any->max = -1;
+		node = new_node2(&c, NODE_CAT, any, node);
+	}
+	if (!anchor_end) {
+		node_t *any = new_node2(&c, NODE_REPEAT, any_node(&c), NULL);
+		any->max = -1;
+		node = new_node2(&c, NODE_CAT, node, any);
+	}
+
+	nfa_build(&c, node, &c.start, &c.accept);
+	if (c.failed)
+		goto out;
+	if (!dfa_build(&c, re))
+		goto out;
+
+	rc = BOOL_TRUE;
+
+out:
+	if (!rc) {
+		faux_free(re->table);
+		faux_free(re->accept);
+		re->table = NULL;
+		re->accept = NULL;
+	}
+	faux_list_free(c.nodes);
+	faux_free(c.states);
+	faux_free(c.csets);
+	faux_str_free(body);
+
+	return rc;
+}
+
+
+static bool_t compile_posix(klish_regex_t *re)
+{
+	if (re->posix_compiled)
+		return BOOL_TRUE;
+	if (regcomp(&re->posix, re->pattern, REG_NOSUB | REG_EXTENDED))
+		return BOOL_FALSE;
+	re->posix_compiled = BOOL_TRUE;
+
+	return BOOL_TRUE;
+}
+
+
+static void klish_regex_free(klish_regex_t *re)
+{
+	if (!re)
+		return;
+
+	if (re->posix_compiled)
+		regfree(&re->posix);
+	faux_free(re->table);
+	faux_free(re->accept);
+	faux_str_free(re->pattern);
+	faux_free(re);
+}
+
+
+/** @brief Gets compiled pattern from cache or compiles it.
+ *
+ * @param [in] pattern ERE pattern.
+ * @return Compiled pattern or NULL on error. Must be released by
+ * klish_regex_put().
+ */
+klish_regex_t *klish_regex_get(const char *pattern)
+{
+	klish_regex_t *re = NULL;
+
+	assert(pattern);
+	if (!pattern)
+		return NULL;
+
+	for (re = regex_cache; re; re = re->next) {
+		if (strcmp(re->pattern, pattern) == 0) {
+			re->refs++;
+			return re;
+		}
+	}
+
+	re = faux_zmalloc(sizeof(*re));
+	assert(re);
+	re->pattern = faux_str_dup(pattern);
+	re->refs = 1;
+
+	// The regcomp() validates syntax of any pattern. But DFA doesn't need
+	// it for ASCII values so it's compiled on demand.
+	if (!compile_dfa(re) && !compile_posix(re)) {
+		klish_regex_free(re);
+		return NULL;
+	}
+
+	re->next = regex_cache;
+	regex_cache = re;
+
+	return re;
+}
+
+
+void klish_regex_put(klish_regex_t *re)
+{
+	klish_regex_t **link = NULL;
+
+	if (!re)
+		return;
+	if (--re->refs > 0)
+		return;
+
+	for (link = &regex_cache; *link; link = &(*link)->next) {
+		if (*link == re) {
+			*link = re->next;
+			break;
+		}
+	}
+	klish_regex_free(re);
+}
+
+
+/** @brief Checks if value matches pattern.
+ *
+ * Works like regexec() without flags.
+ */
+bool_t klish_regex_match(klish_regex_t *re, const char *value)
+{
+	const unsigned char *p = (const unsigned char *)value;
+	int state = 0;
+
+	assert(re);
+	if (!re || !value)
+		return BOOL_FALSE;
+
+	if (re->table) {
+		state = re->start;
+		for (; *p; p++) {
+			if (*p >= 0x80) // Multibyte characters
+				break;
+			state = re->table[state * re->classes_num +
+				re->classes[*p]];
+			if (DFA_DEAD == state)
+				return BOOL_FALSE;
+		}
+		if (!*p)
+			return re->accept[state] ? BOOL_TRUE : BOOL_FALSE;
+	}
+
+	if (!compile_posix(re))
+		return BOOL_FALSE;
+	if (regexec(&re->posix, value, 0, NULL, 0))
+		return BOOL_FALSE;
+
+	return BOOL_TRUE;
+}
+
+
+// Pattern is compiled to DFA. Else regexec() is used for all values.
+bool_t klish_regex_is_dfa(const klish_regex_t *re)
+{
+	assert(re);
+	if (!re)
+		return BOOL_FALSE;
+
+	return re->table ? BOOL_TRUE : BOOL_FALSE;
+}
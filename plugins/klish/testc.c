@@ -0,0 +1,539 @@
+/*
+ * Unit tests and microbenchmarks of "klish" plugin's PTYPEs and regular
+ * expressions.
+ *
+ * The syms are executed by ksession_exec_locally() within minimal scheme
+ * like ksession_validate_arg() does. So the tests check the real output
+ * (canonical form of value) of PTYPEs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <regex.h>
+
+#include <faux/str.h>
+#include <klish/kscheme.h>
+#include <klish/kentry.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+#include <klish/kpargv.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+#include <klish/ksession_parse.h>
+
+#include "private.h"
+
+
+typedef struct {
+	kscheme_t *scheme;
+	ksession_t *session;
+	kentry_t *param; // Parameter with nested PTYPE. It's a candidate
+	kentry_t *ptype;
+	kentry_t *service; // COMPL or HELP of parameter. Can be NULL
+	ksym_t *ptype_sym;
+	ksym_t *service_sym;
+} testc_ptype_t;
+
+
+static kentry_t *testc_entry_new(kentry_t *parent, const char *name,
+	kentry_purpose_e purpose, ksym_t *sym, const char *script)
+{
+	kentry_t *entry = kentry_new(name);
+	kaction_t *action = kaction_new();
+
+	kentry_set_purpose(entry, purpose);
+	kaction_set_sym(action, sym);
+	if (script)
+		kaction_set_script(action, script);
+	kentry_add_actions(entry, action);
+	kentry_add_entrys(parent, entry);
+	kentry_set_nested_by_purpose(parent, purpose, entry);
+
+	return entry;
+}
+
+
+/** @brief Creates scheme with single parameter.
+ *
+ * @param [in] ptype_fn PTYPE's sym function.
+ * @param [in] script PTYPE ACTION's script. Can be NULL.
+ * @param [in] purpose Purpose of service entry (COMPL, HELP).
+ * @param [in] service_fn Service entry's sym function. Can be NULL.
+ */
+static testc_ptype_t *testc_ptype_new(ksym_fn ptype_fn, const char *script,
+	kentry_purpose_e purpose, ksym_fn service_fn)
+{
+	testc_ptype_t *t = faux_zmalloc(sizeof(*t));
+	kentry_t *view = NULL;
+
+	t->scheme = kscheme_new();
+	view = kentry_new("main");
+	kentry_set_prepared(view, BOOL_TRUE);
+	kscheme_add_entrys(t->scheme, view);
+	t->param = kentry_new("param");
+	kentry_add_entrys(view, t->param);
+
+	t->ptype_sym = ksym_new_fast("ptype", ptype_fn);
+	t->ptype = testc_entry_new(t->param, "PTYPE", KENTRY_PURPOSE_PTYPE,
+		t->ptype_sym, script);
+	if (service_fn) {
+		t->service_sym = ksym_new_fast("service", service_fn);
+		t->service = testc_entry_new(t->param, "SERVICE", purpose,
+			t->service_sym, NULL);
+	}
+
+	t->session = ksession_new(t->scheme, "main");
+
+	return t;
+}
+
+
+static void testc_ptype_free(testc_ptype_t *t)
+{
+	ksession_free(t->session);
+	kscheme_free(t->scheme);
+	ksym_free(t->ptype_sym);
+	ksym_free(t->service_sym);
+	faux_free(t);
+}
+
+
+// Returns retcode of entry's ACTION. Output is returned by "out" argument
+static int testc_ptype_exec(testc_ptype_t *t, kentry_t *entry,
+	const char *value, char **out)
+{
+	kpargv_t *pargv = kpargv_new();
+	kparg_t *parg = kparg_new(t->param, value);
+	int retcode = -1;
+
+	*out = NULL;
+	kpargv_set_candidate_parg(pargv, parg);
+	if (!ksession_exec_locally(t->session, entry, pargv, NULL, NULL,
+		&retcode, out))
+		retcode = -1;
+	kpargv_set_candidate_parg(pargv, NULL);
+	kparg_free(parg);
+	kpargv_free(pargv);
+
+	return retcode;
+}
+
+
+typedef struct {
+	const char *name;
+	ksym_fn fn;
+	const char *script;
+	const char *value;
+	const char *expected; // Canonical form. NULL if value is invalid
+} testc_ptype_case_t;
+
+
+static const testc_ptype_case_t testc_ptype_net_cases[] = {
+	// IPv4
+	{"IPV4", klish_ptype_IPV4, NULL, "10.0.0.1", "10.0.0.1"},
+	{"IPV4", klish_ptype_IPV4, NULL, "192.168.001.1", NULL},
+	{"IPV4", klish_ptype_IPV4, NULL, "256.0.0.1", NULL},
+	{"IPV4", klish_ptype_IPV4, NULL, "10.0.0", NULL},
+	{"IPV4_PREFIX", klish_ptype_IPV4_PREFIX, NULL, "10.0.0.0/8",
+		"10.0.0.0/8"},
+	{"IPV4_PREFIX", klish_ptype_IPV4_PREFIX, NULL, "10.0.0.0/33", NULL},
+	// IPv6 canonicalization (RFC 5952)
+	{"IPV6", klish_ptype_IPV6, NULL,
+		"2001:0DB8:0000:0000:0000:0000:0000:0001", "2001:db8::1"},
+	{"IPV6", klish_ptype_IPV6, NULL,
+		"2001:db8:0:0:1:0:0:1", "2001:db8::1:0:0:1"},
+	{"IPV6", klish_ptype_IPV6, NULL, "0:0:0:0:0:0:0:0", "::"},
+	{"IPV6", klish_ptype_IPV6, NULL,
+		"::FFFF:192.0.2.1", "::ffff:192.0.2.1"},
+	{"IPV6", klish_ptype_IPV6, NULL, "2001:db8::1::2", NULL},
+	{"IPV6", klish_ptype_IPV6, NULL, "2001:db8::1/64", NULL},
+	{"IPV6", klish_ptype_IPV6, NULL, "2001:db8::g", NULL},
+	{"IPV6_PREFIX", klish_ptype_IPV6_PREFIX, NULL,
+		"2001:DB8:0::/32", "2001:db8::/32"},
+	{"IPV6_PREFIX", klish_ptype_IPV6_PREFIX, NULL, "2001:db8::/129", NULL},
+	{"IPV6_PREFIX", klish_ptype_IPV6_PREFIX, NULL, "2001:db8::", NULL},
+	// MAC forms
+	{"MAC", klish_ptype_MAC, NULL,
+		"00:1a:2b:3c:4d:5e", "00:1a:2b:3c:4d:5e"},
+	{"MAC", klish_ptype_MAC, NULL,
+		"00-1A-2B-3C-4D-5E", "00:1a:2b:3c:4d:5e"},
+	{"MAC", klish_ptype_MAC, NULL,
+		"001a.2B3C.4d5e", "00:1a:2b:3c:4d:5e"},
+	{"MAC", klish_ptype_MAC, NULL,
+		"001A2B3C4D5E", "00:1a:2b:3c:4d:5e"},
+	{"MAC", klish_ptype_MAC, NULL, "00:1a-2b:3c:4d:5e", NULL},
+	{"MAC", klish_ptype_MAC, NULL, "00:1a:2b:3c:4d:5g", NULL},
+	{"MAC", klish_ptype_MAC, NULL, "001a.2b3c.4d5", NULL},
+	{"MAC", klish_ptype_MAC, NULL, "001a:2b3c:4d5e", NULL},
+	// RANGE_LIST bounds
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094",
+		"1-10,020,4094", "1-10,20,4094"},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "1", "1"},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "0", NULL},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "4095", NULL},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "1-4095", NULL},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "10-5", NULL},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "1,", NULL},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094", "1,,2", NULL},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, NULL,
+		"0-4294967295", "0-4294967295"},
+	{"RANGE_LIST", klish_ptype_RANGE_LIST, NULL, "4294967296", NULL},
+	{NULL, NULL, NULL, NULL, NULL}
+	};
+
+
+int testc_ptype_net(void)
+{
+	const testc_ptype_case_t *c = NULL;
+	int ret = 0;
+
+	for (c = testc_ptype_net_cases; c->name; c++) {
+		testc_ptype_t *t = testc_ptype_new(c->fn, c->script,
+			KENTRY_PURPOSE_COMMON, NULL);
+		char *out = NULL;
+		int rc = testc_ptype_exec(t, t->ptype, c->value, &out);
+
+		if (c->expected && (rc != 0)) {
+			printf("%s: \"%s\" is not valid\n", c->name, c->value);
+			ret = -1;
+		} else if (c->expected && (faux_str_cmp(out, c->expected) != 0)) {
+			printf("%s: \"%s\" -> \"%s\", expected \"%s\"\n",
+				c->name, c->value, out ? out : "",
+				c->expected);
+			ret = -1;
+		} else if (!c->expected && (0 == rc)) {
+			printf("%s: \"%s\" is valid\n", c->name, c->value);
+			ret = -1;
+		}
+		faux_str_free(out);
+		testc_ptype_free(t);
+	}
+
+	return ret;
+}
+
+
+int testc_ptype_enum(void)
+{
+	testc_ptype_t *t = NULL;
+	char *out = NULL;
+	int ret = -1;
+
+	// Single line. Duplicates are not shown by completion
+	t = testc_ptype_new(klish_ptype_ENUM, "tcp udp  tcp icmp",
+		KENTRY_PURPOSE_COMPLETION, klish_completion_ENUM);
+	if ((testc_ptype_exec(t, t->ptype, "tcp", &out) != 0) ||
+		(testc_ptype_exec(t, t->ptype, "icmp", &out) != 0)) {
+		printf("Valid ENUM value is rejected\n");
+		goto err;
+	}
+	if ((testc_ptype_exec(t, t->ptype, "TCP", &out) == 0) ||
+		(testc_ptype_exec(t, t->ptype, "tc", &out) == 0) ||
+		(testc_ptype_exec(t, t->ptype, "", &out) == 0)) {
+		printf("Invalid ENUM value is accepted\n");
+		goto err;
+	}
+	testc_ptype_exec(t, t->service, "", &out);
+	if (faux_str_cmp(out, "tcp\nudp\nicmp\n") != 0) {
+		printf("Completion of ENUM with duplicates:\n%s\n",
+			out ? out : "");
+		goto err;
+	}
+	faux_str_free(out);
+	out = NULL;
+	testc_ptype_free(t);
+
+	// Multiline. The help of the first duplicate wins
+	t = testc_ptype_new(klish_ptype_ENUM,
+		"\n  tcp  First help  \nudp\n\ntcp Second help\n",
+		KENTRY_PURPOSE_HELP, klish_help_ENUM);
+	if (testc_ptype_exec(t, t->ptype, "udp", &out) != 0) {
+		printf("Valid multiline ENUM value is rejected\n");
+		goto err;
+	}
+	testc_ptype_exec(t, t->service, "", &out);
+	if (faux_str_cmp(out, "tcp\nFirst help\nudp\nparam\n") != 0) {
+		printf("Help of ENUM with duplicates:\n%s\n", out ? out : "");
+		goto err;
+	}
+
+	ret = 0;
+err:
+	faux_str_free(out);
+	testc_ptype_free(t);
+
+	return ret;
+}
+
+
+// Microbenchmark. The sym calls PTYPE function within the same context many
+// times so only PTYPE itself is measured but not the execution of ACTION.
+#define TESTC_BENCH_ITERS 100000
+
+static ksym_fn testc_bench_fn = NULL;
+static unsigned long long testc_bench_ns = 0;
+
+
+static int testc_bench_sym(kcontext_t *context)
+{
+	struct timespec start = {};
+	struct timespec stop = {};
+	unsigned int i = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < TESTC_BENCH_ITERS; i++)
+		if (testc_bench_fn(context) != 0)
+			return -1;
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	testc_bench_ns = (stop.tv_sec - start.tv_sec) * 1000000000ULL +
+		stop.tv_nsec - start.tv_nsec;
+
+	return 0;
+}
+
+
+int testc_ptype_bench(void)
+{
+	char enum_script[2048] = {};
+	const testc_ptype_case_t cases[] = {
+		{"IPV4", klish_ptype_IPV4, NULL, "192.168.100.200", NULL},
+		{"IPV6", klish_ptype_IPV6, NULL, "2001:db8:0:0:1:0:0:1", NULL},
+		{"MAC", klish_ptype_MAC, NULL, "001a.2b3c.4d5e", NULL},
+		{"RANGE_LIST", klish_ptype_RANGE_LIST, "1 4094",
+			"1-10,20,30-40", NULL},
+		{"ENUM(200)", klish_ptype_ENUM, enum_script, "v199", NULL},
+		{"STRING", klish_ptype_STRING, "[a-z]+[0-9]*", "eth0", NULL},
+		{NULL, NULL, NULL, NULL, NULL}
+		};
+	const testc_ptype_case_t *c = NULL;
+	int ret = 0;
+	unsigned int i = 0;
+
+	for (i = 0; i < 200; i++) {
+		char word[16] = {};
+		snprintf(word, sizeof(word), "v%u ", i);
+		strcat(enum_script, word);
+	}
+
+	for (c = cases; c->name; c++) {
+		testc_ptype_t *t = testc_ptype_new(testc_bench_sym, c->script,
+			KENTRY_PURPOSE_COMMON, NULL);
+		char *out = NULL;
+
+		testc_bench_fn = c->fn;
+		testc_bench_ns = 0;
+		if (testc_ptype_exec(t, t->ptype, c->value, &out) != 0) {
+			printf("%s: \"%s\" is not valid\n", c->name, c->value);
+			ret = -1;
+		} else {
+			printf("%-12s %8llu ns/op\n", c->name,
+				testc_bench_ns / TESTC_BENCH_ITERS);
+		}
+		faux_str_free(out);
+		testc_ptype_free(t);
+	}
+
+	return ret;
+}
+
+
+// DFA must give the same results as regexec(). The values are checked
+// against each pattern.
+static const char *testc_regex_patterns[] = {
+	"abc",
+	"^abc$",
+	"^a.c$",
+	"a|b",
+	"ab|cd|ef",
+	"^(a|b)+$",
+	"^[a-z]+[0-9]*$",
+	"^[^0-9]+$",
+	"^[[:alpha:]_][[:alnum:]_]*$",
+	"^[[:digit:]]{1,3}$",
+	"^x{2,}$",
+	"^(ab){2}$",
+	"^a?b+c*$",
+	"^[]a]+$",
+	"^[a-]+$",
+	"^(eth|ge|xe)[0-9]+(/[0-9]+)*$",
+	"\\.",
+	"^\\$[0-9]+$",
+	"^[[:space:]]*$",
+	"^[[:upper:]][[:lower:]]*$",
+	"^[[:xdigit:]]{2}(:[[:xdigit:]]{2}){5}$",
+	"a{0}b",
+	"^(a*)*$",
+	"^[[:punct:]]+$",
+	"x*",
+	"^.{3,5}$",
+	"^[a-c]{2}[^a-c]$",
+	"^(a|b)$|c", // Alternation with anchors. Fallback to regcomp()
+	NULL
+	};
+
+static const char *testc_regex_values[] = {
+	"",
+	"a",
+	"b",
+	"abc",
+	"xabcx",
+	"ab",
+	"abab",
+	"ababab",
+	"eth0",
+	"ge1/2/3",
+	"xe10/",
+	"Eth0",
+	"123",
+	"1234",
+	"x",
+	"xxx",
+	"$12",
+	"a.c",
+	"   ",
+	"\t",
+	"00:1a:2b:3c:4d:5e",
+	"Hello",
+	"]a]",
+	"a-a",
+	"ccd",
+	"caf\xc3\xa9", // Non-ASCII. Always checked by regexec()
+	NULL
+	};
+
+
+int testc_regex_dfa(void)
+{
+	const char **pattern = NULL;
+	const char **value = NULL;
+	unsigned int dfa_num = 0;
+	int ret = 0;
+
+	for (pattern = testc_regex_patterns; *pattern; pattern++) {
+		klish_regex_t *re = klish_regex_get(*pattern);
+		regex_t posix = {};
+
+		if (regcomp(&posix, *pattern, REG_NOSUB | REG_EXTENDED)) {
+			printf("Can't compile \"%s\" by regcomp()\n", *pattern);
+			klish_regex_put(re);
+			ret = -1;
+			continue;
+		}
+		if (!re) {
+			printf("Can't compile \"%s\"\n", *pattern);
+			regfree(&posix);
+			ret = -1;
+			continue;
+		}
+		if (klish_regex_is_dfa(re))
+			dfa_num++;
+		for (value = testc_regex_values; *value; value++) {
+			bool_t expected = (regexec(&posix, *value, 0, NULL, 0) == 0) ?
+				BOOL_TRUE : BOOL_FALSE;
+			if (klish_regex_match(re, *value) != expected) {
+				printf("\"%s\" ~ \"%s\": DFA %s, regexec() %s\n",
+					*value, *pattern,
+					expected ? "mismatch" : "match",
+					expected ? "match" : "mismatch");
+				ret = -1;
+			}
+		}
+		regfree(&posix);
+		klish_regex_put(re);
+	}
+
+	// All patterns except the last one are supported by DFA
+	if (dfa_num != (sizeof(testc_regex_patterns) /
+		sizeof(testc_regex_patterns[0]) - 2)) {
+		printf("Only %u patterns are compiled to DFA\n", dfa_num);
+		ret = -1;
+	}
+
+	return ret;
+}
+
+
+// Microbenchmark of regular expressions. Each pattern is matched by DFA and
+// by regexec() against the same value.
+#define TESTC_REGEX_ITERS 100000
+
+typedef struct {
+	const char *name;
+	const char *pattern;
+	const char *value;
+} testc_regex_case_t;
+
+
+int testc_regex_bench(void)
+{
+	const testc_regex_case_t cases[] = {
+		{"word", "^[a-z]+[0-9]*$", "eth0"},
+		{"interface",
+			"^(ethernet|ge|xe)[0-9]+(/[0-9]+){1,2}(\\.[0-9]+)?$",
+			"ethernet1/0/24.100"},
+		{"description", "^[[:alnum:][:punct:] ]{1,80}$",
+			"Uplink to core-sw2 (rack A12), port 10G-LR #3"},
+		{NULL, NULL, NULL}
+		};
+	const testc_regex_case_t *c = NULL;
+	int ret = 0;
+
+	printf("%-12s %10s %10s\n", "", "DFA", "regexec()");
+	for (c = cases; c->name; c++) {
+		klish_regex_t *re = klish_regex_get(c->pattern);
+		regex_t posix = {};
+		struct timespec start = {};
+		struct timespec stop = {};
+		unsigned long long dfa_ns = 0;
+		unsigned long long posix_ns = 0;
+		unsigned int i = 0;
+
+		if (regcomp(&posix, c->pattern, REG_NOSUB | REG_EXTENDED)) {
+			printf("%s: Can't compile \"%s\" by regcomp()\n",
+				c->name, c->pattern);
+			klish_regex_put(re);
+			ret = -1;
+			continue;
+		}
+		if (!re || !klish_regex_is_dfa(re)) {
+			printf("%s: \"%s\" is not compiled to DFA\n",
+				c->name, c->pattern);
+			klish_regex_put(re);
+			regfree(&posix);
+			ret = -1;
+			continue;
+		}
+		if (!klish_regex_match(re, c->value) ||
+			(regexec(&posix, c->value, 0, NULL, 0) != 0)) {
+			printf("%s: \"%s\" doesn't match \"%s\"\n",
+				c->name, c->value, c->pattern);
+			klish_regex_put(re);
+			regfree(&posix);
+			ret = -1;
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TESTC_REGEX_ITERS; i++)
+			klish_regex_match(re, c->value);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		dfa_ns = (stop.tv_sec - start.tv_sec) * 1000000000ULL +
+			stop.tv_nsec - start.tv_nsec;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < TESTC_REGEX_ITERS; i++)
+			regexec(&posix, c->value, 0, NULL, 0);
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		posix_ns = (stop.tv_sec - start.tv_sec) * 1000000000ULL +
+			stop.tv_nsec - start.tv_nsec;
+
+		printf("%-12s %7llu ns %7llu ns\n", c->name,
+			dfa_ns / TESTC_REGEX_ITERS, posix_ns / TESTC_REGEX_ITERS);
+		regfree(&posix);
+		klish_regex_put(re);
+	}
+
+	return ret;
+}
@@ -0,0 +1,21 @@
+#include <stdlib.h>
+
+
+const unsigned char testc_version_major = 1;
+const unsigned char testc_version_minor = 0;
+
+
+const char *testc_module[][2] = {
+
+	// PTYPEs
+	{"testc_ptype_net", "Network PTYPEs: canonical forms and bounds"},
+	{"testc_ptype_enum", "ENUM PTYPE with duplicates"},
+	{"testc_ptype_bench", "PTYPEs microbenchmark, ns/op in output"},
+
+	// Regular expressions
+	{"testc_regex_dfa", "DFA gives the same results as regexec()"},
+	{"testc_regex_bench", "DFA vs regexec() microbenchmark, ns/op in output"},
+
+	// End of list
+	{NULL, NULL}
+	};
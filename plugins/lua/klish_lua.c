@@ -6,10 +6,13 @@
 #include <signal.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
 
 #include <klish/kplugin.h>
 #include <klish/kcontext.h>
+#include <klish/kaction.h>
 #include <faux/ini.h>
+#include <faux/conv.h>
 #include <faux/str.h>
 #include <lua.h>
 #include <lualib.h>
@@ -17,9 +20,14 @@
 #include "lua-compat.h"
 
 #define LUA_CONTEXT "klish_context"
+#define LUA_PARGV_MT "klish.pargv" // Metatable of parameters view
 #define LUA_AUTORUN_SW "autostart"
 #define LUA_BACKTRACE_SW "backtrace"
 #define LUA_PACKAGE_PATH_SW "package.path"
+#define LUA_FAST_TIMEOUT_SW "fast.timeout"
+
+#define LUA_FAST_TIMEOUT 1000 // Default time limit for "lua_fast" (msec)
+#define LUA_FAST_HOOK_COUNT 1000 // Check time limit every N instructions
 
 
 const uint8_t kplugin_lua_major = KPLUGIN_MAJOR;
@@ -28,12 +36,36 @@ const uint8_t kplugin_lua_minor = KPLUGIN_MINOR;
 const uint8_t kplugin_lua_opt_global = 1; // RTLD_GLOBAL flag for dlopen()
 
 
+// Userdata view over kpargv_t. The arrays are built on first access by name
+struct lua_klish_pargv {
+	const kpargv_t *pargv; // NULL if view is expired
+	size_t len; // Number of pargs
+	kparg_t **pargs; // Array of pargs
+	size_t *next; // Index of next parg with the same name. Else "len"
+	size_t *hash; // Name -> index of first parg. Open addressing
+	size_t hash_mask; // Size of hash - 1. Size is a power of two
+};
+
 struct lua_klish_data {
 	lua_State *L;
 	kcontext_t *context;
 	char *package_path_sw;
 	char *autorun_path_sw;
 	int backtrace_sw; // show traceback
+	unsigned int fast_timeout_sw; // Time limit for "lua_fast" (msec)
+	struct timespec fast_deadline; // When "lua_fast" script must be stopped
+	struct lua_klish_pargv *view[2]; // Views of pargv and parent pargv
+	int view_ref[2]; // Registry references to views
+	struct lua_klish_chunk *chunks; // List of compiled ACTIONs' scripts
+};
+
+// Compiled script of ACTION. It's stored as kaction_t's udata
+struct lua_klish_chunk {
+	int ref; // Reference to function within Lua registry
+	struct lua_klish_data *ctx; // Owner of Lua registry
+	kaction_t *action;
+	struct lua_klish_chunk *prev;
+	struct lua_klish_chunk *next;
 };
 
 static lua_State *globalL = NULL;
@@ -44,6 +76,9 @@ static int luaB_pars(lua_State *L);
 static int luaB_ppars(lua_State *L);
 static int luaB_path(lua_State *L);
 static int luaB_context(lua_State *L);
+static int luaB_params(lua_State *L);
+static int luaB_pparams(lua_State *L);
+static int luaB_each(lua_State *L);
 
 static const luaL_Reg klish_lib[] = {
 	{ "par", luaB_par },
@@ -52,6 +87,9 @@ static const luaL_Reg klish_lib[] = {
 	{ "ppars", luaB_ppars },
 	{ "path", luaB_path },
 	{ "context", luaB_context },
+	{ "params", luaB_params },
+	{ "pparams", luaB_pparams },
+	{ "each", luaB_each },
 	{ NULL, NULL }
 };
 
@@ -208,6 +246,20 @@ static int luaB_context(lua_State *L)
 			return val?1:0;
 	}
 
+	if (!name || !strcmp(name, "limit")) {
+		size_t limit = kcontext_compl_limit(context);
+		if (limit > 0) {
+			if (!name) {
+				lua_pushstring(L, "limit");
+				lua_pushinteger(L, limit);
+				lua_rawset(L, -3);
+			} else
+				lua_pushinteger(L, limit);
+		}
+		if (name)
+			return (limit > 0)?1:0;
+	}
+
 	if (!name || !strcmp(name, "cmd")) {
 		pars = kcontext_pargv(context);
 		val = NULL;
@@ -287,68 +339,365 @@ static int luaB_context(lua_State *L)
 	return name?0:1;
 }
 
+// FNV-1a
+static size_t pargv_name_hash(const char *name)
+{
+	size_t h = 2166136261u;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+
+static const char *pargv_view_name(const struct lua_klish_pargv *view,
+	size_t i)
+{
+	return kentry_name(kparg_entry(view->pargs[i]));
+}
+
+
+// Builds arrays of view. It's done once per view.
+static void pargv_view_build(struct lua_klish_pargv *view)
+{
+	kpargv_pargs_node_t *iter = NULL;
+	kparg_t *p = NULL;
+	size_t size = 8;
+	size_t i = 0;
+
+	if (view->pargs || (0 == view->len))
+		return;
+
+	while (size < (view->len * 2))
+		size <<= 1;
+	view->hash_mask = size - 1;
+	view->pargs = faux_zmalloc(view->len * sizeof(*view->pargs));
+	view->next = faux_zmalloc(view->len * sizeof(*view->next));
+	view->hash = faux_zmalloc(size * sizeof(*view->hash));
+	assert(view->pargs && view->next && view->hash);
+	for (i = 0; i < size; i++)
+		view->hash[i] = view->len; // Empty slot
+
+	iter = kpargv_pargs_iter(view->pargv);
+	for (i = 0; (i < view->len) && (p = kpargv_pargs_each(&iter)); i++) {
+		const char *name = kentry_name(kparg_entry(p));
+		size_t slot = pargv_name_hash(name) & view->hash_mask;
+
+		view->pargs[i] = p;
+		view->next[i] = view->len;
+		while (view->hash[slot] != view->len) {
+			size_t n = view->hash[slot];
+			if (strcmp(pargv_view_name(view, n), name) == 0) {
+				// Append to the list of values with the same name
+				while (view->next[n] != view->len)
+					n = view->next[n];
+				view->next[n] = i;
+				break;
+			}
+			slot = (slot + 1) & view->hash_mask;
+		}
+		if (view->hash[slot] == view->len)
+			view->hash[slot] = i;
+	}
+}
+
+
+// Returns index of first parg with specified name or view->len
+static size_t pargv_view_find(struct lua_klish_pargv *view, const char *name)
+{
+	size_t slot = 0;
+
+	pargv_view_build(view);
+	if (0 == view->len)
+		return 0;
+
+	slot = pargv_name_hash(name) & view->hash_mask;
+	while (view->hash[slot] != view->len) {
+		if (strcmp(pargv_view_name(view, view->hash[slot]), name) == 0)
+			return view->hash[slot];
+		slot = (slot + 1) & view->hash_mask;
+	}
+
+	return view->len;
+}
+
+
+static void pargv_view_clean(struct lua_klish_pargv *view)
+{
+	faux_free(view->pargs);
+	faux_free(view->next);
+	faux_free(view->hash);
+	view->pargs = NULL;
+	view->next = NULL;
+	view->hash = NULL;
+	view->pargv = NULL;
+	view->len = 0;
+}
+
+
+/** @brief Gets view of current or parent pargv.
+ *
+ * The view is created once per ACTION execution. So scripts can get
+ * parameters many times without creating new tables.
+ *
+ * @return View. The view is not pushed to the stack.
+ */
+static struct lua_klish_pargv *pargv_view(lua_State *L, int parent)
+{
+	struct lua_klish_data *ctx = NULL;
+	const kpargv_t *pargv = NULL;
+	struct lua_klish_pargv *view = NULL;
+
+	ctx = lua_context(L);
+	assert(ctx);
+	assert(ctx->context);
+	if (ctx->view[parent])
+		return ctx->view[parent];
+
+	pargv = parent ? kcontext_parent_pargv(ctx->context) :
+		kcontext_pargv(ctx->context);
+	if (!pargv)
+		return NULL;
+
+	view = lua_newuserdata(L, sizeof(*view));
+	memset(view, 0, sizeof(*view));
+	view->pargv = pargv;
+	view->len = kpargv_pargs_len(pargv);
+	luaL_getmetatable(L, LUA_PARGV_MT);
+	lua_setmetatable(L, -2);
+	ctx->view_ref[parent] = luaL_ref(L, LUA_REGISTRYINDEX); // Pops view
+	ctx->view[parent] = view;
+
+	return view;
+}
+
+
+// Views are valid while ACTION is executed only
+static void pargv_views_reset(struct lua_klish_data *ctx)
+{
+	int i = 0;
+
+	for (i = 0; i < 2; i++) {
+		if (!ctx->view[i])
+			continue;
+		pargv_view_clean(ctx->view[i]);
+		luaL_unref(ctx->L, LUA_REGISTRYINDEX, ctx->view_ref[i]);
+		ctx->view[i] = NULL;
+	}
+}
+
+
+static struct lua_klish_pargv *check_pargv_view(lua_State *L, int arg)
+{
+	struct lua_klish_pargv *view = luaL_checkudata(L, arg, LUA_PARGV_MT);
+
+	if (!view->pargv)
+		luaL_error(L, "Parameters view is expired");
+
+	return view;
+}
+
+
+// view[name] - the first value of parameter, view[i] - the i-th value
+static int pargv_view_index(lua_State *L)
+{
+	struct lua_klish_pargv *view = check_pargv_view(L, 1);
+	size_t i = 0;
+
+	pargv_view_build(view);
+	if (lua_type(L, 2) == LUA_TNUMBER) {
+		lua_Integer n = lua_tointeger(L, 2);
+		if ((n < 1) || ((size_t)n > view->len))
+			return 0;
+		i = n - 1;
+	} else {
+		i = pargv_view_find(view, luaL_checkstring(L, 2));
+		if (i >= view->len)
+			return 0;
+	}
+	lua_pushstring(L, kparg_value(view->pargs[i]));
+
+	return 1;
+}
+
+
+static int pargv_view_len(lua_State *L)
+{
+	struct lua_klish_pargv *view = check_pargv_view(L, 1);
+
+	lua_pushinteger(L, view->len);
+
+	return 1;
+}
+
+
+static int pargv_view_gc(lua_State *L)
+{
+	struct lua_klish_pargv *view = lua_touserdata(L, 1);
+
+	if (view)
+		pargv_view_clean(view);
+
+	return 0;
+}
+
+
+static const luaL_Reg pargv_view_mt[] = {
+	{ "__index", pargv_view_index },
+	{ "__len", pargv_view_len },
+	{ "__gc", pargv_view_gc },
+	{ NULL, NULL }
+};
+
+
+static int _luaB_params(lua_State *L, int parent)
+{
+	struct lua_klish_data *ctx = lua_context(L);
+	struct lua_klish_pargv *view = NULL;
+
+	view = pargv_view(L, parent);
+	if (!view)
+		return 0;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ctx->view_ref[parent]);
+
+	return 1;
+}
+
+
+static int luaB_params(lua_State *L)
+{
+	return _luaB_params(L, 0);
+}
+
+
+static int luaB_pparams(lua_State *L)
+{
+	return _luaB_params(L, 1);
+}
+
+
+// Iterator over all parameters: index, name, value
+static int pargv_view_next(lua_State *L)
+{
+	struct lua_klish_pargv *view = check_pargv_view(L, 1);
+	lua_Integer i = luaL_optinteger(L, 2, 0);
+
+	pargv_view_build(view);
+	if ((i < 0) || ((size_t)i >= view->len))
+		return 0;
+	lua_pushinteger(L, i + 1);
+	lua_pushstring(L, pargv_view_name(view, i));
+	lua_pushstring(L, kparg_value(view->pargs[i]));
+
+	return 3;
+}
+
+
+// Iterator over values of parameter with specified name: index, name, value
+static int pargv_view_next_named(lua_State *L)
+{
+	struct lua_klish_pargv *view = check_pargv_view(L, 1);
+	lua_Integer i = luaL_optinteger(L, 2, 0);
+	size_t n = 0;
+
+	if (0 == i)
+		n = pargv_view_find(view, lua_tostring(L, lua_upvalueindex(1)));
+	else if ((i > 0) && ((size_t)i <= view->len))
+		n = view->next[i - 1];
+	else
+		return 0;
+	if (n >= view->len)
+		return 0;
+	lua_pushinteger(L, n + 1);
+	lua_pushstring(L, pargv_view_name(view, n));
+	lua_pushstring(L, kparg_value(view->pargs[n]));
+
+	return 3;
+}
+
+
+// for i, name, value in klish.each(view [, name]) do ... end
+static int luaB_each(lua_State *L)
+{
+	const char *name = NULL;
+
+	check_pargv_view(L, 1);
+	name = luaL_optstring(L, 2, NULL);
+	if (name) {
+		lua_pushvalue(L, 2);
+		lua_pushcclosure(L, pargv_view_next_named, 1);
+	} else {
+		lua_pushcfunction(L, pargv_view_next);
+	}
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, 0);
+
+	return 3;
+}
+
+
 static int _luaB_par(lua_State *L, int parent, int multi)
 {
 	unsigned int k = 0, i = 0;
-	kcontext_t *context;
-	const kpargv_t *pars;
-	kpargv_pargs_node_t *par_i;
-	kparg_t *p = NULL;
+	size_t n = 0;
+	struct lua_klish_pargv *view = NULL;
 	const kentry_t *last_entry = NULL;
-	struct lua_klish_data *ctx;
 	const char *name = luaL_optstring(L, 1, NULL);
 
 	if (multi)
 		lua_newtable(L);
 	else if (!name)
 		return 0;
-	ctx = lua_context(L);
-	assert(ctx);
 
-	context = ctx->context;
-	assert(context);
-
-	pars = (parent)?kcontext_parent_pargv(context):kcontext_pargv(context);
-	if (!pars)
-		return multi?1:0;
-
-	par_i = kpargv_pargs_iter(pars);
-	if (kpargv_pargs_len(pars) <= 0)
+	view = pargv_view(L, parent);
+	if (!view || (0 == view->len))
 		return multi?1:0;
+	pargv_view_build(view);
+
+	if (name) {
+		n = pargv_view_find(view, name);
+		if (!multi) {
+			if (n >= view->len)
+				return 0;
+			lua_pushstring(L, kparg_value(view->pargs[n]));
+			return 1;
+		}
+		for (; n < view->len; n = view->next[n]) {
+			lua_pushnumber(L, ++ k);
+			lua_pushstring(L, kparg_value(view->pargs[n]));
+			lua_rawset(L, -3);
+		}
+		return 1;
+	}
 
-	while ((p = kpargv_pargs_each(&par_i))) {
+	for (n = 0; n < view->len; n++) {
+		kparg_t *p = view->pargs[n];
 		const kentry_t *entry = kparg_entry(p);
-		const char *n = kentry_name(entry);
-		if (!name) {
-			if (last_entry != entry) {
-				if (!kentry_container(entry)) {
-					lua_pushnumber(L, ++k);
-					lua_pushstring(L, n);
-					lua_rawset(L, -3);
-				}
-				lua_pushstring(L, n);
-				lua_newtable(L);
+		const char *pn = kentry_name(entry);
+		if (last_entry != entry) {
+			if (!kentry_container(entry)) {
+				lua_pushnumber(L, ++k);
+				lua_pushstring(L, pn);
 				lua_rawset(L, -3);
-				i = 0;
-			}
-			lua_pushstring(L, n);
-			lua_rawget(L, -2);
-			lua_pushnumber(L, ++ i);
-			lua_pushstring(L, kparg_value(p));
-			lua_rawset(L, -3);
-			lua_pop(L, 1);
-			last_entry = entry;
-		} else if (!strcmp(n, name)) {
-			if (!multi) {
-				lua_pushstring(L, kparg_value(p));
-				return 1;
 			}
-			lua_pushnumber(L, ++ k);
-			lua_pushstring(L, kparg_value(p));
+			lua_pushstring(L, pn);
+			lua_newtable(L);
 			lua_rawset(L, -3);
+			i = 0;
 		}
+		lua_pushstring(L, pn);
+		lua_rawget(L, -2);
+		lua_pushnumber(L, ++ i);
+		lua_pushstring(L, kparg_value(p));
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
+		last_entry = entry;
 	}
-	return multi?1:0;
+
+	return 1;
 }
 
 
@@ -416,6 +765,10 @@ static int luaopen_klish(lua_State *L)
 static int clish_env(lua_State *L)
 {
 	luaL_requiref(L, "klish", luaopen_klish, 1);
+	lua_pop(L, 1);
+	luaL_newmetatable(L, LUA_PARGV_MT);
+	luaL_setfuncs(L, pargv_view_mt, 0);
+	lua_pop(L, 1);
 	return 0;
 }
 
@@ -514,10 +867,72 @@ err:
 }
 
 
-static int exec_action(struct lua_klish_data *ctx, const char *script)
+/** @brief Frees compiled script. It's ACTION's udata free function.
+ *
+ * The function is released within Lua registry so it can be collected.
+ */
+static void free_chunk(void *data)
+{
+	struct lua_klish_chunk *chunk = (struct lua_klish_chunk *)data;
+	struct lua_klish_data *ctx = chunk->ctx;
+
+	luaL_unref(ctx->L, LUA_REGISTRYINDEX, chunk->ref);
+	if (chunk->prev)
+		chunk->prev->next = chunk->next;
+	else
+		ctx->chunks = chunk->next;
+	if (chunk->next)
+		chunk->next->prev = chunk->prev;
+	faux_free(chunk);
+}
+
+
+/** @brief Compiles ACTION's script and stores function within Lua registry.
+ *
+ * The script is compiled only once. The reference to compiled function is
+ * stored as ACTION's udata. Usually it's done by klishd before fork() (see
+ * klish_plugin_lua_prepare()) so service processes get compiled function
+ * for free.
+ *
+ * @return Compiled chunk or NULL on error. Error message is on Lua stack.
+ */
+static struct lua_klish_chunk *compile_action(struct lua_klish_data *ctx,
+	kaction_t *action)
+{
+	struct lua_klish_chunk *chunk = NULL;
+	const char *script = NULL;
+
+	chunk = kaction_udata(action);
+	if (chunk)
+		return chunk;
+
+	script = kaction_script(action);
+	if (!script)
+		return NULL;
+	if (luaL_loadstring(ctx->L, script))
+		return NULL;
+
+	chunk = faux_zmalloc(sizeof(*chunk));
+	assert(chunk);
+	chunk->ref = luaL_ref(ctx->L, LUA_REGISTRYINDEX); // Pops function
+	chunk->ctx = ctx;
+	chunk->action = action;
+	chunk->next = ctx->chunks;
+	if (ctx->chunks)
+		ctx->chunks->prev = chunk;
+	ctx->chunks = chunk;
+	kaction_set_udata(action, chunk, free_chunk);
+
+	return chunk;
+}
+
+
+static int exec_action(struct lua_klish_data *ctx, kaction_t *action,
+	const char *script)
 {
 	int rc = 0;
 	lua_State *L = ctx->L;
+	struct lua_klish_chunk *chunk = NULL;
 
 	assert(L);
 	globalL = L;
@@ -525,10 +940,21 @@ static int exec_action(struct lua_klish_data *ctx, const char *script)
 	lua_pushlightuserdata(L, ctx);
 	lua_setglobal(L, LUA_CONTEXT);
 	locale_set();
-	rc = dostring(ctx, script);
+	if (action) {
+		chunk = compile_action(ctx, action);
+		if (chunk) {
+			lua_rawgeti(L, LUA_REGISTRYINDEX, chunk->ref);
+			rc = report(L, docall(ctx, 0));
+		} else {
+			rc = report(L, -1); // Compilation error
+		}
+	} else {
+		rc = dostring(ctx, script);
+	}
 	locale_reset();
 	fflush(stdout);
 	fflush(stderr);
+	pargv_views_reset(ctx);
 	clear(L);
 
 	return rc;
@@ -569,7 +995,7 @@ int klish_plugin_lua_action(kcontext_t *context)
 	sigaction(SIGINT, &sig_new, &sig_old_int);
 	sigaction(SIGQUIT, &sig_new, &sig_old_quit);
 
-	status = exec_action(ctx, script);
+	status = exec_action(ctx, kcontext_action(context), script);
 	while ( wait(NULL) >= 0 || errno != ECHILD);
 
 	// Restore SIGINT and SIGQUIT
@@ -580,6 +1006,178 @@ int klish_plugin_lua_action(kcontext_t *context)
 }
 
 
+// The print() replacement for "lua_fast". Writes to context's buffer.
+static int luaB_fast_print(lua_State *L)
+{
+	struct lua_klish_data *ctx = lua_context(L);
+	int n = lua_gettop(L);
+	int i = 0;
+
+	assert(ctx);
+	lua_getglobal(L, "tostring");
+	for (i = 1; i <= n; i++) {
+		const char *str = NULL;
+		size_t len = 0;
+		lua_pushvalue(L, -1); // Function "tostring"
+		lua_pushvalue(L, i);
+		lua_call(L, 1, 1);
+		str = lua_tolstring(L, -1, &len);
+		if (!str)
+			return luaL_error(L, "'tostring' must return a string "
+				"to 'print'");
+		if (i > 1)
+			kcontext_fwrite(ctx->context, stdout, "\t", 1);
+		kcontext_fwrite(ctx->context, stdout, str, len);
+		lua_pop(L, 1);
+	}
+	kcontext_fwrite(ctx->context, stdout, "\n", 1);
+
+	return 0;
+}
+
+
+// Interrupts runaway "lua_fast" script. The script can catch the error by
+// pcall() so after deadline the hook fires on every instruction and raises
+// the error again until the script is unwound.
+static void lfast_stop(lua_State *L, lua_Debug *ar)
+{
+	struct lua_klish_data *ctx = lua_context(L);
+	struct timespec now = {};
+
+	ar = ar; // Unused arg
+	if (!ctx)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if ((now.tv_sec < ctx->fast_deadline.tv_sec) ||
+		((now.tv_sec == ctx->fast_deadline.tv_sec) &&
+		(now.tv_nsec < ctx->fast_deadline.tv_nsec)))
+		return;
+	lua_sethook(L, lfast_stop, LUA_MASKCOUNT, 1);
+	luaL_error(L, "Time limit of %u ms is exceeded", ctx->fast_timeout_sw);
+}
+
+
+// Writes error message from top of Lua stack to context's stderr buffer
+static void fast_error(struct lua_klish_data *ctx)
+{
+	const char *msg = lua_tostring(ctx->L, -1);
+
+	if (!msg)
+		msg = "(error object is not a string)";
+	kcontext_fprintf(ctx->context, stderr, "Error: %s\n", msg);
+	lua_pop(ctx->L, 1);
+}
+
+
+/** @brief Executes Lua ACTION within service process.
+ *
+ * Unlike "lua" sym it doesn't fork. The print() output goes to context's
+ * buffer. Script is interrupted if it works longer than "fast.timeout".
+ */
+int klish_plugin_lua_fast(kcontext_t *context)
+{
+	int status = -1;
+	const kplugin_t *plugin = NULL;
+	struct lua_klish_data *ctx = NULL;
+	kaction_t *action = NULL;
+	struct lua_klish_chunk *chunk = NULL;
+	lua_State *L = NULL;
+	unsigned int timeout = 0;
+	int base = 0;
+
+	assert(context);
+	plugin = kcontext_plugin(context);
+	assert(plugin);
+	ctx = kplugin_udata(plugin);
+	assert(ctx);
+	ctx->context = context;
+	L = ctx->L;
+
+	action = kcontext_action(context);
+	if (!action || !kaction_script(action)) // Nothing to do
+		return 0;
+
+	lua_pushlightuserdata(L, ctx);
+	lua_setglobal(L, LUA_CONTEXT);
+	locale_set();
+	base = lua_gettop(L);
+
+	chunk = compile_action(ctx, action);
+	if (!chunk) {
+		fast_error(ctx);
+		goto out;
+	}
+
+	// Replace print() for a while. Original one is stored at (base + 1).
+	lua_getglobal(L, "print");
+	lua_pushcfunction(L, luaB_fast_print);
+	lua_setglobal(L, "print");
+
+	timeout = ctx->fast_timeout_sw;
+	if (timeout > 0) {
+		clock_gettime(CLOCK_MONOTONIC, &ctx->fast_deadline);
+		ctx->fast_deadline.tv_sec += timeout / 1000;
+		ctx->fast_deadline.tv_nsec += (timeout % 1000) * 1000000l;
+		if (ctx->fast_deadline.tv_nsec >= 1000000000l) {
+			ctx->fast_deadline.tv_sec++;
+			ctx->fast_deadline.tv_nsec -= 1000000000l;
+		}
+		lua_sethook(L, lfast_stop, LUA_MASKCOUNT, LUA_FAST_HOOK_COUNT);
+	}
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, chunk->ref);
+	if (docall(ctx, 0) != 0)
+		fast_error(ctx);
+	// Script's return value is a retcode
+	else if ((lua_gettop(L) > (base + 1)) && !lua_isnil(L, -1))
+		status = lua_tointeger(L, -1);
+	else
+		status = 0;
+	if (timeout > 0)
+		lua_sethook(L, NULL, 0, 0);
+
+	lua_pushvalue(L, base + 1);
+	lua_setglobal(L, "print");
+
+out:
+	pargv_views_reset(ctx);
+	lua_settop(L, base);
+	locale_reset();
+
+	return status;
+}
+
+
+/** @brief PREPARE: Compile ACTION's script while scheme finalizing
+ */
+int klish_plugin_lua_prepare(kcontext_t *context)
+{
+	kaction_t *action = NULL;
+	const kplugin_t *plugin = NULL;
+	struct lua_klish_data *ctx = NULL;
+	int rc = 0;
+
+	assert(context);
+	action = kcontext_action(context);
+	if (!action)
+		return -1;
+	plugin = kcontext_plugin(context);
+	assert(plugin);
+	ctx = kplugin_udata(plugin);
+	assert(ctx);
+	if (!kaction_script(action)) // Nothing to do
+		return 0;
+
+	locale_set();
+	if (!compile_action(ctx, action))
+		rc = report(ctx->L, -1); // Syntax error
+	locale_reset();
+	clear(ctx->L);
+
+	return rc;
+}
+
+
 static void free_ctx(struct lua_klish_data *ctx)
 {
 	if (ctx->package_path_sw)
@@ -597,6 +1195,7 @@ int kplugin_lua_init(kcontext_t *context)
 	const char *p = NULL;
 	struct lua_klish_data *ctx = NULL;
 	const char *conf = NULL;
+	ksym_t *sym = NULL;
 
 	assert(context);
 	plugin = kcontext_plugin(context);
@@ -610,6 +1209,10 @@ int kplugin_lua_init(kcontext_t *context)
 
 	ctx->context = context;
 	ctx->backtrace_sw = 1;
+	ctx->fast_timeout_sw = LUA_FAST_TIMEOUT;
+	ctx->view[0] = NULL;
+	ctx->view[1] = NULL;
+	ctx->chunks = NULL;
 	ctx->package_path_sw = NULL;
 	ctx->autorun_path_sw = NULL;
 	ctx->L = NULL;
@@ -623,6 +1226,9 @@ int kplugin_lua_init(kcontext_t *context)
 		ctx->package_path_sw = p ? faux_str_dup(p): NULL;
 		p = faux_ini_find(ini, LUA_AUTORUN_SW);
 		ctx->autorun_path_sw = p ? faux_str_dup(p): NULL;
+		p = faux_ini_find(ini, LUA_FAST_TIMEOUT_SW);
+		if (p && !faux_conv_atoui(p, &ctx->fast_timeout_sw, 0))
+			ctx->fast_timeout_sw = LUA_FAST_TIMEOUT;
 		faux_ini_free(ini);
 	}
 	kplugin_set_udata(plugin, ctx);
@@ -630,7 +1236,12 @@ int kplugin_lua_init(kcontext_t *context)
 		free_ctx(ctx);
 		return -1;
 	}
-	kplugin_add_syms(plugin, ksym_new("lua", klish_plugin_lua_action));
+	sym = ksym_new("lua", klish_plugin_lua_action);
+	ksym_set_prepare(sym, klish_plugin_lua_prepare);
+	kplugin_add_syms(plugin, sym);
+	sym = ksym_new_fast("lua_fast", klish_plugin_lua_fast);
+	ksym_set_prepare(sym, klish_plugin_lua_prepare);
+	kplugin_add_syms(plugin, sym);
 
 	return 0;
 }
@@ -648,6 +1259,10 @@ int kplugin_lua_fini(kcontext_t *context)
 	ctx = kplugin_udata(plugin);
 	if (!ctx)
 		return 0;
+	// ACTIONs can outlive the plugin. Don't leave references to closed
+	// Lua state within them.
+	while (ctx->chunks)
+		kaction_set_udata(ctx->chunks->action, NULL, NULL);
 	if (ctx->L)
 		lua_close(ctx->L);
 	free_ctx(ctx);
@@ -0,0 +1,265 @@
+/*
+ * Unit tests of "lua" plugin.
+ *
+ * The plugin is initialized and ACTIONs are executed by
+ * ksession_exec_locally() within minimal scheme. PTYPEs are validated by
+ * ksession_parse_line(). The scheme is finalized like klishd does before
+ * fork().
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <faux/str.h>
+#include <faux/argv.h>
+#include <faux/error.h>
+#include <klish/kscheme.h>
+#include <klish/kplugin.h>
+#include <klish/kentry.h>
+#include <klish/kaction.h>
+#include <klish/ksym.h>
+#include <klish/kpargv.h>
+#include <klish/kcontext.h>
+#include <klish/ksession.h>
+#include <klish/ksession_parse.h>
+
+
+// Plugin's functions (klish_lua.c)
+int kplugin_lua_init(kcontext_t *context);
+int kplugin_lua_fini(kcontext_t *context);
+
+
+#define TESTC_LUA_ITERS 100000
+#define TESTC_LUA_MEM_GROWTH 1024 // KB
+
+
+static kentry_t *testc_lua_entry(kentry_t *view, const char *name,
+	kplugin_t *plugin, ksym_t *sym, const char *script)
+{
+	kentry_t *entry = kentry_new(name);
+	kaction_t *action = kaction_new();
+
+	kaction_set_sym(action, sym);
+	kaction_set_plugin(action, plugin);
+	if (script)
+		kaction_set_script(action, script);
+	kentry_add_actions(entry, action);
+	kentry_add_entrys(view, entry);
+
+	return entry;
+}
+
+
+static kaction_t *testc_lua_action(const kentry_t *entry)
+{
+	return (kaction_t *)faux_list_data(kentry_actions_iter(entry));
+}
+
+
+static int testc_lua_exec(ksession_t *session, kentry_t *entry, char **out)
+{
+	int retcode = -1;
+
+	*out = NULL;
+	if (!ksession_exec_locally(session, entry, NULL, NULL, NULL,
+		&retcode, out))
+		return -1;
+
+	return retcode;
+}
+
+
+// Validates the command name
+static int testc_lua_command(kcontext_t *context)
+{
+	return faux_str_cmp(kcontext_candidate_value(context), "vlan") ? -1 : 0;
+}
+
+
+static int testc_lua_nop(kcontext_t *context)
+{
+	context = context; // Happy compiler
+
+	return 0;
+}
+
+
+// Lua memory in use (KB) after full garbage collection
+static double testc_lua_mem(ksession_t *session, kentry_t *mem)
+{
+	char *out = NULL;
+	double kb = -1;
+
+	if (testc_lua_exec(session, mem, &out) == 0)
+		kb = strtod(out, NULL);
+	faux_str_free(out);
+
+	return kb;
+}
+
+
+// Parses "vlan <id>" line. Returns BOOL_TRUE if line is valid.
+static bool_t testc_lua_parse(ksession_t *session, const char *line)
+{
+	faux_argv_t *argv = faux_argv_new();
+	kpargv_t *pargv = NULL;
+	bool_t valid = BOOL_FALSE;
+
+	faux_argv_parse(argv, line);
+	pargv = ksession_parse_line(session, argv, KPURPOSE_EXEC, BOOL_FALSE);
+	if (pargv && (kpargv_status(pargv) == KPARSE_OK))
+		valid = BOOL_TRUE;
+	kpargv_free(pargv);
+	faux_argv_free(argv);
+
+	return valid;
+}
+
+
+// The PTYPE's script is compiled once by prepare hook (within klishd). Then
+// each validation reuses the same registry reference and the same Lua state.
+// Without cache the script is compiled on each validation and the previous
+// chunk must be released.
+int testc_lua_precompiled(void)
+{
+	kscheme_t *scheme = kscheme_new();
+	kplugin_t *plugin = kplugin_new("lua");
+	ksym_t *init_sym = ksym_new_fast("init", kplugin_lua_init);
+	ksym_t *fini_sym = ksym_new_fast("fini", kplugin_lua_fini);
+	ksym_t *cmd_sym = ksym_new_fast("command", testc_lua_command);
+	ksym_t *nop_sym = ksym_new_fast("nop", testc_lua_nop);
+	kcontext_t *context = kcontext_new(KCONTEXT_TYPE_NONE);
+	faux_error_t *error = faux_error_new();
+	ksession_t *session = NULL;
+	kentry_t *view = NULL;
+	kentry_t *init = NULL;
+	kentry_t *fini = NULL;
+	kentry_t *mem = NULL;
+	kentry_t *cmd = NULL;
+	kentry_t *param = NULL;
+	kentry_t *ptype = NULL;
+	kaction_t *action = NULL;
+	void *chunk = NULL;
+	char *out = NULL;
+	struct timespec start = {};
+	struct timespec stop = {};
+	unsigned long long cached_ns = 0;
+	unsigned long long uncached_ns = 0;
+	double mem_before = 0;
+	double mem_after = 0;
+	unsigned int i = 0;
+	int ret = -1;
+
+	view = kentry_new("main");
+	kentry_set_container(view, BOOL_TRUE);
+	kentry_set_mode(view, KENTRY_MODE_SWITCH);
+	kentry_set_prepared(view, BOOL_TRUE);
+	kscheme_add_entrys(scheme, view);
+	init = testc_lua_entry(view, "init", plugin, init_sym, NULL);
+	fini = testc_lua_entry(view, "fini", plugin, fini_sym, NULL);
+	session = ksession_new(scheme, "main");
+
+	if (testc_lua_exec(session, init, &out) != 0) {
+		printf("Can't init plugin\n");
+		goto err;
+	}
+	faux_str_free(out);
+	out = NULL;
+	mem = testc_lua_entry(view, "mem", plugin,
+		kplugin_find_sym(plugin, "lua_fast"),
+		"collectgarbage()\nprint(collectgarbage(\"count\"))");
+
+	// Command "vlan <id>". The <id> is validated by Lua PTYPE.
+	cmd = testc_lua_entry(view, "vlan", NULL, nop_sym, NULL);
+	ptype = testc_lua_entry(cmd, "PTYPE", NULL, cmd_sym, NULL);
+	kentry_set_purpose(ptype, KENTRY_PURPOSE_PTYPE);
+	kentry_set_nested_by_purpose(cmd, KENTRY_PURPOSE_PTYPE, ptype);
+	param = kentry_new("id");
+	kentry_add_entrys(cmd, param);
+	ptype = testc_lua_entry(param, "PTYPE", plugin,
+		kplugin_find_sym(plugin, "lua_fast"),
+		"local id = tonumber(klish.context(\"val\"))\n"
+		"if id and id >= 1 and id <= 4094 then return 0 end\n"
+		"return -1");
+	kentry_set_purpose(ptype, KENTRY_PURPOSE_PTYPE);
+	kentry_set_nested_by_purpose(param, KENTRY_PURPOSE_PTYPE, ptype);
+	action = testc_lua_action(ptype);
+
+	// Like klishd before fork()
+	if (!kscheme_finalize(scheme, context, error)) {
+		printf("Can't finalize scheme\n");
+		faux_error_show(error);
+		goto err;
+	}
+	chunk = kaction_udata(action);
+	if (!chunk) {
+		printf("Script is not compiled by prepare hook\n");
+		goto err;
+	}
+
+	if (!testc_lua_parse(session, "vlan 100")) {
+		printf("Valid line is rejected\n");
+		goto err;
+	}
+	if (testc_lua_parse(session, "vlan 5000")) {
+		printf("Invalid line is accepted\n");
+		goto err;
+	}
+	if (kaction_udata(action) != chunk) {
+		printf("Script is compiled again\n");
+		goto err;
+	}
+
+	// Validation with precompiled script
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < TESTC_LUA_ITERS; i++)
+		testc_lua_parse(session, "vlan 100");
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	cached_ns = (stop.tv_sec - start.tv_sec) * 1000000000ULL +
+		stop.tv_nsec - start.tv_nsec;
+	if (kaction_udata(action) != chunk) {
+		printf("Script is compiled again\n");
+		goto err;
+	}
+
+	// Validation without cache. Old chunk is released on each iteration.
+	mem_before = testc_lua_mem(session, mem);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < TESTC_LUA_ITERS; i++) {
+		kaction_set_udata(action, NULL, NULL);
+		testc_lua_parse(session, "vlan 100");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	uncached_ns = (stop.tv_sec - start.tv_sec) * 1000000000ULL +
+		stop.tv_nsec - start.tv_nsec;
+	mem_after = testc_lua_mem(session, mem);
+
+	printf("cached   %8llu ns/parse\n", cached_ns / TESTC_LUA_ITERS);
+	printf("uncached %8llu ns/parse\n", uncached_ns / TESTC_LUA_ITERS);
+	printf("Lua memory %.0f KB -> %.0f KB\n", mem_before, mem_after);
+	if ((mem_before < 0) || (mem_after < 0) ||
+		(mem_after - mem_before > TESTC_LUA_MEM_GROWTH)) {
+		printf("Released chunks are not collected\n");
+		goto err;
+	}
+
+	ret = 0;
+err:
+	faux_str_free(out);
+	out = NULL;
+	testc_lua_exec(session, fini, &out);
+	faux_str_free(out);
+	ksession_free(session);
+	kscheme_free(scheme);
+	kplugin_free(plugin);
+	ksym_free(init_sym);
+	ksym_free(fini_sym);
+	ksym_free(cmd_sym);
+	ksym_free(nop_sym);
+	faux_error_free(error);
+	kcontext_free(context);
+
+	return ret;
+}
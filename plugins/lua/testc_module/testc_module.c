@@ -0,0 +1,16 @@
+#include <stdlib.h>
+
+
+const unsigned char testc_version_major = 1;
+const unsigned char testc_version_minor = 0;
+
+
+const char *testc_module[][2] = {
+
+	// Precompiled scripts
+	{"testc_lua_precompiled",
+		"Lua PTYPE with and without chunk cache, ns/parse in output"},
+
+	// End of list
+	{NULL, NULL}
+	};
@@ -168,6 +168,13 @@ static bool_t populate_env(const kcontext_t *context)
 	if (str)
 		setenv(PREFIX"VALUE", str, OVERWRITE);
 
+	// Limit of completions
+	if (kcontext_compl_limit(context) > 0) {
+		char *t = faux_str_sprintf("%zu", kcontext_compl_limit(context));
+		setenv(PREFIX"LIMIT", t, OVERWRITE);
+		faux_str_free(t);
+	}
+
 	// PID
 	pid = ksession_pid(session);
 	if (pid != -1) {
@@ -268,6 +275,9 @@ int script_script(kcontext_t *context)
 	}
 
 	// Parent
+	kmetrics_inc(ksession_metrics(kcontext_session(context)),
+		KMETRICS_FORKS_SCRIPT, 1);
+
 	// Populate environment. Put command parameters to env vars.
 	populate_env(context);
 
@@ -0,0 +1,32 @@
+/** @file pager.h
+ *
+ * @brief Built-in pager
+ *
+ * The pager gets command output by chunks. The output is written to
+ * terminal as is while it fits into the screen. When the screen is full the
+ * pager waits for user's keys. User can scroll output forward and backward
+ * and search for pattern within already received output.
+ */
+
+#ifndef _tinyrl_pager_h
+#define _tinyrl_pager_h
+
+#include <stdio.h>
+#include <faux/faux.h>
+
+
+typedef struct pager_s pager_t;
+
+
+C_DECL_BEGIN
+
+pager_t *pager_new(FILE *istream, FILE *ostream);
+void pager_free(pager_t *pager);
+
+bool_t pager_write(pager_t *pager, const char *data, size_t len);
+bool_t pager_stop(pager_t *pager);
+bool_t pager_engaged(const pager_t *pager);
+
+C_DECL_END
+
+#endif // _tinyrl_pager_h
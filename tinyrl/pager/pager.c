@@ -0,0 +1,727 @@
+/** @file pager.c
+ *
+ * Built-in pager. The received output is stored within single buffer. The
+ * array of line offsets is used to scroll backward and to search. The output
+ * is written to terminal as is while screen is not full. So short outputs
+ * don't need any user interaction. Then pager shows the prompt and waits for
+ * keys. Pager doesn't read output from its source itself. The caller gives
+ * output by chunks. So pager returns to caller when user wants to see more
+ * lines than already received.
+ *
+ * The buffer keeps only the last PAGER_SCREENS screens of already shown
+ * lines (and not more than PAGER_MAX_BUF_SIZE bytes). Older lines are
+ * dropped so the long output doesn't eat memory.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+
+#include "tinyrl/vt100.h"
+#include "tinyrl/pager.h"
+
+#define PAGER_ESC_TIMEOUT 50 // ms to wait for the rest of ESC sequence
+#define PAGER_KEEP_BUF_SIZE (1024 * 1024) // Don't keep larger buffer
+#define PAGER_SCREENS 100 // Number of screens to scroll backward
+#define PAGER_MAX_BUF_SIZE (4 * 1024 * 1024) // Max size of scrollback
+
+// Pseudo key codes for decoded ESC sequences
+#define PAGER_KEY_UP 0x100
+#define PAGER_KEY_DOWN 0x101
+#define PAGER_KEY_HOME 0x102
+#define PAGER_KEY_END 0x103
+#define PAGER_KEY_PGUP 0x104
+#define PAGER_KEY_PGDOWN 0x105
+#define PAGER_KEY_UNKNOWN 0x1ff
+
+
+struct pager_s {
+	vt100_t *term;
+	char *buf; // Received output
+	size_t buf_len;
+	size_t buf_size;
+	size_t *lines; // Offsets of complete lines within buffer
+	size_t lines_num;
+	size_t lines_size;
+	size_t tail; // Offset of unfinished line
+	size_t flushed; // Offset of output written by passthrough
+	size_t width;
+	size_t height;
+	size_t rows; // Screen rows used by output before pager engaged
+	size_t bottom; // Index of the first line that is not shown yet
+	size_t want; // Number of rows user wants to see
+	bool_t started;
+	bool_t engaged; // Screen is full so pager waits for keys
+	bool_t eof; // All output is received
+	bool_t end_shown; // User has seen the end of output
+	bool_t quit;
+	char *pattern; // Last search pattern
+};
+
+
+pager_t *pager_new(FILE *istream, FILE *ostream)
+{
+	pager_t *pager = NULL;
+
+	pager = faux_zmalloc(sizeof(*pager));
+	if (!pager)
+		return NULL;
+
+	pager->term = vt100_new(istream, ostream);
+	if (!pager->term) {
+		faux_free(pager);
+		return NULL;
+	}
+
+	return pager;
+}
+
+
+void pager_free(pager_t *pager)
+{
+	if (!pager)
+		return;
+
+	vt100_free(pager->term);
+	faux_free(pager->buf);
+	faux_free(pager->lines);
+	faux_str_free(pager->pattern);
+	faux_free(pager);
+}
+
+
+bool_t pager_engaged(const pager_t *pager)
+{
+	if (!pager)
+		return BOOL_FALSE;
+
+	return pager->engaged;
+}
+
+
+static bool_t pager_append(pager_t *pager, const char *data, size_t len)
+{
+	size_t i = 0;
+
+	if ((pager->buf_len + len) > pager->buf_size) {
+		size_t size = pager->buf_size ? pager->buf_size : 4096;
+		char *buf = NULL;
+		while (size < (pager->buf_len + len))
+			size *= 2;
+		buf = realloc(pager->buf, size);
+		if (!buf)
+			return BOOL_FALSE;
+		pager->buf = buf;
+		pager->buf_size = size;
+	}
+	memcpy(pager->buf + pager->buf_len, data, len);
+
+	for (i = pager->buf_len; i < (pager->buf_len + len); i++) {
+		if (pager->buf[i] != '\n')
+			continue;
+		if (pager->lines_num == pager->lines_size) {
+			size_t size = pager->lines_size ? (pager->lines_size * 2) : 256;
+			size_t *lines = realloc(pager->lines, size * sizeof(*lines));
+			if (!lines)
+				return BOOL_FALSE;
+			pager->lines = lines;
+			pager->lines_size = size;
+		}
+		pager->lines[pager->lines_num++] = pager->tail;
+		pager->tail = i + 1;
+	}
+	pager->buf_len += len;
+
+	return BOOL_TRUE;
+}
+
+
+// Line without trailing '\n'
+static const char *pager_line(const pager_t *pager, size_t i, size_t *len)
+{
+	size_t start = pager->lines[i];
+	size_t end = ((i + 1) < pager->lines_num) ?
+		pager->lines[i + 1] : pager->tail;
+
+	*len = end - start - 1;
+
+	return pager->buf + start;
+}
+
+
+// Number of screen rows the line takes. UTF-8 continuation bytes don't
+// take place. Escape sequences are not recognized so colored lines are
+// considered longer than they are.
+static size_t pager_line_rows(const pager_t *pager, size_t i)
+{
+	const char *line = NULL;
+	size_t len = 0;
+	size_t cols = 0;
+	size_t j = 0;
+
+	if (0 == pager->width)
+		return 1;
+
+	line = pager_line(pager, i, &len);
+	for (j = 0; j < len; j++) {
+		unsigned char c = (unsigned char)line[j];
+		if ((c & 0xc0) == 0x80)
+			continue;
+		if ('\t' == c)
+			cols = (cols / 8 + 1) * 8;
+		else if ('\r' == c)
+			cols = 0;
+		else
+			cols++;
+	}
+	if (0 == cols)
+		return 1;
+
+	return (cols + pager->width - 1) / pager->width;
+}
+
+
+static void pager_put_line(pager_t *pager, size_t i)
+{
+	FILE *ostream = vt100_ostream(pager->term);
+	const char *line = NULL;
+	size_t len = 0;
+
+	line = pager_line(pager, i, &len);
+	fwrite(line, 1, len, ostream);
+	fputc('\n', ostream);
+}
+
+
+// Screen can contain height - 1 rows of output. The last row is for prompt
+static size_t pager_page(const pager_t *pager)
+{
+	return (pager->height > 1) ? (pager->height - 1) : 1;
+}
+
+
+// The first line of screen that ends with bottom line
+static size_t pager_top(const pager_t *pager, size_t bottom)
+{
+	size_t rows = 0;
+	size_t top = bottom;
+
+	while (top > 0) {
+		size_t r = pager_line_rows(pager, top - 1);
+		if ((rows + r) > pager_page(pager))
+			break;
+		rows += r;
+		top--;
+	}
+
+	return top;
+}
+
+
+/** @brief Drops the oldest lines from scrollback.
+ *
+ * The lines of current screen and the lines that are not shown yet are
+ * kept. Lines are dropped by batches so the data is moved rarely.
+ */
+static void pager_shrink(pager_t *pager)
+{
+	size_t max = PAGER_SCREENS * pager_page(pager);
+	size_t top = 0;
+	size_t drop = 0;
+	size_t off = 0;
+	size_t i = 0;
+
+	if ((pager->lines_num <= (2 * max)) &&
+		(pager->buf_len <= PAGER_MAX_BUF_SIZE))
+		return;
+
+	if (pager->lines_num > max)
+		drop = pager->lines_num - max;
+	while ((drop < pager->lines_num) &&
+		((pager->buf_len - pager->lines[drop]) > (PAGER_MAX_BUF_SIZE / 2)))
+		drop++;
+	top = pager_top(pager, pager->bottom);
+	if (drop > top)
+		drop = top;
+	if (0 == drop)
+		return;
+
+	off = pager->lines[drop];
+	memmove(pager->buf, pager->buf + off, pager->buf_len - off);
+	pager->buf_len -= off;
+	pager->tail -= off;
+	pager->flushed = (pager->flushed > off) ? (pager->flushed - off) : 0;
+	for (i = drop; i < pager->lines_num; i++)
+		pager->lines[i - drop] = pager->lines[i] - off;
+	pager->lines_num -= drop;
+	pager->bottom -= drop;
+}
+
+
+static void pager_redraw(pager_t *pager)
+{
+	size_t rows = 0;
+	size_t i = 0;
+
+	vt100_winsize(pager->term, &pager->width, &pager->height);
+	vt100_clear_screen(pager->term);
+	vt100_cursor_home(pager->term);
+	for (i = pager_top(pager, pager->bottom); i < pager->bottom; i++) {
+		pager_put_line(pager, i);
+		rows += pager_line_rows(pager, i);
+	}
+	// Keep prompt at the last row
+	for (; rows < pager_page(pager); rows++)
+		vt100_printf(pager->term, "\n");
+}
+
+
+// Shows screen that starts with specified line
+static void pager_show_from(pager_t *pager, size_t top)
+{
+	size_t rows = 0;
+
+	pager->bottom = top;
+	while (pager->bottom < pager->lines_num) {
+		size_t r = pager_line_rows(pager, pager->bottom);
+		if (((rows + r) > pager_page(pager)) && (pager->bottom > top))
+			break;
+		rows += r;
+		pager->bottom++;
+	}
+	pager_redraw(pager);
+}
+
+
+static void pager_back(pager_t *pager, size_t num)
+{
+	while ((num-- > 0) && (pager_top(pager, pager->bottom) > 0))
+		pager->bottom--;
+	pager_redraw(pager);
+}
+
+
+static bool_t pager_search(pager_t *pager, bool_t forward)
+{
+	size_t top = pager_top(pager, pager->bottom);
+	size_t i = top;
+
+	if (faux_str_is_empty(pager->pattern))
+		return BOOL_FALSE;
+
+	while (forward ? ((i + 1) < pager->lines_num) : (i > 0)) {
+		const char *line = NULL;
+		size_t len = 0;
+		char *str = NULL;
+		bool_t found = BOOL_FALSE;
+		i = forward ? (i + 1) : (i - 1);
+		line = pager_line(pager, i, &len);
+		str = faux_str_dupn(line, len);
+		found = strstr(str, pager->pattern) ? BOOL_TRUE : BOOL_FALSE;
+		faux_str_free(str);
+		if (found) {
+			pager_show_from(pager, i);
+			return BOOL_TRUE;
+		}
+	}
+
+	return BOOL_FALSE;
+}
+
+
+// Returns key code, PAGER_KEY_* for ESC sequences, -1 on error/EOF or
+// -2 on timeout
+static int pager_getkey(pager_t *pager, int timeout)
+{
+	struct pollfd pfd = {};
+	unsigned char c = 0;
+	int r = 0;
+
+	pfd.fd = fileno(vt100_istream(pager->term));
+	pfd.events = POLLIN;
+	while (1) {
+		r = poll(&pfd, 1, timeout);
+		if (r < 0) {
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		if (0 == r)
+			return -2;
+		if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))
+			return -1;
+		r = vt100_getchar(pager->term, &c);
+		if (1 == r)
+			break;
+		if ((r < 0) && ((EAGAIN == errno) || (EINTR == errno)))
+			continue;
+		return -1;
+	}
+
+	if (c != KEY_ESC)
+		return c;
+
+	// ESC sequence
+	{
+		char seq[8] = {};
+		size_t len = 0;
+		int k = 0;
+
+		while (len < (sizeof(seq) - 1)) {
+			k = pager_getkey(pager, PAGER_ESC_TIMEOUT);
+			if (k < 0)
+				break;
+			seq[len++] = (char)k;
+			if ((k != '[') && (k > 63))
+				break;
+		}
+		if (0 == len)
+			return KEY_ESC;
+		switch (vt100_esc_decode(seq)) {
+		case VT100_CURSOR_UP:
+			return PAGER_KEY_UP;
+		case VT100_CURSOR_DOWN:
+			return PAGER_KEY_DOWN;
+		case VT100_HOME:
+			return PAGER_KEY_HOME;
+		case VT100_END:
+			return PAGER_KEY_END;
+		case VT100_PGUP:
+			return PAGER_KEY_PGUP;
+		case VT100_PGDOWN:
+			return PAGER_KEY_PGDOWN;
+		default:
+			break;
+		}
+	}
+
+	return PAGER_KEY_UNKNOWN;
+}
+
+
+static void pager_prompt(pager_t *pager, const char *msg)
+{
+	vt100_attr_reverse(pager->term);
+	if (msg)
+		vt100_printf(pager->term, "%s", msg);
+	else if (pager->eof && (pager->bottom == pager->lines_num))
+		vt100_printf(pager->term, "(END)");
+	else
+		vt100_printf(pager->term, "--More--");
+	vt100_attr_reset(pager->term);
+	vt100_oflush(pager->term);
+}
+
+
+static void pager_prompt_erase(pager_t *pager)
+{
+	vt100_printf(pager->term, "\r");
+	vt100_erase_line(pager->term);
+}
+
+
+// Reads search pattern at prompt line. Returns NULL if user cancels input
+static char *pager_read_pattern(pager_t *pager)
+{
+	char *pattern = NULL;
+	int key = 0;
+
+	vt100_printf(pager->term, "/");
+	vt100_oflush(pager->term);
+	while ((key = pager_getkey(pager, -1)) >= 0) {
+		if ((KEY_CR == key) || (KEY_LF == key))
+			return pattern ? pattern : faux_str_dup("");
+		if ((KEY_ESC == key) || (KEY_ETX == key))
+			break;
+		if ((KEY_BS == key) || (KEY_DEL == key)) {
+			size_t len = pattern ? strlen(pattern) : 0;
+			if (0 == len)
+				break;
+			// Remove whole UTF-8 character
+			while ((len > 0) && ((pattern[len - 1] & 0xc0) == 0x80))
+				len--;
+			if (len > 0)
+				len--;
+			pattern[len] = '\0';
+			pager_prompt_erase(pager);
+			vt100_printf(pager->term, "/%s", pattern);
+		} else if ((key >= ' ') && (key < 0x100)) {
+			char c[2] = {(char)key, '\0'};
+			faux_str_cat(&pattern, c);
+			vt100_printf(pager->term, "%s", c);
+		}
+		vt100_oflush(pager->term);
+	}
+	faux_str_free(pattern);
+
+	return NULL;
+}
+
+
+/** @brief Interacts with user.
+ *
+ * Shows lines user wants to see. Returns when user wants to see lines that
+ * are not received yet. The ^C is a key here so ISIG is disabled while
+ * pager waits for keys.
+ *
+ * @return BOOL_TRUE - continue, BOOL_FALSE - user quits.
+ */
+static bool_t pager_interact(pager_t *pager)
+{
+	struct termios t = {};
+	bool_t isig = BOOL_FALSE;
+	int fd = fileno(vt100_istream(pager->term));
+	const char *msg = NULL;
+	bool_t retval = BOOL_TRUE;
+
+	if ((tcgetattr(fd, &t) == 0) && (t.c_lflag & ISIG)) {
+		isig = BOOL_TRUE;
+		t.c_lflag &= ~ISIG;
+		tcsetattr(fd, TCSADRAIN, &t);
+	}
+
+	while (1) {
+		int key = 0;
+
+		while ((pager->want > 0) && (pager->bottom < pager->lines_num)) {
+			size_t rows = pager_line_rows(pager, pager->bottom);
+			pager_put_line(pager, pager->bottom);
+			pager->bottom++;
+			pager->want -= (rows < pager->want) ? rows : pager->want;
+		}
+		if (pager->bottom < pager->lines_num)
+			pager->end_shown = BOOL_FALSE;
+		if (pager->want > 0) {
+			// Wait for the rest of output
+			if (!pager->eof)
+				break;
+			// Scroll beyond the end of output finishes pager
+			if (pager->end_shown)
+				break;
+		}
+		pager->want = 0;
+		if (pager->eof && (pager->bottom == pager->lines_num))
+			pager->end_shown = BOOL_TRUE;
+
+		pager_prompt(pager, msg);
+		msg = NULL;
+		key = pager_getkey(pager, -1);
+		pager_prompt_erase(pager);
+
+		switch (key) {
+		case -1:
+		case 'q':
+		case 'Q':
+		case KEY_ETX:
+			pager->quit = BOOL_TRUE;
+			retval = BOOL_FALSE;
+			break;
+		case ' ':
+		case 'f':
+		case 'z':
+		case KEY_ACK:
+		case PAGER_KEY_PGDOWN:
+			pager->want = pager_page(pager);
+			break;
+		case KEY_CR:
+		case KEY_LF:
+		case 'j':
+		case 'e':
+		case KEY_SO:
+		case PAGER_KEY_DOWN:
+			pager->want = 1;
+			break;
+		case 'b':
+		case KEY_STX:
+		case PAGER_KEY_PGUP:
+			pager_back(pager, pager_page(pager));
+			break;
+		case 'k':
+		case 'y':
+		case KEY_DLE:
+		case PAGER_KEY_UP:
+			pager_back(pager, 1);
+			break;
+		case 'g':
+		case '<':
+		case PAGER_KEY_HOME:
+			pager_show_from(pager, 0);
+			break;
+		case 'G':
+		case '>':
+		case PAGER_KEY_END:
+			pager->bottom = pager->lines_num;
+			pager_redraw(pager);
+			break;
+		case 'r':
+		case KEY_FF:
+			pager_redraw(pager);
+			break;
+		case '/': {
+			char *pattern = pager_read_pattern(pager);
+			pager_prompt_erase(pager);
+			if (!pattern)
+				break;
+			// Empty pattern repeats previous search
+			if (!faux_str_is_empty(pattern)) {
+				faux_str_free(pager->pattern);
+				pager->pattern = pattern;
+			} else {
+				faux_str_free(pattern);
+			}
+			if (!pager_search(pager, BOOL_TRUE))
+				msg = "Pattern not found";
+			break;
+		}
+		case 'n':
+		case 'N':
+			if (!pager_search(pager, ('n' == key)))
+				msg = "Pattern not found";
+			break;
+		default:
+			vt100_ding(pager->term);
+			break;
+		}
+		if (pager->quit)
+			break;
+	}
+	vt100_oflush(pager->term);
+
+	if (isig) {
+		t.c_lflag |= ISIG;
+		tcsetattr(fd, TCSADRAIN, &t);
+	}
+
+	return retval;
+}
+
+
+/** @brief Writes output as is while it fits into the screen.
+ *
+ * The unfinished line is written too so prompts and progress output are
+ * not held back. Then line is finished even if it doesn't fit into the
+ * screen because its beginning is already shown.
+ */
+static void pager_passthrough(pager_t *pager)
+{
+	FILE *ostream = vt100_ostream(pager->term);
+
+	while (pager->bottom < pager->lines_num) {
+		size_t start = pager->lines[pager->bottom];
+		size_t end = ((pager->bottom + 1) < pager->lines_num) ?
+			pager->lines[pager->bottom + 1] : pager->tail;
+		size_t rows = pager_line_rows(pager, pager->bottom);
+		if ((pager->flushed <= start) && (pager->height > 1) &&
+			((pager->rows + rows) > pager_page(pager))) {
+			pager->engaged = BOOL_TRUE;
+			break;
+		}
+		if (pager->flushed < start)
+			pager->flushed = start;
+		fwrite(pager->buf + pager->flushed, 1, end - pager->flushed,
+			ostream);
+		pager->flushed = end;
+		pager->rows += rows;
+		pager->bottom++;
+	}
+	if (!pager->engaged && (pager->flushed < pager->buf_len)) {
+		fwrite(pager->buf + pager->flushed, 1,
+			pager->buf_len - pager->flushed, ostream);
+		pager->flushed = pager->buf_len;
+	}
+	vt100_oflush(pager->term);
+}
+
+
+/** @brief Gives next chunk of output to pager.
+ *
+ * The function can block while user reads the screen.
+ *
+ * @param [in] pager Pager object.
+ * @param [in] data Output chunk.
+ * @param [in] len Length of chunk.
+ * @return BOOL_TRUE - success, BOOL_FALSE - user quits pager so the rest of
+ * output is not needed.
+ */
+bool_t pager_write(pager_t *pager, const char *data, size_t len)
+{
+	if (!pager)
+		return BOOL_FALSE;
+	if (pager->quit)
+		return BOOL_FALSE;
+
+	if (!pager->started) {
+		vt100_winsize(pager->term, &pager->width, &pager->height);
+		pager->started = BOOL_TRUE;
+	}
+	if (!pager_append(pager, data, len))
+		return BOOL_FALSE;
+
+	if (!pager->engaged)
+		pager_passthrough(pager);
+	pager_shrink(pager);
+	if (pager->engaged)
+		return pager_interact(pager);
+
+	return BOOL_TRUE;
+}
+
+
+/** @brief Finishes output.
+ *
+ * Pager shows the rest of output if it's engaged. Then pager is reset for
+ * the next output. The unfinished last line gets newline.
+ *
+ * @param [in] pager Pager object.
+ * @return BOOL_TRUE - output is shown, BOOL_FALSE - user quits pager.
+ */
+bool_t pager_stop(pager_t *pager)
+{
+	bool_t retval = BOOL_TRUE;
+
+	if (!pager)
+		return BOOL_FALSE;
+
+	if (pager->started && !pager->quit) {
+		if (pager->tail < pager->buf_len)
+			pager_append(pager, "\n", 1);
+		pager->eof = BOOL_TRUE;
+		if (!pager->engaged)
+			pager_passthrough(pager);
+		if (pager->engaged)
+			retval = pager_interact(pager);
+	}
+	if (pager->quit)
+		retval = BOOL_FALSE;
+
+	// Reset
+	if (pager->buf_size > PAGER_KEEP_BUF_SIZE) {
+		faux_free(pager->buf);
+		pager->buf = NULL;
+		pager->buf_size = 0;
+		faux_free(pager->lines);
+		pager->lines = NULL;
+		pager->lines_size = 0;
+	}
+	pager->buf_len = 0;
+	pager->lines_num = 0;
+	pager->tail = 0;
+	pager->flushed = 0;
+	pager->rows = 0;
+	pager->bottom = 0;
+	pager->want = 0;
+	pager->started = BOOL_FALSE;
+	pager->engaged = BOOL_FALSE;
+	pager->eof = BOOL_FALSE;
+	pager->end_shown = BOOL_FALSE;
+	pager->quit = BOOL_FALSE;
+
+	return retval;
+}
@@ -0,0 +1,192 @@
+/*
+ * Unit tests of built-in pager.
+ *
+ * The output stream is a temporary file (not a terminal) so the screen is
+ * 80x25. The keys are read from another temporary file.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <faux/faux.h>
+#include <faux/str.h>
+
+#include "tinyrl/pager.h"
+
+
+#define TESTC_PAGER_LINES 100000
+#define TESTC_PAGER_CHUNK 4000
+#define TESTC_PAGER_KEYS 3000 // Number of "space" keys before "g"
+
+
+// Reads whole file. The result must be freed by faux_free()
+static char *testc_pager_content(FILE *f, size_t *len)
+{
+	long size = 0;
+	char *data = NULL;
+
+	fflush(f);
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	data = faux_zmalloc(size + 1);
+	fseek(f, 0, SEEK_SET);
+	*len = fread(data, 1, size, f);
+	fseek(f, 0, SEEK_END);
+
+	return data;
+}
+
+
+static bool_t testc_pager_expect(FILE *f, const char *expected)
+{
+	size_t len = 0;
+	char *out = testc_pager_content(f, &len);
+	bool_t equal = BOOL_FALSE;
+
+	if ((len == strlen(expected)) && (memcmp(out, expected, len) == 0))
+		equal = BOOL_TRUE;
+	else
+		printf("Output \"%s\", expected \"%s\"\n", out, expected);
+	faux_free(out);
+
+	return equal;
+}
+
+
+// Unfinished line is written without waiting for '\n'
+int testc_pager_partial(void)
+{
+	FILE *in = tmpfile();
+	FILE *out = tmpfile();
+	pager_t *pager = NULL;
+	char *data = NULL;
+	char *pos = NULL;
+	size_t len = 0;
+	unsigned int i = 0;
+	int ret = -1;
+
+	if (!in || !out)
+		goto err;
+	pager = pager_new(in, out);
+
+	pager_write(pager, "Pass", 4);
+	if (!testc_pager_expect(out, "Pass"))
+		goto err;
+	pager_write(pager, "word: ", 6);
+	if (!testc_pager_expect(out, "Password: "))
+		goto err;
+	pager_write(pager, "ok\nnext", 7);
+	if (!testc_pager_expect(out, "Password: ok\nnext"))
+		goto err;
+	if (!pager_stop(pager) ||
+		!testc_pager_expect(out, "Password: ok\nnext\n"))
+		goto err;
+
+	// Unfinished line is already shown when screen gets full. The line
+	// must not be written twice.
+	fseek(out, 0, SEEK_SET);
+	if (ftruncate(fileno(out), 0) < 0)
+		goto err;
+	for (i = 0; i < 23; i++)
+		pager_write(pager, "line\n", 5);
+	pager_write(pager, "unfin", 5);
+	pager_write(pager, "ished\nline\nline\n", 16);
+	if (!pager_engaged(pager)) {
+		printf("Pager is not engaged\n");
+		goto err;
+	}
+	pager_stop(pager);
+	data = testc_pager_content(out, &len);
+	pos = strstr(data, "unfinished\n");
+	if (!pos || strstr(pos + 1, "unfin")) {
+		printf("Unfinished line is not shown once:\n%s\n", data);
+		goto err;
+	}
+
+	ret = 0;
+err:
+	faux_free(data);
+	pager_free(pager);
+	if (in)
+		fclose(in);
+	if (out)
+		fclose(out);
+
+	return ret;
+}
+
+
+// Scrollback is bounded. User scrolls through large output then goes to
+// the beginning. The first lines must be dropped already.
+int testc_pager_large(void)
+{
+	FILE *in = tmpfile();
+	FILE *out = tmpfile();
+	pager_t *pager = NULL;
+	char *data = NULL;
+	char *output = NULL;
+	char *pos = NULL;
+	char *next = NULL;
+	size_t data_len = 0;
+	size_t len = 0;
+	size_t off = 0;
+	unsigned int first = 0;
+	unsigned int i = 0;
+	int ret = -1;
+
+	if (!in || !out)
+		goto err;
+	for (i = 0; i < TESTC_PAGER_KEYS; i++)
+		fputc(' ', in);
+	fputs("gq", in);
+	fflush(in);
+	rewind(in);
+	pager = pager_new(in, out);
+
+	data = faux_zmalloc(TESTC_PAGER_LINES * 12 + 1);
+	for (i = 0; i < TESTC_PAGER_LINES; i++)
+		data_len += sprintf(data + data_len, "line %06u\n", i);
+	for (off = 0; off < data_len; off += TESTC_PAGER_CHUNK) {
+		size_t chunk = data_len - off;
+		if (chunk > TESTC_PAGER_CHUNK)
+			chunk = TESTC_PAGER_CHUNK;
+		if (!pager_write(pager, data + off, chunk))
+			break;
+	}
+	if (off >= data_len) {
+		printf("User doesn't quit pager\n");
+		goto err;
+	}
+	pager_stop(pager);
+
+	// Screen after "g" key. It starts after the last "clear screen".
+	output = testc_pager_content(out, &len);
+	pos = output;
+	while ((next = strstr(pos, "\033[2J")))
+		pos = next + 1;
+	pos = strstr(pos, "line ");
+	if (!pos) {
+		printf("Screen is not redrawn\n");
+		goto err;
+	}
+	first = strtoul(pos + 5, NULL, 10);
+	printf("The first line within scrollback: %u\n", first);
+	if (first < (TESTC_PAGER_LINES / 2)) {
+		printf("Old lines are not dropped\n");
+		goto err;
+	}
+
+	ret = 0;
+err:
+	faux_free(data);
+	faux_free(output);
+	pager_free(pager);
+	if (in)
+		fclose(in);
+	if (out)
+		fclose(out);
+
+	return ret;
+}
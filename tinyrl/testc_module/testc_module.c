@@ -0,0 +1,16 @@
+#include <stdlib.h>
+
+
+const unsigned char testc_version_major = 1;
+const unsigned char testc_version_minor = 0;
+
+
+const char *testc_module[][2] = {
+
+	// Pager
+	{"testc_pager_partial", "Unfinished line is written through at once"},
+	{"testc_pager_large", "Scrollback of large output is bounded"},
+
+	// End of list
+	{NULL, NULL}
+	};